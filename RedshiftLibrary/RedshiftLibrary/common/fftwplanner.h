@@ -0,0 +1,17 @@
+#ifndef _CORE_COMMON_FFTWPLANNER_
+#define _CORE_COMMON_FFTWPLANNER_
+
+#include <boost/thread.hpp>
+
+namespace NSEpic {
+
+/**
+ * \ingroup Core
+ * Lock of the FFTW planner: fftw_plan_* and fftw_destroy_plan are not thread-safe, every call has to be done under it.
+ * fftw_execute, fftw_malloc and fftw_free do not need it.
+ */
+boost::mutex& GetFFTWPlannerMutex();
+
+} // namespace NSEpic
+
+#endif
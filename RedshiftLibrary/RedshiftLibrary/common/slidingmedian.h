@@ -0,0 +1,53 @@
+#ifndef _REDSHIFT_COMMON_SLIDINGMEDIAN__
+#define _REDSHIFT_COMMON_SLIDINGMEDIAN__
+
+#include <RedshiftLibrary/common/datatypes.h>
+#include <RedshiftLibrary/common/median.h>
+
+#include <algorithm>
+#include <vector>
+#include <math.h>
+
+namespace NSEpic
+{
+
+  /**
+   * \ingroup Redshift
+   * Median and median absolute deviation over a window sliding along an array.
+   * The window [start, stop) is given in samples, so it can follow an irregular wavelength window,
+   * but its bounds must not decrease from one Slide() to the next (else the window is rebuilt).
+   * The values of the window are kept sorted: sliding costs one insertion or removal per sample
+   * entering or leaving the window, and the median and MAD are then found without sorting.
+   * The results are identical to CMedian<T>::Find and to the sorted MAD of the window.
+   */
+template< typename T >
+class CSlidingMedian
+{
+
+public:
+
+    CSlidingMedian();
+    ~CSlidingMedian();
+
+    void Reset();
+    void Slide( const T* a, Int32 start, Int32 stop );
+
+    Int32 GetCount() const;
+    T GetMedian() const;
+    T GetMad( T median ) const;
+
+private:
+
+    T FindAbsDeviation( T median, Int32 k ) const;
+
+    const T*        m_data;
+    Int32           m_start;
+    Int32           m_stop;
+    std::vector<T>  m_sorted;
+};
+
+#include <RedshiftLibrary/common/slidingmedian.hpp>
+
+}
+
+#endif
@@ -0,0 +1,128 @@
+
+template <class T> CSlidingMedian<T>::CSlidingMedian()
+    : m_data(NULL), m_start(0), m_stop(0)
+{
+}
+
+template <class T> CSlidingMedian<T>::~CSlidingMedian() {}
+
+template <class T> void CSlidingMedian<T>::Reset()
+{
+    m_data = NULL;
+    m_start = 0;
+    m_stop = 0;
+    m_sorted.clear();
+}
+
+/**
+ * Moves the window to the samples [start, stop) of a.
+ * Only the samples leaving or entering the window are removed from or inserted in the sorted values.
+ */
+template <class T> void CSlidingMedian<T>::Slide(const T *a, Int32 start, Int32 stop)
+{
+    if (a != m_data || start < m_start || stop < m_stop || start >= m_stop)
+    {
+        // another array, a window going backward or not overlapping: rebuild
+        m_data = a;
+        m_start = start;
+        m_stop = std::max(start, stop);
+        m_sorted.assign(a + m_start, a + m_stop);
+        std::sort(m_sorted.begin(), m_sorted.end());
+        return;
+    }
+
+    for (Int32 i = m_start; i < start; i++)
+    {
+        m_sorted.erase(std::lower_bound(m_sorted.begin(), m_sorted.end(), a[i]));
+    }
+    for (Int32 i = m_stop; i < stop; i++)
+    {
+        m_sorted.insert(std::upper_bound(m_sorted.begin(), m_sorted.end(), a[i]), a[i]);
+    }
+    m_start = start;
+    m_stop = stop;
+}
+
+template <class T> Int32 CSlidingMedian<T>::GetCount() const
+{
+    return m_sorted.size();
+}
+
+/**
+ * Same value as CMedian<T>::Find over the window: the mean of the two central values for an even count,
+ * except above MEDIAN_FAST_OR_BEERS_THRESHOLD where CMedian returns the lower one.
+ */
+template <class T> T CSlidingMedian<T>::GetMedian() const
+{
+    Int32 n = m_sorted.size();
+    if (n == 0)
+    {
+        return m_data[m_start];
+    }
+    if (n & 1)
+    {
+        return m_sorted[n / 2];
+    }
+    if (n > MEDIAN_FAST_OR_BEERS_THRESHOLD)
+    {
+        return m_sorted[n / 2 - 1];
+    }
+    return (0.5 * (m_sorted[n / 2 - 1] + m_sorted[n / 2]));
+}
+
+/**
+ * Median of the absolute deviations to median over the window, the mean of the two central deviations for an even count.
+ */
+template <class T> T CSlidingMedian<T>::GetMad(T median) const
+{
+    Int32 n = m_sorted.size();
+    if (n == 0)
+    {
+        return 0.0;
+    }
+    if (n & 1)
+    {
+        return FindAbsDeviation(median, n / 2);
+    }
+    return 0.5 * (FindAbsDeviation(median, n / 2 - 1) + FindAbsDeviation(median, n / 2));
+}
+
+/**
+ * k-th smallest absolute deviation to median (k from 0).
+ * The deviations of the values below median, read backward, and of the values above it are two sorted sequences:
+ * the k-th smallest of their union is found by bisection on the count taken from the first one.
+ */
+template <class T> T CSlidingMedian<T>::FindAbsDeviation(T median, Int32 k) const
+{
+    const T *v = m_sorted.data();
+    Int32 split = std::lower_bound(m_sorted.begin(), m_sorted.end(), median) - m_sorted.begin();
+    Int32 nLow = split;                    // deviation j of the low part: fabs(v[split-1-j]-median)
+    Int32 nHigh = m_sorted.size() - split; // deviation j of the high part: fabs(v[split+j]-median)
+
+    Int32 lo = std::max(0, k + 1 - nHigh);
+    Int32 hi = std::min(k + 1, nLow);
+    while (lo < hi)
+    {
+        Int32 i = (lo + hi) / 2;
+        Int32 j = k + 1 - i;
+        if (fabs(v[split - 1 - i] - median) < fabs(v[split + j - 1] - median))
+        {
+            lo = i + 1;
+        } else
+        {
+            hi = i;
+        }
+    }
+
+    Int32 i = lo;
+    Int32 j = k + 1 - i;
+    if (i == 0)
+    {
+        return fabs(v[split + j - 1] - median);
+    }
+    if (j == 0)
+    {
+        return fabs(v[split - i] - median);
+    }
+    return std::max(fabs(v[split - i] - median), fabs(v[split + j - 1] - median));
+}
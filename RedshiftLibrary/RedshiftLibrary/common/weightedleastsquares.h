@@ -0,0 +1,54 @@
+#ifndef _REDSHIFT_COMMON_WEIGHTEDLEASTSQUARES__
+#define _REDSHIFT_COMMON_WEIGHTEDLEASTSQUARES__
+
+#include <RedshiftLibrary/common/datatypes.h>
+
+#include <cmath>
+
+namespace NSEpic
+{
+
+  /**
+   * \ingroup Redshift
+   * Weighted linear least-squares fit of a few (N) parameters, y = Sum_k c_k.x_k, without any allocation.
+   * The samples are accumulated in the N x N normal equations, which are solved by a Cholesky factorization
+   * after scaling the parameters to a unit diagonal, so that parameters of very different magnitudes
+   * (eg. powers of dz) are solved with the same accuracy.
+   * Solve() fails when the samples do not constrain all the parameters: there is no truncated SVD solution.
+   */
+template< Int32 N >
+class CWeightedLeastSquares
+{
+
+public:
+
+    CWeightedLeastSquares();
+    ~CWeightedLeastSquares();
+
+    void Reset();
+    void AddSample( const Float64* x, Float64 y, Float64 w );
+
+    Bool Solve();
+
+    Int32 GetSampleCount() const;
+    Float64 GetCoefficient( Int32 k ) const;
+    Float64 GetCovariance( Int32 k, Int32 l ) const;
+    Float64 GetChiSquare() const;
+
+private:
+
+    Int32       m_n;
+    Float64     m_A[N][N];
+    Float64     m_b[N];
+    Float64     m_yWy;
+
+    Float64     m_c[N];
+    Float64     m_cov[N][N];
+    Float64     m_chisq;
+};
+
+#include <RedshiftLibrary/common/weightedleastsquares.hpp>
+
+}
+
+#endif
@@ -0,0 +1,166 @@
+
+template <Int32 N> CWeightedLeastSquares<N>::CWeightedLeastSquares()
+{
+    Reset();
+}
+
+template <Int32 N> CWeightedLeastSquares<N>::~CWeightedLeastSquares() {}
+
+template <Int32 N> void CWeightedLeastSquares<N>::Reset()
+{
+    m_n = 0;
+    m_yWy = 0.0;
+    m_chisq = 0.0;
+    for (Int32 k = 0; k < N; k++)
+    {
+        m_b[k] = 0.0;
+        m_c[k] = 0.0;
+        for (Int32 l = 0; l < N; l++)
+        {
+            m_A[k][l] = 0.0;
+            m_cov[k][l] = 0.0;
+        }
+    }
+}
+
+/**
+ * Adds the sample y = Sum_k c_k.x[k], with weight w (1/err^2).
+ */
+template <Int32 N> void CWeightedLeastSquares<N>::AddSample(const Float64 *x, Float64 y, Float64 w)
+{
+    for (Int32 k = 0; k < N; k++)
+    {
+        Float64 wx = w * x[k];
+        for (Int32 l = 0; l <= k; l++)
+        {
+            m_A[k][l] += wx * x[l];
+        }
+        m_b[k] += wx * y;
+    }
+    m_yWy += w * y * y;
+    m_n++;
+}
+
+/**
+ * Solves the normal equations for the coefficients, their covariance and the chi2.
+ * Returns false if there are less samples than parameters, or if the normal matrix is not numerically
+ * positive definite once scaled, a pivot losing more than 10 significant digits.
+ */
+template <Int32 N> Bool CWeightedLeastSquares<N>::Solve()
+{
+    if (m_n < N)
+    {
+        return false;
+    }
+
+    // scaled matrix S = D^-1.A.D^-1, with D = sqrt(diag(A)), factorized in place as L.Lt
+    Float64 d[N];
+    Float64 L[N][N];
+    for (Int32 k = 0; k < N; k++)
+    {
+        if (!(m_A[k][k] > 0.0) || !std::isfinite(m_A[k][k]))
+        {
+            return false;
+        }
+        d[k] = sqrt(m_A[k][k]);
+    }
+    for (Int32 i = 0; i < N; i++)
+    {
+        for (Int32 j = 0; j <= i; j++)
+        {
+            Float64 sum = m_A[i][j] / (d[i] * d[j]);
+            for (Int32 k = 0; k < j; k++)
+            {
+                sum -= L[i][k] * L[j][k];
+            }
+            if (i == j)
+            {
+                if (!(sum > 1e-10))
+                {
+                    return false;
+                }
+                L[i][i] = sqrt(sum);
+            } else
+            {
+                L[i][j] = sum / L[j][j];
+            }
+        }
+    }
+
+    // S^-1, column by column, from L.Lt.x = e_col
+    Float64 Sinv[N][N];
+    for (Int32 col = 0; col < N; col++)
+    {
+        Float64 x[N];
+        for (Int32 i = 0; i < N; i++)
+        {
+            Float64 sum = (i == col) ? 1.0 : 0.0;
+            for (Int32 k = 0; k < i; k++)
+            {
+                sum -= L[i][k] * x[k];
+            }
+            x[i] = sum / L[i][i];
+        }
+        for (Int32 i = N - 1; i >= 0; i--)
+        {
+            Float64 sum = x[i];
+            for (Int32 k = i + 1; k < N; k++)
+            {
+                sum -= L[k][i] * x[k];
+            }
+            x[i] = sum / L[i][i];
+        }
+        for (Int32 i = 0; i < N; i++)
+        {
+            Sinv[i][col] = x[i];
+        }
+    }
+
+    // A^-1 = D^-1.S^-1.D^-1, c = A^-1.b
+    for (Int32 k = 0; k < N; k++)
+    {
+        for (Int32 l = 0; l < N; l++)
+        {
+            m_cov[k][l] = Sinv[k][l] / (d[k] * d[l]);
+        }
+    }
+    m_chisq = m_yWy;
+    for (Int32 k = 0; k < N; k++)
+    {
+        m_c[k] = 0.0;
+        for (Int32 l = 0; l < N; l++)
+        {
+            m_c[k] += m_cov[k][l] * m_b[l];
+        }
+        m_chisq -= m_c[k] * m_b[k];
+    }
+    if (m_chisq < 0.0)
+    {
+        // rounding of a near perfect fit
+        m_chisq = 0.0;
+    }
+    return true;
+}
+
+template <Int32 N> Int32 CWeightedLeastSquares<N>::GetSampleCount() const
+{
+    return m_n;
+}
+
+template <Int32 N> Float64 CWeightedLeastSquares<N>::GetCoefficient(Int32 k) const
+{
+    return m_c[k];
+}
+
+template <Int32 N> Float64 CWeightedLeastSquares<N>::GetCovariance(Int32 k, Int32 l) const
+{
+    return m_cov[k][l];
+}
+
+/**
+ * Sum of w.(y - Sum_k c_k.x_k)^2 over the samples, computed from the normal equations.
+ */
+template <Int32 N> Float64 CWeightedLeastSquares<N>::GetChiSquare() const
+{
+    return m_chisq;
+}
@@ -6,6 +6,9 @@
 
 #include <gsl/gsl_vector.h>
 #include <gsl/gsl_matrix.h>
+#include <gsl/gsl_multifit_nlin.h>
+
+#include <vector>
 
 namespace NSEpic
 {
@@ -15,6 +18,8 @@ class CSpectrum;
 /**
  * \ingroup Redshift
  * Single gaussian equation fit.
+ * The solver and its workspaces are kept between calls and only reallocated when the number of samples changes,
+ * so a single fitter should be reused to fit all the peaks of a spectrum (see ComputeBatch).
  **/
 class CGaussianFit
 {
@@ -34,10 +39,24 @@ public:
         nStatus_FailToReachTolerance = (1 << 4)
     };
 
+    struct SResult
+    {
+        EStatus Status;
+        Float64 Amplitude;
+        Float64 Position;
+        Float64 Width;
+        Float64 AmplitudeErr;
+        Float64 PositionErr;
+        Float64 WidthErr;
+        Float64 PolyCoeff0;
+    };
+    typedef std::vector<SResult> TResultList;
+
     CGaussianFit();
     ~CGaussianFit();
 
     EStatus    Compute( const CSpectrum& s, const TInt32Range& studyRange );
+    void       ComputeBatch( const CSpectrum& s, const TInt32RangeList& studyRanges, TResultList& results );
 
     void    GetResults( Float64& amplitude, Float64& position, Float64& width ) const;
     void    GetResultsPolyCoeff0( Float64& coeff0 ) const;
@@ -45,6 +64,11 @@ public:
 
 private:
 
+    CGaussianFit( const CGaussianFit& other );
+    CGaussianFit& operator=( const CGaussianFit& other );
+
+    void AllocateSolver( Int32 n, Int32 np );
+    void FreeSolver();
 
     static int GaussF( const gsl_vector *param, void *data, gsl_vector *f );
     static int GaussDF( const gsl_vector *param, void *data, gsl_matrix *J );
@@ -69,6 +93,14 @@ private:
     Float64 m_RelTol;
     Float64 m_coeff0;
     Int32   m_PolyOrder;
+
+    gsl_multifit_fdfsolver* m_Solver;
+    gsl_matrix*             m_J;
+    gsl_matrix*             m_Covar;
+    Int32                   m_SolverN;
+    Int32                   m_SolverP;
+    TFloat64List            m_FirstGuess;
+    TFloat64List            m_Buffer;
 };
 
 }
@@ -37,6 +37,7 @@ class CLineModelElement
     virtual void prepareSupport(const CSpectrumSpectralAxis &spectralAxis,
                                 Float64 redshift,
                                 const TFloat64Range &lambdaRange) = 0;
+    virtual void SetSupportCacheSize(Int32 maxSize) = 0;
     virtual TInt32RangeList getSupport() = 0;
     virtual TInt32RangeList getTheoreticalSupport() = 0;
     virtual TInt32Range getSupportSubElt(Int32 subeIdx) = 0;
@@ -55,6 +56,13 @@ class CLineModelElement
                               const CSpectrumFluxAxis &fluxAxis,
                               const CSpectrumFluxAxis &continuumfluxAxis,
                               Float64 redshift, Int32 lineIdx = -1) = 0;
+    virtual void
+    prepareAmplitudeFitBasis(const CSpectrumSpectralAxis &spectralAxis,
+                             const CSpectrumFluxAxis &fluxAxis,
+                             const CSpectrumFluxAxis &continuumfluxAxis,
+                             Float64 redshift) = 0;
+    virtual bool fitAmplitudeFromBasis(Float64 redshift) = 0;
+    virtual Float64 GetBasisMaxChi2Reduction() = 0;
     virtual void fitAmplitudeAndLambdaOffset(
         const CSpectrumSpectralAxis &spectralAxis,
         const CSpectrumFluxAxis &fluxAxis,
@@ -91,6 +99,7 @@ class CLineModelElement
     virtual void initSpectrumModel(CSpectrumFluxAxis &modelfluxAxis,
                                    CSpectrumFluxAxis &continuumfluxAxis,
                                    Int32 lineIdx = -1) = 0;
+    virtual void GetModelStateKey(Float64 redshift, TFloat64List &key) = 0;
 
     virtual Float64 GetNominalAmplitude(Int32 subeIdx) = 0;
     virtual bool SetNominalAmplitude(Int32 subeIdx, Float64 nominalamp) = 0;
@@ -6,6 +6,7 @@
 
 #include <gsl/gsl_vector.h>
 #include <gsl/gsl_matrix.h>
+#include <gsl/gsl_multifit_nlin.h>
 
 #include <RedshiftLibrary/ray/catalog.h>
 #include <RedshiftLibrary/spectrum/spectrum.h>
@@ -143,6 +144,7 @@ public:
     std::vector<std::vector<Int32>> GetModelVelfitGroups(Int32 lineType );
 
     Bool initModelAtZ(Float64 redshift, const TFloat64Range& lambdaRange, const CSpectrumSpectralAxis &spectralAxis);
+    void SetSupportCacheSize(Int32 maxSize);
 
     Float64 fit(Float64 redshift,
                 const TFloat64Range& lambdaRange,
@@ -150,6 +152,11 @@ public:
                 CContinuumModelSolution &continuumModelSolution,
                 Int32 contreest_iterations=0,
                 bool enableLogging=0);
+    bool getFitMeritLowerBound(Float64 redshift,
+                               const TFloat64Range& lambdaRange,
+                               Int32 contreest_iterations,
+                               Float64& meritLowerBound,
+                               Float64& continuumMerit);
 
     Bool initTplratioCatalogs(std::string opt_tplratioCatRelPath, Int32 opt_tplratio_ismFit);
     void initLambdaOffsets(std::string offsetsCatalogsRelPath);
@@ -158,6 +165,8 @@ public:
     Bool setTplshapeAmplitude(std::vector<Float64> ampsElts, std::vector<Float64> errorsElts);
 
     std::vector<CLmfitController*> createLmfitControllers( const TFloat64Range& lambdaRange);
+    Int32 evaluateLmfit(const CSpectrumFluxAxis& fluxAxis, CLmfitController* controller, const TFloat64List& x, Bool fullGrid,
+                        TFloat64List& residual, TFloat64List& jacobian);
     void fitWithModelSelection(Float64 redshift, const TFloat64Range& lambdaRange, CLineModelSolution &modelSolution);
     void SetFittingMethod(std::string fitMethod);
 
@@ -211,6 +220,7 @@ public:
                                    Float64& snrdi);
     const CSpectrumFluxAxis&    GetModelContinuum() const;
     Float64 getModelFluxVal(UInt32 idx) const;
+    Float64 getContinuumFluxVal(UInt32 idx) const;
     Float64 getModelFluxDerivEltVal(UInt32 DerivEltIdx, UInt32 idx) const;
     Float64 getModelFluxDerivContinuumAmpEltVal(UInt32 DerivEltIdx, UInt32 idx) const;
     Float64 getModelFluxDerivZContinuumVal(UInt32 idx)const;
@@ -251,6 +261,7 @@ public:
     std::vector<std::vector<Float64>> m_FittedErrorTplshape;
     std::vector<std::vector<Float64>> m_MtmTplshape;
     std::vector<std::vector<Float64>> m_DtmTplshape;
+    Int32 m_tplratioFitFromBasisCount = 0;  //number of tpl-ratio amplitude fits done from the unit profiles cross products
 
     bool m_enableAmplitudeOffsets;
     Float64 m_LambdaOffsetMin = -400.0;
@@ -264,11 +275,19 @@ public:
     bool m_opt_firstpass_forcedisableTplratioISMfit=true;
     std::string m_opt_firstpass_fittingmethod = "hybrid";
     std::string m_opt_secondpass_fittingmethod = "hybrid";
+    bool m_opt_enableTplratioFitFromBasis = true;
 private:
 
     Int32 fitAmplitudesHybrid(const CSpectrumSpectralAxis& spectralAxis, const CSpectrumFluxAxis& spcFluxAxisNoContinuum, const CSpectrumFluxAxis &continuumfluxAxis, Float64 redshift);
+    bool isLambdaOffsetFitted();
+    bool fitAmplitudesTplratioFromBasis(const CSpectrumSpectralAxis& spectralAxis, Float64 redshift, Int32 contreest_iterations, bool& basisPrepared);
     void fitAmplitudesSimplex();
     Int32 fitAmplitudesLmfit( const CSpectrumFluxAxis& fluxAxis, CLmfitController * controller);
+    Int32 prepareLmfitData(const CSpectrumFluxAxis& fluxAxis, CLmfitController* controller, const std::vector<UInt32>& filteredEltsIdx,
+                           Bool fullGrid, std::vector<UInt32>& xInds);
+    void prepareLmfitSolver(size_t n, size_t p);
+    void getSupportRows(const std::vector<UInt32>& EltsIdx, const std::vector<UInt32>& xInds, std::vector<UInt32>& rows);
+    void freeLmfitSolver();
     Int32 fitAmplitudesLinSolve(std::vector<UInt32> EltsIdx, const CSpectrumSpectralAxis &spectralAxis, const CSpectrumFluxAxis &fluxAxis, const CSpectrumFluxAxis& continuumfluxAxis, std::vector<Float64> &ampsfitted, std::vector<Float64> &errorsfitted);
     Int32 fitAmplitudesLinSolveAndLambdaOffset(std::vector<UInt32> EltsIdx, const CSpectrumSpectralAxis &spectralAxis, const CSpectrumFluxAxis &fluxAxis, const CSpectrumFluxAxis& continuumfluxAxis, std::vector<Float64> &ampsfitted, std::vector<Float64> &errorsfitted, Bool enableOffsetFitting);
 
@@ -288,10 +307,18 @@ private:
     std::vector<UInt32> getSupportIndexes(std::vector<UInt32> EltsIdx);
     Float64 GetWeightingAnyLineCenterProximity(UInt32 sampleIndex, std::vector<UInt32> EltsIdx);
     std::vector<UInt32> getOverlappingElementsBySupport(UInt32 ind , Float64 overlapThres=0.1);
+    bool hasOverlappingSupports();
     std::vector<UInt32> ReestimateContinuumApprox(std::vector<UInt32> EltsIdx);
     std::vector<UInt32> ReestimateContinuumUnderLines(std::vector<UInt32> EltsIdx);
     void refreshModelAfterContReestimation(std::vector<UInt32> EltsIdx, CSpectrumFluxAxis& modelFluxAxis, CSpectrumFluxAxis& spcFluxAxisNoContinuum);
 
+    Bool refreshModelIncremental(Int32 lineTypeFilter);
+    void getElementModelSupport(UInt32 iElts, TInt32List& support);
+    void getElementModelKey(UInt32 iElts, Int32 lineTypeFilter, TFloat64List& key);
+    void computeElementModel(UInt32 iElts, const TInt32List& support, TFloat64List& contribution);
+    void updateLeastSquareMeritTerms(const TInt32List& samples);
+    void invalidateModelCache();
+
     std::vector<UInt32> findLineIdxInCatalog(const CRayCatalog::TRayVector& restRayList, std::string strTag, Int32 type);
 
 
@@ -373,11 +400,43 @@ private:
     bool m_lmfit_fitEmissionVelocity;
     bool m_lmfit_fitAbsorptionVelocity;
 
+    //lmfit solver and work buffers, reallocated only when the problem size changes
+    gsl_multifit_fdfsolver* m_lmfitSolver=NULL;
+    gsl_matrix* m_lmfitJ=NULL;
+    gsl_matrix* m_lmfitCovar=NULL;
+    size_t m_lmfitSolverN=0;
+    size_t m_lmfitSolverP=0;
+    TFloat64List m_lmfitY;
+    TFloat64List m_lmfitWeights;
+    TFloat64List m_lmfitX;
+    TFloat64List m_lmfitRowBuffer;
+    std::vector<std::vector<UInt32>> m_lmfitEltRows;
+    std::vector<UInt32> m_lmfitModelEltsIdx;   //elements adding to the model, refreshed when the continuum is fitted
+    std::vector<UInt32> m_lmfitModelRows;      //rows of the samples on their support, the model is the continuum elsewhere
+
     std::vector<Float64> m_ampOffsetsX0;
     std::vector<Float64> m_ampOffsetsX1;
     std::vector<Float64> m_ampOffsetsX2;
     std::vector<Int32> m_ampOffsetsIdxStart;
     std::vector<Int32> m_ampOffsetsIdxStop;
+
+    //cache of the last refreshModel, used to only recompute the elements whose state changed.
+    //Invalidated by any other update of the model or of the continuum
+    Bool m_modelCacheValid;
+    std::vector<TFloat64List> m_modelCacheKeys;
+    std::vector<TInt32List> m_modelCacheSupports;
+    std::vector<TFloat64List> m_modelCacheContributions;    //element model minus continuum, on its support
+    TInt32List m_modelCacheDirtySamples;    //union of the supports of the elements changed by an incremental refresh
+    std::vector<bool> m_modelCacheDirtyMask;
+    CSpectrumFluxAxis m_modelCacheScratch;
+
+    //cache of the last getLeastSquareMerit, kept in sync with the incremental refreshes
+    Bool m_meritCacheValid;
+    Int32 m_meritCacheImin;
+    Int32 m_meritCacheImax;
+    Int32 m_meritCacheUpdates;  //number of incremental updates of the sum since it was accumulated from the terms
+    Float64 m_meritCacheSum;
+    TFloat64List m_meritCacheTerms;
 };
 
 }
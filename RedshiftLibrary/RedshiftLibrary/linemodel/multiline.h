@@ -10,6 +10,8 @@
 #include <gsl/gsl_vector.h>
 #include <gsl/gsl_matrix.h>
 
+#include <map>
+
 namespace NSEpic
 {
 
@@ -31,6 +33,7 @@ public:
     std::vector<CRay> GetRays();
 
     void prepareSupport(const CSpectrumSpectralAxis& spectralAxis, Float64 redshift, const TFloat64Range& lambdaRange);
+    void SetSupportCacheSize(Int32 maxSize);
     TInt32RangeList getSupport();
     TInt32RangeList getTheoreticalSupport();
     TInt32Range EstimateTheoreticalSupport(Int32 subeIdx, const CSpectrumSpectralAxis& spectralAxis, Float64 redshift,  const TFloat64Range &lambdaRange);
@@ -42,6 +45,9 @@ public:
     Float64 GetContinuumAtCenterProfile(Int32 subeIdx, const CSpectrumSpectralAxis& spectralAxis, Float64 redshift, CSpectrumFluxAxis &continuumfluxAxis);
 
     void fitAmplitude(const CSpectrumSpectralAxis& spectralAxis, const CSpectrumFluxAxis& fluxAxis, const CSpectrumFluxAxis &continuumfluxAxis, Float64  redshift, Int32 lineIdx=-1 );
+    void prepareAmplitudeFitBasis(const CSpectrumSpectralAxis& spectralAxis, const CSpectrumFluxAxis& fluxAxis, const CSpectrumFluxAxis &continuumfluxAxis, Float64 redshift);
+    bool fitAmplitudeFromBasis(Float64 redshift);
+    Float64 GetBasisMaxChi2Reduction();
     void fitAmplitudeAndLambdaOffset(const CSpectrumSpectralAxis& spectralAxis,
                                      const CSpectrumFluxAxis& fluxAxis,
                                      const CSpectrumFluxAxis &continuumfluxAxis,
@@ -61,6 +67,7 @@ public:
     void addToSpectrumModel( const CSpectrumSpectralAxis& modelspectralAxis, CSpectrumFluxAxis& modelfluxAxis, CSpectrumFluxAxis &continuumfluxAxis, Float64 redshift, Int32 lineIdx=-1 );
     void addToSpectrumModelDerivVel( const CSpectrumSpectralAxis& modelspectralAxis, CSpectrumFluxAxis& modelfluxAxis, CSpectrumFluxAxis& continuumFluxAxis, Float64 redshift, bool emissionRay );
     void initSpectrumModel(CSpectrumFluxAxis &modelfluxAxis , CSpectrumFluxAxis &continuumfluxAxis, Int32 lineIdx=-1 );
+    void GetModelStateKey(Float64 redshift, TFloat64List& key);
     Float64 GetFittedAmplitude(Int32 subeIdx);
     Float64 GetFittedAmplitudeErrorSigma(Int32 subeIdx);
     Float64 GetNominalAmplitude(Int32 subeIdx);
@@ -75,7 +82,23 @@ public:
     bool SetAbsLinesLimit(Float64 limit);
 
 private:
+    struct SSupportState
+    {
+        bool OutsideLambdaRange;
+        TBoolList OutsideLambdaRangeList;
+        TInt32List StartNoOverlap;
+        TInt32List EndNoOverlap;
+        TInt32List StartTheoretical;
+        TInt32List EndTheoretical;
+        std::vector<TInt32List> RayIsActiveOnSupport;
+    };
+    typedef std::map<TFloat64List, SSupportState> TSupportCache;
+
     Int32 FindElementIndex(std::string LineTagStr);
+    void computeSupport(const CSpectrumSpectralAxis& spectralAxis, Float64 redshift, const TFloat64Range& lambdaRange);
+    void getSupportCacheKey(const CSpectrumSpectralAxis& spectralAxis, Float64 redshift, const TFloat64Range& lambdaRange, TFloat64List& key);
+    void getLineProfilesKey(Float64 redshift, TFloat64List& key);
+    void setFittedAmplitudesFromSums();
 
     std::vector<TInt32List>     m_RayIsActiveOnSupport;
     TFloat64List        m_SignFactors;
@@ -97,6 +120,20 @@ private:
 
     TBoolList           m_OutsideLambdaRangeList;
 
+    Int32               m_supportCacheSize=0;
+    TSupportCache       m_supportCache;
+    TFloat64List        m_supportCacheKey;
+
+    //unit profiles cross products, for fitAmplitudeFromBasis
+    TFloat64List        m_basisKey;
+    TFloat64List        m_basisKeyBuffer;
+    TFloat64List        m_basisDtm;
+    TFloat64List        m_basisMtm;
+    TFloat64List        m_basisProfiles;
+    Int32               m_basisNum=0;
+    TFloat64List        m_basisCholesky;
+    TFloat64List        m_basisProjection;
+
     //constant
     Float64 m_c_kms;
 
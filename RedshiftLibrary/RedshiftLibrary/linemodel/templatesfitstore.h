@@ -8,17 +8,25 @@
 
 
 #include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
+#include <memory>
 #include <vector>
 
 namespace NSEpic
 {
 
+/**
+ * \ingroup Redshift
+ * Stores, for each redshift of a lin or log regular grid, the best (lowest merit) continuum template fits.
+ * The values are stored in a contiguous [nz][capacity] array, sorted by merit for each redshift.
+ * Add can be called concurrently: the redshifts are protected by striped locks.
+ */
 class CTemplatesFitStore
 {
 public:
 
     struct SValues{
-        std::string tplName;
+        Int32 tplId; // index of the template name, see GetTplName. -1 if unset
         Float64 ismDustCoeff;
         Int32 igmMeiksinIdx;
 
@@ -29,10 +37,13 @@ public:
     };
     typedef SValues TemplateFitValues;
 
-    CTemplatesFitStore(Float64 minRedshift, Float64 maxRedshift, Float64 stepRedshift, std::string opt_sampling);
+    CTemplatesFitStore(Float64 minRedshift, Float64 maxRedshift, Float64 stepRedshift, std::string opt_sampling, Int32 maxContinuumCandidates);
     ~CTemplatesFitStore();
 
-    bool Add(std::string tplName,
+    Int32 RegisterTemplate(const std::string& tplName);
+    const std::string& GetTplName(Int32 tplId) const;
+
+    bool Add(Int32 tplId,
              Float64 ismDustCoeff,
              Int32 igmMeiksinIdx,
              Float64 redshift,
@@ -43,25 +54,32 @@ public:
 
     void prepareRedshiftList();
     void initFitValues();
-    Int32 GetRedshiftIndex(Float64 z);
+    Int32 GetRedshiftIndex(Float64 z) const;
 
     std::vector<Float64> GetRedshiftList();
     TemplateFitValues GetFitValues(Float64 redshiftVal, Int32 continuumCandidateRank);
     Int32 GetContinuumCount();
 
 private:
-    std::vector<std::vector<SValues>>    m_fitValues; //[nz][n_continuum_candidates]
-    Int32 n_max_continuum_candidates=10000;
-    Int32 n_continuum_candidates=0;
+    Int32 GetRedshiftIndexClosedForm(Float64 z) const;
+
+    std::vector<SValues>    m_fitValues; //[nz][n_max_continuum_candidates], flattened
+    std::vector<Int32>      m_fitCount; //[nz] number of candidates stored for each redshift
+    Int32 n_max_continuum_candidates;
+
+    TStringList m_tplNames;
 
     Float64    m_minRedshift;
     Float64    m_maxRedshift;
     Float64    m_stepRedshift;
     std::string m_samplingRedshift;
+    Float64    m_logStepRedshift; //log(1+step), for the log sampling
 
     std::vector<Float64> redshiftgrid;
-    std::map<UInt32,UInt32> redshiftgridmap;
     Float64 redshiftgridmapPrecision = 1e-8;
+
+    static const Int32 m_nLockStripes = 64;
+    std::vector<std::shared_ptr<boost::mutex>> m_lockStripes;
 };
 
 
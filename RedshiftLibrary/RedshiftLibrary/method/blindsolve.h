@@ -36,6 +36,8 @@ private:
     Bool BlindSolve( CDataStore& resultStore, const CSpectrum& spc, const CSpectrum& spcWithoutCont, const CTemplate& tpl, const CTemplate& tplWithoutCont,
                                    const TFloat64Range& lambdaRange, const TFloat64Range& redshiftsRange, Float64 redshiftStep, Int32 correlationExtremumCount,
                                    Float64 overlapThreshold );
+
+    std::string m_opt_fft;
 };
 
 
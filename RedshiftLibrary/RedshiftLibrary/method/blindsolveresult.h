@@ -25,6 +25,7 @@ public:
 
     void Save( const CDataStore& store, std::ostream& stream ) const;
     void SaveLine( const CDataStore& store, std::ostream& stream ) const;
+    Bool GetRedshiftResult( const CDataStore& store, Float64& redshift, Float64& merit ) const;
     Bool GetBestFitResult( const CDataStore& store, Float64& redshift, Float64& merit, std::string& tplName ) const;
     inline Int32 GetEvidenceFromPdf(const CDataStore& store, Float64 &evidence) const
     {
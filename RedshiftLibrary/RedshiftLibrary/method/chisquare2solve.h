@@ -14,6 +14,8 @@ namespace NSEpic
 class CSpectrum;
 class CTemplateCatalog;
 class CDataStore;
+class CChisquareResult;
+class CPdfzMarginalizer;
 
 /**
  * \ingroup Redshift
@@ -49,9 +51,11 @@ private:
 
     Bool Solve(CDataStore& resultStore, const CSpectrum& spc, const CSpectrum& spcWithoutCont, const CTemplate& tpl, const CTemplate& tplWithoutCont,
                                    const TFloat64Range& lambdaRange, const TFloat64List& redshifts, Float64 overlapThreshold , std::vector<CMask> maskList, Int32 spctype=CChisquare2SolveResult::nType_raw, std::string opt_interp="lin", std::string opt_extinction="no", std::string opt_dustFitting="no");
+    void MarginalizeMerits(CPdfzMarginalizer& marginalizer, const CChisquareResult& meritResult, const std::string& tplName, Float64& cstLog);
     Int32 CombinePDF(CDataStore& store,
                      std::string scopeStr,
                      std::string opt_combine,
+                     CPdfzMarginalizer& marginalizer,
                      std::shared_ptr<CPdfMargZLogResult> postmargZResult);
 
 
@@ -62,6 +66,10 @@ private:
     std::string m_opt_saveintermediateresults;
     Bool m_opt_enableSaveIntermediateChisquareResults=false;
 
+    Int64 m_opt_coarseStepFactor=0;
+    Int64 m_opt_coarseExtremaCount=5;
+    Float64 m_opt_coarseTolerance=1.0;
+
 };
 
 
@@ -0,0 +1,59 @@
+#ifndef _REDSHIFT_METHOD_CHISQUARECOARSETOFINE_
+#define _REDSHIFT_METHOD_CHISQUARECOARSETOFINE_
+
+#include <RedshiftLibrary/common/datatypes.h>
+#include <RedshiftLibrary/common/range.h>
+#include <RedshiftLibrary/common/mask.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace NSEpic
+{
+
+class CSpectrum;
+class CTemplate;
+class CChisquareResult;
+class COperatorChiSquare2;
+
+/**
+ * \ingroup Redshift
+ * Coarse-to-fine redshift grid for the chisquare2 operator: the template is fitted on every n-th redshift first, then on
+ * the full grid only where the coarse chi2 curve needs it, the other redshifts being interpolated.
+ */
+class CChisquareCoarseToFine
+{
+
+public:
+
+    CChisquareCoarseToFine( Int32 stepFactor, Int32 extremaCount, Float64 tolerance );
+    ~CChisquareCoarseToFine();
+
+    Bool IsApplicable( const TFloat64List& redshifts ) const;
+
+    std::shared_ptr<CChisquareResult> Compute( COperatorChiSquare2& chiSquareOperator, const CSpectrum& spc, const CTemplate& tpl,
+                                               const TFloat64Range& lambdaRange, const TFloat64List& redshifts, Float64 overlapThreshold,
+                                               const std::vector<CMask>& maskList, std::string opt_interp, Int32 opt_extinction, Int32 opt_dustFitting );
+
+    Int32 GetFittedCount() const;
+
+private:
+
+    std::shared_ptr<CChisquareResult> ComputeOnGrid( COperatorChiSquare2& chiSquareOperator, const CSpectrum& spc, const CTemplate& tpl,
+                                                     const TFloat64Range& lambdaRange, const TFloat64List& redshifts, const TInt32List& indexes,
+                                                     Float64 overlapThreshold, const std::vector<CMask>& maskList, std::string opt_interp,
+                                                     Int32 opt_extinction, Int32 opt_dustFitting );
+    Bool NeedsRefinement( const CChisquareResult& coarse, Int32 j ) const;
+    static void CopyRedshiftResult( const CChisquareResult& from, Int32 iFrom, CChisquareResult& to, Int32 iTo );
+    static void InterpolateRedshiftResult( CChisquareResult& result, Int32 iLeft, Int32 iRight, Int32 i );
+
+    Int32       m_StepFactor;
+    Int32       m_ExtremaCount;
+    Float64     m_Tolerance;
+    Int32       m_FittedCount;
+};
+
+}
+
+#endif
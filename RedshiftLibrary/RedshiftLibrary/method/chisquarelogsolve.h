@@ -15,6 +15,8 @@ namespace NSEpic
 class CSpectrum;
 class CTemplateCatalog;
 class CDataStore;
+class CChisquareResult;
+class CPdfzMarginalizer;
 
 /**
  * \ingroup Redshift
@@ -50,9 +52,11 @@ private:
 
     Bool Solve(CDataStore& resultStore, const CSpectrum& spc, const CSpectrum& spcWithoutCont, const CTemplate& tpl, const CTemplate& tplWithoutCont,
                                    const TFloat64Range& lambdaRange, const TFloat64List& redshifts, Float64 overlapThreshold , std::vector<CMask> maskList, Int32 spctype=CChisquareLogSolveResult::nType_raw, std::string opt_interp="lin", std::string opt_extinction="no", std::string opt_dustFitting="no");
+    void MarginalizeMerits(CPdfzMarginalizer& marginalizer, const CChisquareResult& meritResult, const std::string& tplName, Float64& cstLog);
     Int32 CombinePDF(CDataStore& store,
                      std::string scopeStr,
                      std::string opt_combine,
+                     CPdfzMarginalizer& marginalizer,
                      std::shared_ptr<NSEpic::CPdfMargZLogResult> postmargZResult);
 
 
@@ -33,6 +33,7 @@ public:
 
     void Save( const CDataStore& store, std::ostream& stream ) const;
     void SaveLine( const CDataStore& store, std::ostream& stream ) const;
+    Bool GetRedshiftResult( const CDataStore& store, Float64& redshift, Float64& merit ) const;
     Bool GetBestRedshift(const CDataStore& store, Float64& redshift, Float64& merit, std::string& tplName , Float64& amplitude, Float64& dustCoeff, Int32& meiksinIdx) const;
     Bool GetBestRedshiftPerTemplateString( const CDataStore& store, std::string& output ) const;
     Bool GetBestRedshiftFromPdf(const CDataStore& store, Float64& redshift, Float64& merit, Float64 &evidence) const;
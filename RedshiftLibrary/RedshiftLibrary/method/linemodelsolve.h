@@ -53,6 +53,7 @@ private:
     std::string m_opt_secondpasslcfittingmethod;
     std::string m_opt_continuumcomponent;
     std::string m_opt_skipsecondpass="no";
+    Int64 m_opt_secondpass_threadcount=0;
 
     std::string m_opt_tplfit_dustfit="no";
     std::string m_opt_tplfit_igmfit="no";
@@ -71,6 +72,7 @@ private:
     Float64 m_opt_abs_velocity_fit_min;
     Float64 m_opt_abs_velocity_fit_max;
     Float64 m_opt_abs_velocity_fit_step;
+    std::string m_opt_velocity_fit_search="grid";
     std::string m_opt_continuumreest;
     std::string m_opt_rules;
 
@@ -86,6 +88,8 @@ private:
     std::string m_opt_firstpass_tplratio_ismfit;
     std::string m_opt_firstpass_disablemultiplecontinuumfit;
     std::string m_opt_firstpass_fittingmethod;
+    std::string m_opt_firstpass_pruning;
+    Float64 m_opt_firstpass_pruningtolerance;
 
     std::string m_opt_pdfcombination;
     Float64 m_opt_stronglinesprior;
@@ -33,6 +33,7 @@ public:
 
     void Save( const CDataStore& store, std::ostream& stream ) const;
     void SaveLine( const CDataStore& store, std::ostream& stream ) const;
+    Bool GetRedshiftResult( const CDataStore& store, Float64& redshift, Float64& merit ) const;
     Bool GetBestRedshift(const CDataStore& store,
                          Float64& redshift,
                          Float64& merit ,
@@ -38,7 +38,6 @@ public:
 
 private:
 
-    Int32 getValueFromRefFile( const char* filePath, std::string spcid, Int32 colID, Float64& zref, Int32 reverseInclusion );
     Int32 getVelocitiesFromRefFile( const char* filePath, std::string spcid, Float64& elv, Float64& alv );
     Int32 getContaminantNameFromFile(const char* filePath, std::string spcid, Int32 colID,
                                      std::string& contSpcFileName,
@@ -38,13 +38,13 @@ public:
                                     Float64 overlapThreshold );
     const Float64*  getDustCoeff(Float64 dustCoeff, Float64 maxLambda);
     const Float64*  getMeiksinCoeff(Int32 meiksinIdx, Float64 redshift, Float64 maxLambda);
+    void            EstimateExtrema( CChisquareResult& result ) const;
 
 
 private:
 
     void BasicFit(const CSpectrum& spectrum,
                   const CTemplate& tpl,
-                  Float64 *pfgTplBuffer,
                   const TFloat64Range& lambdaRange,
                   Float64 redshift,
                   Float64 overlapThreshold,
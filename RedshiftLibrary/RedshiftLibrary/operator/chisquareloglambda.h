@@ -69,7 +69,9 @@ private:
 
     Int32 FitRangez(Float64* spectrumRebinedLambda,
                     Float64* spectrumRebinedFluxRaw,
-                    Float64 *error,
+                    const Float64* spcRebinedFluxOverErr2,
+                    const Float64* oneSpcRebinedFluxOverErr2,
+                    Float64 dtd,
                     Float64* tplRebinedLambda,
                     Float64* tplRebinedFluxRaw,
                     UInt32 nSpc,
@@ -97,6 +99,7 @@ private:
     CMask           m_mskRebinedLog;
     CSpectrum       m_spectrumRebinedLog;
     CSpectrumFluxAxis m_errorRebinedLog;
+    CSpectrumFluxAxis m_spectrumRebinedLogWeights;
 
     //buffers for fft computation
     Int32 m_nPaddedSamples;
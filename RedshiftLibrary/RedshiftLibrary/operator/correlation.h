@@ -17,6 +17,8 @@ class CTemplate;
 
 /**
  * \ingroup Redshift
+ * Normalized cross correlation between a spectrum and a template, both in log scale.
+ * The FFT mode (see EnableFFT) computes the correlation curve for all the redshifts at once.
  */
 class COperatorCorrelation : public COperator
 {
@@ -36,11 +38,21 @@ public:
                                               Int32 opt_extinction_unused=0 ,
                                               Int32 opt_dustFitting_unused=0 );
 
+    Bool ComputeFFT( const CSpectrum& spectrum,
+                     const CTemplate& tpl,
+                     const TFloat64Range& lambdaRange,
+                     const TFloat64List& redshifts,
+                     Float64 overlapThreshold,
+                     CCorrelationResult& result );
+
+    void EnableFFT( Bool enable );
+
     Float64 GetComputationDuration() const;
 
 private:
 
     Float64                 m_TotalDuration;
+    Bool                    m_enableFFT;
 };
 
 
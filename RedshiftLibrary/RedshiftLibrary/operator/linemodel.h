@@ -17,6 +17,8 @@
 #include <RedshiftLibrary/spectrum/spectrum.h>
 #include <RedshiftLibrary/ray/catalog.h>
 
+#include <boost/function.hpp>
+
 namespace NSEpic
 {
 
@@ -202,6 +204,7 @@ public:
     Float64 m_secondPass_velfit_dzInfLim = -4e-4;
     Float64 m_secondPass_velfit_dzSupLim = 4e-4;
     Float64 m_secondPass_velfit_dzStep = 2e-4;
+    Int32 m_secondPass_velfit_coarseStep = 4;
 
     bool m_enableLoadContTemplate=false;
     Int32 m_iRollContaminated=-1;
@@ -220,10 +223,98 @@ public:
     Int32 m_opt_firstpass_tplratio_ismFit=0;
     Int32 m_opt_firstpass_multiplecontinuumfit_disable=1;
     std::string m_opt_firstpass_fittingmethod;
+    Int32 m_opt_firstpass_pruning=0; //1: skip the first pass fits whose merit lower bound is above the best merit + m_opt_firstpass_pruningTolerance
+    Float64 m_opt_firstpass_pruningTolerance=100.0; //chi2 margin: the pdf of a pruned z is below exp(-tolerance/2) times the pdf peak
     std::string m_opt_secondpasslcfittingmethod="-1";
     Int32 m_opt_secondpass_estimateParms_tplfit_fixfromfirstpass=1; //0: load fit continuum, 1 (default): use the best continuum from first pass
+    Int32 m_opt_secondpass_threadCount=0; //0 (default): candidates refined one after the other, N>0: refined concurrently on N threads. Each candidate has its own model either way
+    std::string m_opt_secondpass_velfitSearch="grid"; //"grid" (default): all the velocities of the grid are fitted, "coarsetofine": coarse grid refined around its minimum
+protected:
+    //the velocity search only sees the merits returned by fitVelocity
+    virtual Float64 fitVelocity(std::shared_ptr<CLineModelElementList> model,
+                                Float64 redshift,
+                                Float64 velocity,
+                                Int32 iLineType,
+                                const std::vector<Int32>& velfitGroup,
+                                const TFloat64Range& lambdaRange,
+                                Int32 contreest_iterations,
+                                CLineModelSolution& modelSolution,
+                                CContinuumModelSolution& continuumModelSolution,
+                                Float64& fittedVelocity);
+    Int32 fitVelocityGrid(std::shared_ptr<CLineModelElementList> model,
+                          Float64 redshift,
+                          Float64 vInfLim,
+                          Float64 vStep,
+                          Int32 nSteps,
+                          Int32 iLineType,
+                          const std::vector<Int32>& velfitGroup,
+                          const TFloat64Range& lambdaRange,
+                          Int32 contreest_iterations,
+                          CLineModelSolution& modelSolution,
+                          CContinuumModelSolution& continuumModelSolution,
+                          TFloat64List& merits,
+                          TFloat64List& velocities);
 private:
 
+    //fit results of one candidate over its second pass z-range, merged into m_result in candidate order
+    struct SSecondPassCandidateFit
+    {
+        Int32 izmin;
+        SPoint recomputedExtremum;
+        TFloat64List ChiSquare;
+        TFloat64List ScaleMargCorrection;
+        std::vector<CLineModelSolution> LineModelSolutions;
+        std::vector<CContinuumModelSolution> ContinuumModelSolutions;
+        std::vector<TFloat64List> ChiSquareTplshape;
+        std::vector<TFloat64List> ScaleMargCorrTplshape;
+        std::vector<std::vector<bool>> StrongELPresentTplshape;
+        TFloat64List ChiSquareContinuum;
+        TFloat64List ScaleMargCorrectionContinuum;
+    };
+
+    std::shared_ptr<CLineModelElementList> createModel(const CSpectrum& spectrum,
+                                                       const CSpectrum& spectrumContinuum,
+                                                       const CTemplateCatalog& tplCatalog,
+                                                       const TStringList& tplCategoryList,
+                                                       const std::string opt_calibrationPath,
+                                                       const CRayCatalog::TRayVector& restRayList,
+                                                       const std::string& opt_fittingmethod,
+                                                       const std::string& opt_continuumcomponent,
+                                                       const std::string& opt_lineWidthType,
+                                                       const Float64 opt_resolution,
+                                                       const Float64 opt_velocityEmission,
+                                                       const Float64 opt_velocityAbsorption,
+                                                       const std::string& opt_rules,
+                                                       const std::string& opt_rigidity);
+    void initSecondPassCandidateModels(const CSpectrum& spectrum,
+                                       const CSpectrum& spectrumContinuum,
+                                       const CTemplateCatalog& tplCatalog,
+                                       const TStringList& tplCategoryList,
+                                       const std::string opt_calibrationPath,
+                                       const std::string& opt_fittingmethod,
+                                       const std::string& opt_continuumcomponent,
+                                       const std::string& opt_lineWidthType,
+                                       const Float64 opt_resolution,
+                                       const Float64 opt_velocityEmission,
+                                       const Float64 opt_velocityAbsorption,
+                                       const std::string& opt_rules,
+                                       const std::string& opt_rigidity);
+    void runSecondPassCandidateTasks(std::vector<boost::function<void ()>>& tasks);
+    void runSecondPassCandidateTask(boost::function<void ()> task, Int32 icandidate);
+    void estimateSecondPassParametersCandidate(Int32 i,
+                                               const CSpectrum& spectrum,
+                                               const TFloat64Range& lambdaRange,
+                                               const std::string& opt_continuumreest,
+                                               const std::string& opt_fittingmethod,
+                                               const std::string& opt_rigidity);
+    void recomputeAroundCandidate(Int32 i,
+                                  Float64 z,
+                                  const TFloat64Range& lambdaRange,
+                                  const std::string& opt_continuumreest,
+                                  const Int32 tplfit_option,
+                                  const bool overrideRecomputeOnlyOnTheCandidate,
+                                  SSecondPassCandidateFit& candidateFit);
+
     std::shared_ptr<CLineModelResult> m_result;
     std::shared_ptr<CLineModelElementList> m_model;
     TFloat64List m_sortedRedshifts;
@@ -233,6 +324,24 @@ private:
     CLineModelExtremaResult m_firstpass_extremaResult;
     CLineModelExtremaResult m_secondpass_parameters_extremaResult;
     std::vector<Int32> m_secondpass_indiceSortedCandidatesList;
+    std::vector<std::shared_ptr<CLineModelElementList>> m_secondpass_candidateModels; //model used by each candidate, m_model when there is a single candidate
+    std::vector<std::string> m_secondpass_candidateErrors;
+
+    //first pass settings needed to build the per-candidate models
+    std::string m_tplratioCatRelPath;
+    std::string m_offsetCatRelPath;
+    CTemplatesFitStore* m_tplfitStore = NULL;
+    Float64 m_sourcesizeInit = 0.1;
+    Float64 m_absLinesLimit = 1.0; //-1 to disable, 1.0 is typical
+
+    //second pass velocity fitting grid, set in EstimateSecondPassParameters
+    bool m_secondPass_velfitEnabled = false;
+    Float64 m_secondPass_velfitMinE;
+    Float64 m_secondPass_velfitMaxE;
+    Float64 m_secondPass_velfitStepE;
+    Float64 m_secondPass_velfitMinA;
+    Float64 m_secondPass_velfitMaxA;
+    Float64 m_secondPass_velfitStepA;
 
     Int32 m_enableFastFitLargeGrid = 0;
     Int32 m_estimateLeastSquareFast = 0;
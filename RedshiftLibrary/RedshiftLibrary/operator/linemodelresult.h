@@ -59,6 +59,7 @@ public:
     std::vector<std::vector<bool>> StrongELPresentTplshapes; // full strongELPresent results (for each tplshape)
     TFloat64List ChiSquareContinuum; // chi2 result for the continuum
     TFloat64List ScaleMargCorrectionContinuum; //  scale marginalization correction result for the continuum
+    std::vector<bool> FirstpassPruned; // z not fitted by the first pass pruning: their ChiSquare is the continuum-only merit
 
     std::vector<CLineModelSolution> LineModelSolutions;
     std::vector<CContinuumModelSolution> ContinuumModelSolutions;
@@ -23,6 +23,14 @@ namespace NSEpic
     std::shared_ptr<CRayMatchingResult> Compute( const CRayCatalog& restRayCatalog, const CRayCatalog& detectedRayCatalog, const TFloat64Range& redshiftRange, Int32 nThreshold = 5, Float64 tol = 0.002, Int32 typeFilter = CRay::nType_Emission, Int32 detectedForceFilter = -1, Int32 restRorceFilter = -1 );
     
   private:
+    struct SRedshiftCandidate
+    {
+      Float64 Redshift;
+      Int32 DetectedIndex;
+      Int32 RestIndex;
+    };
+
+    Bool GetSolutionSetKey( const CRayMatchingResult::TSolutionSet& s, TFloat64List& key );
     Bool AreSolutionSetsEqual( const CRayMatchingResult::TSolutionSet& s1, const CRayMatchingResult::TSolutionSet& s2);
   };
 }
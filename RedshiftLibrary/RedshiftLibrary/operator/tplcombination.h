@@ -13,6 +13,8 @@
 #include <RedshiftLibrary/spectrum/fluxcorrectionmeiksin.h>
 #include <RedshiftLibrary/spectrum/fluxcorrectioncalzetti.h>
 
+#include <boost/progress.hpp>
+
 namespace NSEpic
 {
 
@@ -24,7 +26,7 @@ public:
     ~COperatorTplcombination();
 
     std::shared_ptr<COperatorResult> Compute(const CSpectrum& spectrum,
-                                             std::vector<CTemplate> tplList,
+                                             const TTemplateConstRefList& tplList,
                                              const TFloat64Range& lambdaRange,
                                              const TFloat64List& redshifts,
                                              Float64 overlapThreshold,
@@ -35,6 +37,8 @@ public:
 
     void SaveSpectrumResults(CDataStore &dataStore);
 
+    Int32 m_opt_threadCount=0; //0 (default): redshifts fitted one after the other, N>0: the redshift grid is split over N threads
+
 private:
 
     struct STplcombination_basicfitresult
@@ -48,21 +52,56 @@ private:
         std::vector<TFloat64List> ChiSquareInterm;
     };
 
+    // buffers of a fit, allocated once per Compute and reused for every redshift: one per thread
+    struct STplcombination_workspace
+    {
+        std::vector<std::shared_ptr<CTemplate>>  templatesRebined; // precomputed fine grid templates, rebinned on the spectrum
+        std::vector<std::shared_ptr<CMask>>      masksRebined;
+        std::vector<std::shared_ptr<CSpectrumSpectralAxis>>   shiftedTemplatesSpectralAxis;
+        TFloat64List    weightedTemplates;  // w*X, n x nddl, one template after the other
+        TFloat64List    normalMatrix;       // Xt.W.X, nddl x nddl
+        TFloat64List    normalVector;       // Xt.W.y
+        TFloat64List    cholesky;           // lower factor of Xt.W.X
+        TFloat64List    amplitudes;
+        TFloat64List    covariance;         // (Xt.W.X)^-1
+        TFloat64List    unitVector;
+        std::string     error;
+    };
+
+    // inputs shared by the threads fitting the redshift grid
+    struct STplcombination_fitinputs
+    {
+        const CSpectrum*            spectrum;
+        const TTemplateConstRefList* tplList;
+        const TFloat64Range*        lambdaRange;
+        Float64                     overlapThreshold;
+        const std::vector<CMask>*   additional_spcMasks;
+        const CMask*                default_spcMask;
+        Bool                        useDefaultMask;
+        const TFloat64List*         sortedIndexes;
+        std::string                 opt_interp;
+        Int32                       opt_extinction;
+        Int32                       opt_dustFitting;
+        CTplcombinationResult*      result;
+        boost::progress_display*    progress;
+    };
+
     std::vector<std::shared_ptr<CModelSpectrumResult>  > m_savedModelSpectrumResults;
 
     void BasicFit(const CSpectrum& spectrum,
-                  std::vector<CTemplate>& tplList,
-                  Float64 *pfgTplBuffer,
+                  const TTemplateConstRefList& tplList,
                   const TFloat64Range& lambdaRange,
                   Float64 redshift,
                   Float64 overlapThreshold,
                   STplcombination_basicfitresult& fittingResults,
-                  std::string opt_interp, Float64 forcedAmplitude=-1, Int32 opt_extinction=0, Int32 opt_dustFitting=0, CMask spcMaskAdditional=CMask() );
+                  STplcombination_workspace& workspace,
+                  std::string opt_interp, Float64 forcedAmplitude=-1, Int32 opt_extinction=0, Int32 opt_dustFitting=0, CMask spcMaskAdditional=CMask(), Bool buildModel=true );
+
+    void AllocateWorkspace( STplcombination_workspace& workspace, const CSpectrum& spectrum, const TTemplateConstRefList& tplList );
+    Bool SolveNormalEquations( STplcombination_workspace& workspace, Int32 nddl );
+    void FitRedshiftRange( const STplcombination_fitinputs& inputs, Int32 izBegin, Int32 izEnd, Int32 iWorkspace );
 
-    // buffers for the precomputed fine grid templates
-    std::vector<std::shared_ptr<CTemplate>>  m_templatesRebined_bf; //buffer
-    std::vector<std::shared_ptr<CMask>>      m_masksRebined_bf; //buffer
-    std::vector<std::shared_ptr<CSpectrumSpectralAxis>>   m_shiftedTemplatesSpectralAxis_bf; //buffer
+    std::vector<STplcombination_workspace> m_workspaces;
 
     //ISM Calzetti
     Float64* m_YtplRawBuffer;
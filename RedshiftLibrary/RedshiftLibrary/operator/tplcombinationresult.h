@@ -1,4 +1,4 @@
-#ifndef _REDSHIFT_OPERATOR_TPLCOMBINATIONERESULT_
+#ifndef _REDSHIFT_OPERATOR_TPLCOMBINATIONRESULT_
 #define _REDSHIFT_OPERATOR_TPLCOMBINATIONRESULT_
 
 #include <RedshiftLibrary/processflow/result.h>
@@ -39,6 +39,10 @@ public:
     //intermediate chisquare results
     std::vector<std::vector<TFloat64List>> ChiSquareIntermediate; // full chi2 results (for each config [Calzetti, Meiksin])
 
+    //fitted amplitude of each template and its error, for each redshift
+    std::vector<TFloat64List> FitAmplitudes;
+    std::vector<TFloat64List> FitAmplitudesError;
+
     TFloat64List            Overlap;
     TFloat64List            Extrema;
     COperator::TStatusList  Status;
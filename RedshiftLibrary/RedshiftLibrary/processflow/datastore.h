@@ -31,6 +31,7 @@ public:
     };
 
     CDataStore( COperatorResultStore& resultStore, CParameterStore& parameStore );
+    CDataStore( const CDataStore& other );
     virtual ~CDataStore();
 
     void                PushScope( const std::string& name );
@@ -4,12 +4,15 @@
 #include <RedshiftLibrary/common/datatypes.h>
 #include <RedshiftLibrary/common/range.h>
 #include <boost/property_tree/ptree.hpp>
+#include <boost/thread/recursive_mutex.hpp>
 
 namespace NSEpic
 {
 
 /**
  * \ingroup Redshift
+ * Parameters read from a json file, by dot separated names (eg. "linemodelsolve.linemodel.rules").
+ * Get adds a missing parameter with its default value, and returns false for a value of the wrong type.
  */
 class CParameterStore
 {
@@ -17,6 +20,7 @@ class CParameterStore
 public:
 
     CParameterStore();
+    CParameterStore( const CParameterStore& other );
     virtual ~CParameterStore();
 
     Bool Get( const std::string& name, TFloat64List& v, const TFloat64List& defaultValue = TFloat64List() ) const;
@@ -39,12 +43,19 @@ public:
     Bool Set( const std::string& name, Int64 v );
     Bool Set( const std::string& name, Bool v );
 
+    TStringList GetChildNames( const std::string& name = "" ) const;
+
     Bool Save( const std::string& path ) const;
     Bool Load( const std::string& path );
 
 private:
 
+    template<typename T> Bool GetValue( const std::string& name, T& v, const T& defaultValue ) const;
+    template<typename T> Bool GetList( const std::string& name, std::vector<T>& v, const std::vector<T>& defaultValue ) const;
+
     mutable boost::property_tree::ptree m_PropertyTree;
+    // Get adds the missing parameters with their default value: reads and writes are serialized, recursively as Get calls Set
+    mutable boost::recursive_mutex      m_Mutex;
 
 };
 
@@ -10,10 +10,14 @@
 #include <RedshiftLibrary/spectrum/template/template.h>
 #include <RedshiftLibrary/spectrum/template/catalog.h>
 
+#include <boost/function.hpp>
+
 namespace NSEpic
 {
 
 class CProcessFlowContext;
+class CProcessFlowParameters;
+class CDataStore;
 class CTemplate;
 class CSpectrum;
 
@@ -29,11 +33,15 @@ public:
     ~CProcessFlow();
 
     void Process( CProcessFlowContext& ctx );
+    void Process( CProcessFlowContext& ctx, const CProcessFlowParameters& params );
 
 private:
 
+    void ProcessStellarSolve( CProcessFlowContext& ctx, const CProcessFlowParameters& params, CDataStore& dataStore, TFloat64Range spcLambdaRange, std::shared_ptr<COperatorResult>& starResult );
+    void ProcessQsoSolve( CProcessFlowContext& ctx, const CProcessFlowParameters& params, CDataStore& dataStore, TFloat64Range spcLambdaRange, std::shared_ptr<COperatorResult>& qsoResult );
+    void RunSolveTask( boost::function<void ()> task, std::string& error );
+
     Bool isPdfValid(CProcessFlowContext &ctx) const;
-    Int32 getValueFromRefFile( const char* filePath, std::string spcid, Int32 colID, Float64& zref, Int32 reverseInclusion );
 };
 
 
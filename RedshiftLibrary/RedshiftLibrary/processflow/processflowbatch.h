@@ -0,0 +1,83 @@
+#ifndef _REDSHIFT_PROCESSFLOW_PROCESSFLOWBATCH_
+#define _REDSHIFT_PROCESSFLOW_PROCESSFLOWBATCH_
+
+#include <RedshiftLibrary/common/datatypes.h>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace NSEpic
+{
+
+class CTemplateCatalog;
+class CRayCatalog;
+class CParameterStore;
+class CClassifierStore;
+class CProcessFlowParameters;
+
+/**
+ * \ingroup Redshift
+ * Runs the process flow on a batch of spectra given as arrays in memory, and keeps the main results in memory:
+ * best redshift and merit, redshift pdf and candidates, for each spectrum.
+ *
+ * The spectra are stored row-wise, nSpectra rows of nSamples wavelengths, fluxes and noise (flux error) values.
+ * The spectra are processed concurrently on threadCount threads, each with its own copy of the parameters, and
+ * sharing the read-only template and line catalogs and process flow parameters. Nothing is written to disk.
+ */
+class CProcessFlowBatch
+{
+
+public:
+
+    CProcessFlowBatch( std::shared_ptr<const CTemplateCatalog> templateCatalog,
+                       std::shared_ptr<const CRayCatalog> rayCatalog,
+                       std::shared_ptr<CParameterStore> paramStore,
+                       std::shared_ptr<CClassifierStore> zqualStore );
+    ~CProcessFlowBatch();
+
+    void    Process( const Float64* spectralAxis, const Float64* flux, const Float64* noise,
+                     Int32 nSpectra, Int32 nSamples, Int32 threadCount );
+
+    Int32   GetSpectraCount() const;
+    Int32   GetStatus( Int32 iSpectrum ) const;
+    std::string GetError( Int32 iSpectrum ) const;
+    Int32   GetPdfSize() const;
+    Int32   GetCandidatesMaxCount() const;
+
+    void    GetRedshifts( Float64* redshifts, Int32 nSpectra ) const;
+    void    GetMerits( Float64* merits, Int32 nSpectra ) const;
+    void    GetPdfRedshifts( Float64* redshifts, Int32 nz ) const;
+    void    GetPdfs( Float64* logProba, Int32 nSpectra, Int32 nz ) const;
+    void    GetCandidates( Float64* redshifts, Int32 nSpectra, Int32 nCandidates ) const;
+    void    GetCandidatesProba( Float64* proba, Int32 nSpectra, Int32 nCandidates ) const;
+
+private:
+
+    struct SSpectrumResult
+    {
+        Int32           Status;
+        std::string     Error;
+        Float64         Redshift;
+        Float64         Merit;
+        TFloat64List    PdfRedshifts;
+        TFloat64List    PdfLogProba;
+        TFloat64List    CandidatesRedshift;
+        TFloat64List    CandidatesProba;
+    };
+
+    void    ProcessSpectrum( const Float64* spectralAxis, const Float64* flux, const Float64* noise, Int32 nSamples, Int32 iSpectrum );
+    void    CheckSpectraCount( Int32 nSpectra ) const;
+
+    std::shared_ptr<const CTemplateCatalog>     m_TemplateCatalog;
+    std::shared_ptr<const CRayCatalog>          m_RayCatalog;
+    std::shared_ptr<CParameterStore>            m_ParameterStore;
+    std::shared_ptr<CClassifierStore>           m_ClassifierStore;
+    std::shared_ptr<const CProcessFlowParameters> m_ProcessFlowParameters;
+
+    std::vector<SSpectrumResult>                m_Results;
+};
+
+}
+
+#endif
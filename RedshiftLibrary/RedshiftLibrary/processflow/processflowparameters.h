@@ -0,0 +1,81 @@
+#ifndef _REDSHIFT_PROCESSFLOW_PROCESSFLOWPARAMETERS_
+#define _REDSHIFT_PROCESSFLOW_PROCESSFLOWPARAMETERS_
+
+#include <RedshiftLibrary/common/datatypes.h>
+#include <RedshiftLibrary/common/range.h>
+
+#include <string>
+
+namespace NSEpic
+{
+
+class CParameterStore;
+
+/**
+ * \ingroup Redshift
+ * The parameters read by CProcessFlow, resolved once from a CParameterStore into native values.
+ *
+ * Load checks them all before any spectrum is processed: a value of the wrong type or out of its allowed values
+ * is an error, a top-level parameter that no part of the process flow reads is a warning.
+ * Once loaded, the parameters are read-only: a batch of spectra shares them between its threads without locking.
+ * The methods still read their own parameters, in their scope, from the data store.
+ */
+class CProcessFlowParameters
+{
+
+public:
+
+    /**
+     * Parameters of a template fitting solve (chisquare2solve, chisquarelogsolve, tplcombinationsolve, starsolve, qsosolve).
+     */
+    struct STemplateFittingParameters
+    {
+        Float64         OverlapThreshold;
+        std::string     SpcComponent;
+        std::string     Interpolation;
+        std::string     Extinction;
+        std::string     DustFit;
+    };
+
+    CProcessFlowParameters();
+    ~CProcessFlowParameters();
+
+    Bool Load( const CParameterStore& store );
+
+    const TStringList& GetErrors() const;
+    const TStringList& GetWarnings() const;
+
+    TFloat64Range       LambdaRange;
+    TFloat64Range       RedshiftRange;
+    Float64             RedshiftStep;
+    std::string         RedshiftSampling;
+    TFloat64List        Redshifts;
+    std::string         MethodName;
+    std::string         LineMeasCatalogPath;
+    TStringList         TemplateCategoryList;
+    std::string         CalibrationDirPath;
+    Bool                AutoCorrectInput;
+    Bool                EnableStellarSolve;
+    Bool                EnableQsoSolve;
+    Int64               ThreadCount;
+
+    STemplateFittingParameters  MethodFitting;
+    STemplateFittingParameters  StellarFitting;
+    STemplateFittingParameters  QsoFitting;
+
+private:
+
+    void LoadTemplateFitting( const CParameterStore& store, const std::string& overlapName, const std::string& prefix,
+                              const std::string& defaultInterpolation, const std::string& defaultExtinction,
+                              const std::string& defaultDustFit, STemplateFittingParameters& params );
+    void CheckRead( Bool read, const std::string& name );
+    void CheckChoice( const std::string& name, const std::string& value, const TStringList& choices );
+    void CheckUnknownNames( const CParameterStore& store );
+
+    TStringList         m_Errors;
+    TStringList         m_Warnings;
+};
+
+}
+
+#endif
@@ -0,0 +1,60 @@
+#ifndef _REDSHIFT_PROCESSFLOW_REFERENCECATALOG_
+#define _REDSHIFT_PROCESSFLOW_REFERENCECATALOG_
+
+#include <RedshiftLibrary/common/datatypes.h>
+
+#include <boost/unordered_map.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace NSEpic
+{
+
+/**
+ * \ingroup Redshift
+ * Reference values per spectrum (zref, velocities...) read from a text catalog: one row per spectrum,
+ * whitespace separated columns, the spectrum ID in column 1, and '#' starting the comment lines.
+ *
+ * The file is read once and its rows are indexed by ID, and by ID without its extension (eg. ".fits"). An indexed ID
+ * is looked up before falling back on matching the IDs by inclusion, see FindRow.
+ * GetShared keeps one read-only catalog per file path, shared by all the process flows.
+ */
+class CReferenceCatalog
+{
+
+public:
+
+    CReferenceCatalog();
+    ~CReferenceCatalog();
+
+    Bool    Load( const std::string& filePath );
+
+    static std::shared_ptr<const CReferenceCatalog> GetShared( const std::string& filePath );
+
+    UInt32  GetRowCount() const;
+    Int32   FindRow( const std::string& spcid, Int32 reverseInclusion = 0, Int32 colID = 1 ) const;
+
+    Bool    GetValue( const std::string& spcid, Int32 colID, Float64& v, Int32 reverseInclusion = 0 ) const;
+    Bool    GetValue( const std::string& spcid, Int32 colID, Int64& v, Int32 reverseInclusion = 0 ) const;
+    Bool    GetValue( const std::string& spcid, Int32 colID, std::string& v, Int32 reverseInclusion = 0 ) const;
+
+private:
+
+    typedef boost::unordered_map<std::string, Int32> TIdIndex;
+
+    const std::string* GetField( const std::string& spcid, Int32 colID, Int32 reverseInclusion ) const;
+    Bool    HasColumn( Int32 row, Int32 colID ) const;
+    Bool    IsIncluded( const std::string& name, const std::string& spcid, Int32 reverseInclusion ) const;
+    Int32   FindIndexedRow( const TIdIndex& index, const std::string& key ) const;
+    static std::string GetStem( const std::string& name );
+
+    std::vector<TStringList>    m_Rows;
+    TIdIndex                    m_IdIndex;
+    TIdIndex                    m_StemIndex;
+};
+
+}
+
+#endif
@@ -30,6 +30,7 @@ public:
     void SetReliabilityLabel( std::string lbl );
     void SetTypeLabel( std::string lbl );
     virtual Int32 GetEvidenceFromPdf(const CDataStore& store, Float64 &evidence) const = 0;
+    virtual Bool GetRedshiftResult( const CDataStore& store, Float64& redshift, Float64& merit ) const;
 
 
 protected:
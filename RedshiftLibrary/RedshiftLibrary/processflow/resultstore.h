@@ -5,6 +5,7 @@
 #include <RedshiftLibrary/processflow/result.h>
 
 #include <boost/filesystem.hpp>
+#include <boost/thread/mutex.hpp>
 #include <vector>
 #include <ostream>
 
@@ -27,6 +28,7 @@ public:
 
 
     COperatorResultStore();
+    COperatorResultStore( const COperatorResultStore& other );
     virtual ~COperatorResultStore();
 
     void                    StorePerTemplateResult( const CTemplate& t, const std::string& path, const std::string& name, std::shared_ptr<const COperatorResult> result );
@@ -59,6 +61,8 @@ protected:
 
     TPerTemplateResultsMap          m_PerTemplateResults;
     TResultsMap                     m_GlobalResults;
+    // methods running concurrently store and read their results at the same time
+    mutable boost::mutex            m_Mutex;
 
 };
 
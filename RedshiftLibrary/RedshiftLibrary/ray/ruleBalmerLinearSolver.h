@@ -19,7 +19,7 @@ namespace NSEpic
     void SetUp( Bool EnabledArgument, ... );
   private:
     void Correct( CLineModelElementList& LineModelElementList );
-    TFloat64List BalmerModelLinSolve( std::vector<Float64> lambdax, std::vector<Float64> continuumx, std::vector<Float64> datax, std::vector<Float64> errdatax );
+    TFloat64List BalmerModelLinSolve( const std::vector<Float64>& lambdax, const std::vector<Float64>& continuumx, const std::vector<Float64>& datax, const std::vector<Float64>& errdatax );
   };
 }
 
@@ -5,6 +5,8 @@
 #include <RedshiftLibrary/spectrum/axis.h>
 #include <RedshiftLibrary/common/range.h>
 
+#include <boost/thread/mutex.hpp>
+
 namespace NSEpic
 {
 
@@ -24,13 +26,26 @@ public:
     explicit CSpectrumFluxAxis( UInt32 n );
     CSpectrumFluxAxis( const Float64* samples, UInt32 n );
     CSpectrumFluxAxis( const Float64* samples, UInt32 n, const Float64* error, UInt32 m );
+    CSpectrumFluxAxis( const CSpectrumFluxAxis& other );
     ~CSpectrumFluxAxis();
 
     CSpectrumFluxAxis& operator=(const CSpectrumFluxAxis& other);
 
+    Float64 operator[]( const UInt32 i ) const;
+    Float64& operator[]( const UInt32 i );
+
+    const Float64*      GetSamples() const;
+    Float64*            GetSamples();
+
     const TFloat64List&      GetError() const;
     TFloat64List&            GetError();
 
+    const Float64*      GetInverseVariance() const;
+    const Float64*      GetWeightedFlux() const;
+    Float64             GetSquaredWeightedFluxSum( UInt32 imin, UInt32 imax ) const;
+    void                ResetWeights();
+    void                ResetWeightedFlux();
+
     void                SetSize( UInt32 s );
 
     Bool                ApplyMeanSmooth( UInt32 kernelHalfWidth );
@@ -46,6 +61,8 @@ public:
                                CSpectrumFluxAxis& rebinedFluxAxis, CSpectrumSpectralAxis& rebinedSpectralAxis, CMask& rebinedMask );
     static Bool         Rebin2(const TFloat64Range& range, const CSpectrumFluxAxis& sourceFluxAxis, const Float64 *pfgTplBuffer, Float64 sourcez, const CSpectrumSpectralAxis& sourceSpectralAxis, const CSpectrumSpectralAxis& targetSpectralAxis,
                                CSpectrumFluxAxis& rebinedFluxAxis, CSpectrumSpectralAxis& rebinedSpectralAxis, CMask& rebinedMask , const std::string opt_interp);
+    static Bool         Rebin2SinglePrecision(const TFloat64Range& range, const CSpectrumFluxAxis& sourceFluxAxis, const Float32 *pfgTplBuffer, Float64 sourcez, const CSpectrumSpectralAxis& sourceSpectralAxis, const CSpectrumSpectralAxis& targetSpectralAxis,
+                               CSpectrumFluxAxis& rebinedFluxAxis, CSpectrumSpectralAxis& rebinedSpectralAxis, CMask& rebinedMask , const std::string opt_interp);
     static Bool         RebinVarianceWeighted( const CSpectrumFluxAxis& sourceFluxAxis, const CSpectrumSpectralAxis& sourceSpectralAxis, const CSpectrumFluxAxis& sourceError,
                                                    const CSpectrumSpectralAxis& targetSpectralAxis,
                                                    CSpectrumFluxAxis& rebinedFluxAxis, CSpectrumSpectralAxis& rebinedSpectralAxis, CSpectrumFluxAxis& rebinedError,
@@ -55,14 +72,56 @@ private:
 
     Bool                ComputeMeanAndSDevWithoutError( const CMask& mask, Float64& mean,  Float64& sdev) const;
     Bool                ComputeMeanAndSDevWithError( const CMask& mask, Float64& mean, Float64& sdev, const TFloat64List error ) const;
+    void                BuildInverseVariance() const;
+    void                BuildWeightedFlux() const;
 
     TFloat64List        m_StatError;
 
+    // 1/err^2, flux/err^2 and cumulated flux^2/err^2, built on first request under m_WeightsMutex.
+    // The non-const accessors are treated as writes: operator[] and GetSamples drop the flux weights, GetError drops
+    // all of them, so the next request rebuilds them. A pointer or reference kept from an earlier non-const access
+    // and written through after the weights were read again needs an explicit ResetWeightedFlux (samples) or
+    // ResetWeights (errors).
+    mutable boost::mutex        m_WeightsMutex;
+    mutable Bool                m_InverseVarianceReady;
+    mutable Bool                m_WeightedFluxReady;
+    mutable TFloat64List        m_InverseVariance;
+    mutable TFloat64List        m_WeightedFlux;
+    mutable TFloat64List        m_SquaredWeightedFluxCumul;
+
 };
 
+inline
+Float64 CSpectrumFluxAxis::operator[]( const UInt32 i ) const
+{
+    return m_Samples[i];
+}
+
+inline
+Float64& CSpectrumFluxAxis::operator[]( const UInt32 i )
+{
+    m_WeightedFluxReady = false;
+    return m_Samples[i];
+}
+
+inline
+const Float64* CSpectrumFluxAxis::GetSamples() const
+{
+    return m_Samples.data();
+}
+
+inline
+Float64* CSpectrumFluxAxis::GetSamples()
+{
+    m_WeightedFluxReady = false;
+    return m_Samples.data();
+}
+
 inline
 TFloat64List& CSpectrumFluxAxis::GetError()
 {
+  m_InverseVarianceReady = false;
+  m_WeightedFluxReady = false;
   return m_StatError;
 }
 
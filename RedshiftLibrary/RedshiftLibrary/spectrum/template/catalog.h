@@ -33,6 +33,8 @@ public:
 
     UInt32 GetTemplateCount( const std::string& category ) const;
 
+    void SetFineGridSinglePrecision( Bool enable );
+
 private:
 
     Bool                    LoadCategory( const boost::filesystem::path& dirPath, const std::string& category );
@@ -46,6 +48,8 @@ private:
     Float64 m_continuumRemovalWaveletsNScales;
     std::string m_continuumRemovalWaveletsBinPath;
 
+    Bool m_fineGridSinglePrecision;
+
 };
 
 /**
@@ -4,6 +4,8 @@
 #include <RedshiftLibrary/common/datatypes.h>
 #include <RedshiftLibrary/spectrum/spectrum.h>
 
+#include <boost/thread/mutex.hpp>
+
 #include <string>
 #include <map>
 
@@ -19,16 +21,36 @@ public:
     CTemplate( const std::string& name, const std::string& category );
     CTemplate( const std::string& name, const std::string& category,
 	       CSpectrumSpectralAxis& spectralAxis, CSpectrumFluxAxis& fluxAxis);
+    CTemplate( const CTemplate& other );
     ~CTemplate();
 
+    CTemplate& operator=( const CTemplate& other );
+
     const std::string&  GetCategory() const;
     const std::string&  GetName() const;
     Bool Save(const char *filePath ) const;
 
+    void                SetFineGridSinglePrecision( Bool enable );
+    Bool                GetFineGridSinglePrecision() const;
+    const Float64*      GetFineGridFlux() const;
+    const Float32*      GetFineGridFluxSinglePrecision() const;
+    void                ResetFineGrid();
+
+    static const Float64 FineGridStep;
+
 private:
 
+    void                InitFineGrid() const;
+
     std::string     m_Category;
     std::string     m_Name;
+
+    // precomputed fine grid (see Rebin2 'precomputedfinegrid'), built on first request
+    Bool                        m_FineGridSinglePrecision;
+    mutable boost::mutex        m_FineGridMutex;
+    mutable Bool                m_FineGridReady;
+    mutable TFloat64List        m_FineGridFlux;
+    mutable std::vector<Float32> m_FineGridFluxSinglePrecision;
 };
 
 typedef std::vector< std::shared_ptr<CTemplate> >          TTemplateRefList;
@@ -23,8 +23,8 @@ public:
     CDeltaz();
     ~CDeltaz();
 
-    Int32 Compute(TFloat64List merits, TFloat64List redshifts, Float64 redshift, TFloat64Range redshiftRange, Float64 &deltaz);
-    Int32 Compute3ddl(TFloat64List merits, TFloat64List redshifts, Float64 redshift, TFloat64Range redshiftRange, Float64 &deltaz);
+    Int32 Compute(const TFloat64List& merits, const TFloat64List& redshifts, Float64 redshift, TFloat64Range redshiftRange, Float64 &deltaz);
+    Int32 Compute3ddl(const TFloat64List& merits, const TFloat64List& redshifts, Float64 redshift, TFloat64Range redshiftRange, Float64 &deltaz);
 
 private:
 
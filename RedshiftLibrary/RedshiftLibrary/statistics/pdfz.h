@@ -24,16 +24,16 @@ public:
     CPdfz();
     ~CPdfz();
 
-    Int32 Compute(TFloat64List merits, TFloat64List redshifts, Float64 cstLog, TFloat64List zPrior, TFloat64List &logPdf, Float64 &logEvidence);
+    Int32 Compute(const TFloat64List& merits, const TFloat64List& redshifts, Float64 cstLog, const TFloat64List& zPrior, TFloat64List &logPdf, Float64 &logEvidence);
     std::vector<Float64> GetConstantLogZPrior(UInt32 nredshifts);
     std::vector<Float64> GetStrongLinePresenceLogZPrior(std::vector<bool> linePresence, Float64 penalization_factor);
     std::vector<Float64> GetEuclidNhaLogZPrior(std::vector<Float64> redshifts, Float64 aCoeff);
-    std::vector<Float64> CombineLogZPrior(std::vector<Float64> logprior1, std::vector<Float64> logprior2);
+    std::vector<Float64> CombineLogZPrior(const std::vector<Float64>& logprior1, const std::vector<Float64>& logprior2);
 
-    Float64 getSumTrapez(std::vector<Float64> redshifts, std::vector<Float64> valprobalog);
-    Float64 getSumRect(std::vector<Float64> redshifts, std::vector<Float64> valprobalog);
-    Float64 getCandidateSumTrapez(std::vector<Float64> redshifts,
-                                  std::vector<Float64> valprobalog,
+    Float64 getSumTrapez(const std::vector<Float64>& redshifts, const std::vector<Float64>& valprobalog);
+    Float64 getSumRect(const std::vector<Float64>& redshifts, const std::vector<Float64>& valprobalog);
+    Float64 getCandidateSumTrapez(const std::vector<Float64>& redshifts,
+                                  const std::vector<Float64>& valprobalog,
                                   Float64 zcandidate,
                                   Float64 zwidth);
 
@@ -44,12 +44,12 @@ public:
                                        Float64 &gaussAmp, Float64 &gaussAmpErr,
                                        Float64 &gaussSigma, Float64 &gaussSigmaErr);
 
-    Int32 Marginalize(TFloat64List redshifts,
-                      std::vector<TFloat64List> meritResults,
-                      std::vector<TFloat64List> zPriors,
+    Int32 Marginalize(const TFloat64List& redshifts,
+                      const std::vector<TFloat64List>& meritResults,
+                      const std::vector<TFloat64List>& zPriors,
                       Float64 cstLog,
                       std::shared_ptr<CPdfMargZLogResult> postmargZResult,
-                      std::vector<Float64> modelPriors=std::vector<Float64>());
+                      const std::vector<Float64>& modelPriors=std::vector<Float64>());
     Int32 BestProba(TFloat64List redshifts, std::vector<TFloat64List> meritResults, std::vector<TFloat64List> zPriors, Float64 cstLog, std::shared_ptr<CPdfMargZLogResult> postmargZResult);
     Int32 BestChi2(TFloat64List redshifts, std::vector<TFloat64List> meritResults, std::vector<TFloat64List> zPriors, Float64 cstLog, std::shared_ptr<CPdfMargZLogResult> postmargZResult);
 
@@ -0,0 +1,51 @@
+#ifndef _REDSHIFT_STATISTICS_PDFZMARGINALIZER_
+#define _REDSHIFT_STATISTICS_PDFZMARGINALIZER_
+
+#include <RedshiftLibrary/common/datatypes.h>
+#include <RedshiftLibrary/operator/pdfMargZLogResult.h>
+
+#include <memory>
+
+namespace NSEpic
+{
+
+/**
+ * \ingroup Redshift
+ * Streaming marginalization of z-PDFs over models.
+ *
+ * Merit curves are added one model at a time. Each one is converted into a
+ * log-posterior and its log-evidence in a single CPdfz::Compute call, then
+ * folded into running log-sum-exp accumulators, so that the curves do not
+ * need to be kept in memory until the marginalization is finalized.
+ */
+class CPdfzMarginalizer
+{
+
+public:
+
+    CPdfzMarginalizer();
+    ~CPdfzMarginalizer();
+
+    Int32 Add(const TFloat64List& redshifts,
+              const TFloat64List& merits,
+              const TFloat64List& logZPrior,
+              Float64 cstLog,
+              Float64 modelPrior=-1.0);
+    Int32 Finalize(std::shared_ptr<CPdfMargZLogResult> postmargZResult);
+
+    UInt32 GetModelCount() const;
+
+private:
+
+    TFloat64List m_redshifts;
+    TFloat64List m_logSumProba;
+    Float64 m_logSumEvidence;
+    UInt32 m_nModels;
+    UInt32 m_nModelPriors;
+    Float64 m_sumModelPriors;
+    Bool m_failed;
+};
+
+}
+
+#endif
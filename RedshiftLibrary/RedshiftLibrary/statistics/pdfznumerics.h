@@ -0,0 +1,41 @@
+#ifndef _REDSHIFT_STATISTICS_PDFZNUMERICS_
+#define _REDSHIFT_STATISTICS_PDFZNUMERICS_
+
+#include <RedshiftLibrary/common/datatypes.h>
+
+namespace NSEpic
+{
+
+/**
+ * \ingroup Redshift
+ * Numerically stable kernels used by the z-pdf computations.
+ *
+ * All the kernels work on contiguous arrays in log space, and shift the
+ * exponentials by the maximum value (log-sum-exp trick) to avoid underflows.
+ * Loops are kept branch-free so that they can be vectorized by the compiler.
+ */
+class CPdfzNumerics
+{
+
+public:
+
+    static Float64 Max(const Float64* x, UInt32 n);
+    static void MinMax(const Float64* x, UInt32 n, Float64& vmin, Float64& vmax);
+
+    static Float64 LogAddExp(Float64 a, Float64 b);
+    static void LogAddExp(Float64* acc, const Float64* x, Float64 shift, UInt32 n);
+
+    static Float64 LogSumExp(const Float64* x, UInt32 n);
+    static Float64 LogSumExpWeighted(const Float64* x, const Float64* w, UInt32 n);
+
+    static void RectWidths(const Float64* z, UInt32 n, Float64* widths);
+    static Float64 LogTrapzExp(const Float64* z, const Float64* logy, UInt32 n);
+    static Float64 LogRectExp(const Float64* z, const Float64* logy, UInt32 n);
+
+    static void Add(const Float64* a, const Float64* b, Float64* out, UInt32 n);
+    static void AddScalar(Float64* x, Float64 c, UInt32 n);
+};
+
+}
+
+#endif
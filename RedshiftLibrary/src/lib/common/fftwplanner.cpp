@@ -0,0 +1,12 @@
+#include <RedshiftLibrary/common/fftwplanner.h>
+
+using namespace NSEpic;
+
+/**
+ *
+ */
+boost::mutex& NSEpic::GetFFTWPlannerMutex()
+{
+    static boost::mutex plannerMutex;
+    return plannerMutex;
+}
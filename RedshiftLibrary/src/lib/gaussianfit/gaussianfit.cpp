@@ -4,6 +4,7 @@
 #include <RedshiftLibrary/spectrum/spectrum.h>
 
 #include <math.h>
+#include <algorithm>
 #include <gsl/gsl_rng.h>
 #include <gsl/gsl_randist.h>
 #include <gsl/gsl_vector.h>
@@ -27,17 +28,72 @@ CGaussianFit::CGaussianFit( ) :
     m_MuErr( 0.0 ),
     m_RelTol( 1e-12),
     m_coeff0( 0.0),
-    m_PolyOrder( 2 )
+    m_PolyOrder( 2 ),
+    m_Solver( NULL ),
+    m_J( NULL ),
+    m_Covar( NULL ),
+    m_SolverN( 0 ),
+    m_SolverP( 0 )
 {
 
 }
 
 /**
- * Empty destructor.
+ * Frees the solver and its workspaces.
  */
 CGaussianFit::~CGaussianFit()
 {
+    FreeSolver();
+}
+
+/**
+ * Allocates the Levenberg-Marquardt solver, the jacobian and the covariance matrices for n samples and np parameters,
+ * unless the ones kept from the previous call already have these sizes.
+ */
+void CGaussianFit::AllocateSolver( Int32 n, Int32 np )
+{
+    if( m_Solver!=NULL && n==m_SolverN && np==m_SolverP )
+    {
+        return;
+    }
 
+    if( np!=m_SolverP && m_Covar!=NULL )
+    {
+        gsl_matrix_free( m_Covar );
+        m_Covar = NULL;
+    }
+    if( m_Solver!=NULL )
+    {
+        gsl_multifit_fdfsolver_free( m_Solver );
+        gsl_matrix_free( m_J );
+    }
+
+    m_Solver = gsl_multifit_fdfsolver_alloc( gsl_multifit_fdfsolver_lmsder, n, np );
+    m_J = gsl_matrix_alloc( n, np );
+    if( m_Covar==NULL )
+    {
+        m_Covar = gsl_matrix_alloc( np, np );
+    }
+    m_SolverN = n;
+    m_SolverP = np;
+}
+
+void CGaussianFit::FreeSolver()
+{
+    if( m_Solver!=NULL )
+    {
+        gsl_multifit_fdfsolver_free( m_Solver );
+        gsl_matrix_free( m_J );
+        m_Solver = NULL;
+        m_J = NULL;
+    }
+    if( m_Covar!=NULL )
+    {
+        gsl_matrix_free( m_Covar );
+        m_Covar = NULL;
+    }
+    m_SolverN = 0;
+    m_SolverP = 0;
 }
 
 /**
@@ -78,17 +134,18 @@ void CGaussianFit::ComputeFirstGuess( const CSpectrum& spectrum, const TInt32Ran
 
     Int32 i;
     // Copy flux axis to v
-    Float64 *v = (Float64*)calloc( n, sizeof( Float64 ) );
-    for( i=0; i<n; i++ )
+    m_Buffer.assign( y, y + n );
+    Float64 *v = m_Buffer.data();
+
+    // Extract median: only the central values need to be in place, no full sort
+    std::nth_element( v, v + n/2, v + n );
+    Float64 y_median = v[n/2];
+    if( n%2==0 )
       {
-        v[i] = y[i];
+        Float64 lower = *std::max_element( v, v + n/2 );
+        y_median = ( lower + y_median ) / 2.0;
       }
 
-    // Sort v
-    gsl_sort( v, 1, n );
-    // Extract median
-    Float64 y_median = gsl_stats_median_from_sorted_data( v, 1, n );
-
     for( i=0; i<n; i++ )
       {
         v[i] = y[i] - y_median;
@@ -147,14 +204,15 @@ CGaussianFit::EStatus CGaussianFit::Compute( const CSpectrum& spectrum, const TI
 {
     Int32 np = (3 + m_PolyOrder + 1);
     Int32 n = studyRange.GetLength();
-    if( n<1 )
+    if( n<1 || n<np )
       {
         return nStatus_IllegalInput;
       }
 
     // Create suitable first guess
     // To BE improved, trivial version now
-    Float64* firstGuessData = (Float64*) calloc( np, sizeof( Float64 ) );
+    m_FirstGuess.assign( np, 0.0 );
+    Float64* firstGuessData = m_FirstGuess.data();
     gsl_vector_view firstGuessView = gsl_vector_view_array( firstGuessData, np );
 
     Float64 peakValue;
@@ -167,11 +225,6 @@ CGaussianFit::EStatus CGaussianFit::Compute( const CSpectrum& spectrum, const TI
     firstGuessData[1] = peakPos;
     firstGuessData[2] = gaussAmp;
 
-    if( n<np )
-      {
-        return nStatus_IllegalInput;
-      }
-
     SUserData userData;
     userData.spectrum = &spectrum;
     userData.studyRange = &studyRange;
@@ -187,8 +240,9 @@ CGaussianFit::EStatus CGaussianFit::Compute( const CSpectrum& spectrum, const TI
     multifitFunction.p = np;
     multifitFunction.params = &userData;
 
-    // Use a derivative solver Levenberg-Marquardt
-    gsl_multifit_fdfsolver* multifitSolver = gsl_multifit_fdfsolver_alloc( gsl_multifit_fdfsolver_lmsder, n, np );
+    // Use a derivative solver Levenberg-Marquardt, kept from the previous call if the sizes did not change
+    AllocateSolver( n, np );
+    gsl_multifit_fdfsolver* multifitSolver = m_Solver;
     gsl_multifit_fdfsolver_set( multifitSolver, &multifitFunction, &firstGuessView.vector );
 
     //Iterate
@@ -217,9 +271,9 @@ CGaussianFit::EStatus CGaussianFit::Compute( const CSpectrum& spectrum, const TI
     }
 
     // Set values and errors
-    gsl_matrix *covarMatrix = gsl_matrix_alloc( np, np );
+    gsl_matrix *covarMatrix = m_Covar;
     //gsl_multifit_covar( multifitSolver->J, 0.0, covarMatrix ); //WARNING: fit broken since using GSL2.1 instead of GSL1.16 = OLD version
-    gsl_matrix *J = gsl_matrix_alloc(n, np);     //WARNING: fit broken since using GSL2.1 instead of GSL1.16  = replacement version
+    gsl_matrix *J = m_J;     //WARNING: fit broken since using GSL2.1 instead of GSL1.16  = replacement version
     gsl_multifit_fdfsolver_jac(multifitSolver, J);   //WARNING: fit broken since using GSL2.1 instead of GSL1.16  = replacement version
     gsl_multifit_covar (J, 0.0, covarMatrix);    //WARNING: fit broken since using GSL2.1 instead of GSL1.16     = replacement version
 
@@ -267,8 +321,9 @@ CGaussianFit::EStatus CGaussianFit::Compute( const CSpectrum& spectrum, const TI
     }
 
 
-    Float64 *output = (Float64*) calloc( n ,sizeof( Float64 ) );
-    Float64 *outputError = (Float64*) calloc( n ,sizeof( Float64 ) );
+    m_Buffer.resize( 2*np );
+    Float64 *output = m_Buffer.data();
+    Float64 *outputError = output + np;
 
     for( Int32 i=0; i<np; i++)
     {
@@ -312,15 +367,43 @@ CGaussianFit::EStatus CGaussianFit::Compute( const CSpectrum& spectrum, const TI
 
     m_coeff0 = output[3];
 
-    gsl_multifit_fdfsolver_free( multifitSolver );
-    gsl_matrix_free( covarMatrix );
-    gsl_matrix_free( J );
+    return returnCode;
+}
 
-    free( firstGuessData );
-    free(output);
-    free(outputError);
+/**
+ * Fits every range of studyRanges on s, with the same solver and workspaces.
+ * The ranges are fitted by increasing length, so that the solver is reallocated once per distinct length,
+ * and results[k] holds the status and the parameters fitted on studyRanges[k] (as Compute, GetResults, GetResultsError
+ * and GetResultsPolyCoeff0 would give them). The last fit done stays available through the getters.
+ */
+void CGaussianFit::ComputeBatch( const CSpectrum& s, const TInt32RangeList& studyRanges, TResultList& results )
+{
+    UInt32 nRanges = studyRanges.size();
+    results.resize( nRanges );
 
-    return returnCode;
+    std::vector<std::pair<Int32, UInt32> > order( nRanges );
+    for( UInt32 k=0; k<nRanges; k++ )
+    {
+        order[k] = std::make_pair( studyRanges[k].GetLength(), k );
+    }
+    std::sort( order.begin(), order.end() );
+
+    for( UInt32 o=0; o<nRanges; o++ )
+    {
+        UInt32 k = order[o].second;
+        SResult& r = results[k];
+        r.Status = Compute( s, studyRanges[k] );
+        if( r.Status==nStatus_IllegalInput )
+        {
+            r.Amplitude = r.Position = r.Width = 0.0;
+            r.AmplitudeErr = r.PositionErr = r.WidthErr = 0.0;
+            r.PolyCoeff0 = 0.0;
+            continue;
+        }
+        GetResults( r.Amplitude, r.Position, r.Width );
+        GetResultsError( r.AmplitudeErr, r.PositionErr, r.WidthErr );
+        GetResultsPolyCoeff0( r.PolyCoeff0 );
+    }
 }
 
 /**
@@ -337,14 +420,7 @@ int CGaussianFit::GaussF( const gsl_vector *param, void *data, gsl_vector * f )
     const Float64* x = userData->spectrum->GetSpectralAxis().GetSamples() + userData->studyRange->GetBegin();
     const Float64* y = userData->spectrum->GetFluxAxis().GetSamples() + userData->studyRange->GetBegin();
     //const Float64* err = userData->spectrum->GetFluxAxis().GetError() + userData->studyRange->GetBegin();
-    std::vector<Float64> err( n );
-    if( true ) // WARNING: Hardcoded disable the use of err vect. = 1.0
-      { 
-        for ( Int32 i = 0; i < n; i++)
-	  {
-            err[i] = 1.0;
-	  }
-      }
+    // WARNING: Hardcoded disable the use of err vect. = 1.0
 
     Float64 A = gsl_vector_get( param, 0 );
     Float64 mu = gsl_vector_get( param, 1 );
@@ -355,16 +431,18 @@ int CGaussianFit::GaussF( const gsl_vector *param, void *data, gsl_vector * f )
 
     for ( Int32 i = 0; i < n; i++)
     {
-        /* Polynomial term */
-        Float64 Pi = 0;
-        for(Int32 k=0; k<=order; k++)
+        Float64 d = x[i] - mu;
+
+        /* Polynomial term, Horner's rule */
+        Float64 Pi = gsl_vector_get( param, 3 + order );
+        for(Int32 k=order-1; k>=0; k--)
         {
-            Pi += gsl_vector_get( param, 3 + k ) * pow( x[i] - mu, k );
+            Pi = Pi * d + gsl_vector_get( param, 3 + k );
         }
 
         // Add gaussian term to polynomial term
-        Float64 Yi = A * exp (-1.*(x[i]-mu)*(x[i]-mu)/(c*c)) + Pi;
-        gsl_vector_set( f, i, (Yi - y[i])/err[i] );
+        Float64 Yi = A * exp (-1.*d*d/(c*c)) + Pi;
+        gsl_vector_set( f, i, Yi - y[i] );
     }
 
   return GSL_SUCCESS;
@@ -379,14 +457,7 @@ int CGaussianFit::GaussDF( const gsl_vector* param, void* data, gsl_matrix* J )
     Int32 n = userData->studyRange->GetLength();
     const Float64* x = userData->spectrum->GetSpectralAxis().GetSamples() + userData->studyRange->GetBegin();
     //Float64* err = userData->spectrum->GetFluxAxis().GetError() + userData->studyRange->GetBegin();
-    std::vector<Float64> err( n );
-    if( true ) //WARNING: Hardcoded disable the use of err vect. = 1.0
-      {
-        for( Int32 i=0; i<n; i++ )
-	  {
-            err[i] = 1.0;
-	  }
-      }
+    //WARNING: Hardcoded disable the use of err vect. = 1.0
 
     Float64 A = gsl_vector_get( param, 0 );
     Float64 mu = gsl_vector_get( param, 1 );
@@ -404,23 +475,31 @@ int CGaussianFit::GaussDF( const gsl_vector* param, void* data, gsl_matrix* J )
         // where fi = (Yi - yi)/err[i],
         //       Yi = A * exp(-1*(xi-mu)**2/c**2) + P(n, x-mu)
 
+        Float64 d = x[i] - mu;
+
         // Exponential term */
-        Float64 e = exp( -1.0*( x[i]-mu ) * ( x[i]-mu ) / ( c*c ) ) / err[i];
+        Float64 e = exp( -1.0*d*d / ( c*c ) );
 
         // Gaussian term
         gsl_matrix_set (J, i, 0, e);
+
+        // dP/dmu = -P'(x-mu), Horner's rule
         Float64 P_mu = 0;
-        for( Int32 k=1; k<=order; k++ )
+        for( Int32 k=order; k>=1; k-- )
         {
-            P_mu+=(-1.*(k*pow(x[i]-mu, k-1)*gsl_vector_get( param, 3+k )));
+            P_mu = P_mu*d + k*gsl_vector_get( param, 3+k );
         }
 
-        gsl_matrix_set( J, i, 1, A_d*(x[i]-mu)*e + P_mu/err[i] );
-        gsl_matrix_set( J, i, 2, A_d*(x[i]-mu)*(x[i]-mu)*e/c );
+        gsl_matrix_set( J, i, 1, A_d*d*e - P_mu );
+        gsl_matrix_set( J, i, 2, A_d*d*d*e/c );
 
-        // Polynomial term
+        // Polynomial term, powers of (x-mu) by recurrence
+        Float64 dk = 1.0;
         for( Int32 k=0; k<=order; k++ )
-            gsl_matrix_set( J, i, 3+k, pow(x[i] - mu, k)/err[i] );
+        {
+            gsl_matrix_set( J, i, 3+k, dk );
+            dk *= d;
+        }
     }
     return GSL_SUCCESS;
 }
@@ -105,6 +105,14 @@ CLineModelElementList::CLineModelElementList(const CSpectrum& spectrum,
     m_ContinuumFluxAxis.SetSize( spectrumSampleCount );
     m_SpcFluxAxisModelDerivVelEmi.SetSize( spectrumSampleCount );
     m_SpcFluxAxisModelDerivVelAbs.SetSize( spectrumSampleCount );
+    m_modelCacheScratch.SetSize( spectrumSampleCount );
+    m_modelCacheDirtyMask.assign( spectrumSampleCount, false );
+    m_modelCacheValid = false;
+    m_meritCacheValid = false;
+    m_meritCacheImin = -1;
+    m_meritCacheImax = -1;
+    m_meritCacheUpdates = 0;
+    m_meritCacheSum = 0.0;
     CSpectrumFluxAxis& modelFluxAxis = m_SpectrumModel->GetFluxAxis();
     const CSpectrumFluxAxis& spectrumFluxAxis = spectrum.GetFluxAxis();
     m_spcFluxAxisNoContinuum.SetSize( spectrumSampleCount );
@@ -144,6 +152,10 @@ CLineModelElementList::CLineModelElementList(const CSpectrum& spectrum,
             m_SpcFluxAxis[i] = spectrumFluxAxis[i];
         }
     }
+    // the error and flux vectors were written through the non-const accessors
+    m_spcFluxAxisNoContinuum.ResetWeights();
+    m_SpcFluxAxis.ResetWeights();
+    m_SpcContinuumFluxAxis.ResetWeights();
     m_observeGridContinuumFlux = NULL;
     m_unscaleContinuumFluxAxisDerivZ =NULL;
     m_chiSquareOperator = NULL;
@@ -228,6 +240,7 @@ CLineModelElementList::~CLineModelElementList()
     {
         delete m_chiSquareOperator;
     }
+    freeLmfitSolver();
 }
 
 void CLineModelElementList::initLambdaOffsets(std::string offsetsCatalogsRelPath)
@@ -576,6 +589,15 @@ Float64 CLineModelElementList::getModelFluxVal(UInt32 idx) const
     return -1.0;
 }
 
+Float64 CLineModelElementList::getContinuumFluxVal(UInt32 idx) const
+{
+    if(idx<m_ContinuumFluxAxis.GetSamplesCount()){
+        return m_ContinuumFluxAxis[idx];
+    }
+
+    return -1.0;
+}
+
 
 Float64 CLineModelElementList::getModelFluxDerivEltVal(UInt32 DerivEltIdx, UInt32 idx) const
 {
@@ -937,7 +959,7 @@ void CLineModelElementList::LoadFitContinuum(const TFloat64Range& lambdaRange, I
         }
     }else if(m_fitContinuum_option==1){
         CTemplatesFitStore::TemplateFitValues fitValues = m_fitContinuum_tplfitStore->GetFitValues(m_Redshift, icontinuum);
-        if(fitValues.tplName=="")
+        if(fitValues.tplId<0)
         {
             throw runtime_error("Empty template name");
         }
@@ -947,7 +969,7 @@ void CLineModelElementList::LoadFitContinuum(const TFloat64Range& lambdaRange, I
         bestFitMeiksinIdx = fitValues.igmMeiksinIdx;
         bestFitDtM = fitValues.fitDtM;
         bestFitMtM = fitValues.fitMtM;
-        bestTplName = fitValues.tplName;
+        bestTplName = m_fitContinuum_tplfitStore->GetTplName(fitValues.tplId);
     }else if(m_fitContinuum_option==2){
         //values unmodified
         bestTplName = m_fitContinuum_tplName;
@@ -1069,6 +1091,7 @@ void CLineModelElementList::LoadFitContinuum(const TFloat64Range& lambdaRange, I
 }
 
 void CLineModelElementList::setFitContinuum_tplAmplitude(Float64 tplAmp, std::vector<Float64> polyCoeffs){
+    invalidateModelCache();
     const CSpectrumSpectralAxis& spcSpectralAxis = m_SpectrumModel->GetSpectralAxis();
 
     //Float64 alpha = 0.5; //alpha blend = 1: only m_SpcContinuumFluxAxis, alpha=0: only tplfit
@@ -1088,6 +1111,7 @@ void CLineModelElementList::setFitContinuum_tplAmplitude(Float64 tplAmp, std::ve
         }
         m_spcFluxAxisNoContinuum[k] = m_SpcFluxAxis[k]-m_ContinuumFluxAxis[k];
     }
+    m_spcFluxAxisNoContinuum.ResetWeightedFlux();
 }
 
 
@@ -1355,6 +1379,8 @@ Int32 CLineModelElementList::LoadFitContaminantTemplate(const TFloat64Range& lam
             m_SpcFluxAxis[k] = inputSpectrumFluxAxis[k]-tplContaminantRebinFluxAxis[k];
         }
     }
+    m_SpcFluxAxis.ResetWeightedFlux();
+    invalidateModelCache();
 
     return 1;
 }
@@ -1443,6 +1469,7 @@ void CLineModelElementList::SetFitContinuum_FitValues(std::string tplfit_name,
  **/
 void CLineModelElementList::PrepareContinuum(Float64 z)
 {
+    invalidateModelCache();
     const CSpectrumSpectralAxis& targetSpectralAxis = m_SpectrumModel->GetSpectralAxis();
     Float64* Yrebin = m_ContinuumFluxAxis.GetSamples();
 
@@ -1523,6 +1550,18 @@ Bool CLineModelElementList::initModelAtZ(Float64 redshift, const TFloat64Range&
     return true;
 }
 
+/**
+ * \brief Enables the memoization of the elements supports for up to maxSize redshifts (and line widths), 0 disables it.
+ * The supports prepared at a redshift are then reused by any later initModelAtZ or fit at the same redshift with the same line widths.
+ **/
+void CLineModelElementList::SetSupportCacheSize(Int32 maxSize)
+{
+    for( UInt32 iElts=0; iElts<m_Elements.size(); iElts++ )
+    {
+        m_Elements[iElts]->SetSupportCacheSize(maxSize);
+    }
+}
+
 Bool CLineModelElementList::setTplshapeModel(Int32 itplshape, Bool enableSetVelocity)
 {
     m_CatalogTplShape->SetLyaProfile(*this, itplshape);
@@ -1560,6 +1599,98 @@ Bool CLineModelElementList::initDtd(const TFloat64Range& lambdaRange)
     return true;
 }
 
+/**
+ * \brief Cheap lower bound of the merit fit() would return at this redshift, without fitting the lines.
+ * For each continuum fit() would try, the continuum-only chi2 is decreased by the largest chi2 decrease each element can bring
+ * on its support, whatever its amplitudes (see CMultiLine::GetBasisMaxChi2Reduction). These reductions only add up when the element
+ * supports are disjoint: returns false, with no bound, as soon as two supports share a sample. It also requires the continuum and the
+ * line profiles not to be re-estimated by fit(): returns false for the fitting configurations where they are.
+ **/
+bool CLineModelElementList::getFitMeritLowerBound(Float64 redshift,
+                                                  const TFloat64Range& lambdaRange,
+                                                  Int32 contreest_iterations,
+                                                  Float64& meritLowerBound,
+                                                  Float64& continuumMerit)
+{
+    if(!(m_fittingmethod=="hybrid" || m_fittingmethod=="individual" || m_fittingmethod=="svd"))
+    {
+        return false;
+    }
+    if(!(m_ContinuumComponent=="tplfit" || m_ContinuumComponent=="fromspectrum"))
+    {
+        return false;
+    }
+    if(contreest_iterations>0 || m_enableAmplitudeOffsets || isLambdaOffsetFitted() || m_tplshapeLeastSquareFast)
+    {
+        return false;
+    }
+
+    const CSpectrumSpectralAxis& spectralAxis = m_SpectrumModel->GetSpectralAxis();
+    initModelAtZ(redshift, lambdaRange, spectralAxis);
+    if(hasOverlappingSupports())
+    {
+        return false;
+    }
+    if(! (m_dTransposeDLambdaRange.GetBegin()==lambdaRange.GetBegin() && m_dTransposeDLambdaRange.GetEnd()==lambdaRange.GetEnd() ) )
+    {
+        initDtd(lambdaRange);
+    }
+
+    //the Lya asymmetric profile is fitted (or set per tpl-ratio) by fit(): no bound with the current profile
+    linetags ltags;
+    Int32 idxLineLyaE = -1;
+    Int32 idxLyaE = FindElementIndex(ltags.lya_em, -1, idxLineLyaE);
+    if(idxLyaE>=0 && idxLineLyaE>=0 && !m_Elements[idxLyaE]->IsOutsideLambdaRange())
+    {
+        for(Int32 iray=0; iray<m_Elements[idxLyaE]->GetSize(); iray++)
+        {
+            CRay::TProfile profile = m_RestRayList[m_Elements[idxLyaE]->m_LineCatalogIndexes[iray]].GetProfile();
+            if(profile==CRay::ASYMFIT || profile==CRay::ASYMFIXED)
+            {
+                return false;
+            }
+        }
+    }
+
+    Int32 ncontinuumfitting=1;
+    if(m_ContinuumComponent == "tplfit" && !m_forcedisableMultipleContinuumfit)
+    {
+        ncontinuumfitting=m_opt_fitcontinuum_maxCount;
+    }
+
+    meritLowerBound = DBL_MAX;
+    continuumMerit = DBL_MAX;
+    for(Int32 icontfitting=0; icontfitting<ncontinuumfitting; icontfitting++)
+    {
+        if(m_ContinuumComponent == "tplfit")
+        {
+            LoadFitContinuum(lambdaRange, icontfitting);
+        }
+        if(m_ContinuumComponent == "tplfit" && m_fitContinuum_observedFrame){
+            PrepareContinuum(0.0);
+        }else{
+            PrepareContinuum(redshift);
+        }
+        for(UInt32 i=0; i<m_spcFluxAxisNoContinuum.GetSamplesCount(); i++)
+        {
+            m_spcFluxAxisNoContinuum[i] = m_SpcFluxAxis[i]-m_ContinuumFluxAxis[i];
+        }
+        m_spcFluxAxisNoContinuum.ResetWeightedFlux();
+
+        Float64 contMerit = getLeastSquareContinuumMerit(lambdaRange);
+        Float64 reduction = 0.0;
+        for( UInt32 iElts=0; iElts<m_Elements.size(); iElts++ )
+        {
+            m_Elements[iElts]->prepareAmplitudeFitBasis(spectralAxis, m_spcFluxAxisNoContinuum, m_ContinuumFluxAxis, redshift);
+            reduction += m_Elements[iElts]->GetBasisMaxChi2Reduction();
+        }
+
+        continuumMerit = std::min(continuumMerit, contMerit);
+        meritLowerBound = std::min(meritLowerBound, contMerit-reduction);
+    }
+    return true;
+}
+
 /**
  * \brief Prepares the context and fits the Linemodel to the spectrum, returning the merit of the fit.
  * Prepare the continuum.
@@ -1641,6 +1772,7 @@ Float64 CLineModelElementList::fit(Float64 redshift,
                 modelFluxAxis[i] = m_ContinuumFluxAxis[i];
                 m_spcFluxAxisNoContinuum[i] = m_SpcFluxAxis[i]-m_ContinuumFluxAxis[i];
             }
+            m_spcFluxAxisNoContinuum.ResetWeightedFlux();
         }
 
         if(m_enableAmplitudeOffsets)
@@ -1648,6 +1780,7 @@ Float64 CLineModelElementList::fit(Float64 redshift,
             prepareAmplitudeOffset(m_spcFluxAxisNoContinuum);
         }
 
+        bool tplratioBasisPrepared = false;
         for(Int32 ifitting=0; ifitting<nfitting; ifitting++)
         {
             if(m_rigidity!="tplshape")
@@ -1889,6 +2022,8 @@ Float64 CLineModelElementList::fit(Float64 redshift,
                    //modelSolution = GetModelSolution();
                 }else{
                   Log.LogError( "LineModel Lmfit: not able to fit values at z %f", m_Redshift);
+                  //the evaluations only refreshed the element supports
+                  refreshModelInitAllGrid();
                   //continue;
                   return DBL_MAX;
                 }
@@ -1970,6 +2105,7 @@ Float64 CLineModelElementList::fit(Float64 redshift,
                     modelFluxAxis[i] = m_ContinuumFluxAxis[i];
                     m_spcFluxAxisNoContinuum[i] = m_SpcFluxAxis[i]-m_ContinuumFluxAxis[i];
                 }
+                m_spcFluxAxisNoContinuum.ResetWeightedFlux();
 
                 //2. loop on the continuum templates from catalog
                 /*
@@ -2036,6 +2172,7 @@ Float64 CLineModelElementList::fit(Float64 redshift,
                                     modelFluxAxis[i] = m_ContinuumFluxAxis[i];
                                     m_spcFluxAxisNoContinuum[i] = m_SpcFluxAxis[i]-m_ContinuumFluxAxis[i];
                                 }
+                                m_spcFluxAxisNoContinuum.ResetWeightedFlux();
                                 //refreshModel();
                             }
                             bestChi2 = chi2_cl;
@@ -2056,6 +2193,7 @@ Float64 CLineModelElementList::fit(Float64 redshift,
                     modelFluxAxis[i] = m_ContinuumFluxAxis[i];
                     m_spcFluxAxisNoContinuum[i] = m_SpcFluxAxis[i]-m_ContinuumFluxAxis[i];
                 }
+                m_spcFluxAxisNoContinuum.ResetWeightedFlux();
                 //*/
 
             }
@@ -2063,7 +2201,10 @@ Float64 CLineModelElementList::fit(Float64 redshift,
             //fit the amplitudes of each element independently, unless there is overlap
             if(m_fittingmethod=="hybrid")
             {
-                fitAmplitudesHybrid(spectralAxis, m_spcFluxAxisNoContinuum, m_ContinuumFluxAxis, redshift);
+                if(!fitAmplitudesTplratioFromBasis(spectralAxis, redshift, contreest_iterations, tplratioBasisPrepared))
+                {
+                    fitAmplitudesHybrid(spectralAxis, m_spcFluxAxisNoContinuum, m_ContinuumFluxAxis, redshift);
+                }
 
                 //apply a continuum iterative re-estimation with lines removed from the initial spectrum
                 Int32 nIt = contreest_iterations;
@@ -2092,6 +2233,7 @@ Float64 CLineModelElementList::fit(Float64 redshift,
                         modelFluxAxis[i] = m_ContinuumFluxAxis[i];
                         m_spcFluxAxisNoContinuum[i] = m_SpcFluxAxis[i]-m_ContinuumFluxAxis[i];
                     }
+                    m_spcFluxAxisNoContinuum.ResetWeightedFlux();
                     //*/
 
                     /*
@@ -2417,6 +2559,7 @@ void CLineModelElementList::SetAbsLinesLimit(Float64 limit)
  **/
 void CLineModelElementList::reinitModel()
 {
+    invalidateModelCache();
     CSpectrumFluxAxis& modelFluxAxis = m_SpectrumModel->GetFluxAxis();
 
     /*
@@ -2445,6 +2588,7 @@ void CLineModelElementList::reinitModel()
  **/
 void CLineModelElementList::reinitModelUnderElements(std::vector<UInt32>  filterEltsIdx, Int32 lineIdx )
 {
+    invalidateModelCache();
     Int32 iElts;
     CSpectrumFluxAxis& modelFluxAxis = m_SpectrumModel->GetFluxAxis();
     //init spectrum model with continuum
@@ -2462,7 +2606,13 @@ void CLineModelElementList::reinitModelUnderElements(std::vector<UInt32>  filter
  **/
 void CLineModelElementList::refreshModel(Int32 lineTypeFilter)
 {
-    reinitModel();    
+    if(refreshModelIncremental(lineTypeFilter))
+    {
+        return;
+    }
+
+    reinitModel();
+    m_meritCacheValid = false;
 
     const CSpectrumSpectralAxis& spectralAxis = m_SpectrumModel->GetSpectralAxis();
     CSpectrumFluxAxis& modelFluxAxis = m_SpectrumModel->GetFluxAxis();
@@ -2523,14 +2673,28 @@ void CLineModelElementList::refreshModel(Int32 lineTypeFilter)
         //addToSpectrumAmplitudeOffset(contFluxAxisWithAmpOffset);
     }
 
-    //create spectrum model
+    //create spectrum model, keeping each element contribution for the next incremental refresh
     UInt32 nElements = m_Elements.size();
+    m_modelCacheKeys.resize(nElements);
+    m_modelCacheSupports.resize(nElements);
+    m_modelCacheContributions.resize(nElements);
     for( UInt32 iElts=0; iElts<nElements; iElts++ )
     {
+        TInt32List& support = m_modelCacheSupports[iElts];
+        TFloat64List& contribution = m_modelCacheContributions[iElts];
+        getElementModelSupport(iElts, support);
+        getElementModelKey(iElts, lineTypeFilter, m_modelCacheKeys[iElts]);
         Int32 lineType = m_Elements[iElts]->m_Rays[0].GetType();
         if(lineTypeFilter==-1 || lineTypeFilter==lineType)
         {
-            m_Elements[iElts]->addToSpectrumModel(spectralAxis, modelFluxAxis, m_ContinuumFluxAxis, m_Redshift);
+            computeElementModel(iElts, support, contribution);
+            for( UInt32 n=0; n<support.size(); n++ )
+            {
+                modelFluxAxis[support[n]] += contribution[n];
+            }
+        }else
+        {
+            contribution.assign(support.size(), 0.0);
         }
 
         /*
@@ -2576,6 +2740,214 @@ void CLineModelElementList::refreshModel(Int32 lineTypeFilter)
         Log.LogDebug( "CLineModelElementList::refreshModel AFTER addToSpectrumModel: model min=%e and model max=%e", fmin, fmax );
     }
 
+    m_modelCacheValid = !m_enableAmplitudeOffsets;
+}
+
+/**
+ * \brief Updates the spectrum model from the contributions cached by the last refreshModel.
+ * Only the elements whose state key changed are recomputed. The samples of their supports are then rebuilt from the
+ * continuum and the cached contributions, in the same order as a full refresh, and the least square merit terms are
+ * updated on these samples only.
+ * Returns false, without modifying the model, when a full refresh is needed: no valid cache, amplitude offsets enabled,
+ * or a changed element support.
+ **/
+Bool CLineModelElementList::refreshModelIncremental(Int32 lineTypeFilter)
+{
+    UInt32 nElements = m_Elements.size();
+    if(!m_modelCacheValid || m_enableAmplitudeOffsets || m_modelCacheKeys.size()!=nElements)
+    {
+        return false;
+    }
+
+    //find the modified elements, all the supports have to be checked before updating the model
+    TInt32List support;
+    TFloat64List key;
+    std::vector<UInt32> modifiedElts;
+    std::vector<TFloat64List> modifiedKeys;
+    for( UInt32 iElts=0; iElts<nElements; iElts++ )
+    {
+        getElementModelKey(iElts, lineTypeFilter, key);
+        if(key==m_modelCacheKeys[iElts])
+        {
+            continue;
+        }
+        getElementModelSupport(iElts, support);
+        if(support!=m_modelCacheSupports[iElts])
+        {
+            return false;
+        }
+        modifiedElts.push_back(iElts);
+        modifiedKeys.push_back(key);
+    }
+    if(modifiedElts.empty())
+    {
+        return true;
+    }
+
+    //recompute the modified contributions, and collect the dirty samples
+    TFloat64List contribution;
+    m_modelCacheDirtySamples.clear();
+    for( UInt32 i=0; i<modifiedElts.size(); i++ )
+    {
+        UInt32 iElts = modifiedElts[i];
+        const TInt32List& eltSupport = m_modelCacheSupports[iElts];
+        Int32 lineType = m_Elements[iElts]->m_Rays[0].GetType();
+        if(lineTypeFilter==-1 || lineTypeFilter==lineType)
+        {
+            computeElementModel(iElts, eltSupport, contribution);
+        }else
+        {
+            contribution.assign(eltSupport.size(), 0.0);
+        }
+        m_modelCacheContributions[iElts].swap(contribution);
+        m_modelCacheKeys[iElts].swap(modifiedKeys[i]);
+
+        for( UInt32 n=0; n<eltSupport.size(); n++ )
+        {
+            if(!m_modelCacheDirtyMask[eltSupport[n]])
+            {
+                m_modelCacheDirtyMask[eltSupport[n]] = true;
+                m_modelCacheDirtySamples.push_back(eltSupport[n]);
+            }
+        }
+    }
+    if(m_modelCacheDirtySamples.empty())
+    {
+        return true;
+    }
+    std::sort(m_modelCacheDirtySamples.begin(), m_modelCacheDirtySamples.end());
+    Int32 dirtyBegin = m_modelCacheDirtySamples.front();
+    Int32 dirtyEnd = m_modelCacheDirtySamples.back();
+
+    //rebuild the dirty samples as the full refresh does: continuum, then the contributions in the elements order
+    Float64* flux = m_SpectrumModel->GetFluxAxis().GetSamples();
+    const Float64* continuum = m_ContinuumFluxAxis.GetSamples();
+    for( UInt32 n=0; n<m_modelCacheDirtySamples.size(); n++ )
+    {
+        flux[m_modelCacheDirtySamples[n]] = continuum[m_modelCacheDirtySamples[n]];
+    }
+    for( UInt32 iElts=0; iElts<nElements; iElts++ )
+    {
+        const TInt32List& eltSupport = m_modelCacheSupports[iElts];
+        if(eltSupport.empty() || eltSupport.back()<dirtyBegin || eltSupport.front()>dirtyEnd)
+        {
+            continue;
+        }
+        const TFloat64List& eltContribution = m_modelCacheContributions[iElts];
+        for( UInt32 n=0; n<eltSupport.size(); n++ )
+        {
+            if(m_modelCacheDirtyMask[eltSupport[n]])
+            {
+                flux[eltSupport[n]] += eltContribution[n];
+            }
+        }
+    }
+
+    updateLeastSquareMeritTerms(m_modelCacheDirtySamples);
+    for( UInt32 n=0; n<m_modelCacheDirtySamples.size(); n++ )
+    {
+        m_modelCacheDirtyMask[m_modelCacheDirtySamples[n]] = false;
+    }
+    return true;
+}
+
+/**
+ * \brief Sorted sample indexes of the element support, the support ranges of the rays may overlap.
+ **/
+void CLineModelElementList::getElementModelSupport(UInt32 iElts, TInt32List& support)
+{
+    support.clear();
+    TInt32RangeList s = m_Elements[iElts]->getSupport();
+    for( UInt32 iS=0; iS<s.size(); iS++ )
+    {
+        for( Int32 i=s[iS].GetBegin(); i<=s[iS].GetEnd(); i++ )
+        {
+            support.push_back(i);
+        }
+    }
+    if(s.size()>1)
+    {
+        std::sort(support.begin(), support.end());
+        support.erase(std::unique(support.begin(), support.end()), support.end());
+    }
+}
+
+/**
+ * \brief State key of the element, with a last entry telling if the element is included by the line type filter.
+ **/
+void CLineModelElementList::getElementModelKey(UInt32 iElts, Int32 lineTypeFilter, TFloat64List& key)
+{
+    m_Elements[iElts]->GetModelStateKey(m_Redshift, key);
+    Int32 lineType = m_Elements[iElts]->m_Rays[0].GetType();
+    key.push_back(lineTypeFilter==-1 || lineTypeFilter==lineType);
+}
+
+/**
+ * \brief Computes the model of the element alone, without continuum, on its support.
+ **/
+void CLineModelElementList::computeElementModel(UInt32 iElts, const TInt32List& support, TFloat64List& contribution)
+{
+    const CSpectrumSpectralAxis& spectralAxis = m_SpectrumModel->GetSpectralAxis();
+    Float64* scratch = m_modelCacheScratch.GetSamples();
+    for( UInt32 n=0; n<support.size(); n++ )
+    {
+        scratch[support[n]] = 0.0;
+    }
+    m_Elements[iElts]->addToSpectrumModel(spectralAxis, m_modelCacheScratch, m_ContinuumFluxAxis, m_Redshift);
+    contribution.resize(support.size());
+    for( UInt32 n=0; n<support.size(); n++ )
+    {
+        contribution[n] = scratch[support[n]];
+    }
+}
+
+/**
+ * \brief Updates the cached least square merit on the given samples, after a model update.
+ * The sum is periodically accumulated again from the terms, to bound the drift of the incremental updates.
+ **/
+void CLineModelElementList::updateLeastSquareMeritTerms(const TInt32List& samples)
+{
+    const Int32 maxIncrementalUpdates = 64;
+    if(!m_meritCacheValid)
+    {
+        return;
+    }
+    const Float64* Ymodel = m_SpectrumModel->GetFluxAxis().GetSamples();
+    const Float64* Yspc = m_SpcFluxAxis.GetSamples();
+    const Float64* invErr2 = m_spcFluxAxisNoContinuum.GetInverseVariance();
+    for( UInt32 n=0; n<samples.size(); n++ )
+    {
+        Int32 j = samples[n];
+        if(j<m_meritCacheImin || j>=m_meritCacheImax)
+        {
+            continue;
+        }
+        Float64 diff = (Yspc[j] - Ymodel[j]);
+        Float64 term = (diff*diff) * invErr2[j];
+        m_meritCacheSum += term - m_meritCacheTerms[j-m_meritCacheImin];
+        m_meritCacheTerms[j-m_meritCacheImin] = term;
+    }
+
+    m_meritCacheUpdates++;
+    if(m_meritCacheUpdates>=maxIncrementalUpdates)
+    {
+        m_meritCacheSum = 0.0;
+        for( UInt32 k=0; k<m_meritCacheTerms.size(); k++ )
+        {
+            m_meritCacheSum += m_meritCacheTerms[k];
+        }
+        m_meritCacheUpdates = 0;
+    }
+}
+
+/**
+ * \brief To be called when the observed spectrum, the continuum or the model are modified outside of refreshModel:
+ * the model and merit caches are then rebuilt from scratch.
+ **/
+void CLineModelElementList::invalidateModelCache()
+{
+    m_modelCacheValid = false;
+    m_meritCacheValid = false;
 }
 
 
@@ -2673,6 +3045,7 @@ Int32 CLineModelElementList::prepareAmplitudeOffset(const CSpectrumFluxAxis& spc
  **/
 void CLineModelElementList::refreshModelInitAllGrid()
 {
+    invalidateModelCache();
 
     const CSpectrumSpectralAxis& spectralAxis = m_SpectrumModel->GetSpectralAxis();
     CSpectrumFluxAxis& modelFluxAxis = m_SpectrumModel->GetFluxAxis();
@@ -2768,6 +3141,7 @@ void CLineModelElementList::refreshModelDerivVelUnderElements(std::vector<UInt32
 
 void CLineModelElementList::setModelSpcObservedOnSupportZeroOutside(  const TFloat64Range& lambdaRange )
 {
+    invalidateModelCache();
     m_Redshift = 0.0;
 
     //initialize the model spectrum
@@ -2999,6 +3373,76 @@ Int32 CLineModelElementList::fitAmplitudesHybrid(const CSpectrumSpectralAxis& sp
   return 0;
 }
 
+/**
+ * \brief Returns true if the lambda offset of at least one ray is fitted, as set by the offsets calibration.
+ **/
+bool CLineModelElementList::isLambdaOffsetFitted()
+{
+    if(!m_enableLambdaOffsetsFit)
+    {
+        return false;
+    }
+    for( UInt32 iElts=0; iElts<m_Elements.size(); iElts++ )
+    {
+        for( UInt32 j=0; j<m_Elements[iElts]->m_Rays.size(); j++ )
+        {
+            if(m_Elements[iElts]->m_Rays[j].GetOffsetFitEnabled())
+            {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+/**
+ * \brief For rigidity=tplshape, fits the amplitudes from the cross products of the unit line profiles, prepared once per redshift and continuum, instead of synthesizing the profiles again for each tpl-ratio.
+ * Only done when the hybrid fit reduces to the individual fit of each element (ex. the Em and Abs multilines): no continuum re-estimation,
+ * no amplitude offsets, no lambda offset to fit and no overlapping elements.
+ * @return false if the amplitudes were not fitted
+ **/
+bool CLineModelElementList::fitAmplitudesTplratioFromBasis(const CSpectrumSpectralAxis& spectralAxis, Float64 redshift, Int32 contreest_iterations, bool& basisPrepared)
+{
+    if(!m_opt_enableTplratioFitFromBasis || m_rigidity!="tplshape" || contreest_iterations>0 || m_enableAmplitudeOffsets || isLambdaOffsetFitted())
+    {
+        return false;
+    }
+    std::vector<UInt32> validEltsIdx = GetModelValidElementsIndexes();
+    bool fitted = basisPrepared;
+    for( UInt32 iValidElts=0; fitted && iValidElts<validEltsIdx.size(); iValidElts++ )
+    {
+        fitted = m_Elements[validEltsIdx[iValidElts]]->fitAmplitudeFromBasis(redshift);
+    }
+    if(!fitted)
+    {
+        //first tpl-ratio, or the line profiles changed for this tpl-ratio (ex. Lya asymfit)
+        Float64 overlapThres = 0.15; //same as fitAmplitudesHybrid
+        for( UInt32 iValidElts=0; iValidElts<validEltsIdx.size(); iValidElts++ )
+        {
+            if(getOverlappingElements(validEltsIdx[iValidElts], std::vector<UInt32>(), overlapThres).size()>1)
+            {
+                basisPrepared = false;
+                return false;
+            }
+        }
+        for( UInt32 iValidElts=0; iValidElts<validEltsIdx.size(); iValidElts++ )
+        {
+            UInt32 iElts = validEltsIdx[iValidElts];
+            m_Elements[iElts]->prepareAmplitudeFitBasis(spectralAxis, m_spcFluxAxisNoContinuum, m_ContinuumFluxAxis, redshift);
+            m_Elements[iElts]->fitAmplitudeFromBasis(redshift);
+        }
+        basisPrepared = true;
+    }
+    for( UInt32 iValidElts=0; iValidElts<validEltsIdx.size(); iValidElts++ )
+    {
+        m_Elements[validEltsIdx[iValidElts]]->m_fittingGroupInfo = boost::str(boost::format("hy%d") % iValidElts);
+    }
+    m_tplratioFitFromBasisCount++;
+
+    improveBalmerFit();
+    return true;
+}
+
 /**
  * @brief CLineModelElementList::estimateMeanSqFluxAndGradient
  * @param varPack: the variables of the model being fitted
@@ -3107,30 +3551,12 @@ Int32 CLineModelElementList::fitAmplitudesLmfit( const CSpectrumFluxAxis& fluxAx
         return -1;
     }
 
-    std::vector<UInt32> xInds;
-    if(! controller->isContinuumFitted()){
-        xInds = getSupportIndexes( filteredEltsIdx );
-    }else{
-        xInds=  std::vector<UInt32>(fluxAxis.GetSamplesCount());
-        //boost::push_back(xInds, fluxAxis.GetSamplesCount());
-        std::iota(std::begin(xInds), std::end(xInds), 0);
-    }
-
-    const Float64* flux = fluxAxis.GetSamples();
     Float64 amplitudeContinuumInit = m_fitContinuum_tplFitAmplitude;
 
-    //create gsl solver object
-    const gsl_multifit_fdfsolver_type *T = gsl_multifit_fdfsolver_lmsder;
-    gsl_multifit_fdfsolver *s;
-    int status, info;
-    size_t i;
-    size_t n; //n samples on the support, /* number of data points to fit */
-    size_t p = controller->getNumberParameters(); //DOF = n amplitudes to fit (1 for each element) + 1 (EL velocity) +1 Absorption VEl +1 Amplitude Template
-
-    n = xInds.size();
-    if(n<nddl){
+    std::vector<UInt32> xInds;
+    if(prepareLmfitData(fluxAxis, controller, filteredEltsIdx, false, xInds)!=0)
+    {
         controller->resizeAmpsLine();
-        Log.LogError( "LineModel Infos: LMfit not enough smaples on support");
         for (Int32 iddl = 0; iddl < nddl; iddl++)
         {
             controller->setAmpLine(iddl, 0.0,0.0);
@@ -3138,39 +3564,24 @@ Int32 CLineModelElementList::fitAmplitudesLmfit( const CSpectrumFluxAxis& fluxAx
         return -1;
     }
 
-    //set the norm factor
-    Int32 idx = 0;
-    Float64 maxabsval = DBL_MIN;
-    Float64 normFactor;
-    // if(controller->needCalculateNormFactor()){
-      for (i = 0; i < n; i++)
-      {
-          idx = xInds[i];
-
-          if(maxabsval<std::abs(flux[idx]))
-          {
-              maxabsval=std::abs(flux[idx]);
-          }
-      }
-      normFactor = 1.0/maxabsval;
-      controller->setNormFactor(normFactor);
-    // }else{
-    //   // the norm factor is the same as the last call
-    //   normFactor=controller->getNormFactor();
-    // }
-
-    if(verbose)
-    {
-        //Log.LogInfo("normFactor = '%.3e'", normFactor);
-    }
-
-    gsl_matrix *J = gsl_matrix_alloc(n, p);
-    gsl_matrix *covar = gsl_matrix_alloc (p, p);
-    double y[n], weights[n];
-    struct lmfitdata d = {n,y,this, xInds, m_observeGridContinuumFlux, controller};
+    int status, info;
+    size_t i;
+    size_t n = xInds.size(); //n samples on the support, /* number of data points to fit */
+    size_t p = controller->getNumberParameters(); //DOF = n amplitudes to fit (1 for each element) + 1 (EL velocity) +1 Absorption VEl +1 Amplitude Template
+    Float64 normFactor = controller->getNormFactor();
+
+    //the solver and the work buffers are kept from one call to the other
+    prepareLmfitSolver(n, p);
+    gsl_multifit_fdfsolver *s = m_lmfitSolver;
+    gsl_matrix *J = m_lmfitJ;
+    gsl_matrix *covar = m_lmfitCovar;
+    m_lmfitX.assign(p, 0.0);
+    Float64* x_init = m_lmfitX.data();
+
+    struct lmfitdata d = {n, m_lmfitY.data(), this, &xInds, m_observeGridContinuumFlux, controller, &filteredEltsIdx, &m_lmfitEltRows, m_lmfitRowBuffer.data(),
+                          &m_lmfitModelEltsIdx, &m_lmfitModelRows, false};
     gsl_multifit_function_fdf f;
 
-    Float64* x_init = (Float64*) calloc( p, sizeof( Float64 ) );
     //initialize lmfit with previously estimated individual/hybrid fit method
     Float64 bestAmpLine = -1;
     for(Int32 kp=0; kp<nddl; kp++)
@@ -3242,7 +3653,7 @@ Int32 CLineModelElementList::fitAmplitudesLmfit( const CSpectrumFluxAxis& fluxAx
 
 
     gsl_vector_view x = gsl_vector_view_array (x_init, p);
-    gsl_vector_view w = gsl_vector_view_array(weights, n);
+    gsl_vector_view w = gsl_vector_view_array(m_lmfitWeights.data(), n);
     //const gsl_rng_type * type;
     //gsl_rng * r;
     gsl_vector *res_f;
@@ -3264,18 +3675,6 @@ Int32 CLineModelElementList::fitAmplitudesLmfit( const CSpectrumFluxAxis& fluxAx
     f.p = p;
     f.params = &d;
 
-    // This is the data to be fitted
-    Float64 ei;
-    for (i = 0; i < n; i++)
-    {
-        idx = xInds[i];
-        ei = m_ErrorNoContinuum[idx]*normFactor;
-        weights[i] = 1.0 / (ei * ei);
-        y[i] = flux[idx]*normFactor;
-    }
-
-    s = gsl_multifit_fdfsolver_alloc (T, n, p);
-
     /* initialize solver with starting point and weights */
     gsl_multifit_fdfsolver_wset (s, &f, &x.vector, &w.vector);
 
@@ -3435,14 +3834,201 @@ Int32 CLineModelElementList::fitAmplitudesLmfit( const CSpectrumFluxAxis& fluxAx
         outputStatus = 1;
     }
 
-    gsl_multifit_fdfsolver_free (s);
-    gsl_matrix_free (covar);
-    gsl_matrix_free (J);
     //gsl_rng_free (r);
 
     return outputStatus;
 }
 
+/**
+ * \brief Sets the lmfit samples, data, weights and rows for the elements filteredEltsIdx.
+ * The samples are the support of the elements, or the whole grid when the continuum is fitted. With fullGrid, the
+ * lines derivatives are evaluated on all the samples instead of the support of each element.
+ * Returns -1 if there are less samples than elements to fit.
+ **/
+Int32 CLineModelElementList::prepareLmfitData(const CSpectrumFluxAxis& fluxAxis, CLmfitController* controller, const std::vector<UInt32>& filteredEltsIdx,
+                                              Bool fullGrid, std::vector<UInt32>& xInds)
+{
+    UInt32 nddl = filteredEltsIdx.size();
+    if(! controller->isContinuumFitted()){
+        xInds = getSupportIndexes( filteredEltsIdx );
+    }else{
+        xInds=  std::vector<UInt32>(fluxAxis.GetSamplesCount());
+        std::iota(std::begin(xInds), std::end(xInds), 0);
+    }
+
+    size_t n = xInds.size();
+    if(n<nddl){
+        Log.LogError( "LineModel Infos: LMfit not enough smaples on support");
+        return -1;
+    }
+
+    //set the norm factor
+    const Float64* flux = fluxAxis.GetSamples();
+    Float64 maxabsval = DBL_MIN;
+    for (UInt32 i = 0; i < n; i++)
+    {
+        if(maxabsval<std::abs(flux[xInds[i]]))
+        {
+            maxabsval=std::abs(flux[xInds[i]]);
+        }
+    }
+    Float64 normFactor = 1.0/maxabsval;
+    controller->setNormFactor(normFactor);
+    controller->setNormAmpLine(1.0);
+    controller->setNormEmiFactor(1.0);
+    controller->setNormAbsFactor(1.0);
+
+    // This is the data to be fitted
+    m_lmfitY.resize(n);
+    m_lmfitWeights.resize(n);
+    m_lmfitRowBuffer.resize(n);
+    for (UInt32 i = 0; i < n; i++)
+    {
+        Float64 ei = m_ErrorNoContinuum[xInds[i]]*normFactor;
+        m_lmfitWeights[i] = 1.0 / (ei * ei);
+        m_lmfitY[i] = flux[xInds[i]]*normFactor;
+    }
+
+    //rows of the samples on the support of each element: the lines derivatives are null elsewhere
+    if(m_lmfitEltRows.size()<nddl)
+    {
+        m_lmfitEltRows.resize(nddl);
+    }
+    for(Int32 kp=0; kp<nddl; kp++)
+    {
+        if(fullGrid)
+        {
+            m_lmfitEltRows[kp].resize(n);
+            std::iota(m_lmfitEltRows[kp].begin(), m_lmfitEltRows[kp].end(), 0);
+        }else{
+            getSupportRows(std::vector<UInt32>(1, filteredEltsIdx[kp]), xInds, m_lmfitEltRows[kp]);
+        }
+    }
+
+    //with the continuum fitted, the model is refreshed on the support of all the elements only
+    m_lmfitModelEltsIdx.clear();
+    m_lmfitModelRows.clear();
+    if(controller->isContinuumFitted())
+    {
+        for(UInt32 iElts=0; iElts<m_Elements.size(); iElts++)
+        {
+            if(!m_Elements[iElts]->IsOutsideLambdaRange())
+            {
+                m_lmfitModelEltsIdx.push_back(iElts);
+            }
+        }
+        getSupportRows(m_lmfitModelEltsIdx, xInds, m_lmfitModelRows);
+    }
+    return 0;
+}
+
+/**
+ * \brief Evaluates the lmfit residual (model - flux, normalized) and jacobian at the parameters x, as seen by the
+ * solver in fitAmplitudesLmfit.
+ * With fullGrid, the whole model is refreshed and the lines derivatives are evaluated on all the samples: this is the
+ * reference for the evaluation restricted to the supports of the elements.
+ * The jacobian is stored row major, n rows (the samples) by p columns (the parameters).
+ * Returns -1 if x does not hold the controller parameters or if there are not enough samples.
+ **/
+Int32 CLineModelElementList::evaluateLmfit(const CSpectrumFluxAxis& fluxAxis, CLmfitController* controller, const TFloat64List& x, Bool fullGrid,
+                                           TFloat64List& residual, TFloat64List& jacobian)
+{
+    std::vector<UInt32> filteredEltsIdx= controller->getFilteredIdx();
+    size_t p = controller->getNumberParameters();
+    if(filteredEltsIdx.size()<1 || x.size()!=p)
+    {
+        return -1;
+    }
+    std::vector<UInt32> xInds;
+    if(prepareLmfitData(fluxAxis, controller, filteredEltsIdx, fullGrid, xInds)!=0)
+    {
+        return -1;
+    }
+    size_t n = xInds.size();
+
+    struct lmfitdata d = {n, m_lmfitY.data(), this, &xInds, m_observeGridContinuumFlux, controller, &filteredEltsIdx, &m_lmfitEltRows, m_lmfitRowBuffer.data(),
+                          &m_lmfitModelEltsIdx, &m_lmfitModelRows, fullGrid};
+    gsl_vector* gx = gsl_vector_alloc(p);
+    gsl_vector* f = gsl_vector_alloc(n);
+    gsl_matrix* J = gsl_matrix_alloc(n, p);
+    for(UInt32 k=0; k<p; k++)
+    {
+        gsl_vector_set(gx, k, x[k]);
+    }
+    lmfit_f(gx, &d, f);
+    lmfit_df(gx, &d, J);
+
+    residual.resize(n);
+    jacobian.resize(n*p);
+    for(UInt32 i=0; i<n; i++)
+    {
+        residual[i] = gsl_vector_get(f, i);
+        for(UInt32 k=0; k<p; k++)
+        {
+            jacobian[i*p+k] = gsl_matrix_get(J, i, k);
+        }
+    }
+    gsl_matrix_free(J);
+    gsl_vector_free(f);
+    gsl_vector_free(gx);
+    return 0;
+}
+
+/**
+ * \brief Gets the rows of xInds (sorted sample indexes) on the support of the elements EltsIdx, sorted and unique.
+ **/
+void CLineModelElementList::getSupportRows(const std::vector<UInt32>& EltsIdx, const std::vector<UInt32>& xInds, std::vector<UInt32>& rows)
+{
+    rows.clear();
+    for(UInt32 i=0; i<EltsIdx.size(); i++)
+    {
+        TInt32RangeList support = m_Elements[EltsIdx[i]]->getSupport();
+        for(UInt32 is=0; is<support.size(); is++)
+        {
+            std::vector<UInt32>::const_iterator it = std::lower_bound(xInds.begin(), xInds.end(), (UInt32)std::max(0, support[is].GetBegin()));
+            for(; it!=xInds.end() && (Int32)(*it)<=support[is].GetEnd(); it++)
+            {
+                rows.push_back(it-xInds.begin());
+            }
+        }
+    }
+    std::sort(rows.begin(), rows.end());
+    rows.erase(std::unique(rows.begin(), rows.end()), rows.end());
+}
+
+/**
+ * \brief Allocates the lmfit solver and its matrices for n samples and p parameters.
+ * The previous allocation is reused when the problem has the same dimensions.
+ **/
+void CLineModelElementList::prepareLmfitSolver(size_t n, size_t p)
+{
+    if(m_lmfitSolver!=NULL && m_lmfitSolverN==n && m_lmfitSolverP==p)
+    {
+        return;
+    }
+    freeLmfitSolver();
+    m_lmfitSolver = gsl_multifit_fdfsolver_alloc(gsl_multifit_fdfsolver_lmsder, n, p);
+    m_lmfitJ = gsl_matrix_alloc(n, p);
+    m_lmfitCovar = gsl_matrix_alloc(p, p);
+    m_lmfitSolverN = n;
+    m_lmfitSolverP = p;
+}
+
+void CLineModelElementList::freeLmfitSolver()
+{
+    if(m_lmfitSolver!=NULL)
+    {
+        gsl_multifit_fdfsolver_free(m_lmfitSolver);
+        gsl_matrix_free(m_lmfitCovar);
+        gsl_matrix_free(m_lmfitJ);
+    }
+    m_lmfitSolver = NULL;
+    m_lmfitJ = NULL;
+    m_lmfitCovar = NULL;
+    m_lmfitSolverN = 0;
+    m_lmfitSolverP = 0;
+}
+
 /**
  * \brief Returns a sorted set of samples indices present in the supports of the argument.
  * For each EltsIdx entry, if the entry is not outside lambda range, get the support of each subelement.
@@ -3605,6 +4191,39 @@ std::vector<UInt32> CLineModelElementList::getOverlappingElementsBySupport( UInt
     return indexes;
 }
 
+/**
+ * \brief Returns true if the supports of two different elements share at least one sample, whatever the line types.
+ **/
+bool CLineModelElementList::hasOverlappingSupports()
+{
+    std::vector<TInt32RangeList> supports(m_Elements.size());
+    for( UInt32 iElts=0; iElts<m_Elements.size(); iElts++ )
+    {
+        if(!m_Elements[iElts]->IsOutsideLambdaRange())
+        {
+            supports[iElts] = m_Elements[iElts]->getSupport();
+        }
+    }
+    for( UInt32 iElts=0; iElts<m_Elements.size(); iElts++ )
+    {
+        for( UInt32 jElts=iElts+1; jElts<m_Elements.size(); jElts++ )
+        {
+            for( UInt32 iS=0; iS<supports[iElts].size(); iS++ )
+            {
+                for( UInt32 jS=0; jS<supports[jElts].size(); jS++ )
+                {
+                    if( std::max(supports[iElts][iS].GetBegin(), supports[jElts][jS].GetBegin()) <=
+                        std::min(supports[iElts][iS].GetEnd(), supports[jElts][jS].GetEnd()) )
+                    {
+                        return true;
+                    }
+                }
+            }
+        }
+    }
+    return false;
+}
+
 /**
  * \brief Returns a sorted, de-duplicated list of indices of lines whose support overlap ind's support and are not listed in the argument excludedInd.
  **/
@@ -4410,6 +5029,7 @@ Int32 CLineModelElementList::setLyaProfile(Float64 redshift, const CSpectrumSpec
 */
 std::vector<UInt32> CLineModelElementList::ReestimateContinuumUnderLines(std::vector<UInt32> EltsIdx)
 {
+    invalidateModelCache();
     if(EltsIdx.size()<1){
         std::vector<UInt32> empty;
         return empty;
@@ -4533,6 +5153,7 @@ std::vector<UInt32> CLineModelElementList::ReestimateContinuumUnderLines(std::ve
  **/
 std::vector<UInt32> CLineModelElementList::ReestimateContinuumApprox(std::vector<UInt32> EltsIdx)
 {
+    invalidateModelCache();
     //smoothing factor in continuum median filter
     Float64 smoof = 150;
 
@@ -4605,6 +5226,7 @@ std::vector<UInt32> CLineModelElementList::ReestimateContinuumApprox(std::vector
  **/
 void CLineModelElementList::refreshModelAfterContReestimation(std::vector<UInt32> xInds, CSpectrumFluxAxis& modelFluxAxis, CSpectrumFluxAxis& spcFluxAxisNoContinuum)
 {
+    invalidateModelCache();
     Int32 n = xInds.size();
 
     Int32 idx = 0;
@@ -4615,6 +5237,7 @@ void CLineModelElementList::refreshModelAfterContReestimation(std::vector<UInt32
         modelFluxAxis[idx] = m_ContinuumFluxAxis[idx];
         spcFluxAxisNoContinuum[idx] = m_SpcFluxAxis[idx]-m_ContinuumFluxAxis[idx];
     }
+    spcFluxAxisNoContinuum.ResetWeightedFlux();
 }
 
 /**
@@ -4634,11 +5257,21 @@ Float64 CLineModelElementList::getLeastSquareMerit(const TFloat64Range& lambdaRa
 
     Int32 imin = spcSpectralAxis.GetIndexAtWaveLength(lambdaRange.GetBegin());
     Int32 imax = spcSpectralAxis.GetIndexAtWaveLength(lambdaRange.GetEnd());
+
+    //the cached terms are kept in sync with the model by the incremental refreshModel
+    if(m_meritCacheValid && m_meritCacheImin==imin && m_meritCacheImax==imax && !std::isnan(m_meritCacheSum))
+    {
+        return m_meritCacheSum;
+    }
+
+    const Float64* invErr2 = m_spcFluxAxisNoContinuum.GetInverseVariance();
+    m_meritCacheTerms.resize(imax>imin ? imax-imin : 0);
     for(Int32 j=imin; j<imax; j++)
     {
         //numDevs++;
         diff = (Yspc[j] - Ymodel[j]);
-        fit += (diff*diff) / (m_ErrorNoContinuum[j]*m_ErrorNoContinuum[j]);
+        m_meritCacheTerms[j-imin] = (diff*diff) * invErr2[j];
+        fit += m_meritCacheTerms[j-imin];
         //        if ( 1E6 * diff < m_ErrorNoContinuum[j] )
         //        {
         //            Log.LogDebug( "Warning: noise is at least 6 orders greater than the residue!" );
@@ -4646,6 +5279,11 @@ Float64 CLineModelElementList::getLeastSquareMerit(const TFloat64Range& lambdaRa
         //            Log.LogDebug( "CLineModelElementList::getLeastSquareMerit m_ErrorNoContinuum[%d] = %f", j, m_ErrorNoContinuum[j] );
         //        }
     }
+    m_meritCacheValid = m_modelCacheValid && imax>imin;
+    m_meritCacheImin = imin;
+    m_meritCacheImax = imax;
+    m_meritCacheUpdates = 0;
+    m_meritCacheSum = fit;
     Log.LogDebug( "CLineModelElementList::getLeastSquareMerit fit = %f", fit );
     if(std::isnan(fit))
     {
@@ -4691,13 +5329,15 @@ Float64 CLineModelElementList::getLeastSquareContinuumMerit(const TFloat64Range&
     const Float64* Yspc = spcFluxAxis.GetSamples();
     Float64 diff = 0.0;
 
+    const Float64* invErr2 = m_spcFluxAxisNoContinuum.GetInverseVariance();
+
     Float64 imin = spcSpectralAxis.GetIndexAtWaveLength(lambdaRange.GetBegin());
     Float64 imax = spcSpectralAxis.GetIndexAtWaveLength(lambdaRange.GetEnd());
     for( UInt32 j=imin; j<imax; j++ )
     {
         numDevs++;
         diff = (Yspc[j] - YCont[j]);
-        fit += (diff*diff) / (m_ErrorNoContinuum[j]*m_ErrorNoContinuum[j]);
+        fit += (diff*diff) * invErr2[j];
     }
     return fit;
 }
@@ -4847,13 +5487,14 @@ Float64 CLineModelElementList::getLeastSquareMeritUnderElements()
     }
 
 
+    const Float64* invErr2 = m_spcFluxAxisNoContinuum.GetInverseVariance();
     for( UInt32 iS=0; iS<support.size(); iS++ )
     {
         for( UInt32 j=support[iS].GetBegin(); j<support[iS].GetEnd(); j++ )
         {
             numDevs++;
             diff = (Yspc[j] - Ymodel[j]);
-            fit += (diff*diff) / (m_ErrorNoContinuum[j]*m_ErrorNoContinuum[j]);
+            fit += (diff*diff) * invErr2[j];
         }
     }
     return fit;
@@ -4897,13 +5538,14 @@ Float64 CLineModelElementList::getModelErrorUnderElement( UInt32 eltId )
 
 
     Float64 w=0.0;
+    const Float64* invErr2 = m_spcFluxAxisNoContinuum.GetInverseVariance();
     for( UInt32 iS=0; iS<support.size(); iS++ )
     {
         for( UInt32 j=support[iS].GetBegin(); j<support[iS].GetEnd(); j++ )
         {
             numDevs++;
             diff = (Yspc[j] - Ymodel[j]);
-            w = 1.0 / (m_ErrorNoContinuum[j]*m_ErrorNoContinuum[j]);
+            w = invErr2[j];
             fit += (diff*diff) * w;
             sumErr += w;
         }
@@ -6018,6 +6660,7 @@ Int32 CLineModelElementList::ApplyVelocityBound(Float64 inf, Float64 sup)
  **/
 void CLineModelElementList::EstimateSpectrumContinuum( Float64 opt_enhance_lines, const TFloat64Range& lambdaRange )
 {
+    invalidateModelCache();
     std::vector<UInt32> validEltsIdx = GetModelValidElementsIndexes();
     //std::vector<UInt32> xInds = getSupportIndexes( validEltsIdx );
     const CSpectrumSpectralAxis& spectralAxis = m_SpectrumModel->GetSpectralAxis();
@@ -6203,25 +6846,16 @@ Float64 CLineModelElementList::EstimateDTransposeD(const TFloat64Range& lambdaRa
     const CSpectrumFluxAxis& spcFluxAxis = m_SpcFluxAxis;
     const CSpectrumFluxAxis& spcFluxAxisNoContinuum = m_spcFluxAxisNoContinuum;
 
-    Int32 numDevs = 0;
+    //both flux axis carry the same error as m_ErrorNoContinuum: use their cumulated flux^2/err^2
+    Int32 imin = spcSpectralAxis.GetIndexAtWaveLength(lambdaRange.GetBegin());
+    Int32 imax = spcSpectralAxis.GetIndexAtWaveLength(lambdaRange.GetEnd());
     Float64 dtd = 0.0;
-    const Float64* Yspc = spcFluxAxis.GetSamples();
-    const Float64* YspcNoContinuum = spcFluxAxisNoContinuum.GetSamples();
-    Float64 flux = 0.0;
-
-    Float64 imin = spcSpectralAxis.GetIndexAtWaveLength(lambdaRange.GetBegin());
-    Float64 imax = spcSpectralAxis.GetIndexAtWaveLength(lambdaRange.GetEnd());
-    for( UInt32 j=imin; j<imax; j++ )
+    if(spcComponent=="nocontinuum")
     {
-        numDevs++;
-        if(spcComponent=="nocontinuum")
-        {
-            flux = YspcNoContinuum[j];
-        }else
-        {
-            flux = Yspc[j];
-        }
-        dtd += (flux*flux) / (m_ErrorNoContinuum[j]*m_ErrorNoContinuum[j]);
+        dtd = spcFluxAxisNoContinuum.GetSquaredWeightedFluxSum(imin, imax);
+    }else
+    {
+        dtd = spcFluxAxis.GetSquaredWeightedFluxSum(imin, imax);
     }
     Log.LogDebug( "CLineModelElementList::EstimateDTransposeD val = %f", dtd );
 
@@ -6239,6 +6873,7 @@ Float64 CLineModelElementList::EstimateMTransposeM(const TFloat64Range& lambdaRa
     Int32 numDevs = 0;
     Float64 mtm = 0.0;
     const Float64* Yspc = spcFluxAxis.GetSamples();
+    const Float64* invErr2 = m_spcFluxAxisNoContinuum.GetInverseVariance();
     Float64 diff = 0.0;
 
     Float64 imin = spcSpectralAxis.GetIndexAtWaveLength(lambdaRange.GetBegin());
@@ -6249,7 +6884,7 @@ Float64 CLineModelElementList::EstimateMTransposeM(const TFloat64Range& lambdaRa
         {
             diff = Yspc[j];
         }
-        mtm += (diff*diff) / (m_ErrorNoContinuum[j]*m_ErrorNoContinuum[j]);
+        mtm += (diff*diff) * invErr2[j];
     }
     //Log.LogDebug( "CLineModelElementList::EstimateMTransposeM val = %f", mtm );
 
@@ -6270,6 +6905,7 @@ Int32 CLineModelElementList::getMTransposeMCumulative(const TFloat64Range& lambd
     Int32 numDevs = 0;
     Float64 mtm = 0.0;
     const Float64* Yspc = spcFluxAxis.GetSamples();
+    const Float64* invErr2 = m_spcFluxAxisNoContinuum.GetInverseVariance();
     Float64 diff = 0.0;
 
     Float64 imin = spcSpectralAxis.GetIndexAtWaveLength(lambdaRange.GetBegin());
@@ -6280,7 +6916,7 @@ Int32 CLineModelElementList::getMTransposeMCumulative(const TFloat64Range& lambd
         {
             diff = Yspc[j];
         }
-        mtm += (diff*diff) / (m_ErrorNoContinuum[j]*m_ErrorNoContinuum[j]);
+        mtm += (diff*diff) * invErr2[j];
         lbda.push_back(spcSpectralAxis[j]);
         mtmCumul.push_back(mtm);
     }
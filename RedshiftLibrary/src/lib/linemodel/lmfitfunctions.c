@@ -16,9 +16,15 @@ struct lmfitdata {
     size_t n;
     Float64 * y;
     CLineModelElementList* linemodel;
-    std::vector<UInt32> linemodel_samples_indexes;
+    const std::vector<UInt32>* linemodel_samples_indexes;
     const Float64* observeGridContinuumFlux;
     CLmfitController* controller;
+    const std::vector<UInt32>* elts_indexes;
+    const std::vector<std::vector<UInt32>>* elts_rows; //for each element, the rows of the samples on its support
+    Float64* rowBuffer; //n values, jacobian assembly buffer
+    const std::vector<UInt32>* model_elts_indexes; //with the continuum fitted, the elements adding to the model
+    const std::vector<UInt32>* model_rows; //and the rows of the samples on their support
+    bool fullGrid; //refresh the whole model and evaluate the lines derivatives on all the rows, reference evaluation
 };
 
 int
@@ -30,8 +36,8 @@ lmfit_f (const gsl_vector * x, void *data,
     //std::shared_ptr<CLineModelElementList> linemodel = ((struct lmfitdata *)data)->linemodel;
     CLineModelElementList* linemodel = ((struct lmfitdata *)data)->linemodel;
     CLmfitController* controller = ((struct lmfitdata *)data)->controller;
-    std::vector<UInt32> elts_indexes = controller->getFilteredIdx();
-    std::vector<UInt32> samples_indexes = ((struct lmfitdata *)data)->linemodel_samples_indexes;
+    const std::vector<UInt32>& elts_indexes = *((struct lmfitdata *)data)->elts_indexes;
+    const std::vector<UInt32>& samples_indexes = *((struct lmfitdata *)data)->linemodel_samples_indexes;
     Float64 normFactor = controller->getNormFactor();
     //const Float64* observeGridContinuumFlux = ((struct lmfitdata *)data)->observeGridContinuumFlux;
 
@@ -68,14 +74,35 @@ lmfit_f (const gsl_vector * x, void *data,
       linemodel->SetVelocityAbsorption(velocity);
     }
 
-    //
-    if(controller->isContinuumFitted()){
+    if(((struct lmfitdata *)data)->fullGrid){
       linemodel->refreshModelInitAllGrid();
-    }else{
-      linemodel->refreshModelUnderElements(elts_indexes);
+      for (UInt32 i = 0; i < n; i++)
+      {
+          Float64 Yi = linemodel->getModelFluxVal(samples_indexes[i])*normFactor;
+          gsl_vector_set (f, i, Yi - y[i]);
+      }
+      return GSL_SUCCESS;
     }
 
+    if(controller->isContinuumFitted()){
+      //the model is only refreshed on the support of the elements, it is the continuum elsewhere
+      const std::vector<UInt32>& model_rows = *((struct lmfitdata *)data)->model_rows;
+      linemodel->refreshModelUnderElements(*((struct lmfitdata *)data)->model_elts_indexes);
+      for (UInt32 i = 0; i < n; i++)
+      {
+          Float64 Yi = linemodel->getContinuumFluxVal(samples_indexes[i])*normFactor;
+          gsl_vector_set (f, i, Yi - y[i]);
+      }
+      for (UInt32 r = 0; r < model_rows.size(); r++)
+      {
+          UInt32 i = model_rows[r];
+          Float64 Yi = linemodel->getModelFluxVal(samples_indexes[i])*normFactor;
+          gsl_vector_set (f, i, Yi - y[i]);
+      }
+      return GSL_SUCCESS;
+    }
 
+    linemodel->refreshModelUnderElements(elts_indexes);
     for (UInt32 i = 0; i < n; i++)
     {
 
@@ -96,8 +123,10 @@ lmfit_df (const gsl_vector * x, void *data,
     //std::shared_ptr<CLineModelElementList> linemodel = ((struct lmfitdata *)data)->linemodel;
     CLineModelElementList* linemodel = ((struct lmfitdata *)data)->linemodel;
     CLmfitController* controller = ((struct lmfitdata *)data)->controller;
-    std::vector<UInt32> elts_indexes = controller->getFilteredIdx();
-    std::vector<UInt32> samples_indexes = ((struct lmfitdata *)data)->linemodel_samples_indexes;
+    const std::vector<UInt32>& elts_indexes = *((struct lmfitdata *)data)->elts_indexes;
+    const std::vector<std::vector<UInt32>>& elts_rows = *((struct lmfitdata *)data)->elts_rows;
+    const std::vector<UInt32>& samples_indexes = *((struct lmfitdata *)data)->linemodel_samples_indexes;
+    Float64* rowBuffer = ((struct lmfitdata *)data)->rowBuffer;
     Float64 normFactor = controller->getNormFactor();
     const Float64* observeGridContinuumFlux = ((struct lmfitdata *)data)->observeGridContinuumFlux;
 
@@ -145,15 +174,22 @@ lmfit_df (const gsl_vector * x, void *data,
     }
     //linemodel->refreshModel();
     Float64 normAmpLine = controller->getNormAmpLine();
-    for (UInt32 i = 0; i < n; i++)
-    {
 
-        for (UInt32 iElt = 0; iElt < elts_indexes.size(); iElt++)
+    //the lines derivatives are only evaluated on the support of each element, where the model is refreshed
+    gsl_matrix_set_zero(J);
+    for (UInt32 iElt = 0; iElt < elts_indexes.size(); iElt++)
+    {
+        const std::vector<UInt32>& rows = elts_rows[iElt];
+        for (UInt32 r = 0; r < rows.size(); r++)
         {
+            UInt32 i = rows[r];
             Float64 dval = linemodel->getModelFluxDerivEltVal(elts_indexes[iElt], samples_indexes[i])*normFactor/normAmpLine*2*gsl_vector_get (x, iElt);
             gsl_matrix_set (J, i, iElt, dval);
         }
+    }
 
+    for (UInt32 i = 0; i < n; i++)
+    {
         if(controller->isEmissionVelocityFitted()){
           Float64 normEmiFactor = controller->getNormEmiFactor();
           Float64 dval = linemodel->getModelFluxDerivVelEmissionVal(samples_indexes[i])*normFactor/normEmiFactor*2*gsl_vector_get (x, controller->getIndEmissionVel());
@@ -167,37 +203,53 @@ lmfit_df (const gsl_vector * x, void *data,
           //Log.LogInfo("Deriv sigma Abs for i %d = %f",i, dval);
           gsl_matrix_set (J, i, controller->getIndAbsorptionVel(), dval);
         }
+    }
 
-        if(controller->isContinuumFitted()){
-          Float64 dval =  observeGridContinuumFlux[samples_indexes[i]];
-          for (UInt32 iElt = 0; iElt < elts_indexes.size(); iElt++)
+    if(controller->isContinuumFitted()){
+      for (UInt32 i = 0; i < n; i++)
+      {
+          rowBuffer[i] = observeGridContinuumFlux[samples_indexes[i]];
+      }
+      for (UInt32 iElt = 0; iElt < elts_indexes.size(); iElt++)
+      {
+          const std::vector<UInt32>& rows = elts_rows[iElt];
+          for (UInt32 r = 0; r < rows.size(); r++)
           {
-              dval += linemodel->getModelFluxDerivContinuumAmpEltVal(elts_indexes[iElt], samples_indexes[i]);
+              rowBuffer[rows[r]] += linemodel->getModelFluxDerivContinuumAmpEltVal(elts_indexes[iElt], samples_indexes[rows[r]]);
           }
-          dval = dval *normFactor * 2 * gsl_vector_get (x,controller->getIndContinuumAmp());
+      }
+      for (UInt32 i = 0; i < n; i++)
+      {
+          Float64 dval = rowBuffer[i] *normFactor * 2 * gsl_vector_get (x,controller->getIndContinuumAmp());
           gsl_matrix_set (J, i, controller->getIndContinuumAmp(),dval);
-        }
+      }
+    }
 
-        if(controller->isRedshiftFitted()){
-          if(!controller->isNoContinuum()){
-              Float64 dvalContinuum = linemodel->getModelFluxDerivZContinuumVal(samples_indexes[i] );
-              Float64 dval = dvalContinuum;
-              for (UInt32 iElt = 0; iElt < elts_indexes.size(); iElt++)
-              {
-                 dval += linemodel-> getModelFluxDerivZEltVal(elts_indexes[iElt], samples_indexes[i], dvalContinuum);
-              }
-              dval = dval * normFactor;
-              gsl_matrix_set (J, i, controller->getIndRedshift(),dval);
-           }else{
-              Float64 dval = 0.;
-              for (UInt32 iElt = 0; iElt < elts_indexes.size(); iElt++)
-              {
-                 dval += linemodel-> getModelFluxDerivZEltValNoContinuum(elts_indexes[iElt], samples_indexes[i]);
+    if(controller->isRedshiftFitted()){
+      bool noContinuum = controller->isNoContinuum();
+      for (UInt32 i = 0; i < n; i++)
+      {
+          rowBuffer[i] = noContinuum ? 0. : linemodel->getModelFluxDerivZContinuumVal(samples_indexes[i]);
+      }
+      for (UInt32 iElt = 0; iElt < elts_indexes.size(); iElt++)
+      {
+          const std::vector<UInt32>& rows = elts_rows[iElt];
+          for (UInt32 r = 0; r < rows.size(); r++)
+          {
+              UInt32 i = rows[r];
+              if(!noContinuum){
+                  Float64 dvalContinuum = linemodel->getModelFluxDerivZContinuumVal(samples_indexes[i]);
+                  rowBuffer[i] += linemodel-> getModelFluxDerivZEltVal(elts_indexes[iElt], samples_indexes[i], dvalContinuum);
+              }else{
+                  rowBuffer[i] += linemodel-> getModelFluxDerivZEltValNoContinuum(elts_indexes[iElt], samples_indexes[i]);
               }
-              dval = dval * normFactor;
-              gsl_matrix_set (J, i, controller->getIndRedshift(),dval);
           }
-        }
+      }
+      for (UInt32 i = 0; i < n; i++)
+      {
+          Float64 dval = rowBuffer[i] * normFactor;
+          gsl_matrix_set (J, i, controller->getIndRedshift(),dval);
+      }
     }
     /*
     // export for debug
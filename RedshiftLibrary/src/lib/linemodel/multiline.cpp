@@ -188,11 +188,113 @@ TInt32Range CMultiLine::EstimateIndexRange(Int32 subeIdx, const CSpectrumSpectra
  * Sets the global outside lambda range.
  * Inits the fitted amplitude values.
  **/
+/**
+ * \brief Prepares the supports of the rays for the redshift, reusing the supports memoized at a previous call with the same inputs if the support cache is enabled.
+ **/
 void CMultiLine::prepareSupport(const CSpectrumSpectralAxis& spectralAxis, Float64 redshift, const TFloat64Range &lambdaRange)
+{
+    bool cached = false;
+    if(m_supportCacheSize>0)
+    {
+        getSupportCacheKey(spectralAxis, redshift, lambdaRange, m_supportCacheKey);
+        TSupportCache::const_iterator it = m_supportCache.find(m_supportCacheKey);
+        if(it != m_supportCache.end())
+        {
+            const SSupportState& state = it->second;
+            m_OutsideLambdaRange = state.OutsideLambdaRange;
+            m_OutsideLambdaRangeList = state.OutsideLambdaRangeList;
+            m_StartNoOverlap = state.StartNoOverlap;
+            m_EndNoOverlap = state.EndNoOverlap;
+            m_StartTheoretical = state.StartTheoretical;
+            m_EndTheoretical = state.EndTheoretical;
+            m_RayIsActiveOnSupport = state.RayIsActiveOnSupport;
+            cached = true;
+        }
+    }
+
+    if(!cached)
+    {
+        computeSupport(spectralAxis, redshift, lambdaRange);
+        if(m_supportCacheSize>0)
+        {
+            if(m_supportCache.size()>=m_supportCacheSize)
+            {
+                m_supportCache.clear();
+            }
+            SSupportState& state = m_supportCache[m_supportCacheKey];
+            state.OutsideLambdaRange = m_OutsideLambdaRange;
+            state.OutsideLambdaRangeList = m_OutsideLambdaRangeList;
+            state.StartNoOverlap = m_StartNoOverlap;
+            state.EndNoOverlap = m_EndNoOverlap;
+            state.StartTheoretical = m_StartTheoretical;
+            state.EndTheoretical = m_EndTheoretical;
+            state.RayIsActiveOnSupport = m_RayIsActiveOnSupport;
+        }
+    }
+
+    //init the fitted amplitude values
+    for(Int32 k=0; k<m_Rays.size(); k++){
+        if(m_OutsideLambdaRangeList[k]){
+            m_FittedAmplitudes[k] = -1.0;
+        }
+    }
+}
+
+/**
+ * \brief Enables the memoization of the supports computed by prepareSupport, keeping at most maxSize supports. 0 disables it.
+ **/
+void CMultiLine::SetSupportCacheSize(Int32 maxSize)
+{
+    m_supportCacheSize = std::max(maxSize, 0);
+    m_supportCache.clear();
+}
+
+/**
+ * \brief Key of the support cache: the redshift, the lambda range, the spectral axis and the members changing the line positions or widths after construction.
+ **/
+void CMultiLine::getSupportCacheKey(const CSpectrumSpectralAxis& spectralAxis, Float64 redshift, const TFloat64Range &lambdaRange, TFloat64List& key)
+{
+    getLineProfilesKey(redshift, key);
+    key.push_back(lambdaRange.GetBegin());
+    key.push_back(lambdaRange.GetEnd());
+    key.push_back(spectralAxis.GetSamplesCount());
+    if(spectralAxis.GetSamplesCount()>0)
+    {
+        key.push_back(spectralAxis[0]);
+        key.push_back(spectralAxis[spectralAxis.GetSamplesCount()-1]);
+    }
+}
+
+/**
+ * \brief Key of the line profiles: the redshift and the members changing the line positions or widths after construction.
+ **/
+void CMultiLine::getLineProfilesKey(Float64 redshift, TFloat64List& key)
+{
+    key.clear();
+    key.push_back(redshift);
+    key.push_back(m_VelocityEmission);
+    key.push_back(m_VelocityAbsorption);
+    key.push_back(m_SourceSizeDispersion);
+    key.push_back(m_asymfit_sigma_coeff);
+    key.push_back(m_asymfit_alpha);
+    key.push_back(m_asymfit_delta);
+    for(Int32 k=0; k<m_Rays.size(); k++)
+    {
+        key.push_back(m_Rays[k].GetOffset());
+    }
+}
+
+/**
+ * \brief Computes the theoretical and the non-overlapping supports of the rays, and the rays active on each support.
+ **/
+void CMultiLine::computeSupport(const CSpectrumSpectralAxis& spectralAxis, Float64 redshift, const TFloat64Range &lambdaRange)
 {
     Int32 nRays = m_Rays.size();
     m_OutsideLambdaRange=true;
     m_RayIsActiveOnSupport.resize( nRays , std::vector<Int32>( nRays , 0.0 ) );
+    for(Int32 i=0; i<nRays; i++){
+        std::fill(m_RayIsActiveOnSupport[i].begin(), m_RayIsActiveOnSupport[i].end(), 0);
+    }
     m_StartNoOverlap.resize(nRays);
     m_EndNoOverlap.resize(nRays);
     m_StartTheoretical.resize(nRays);
@@ -346,14 +448,6 @@ void CMultiLine::prepareSupport(const CSpectrumSpectralAxis& spectralAxis, Float
             }
         }
     }
-
-
-    //init the fitted amplitude values
-    for(Int32 k=0; k<nRays; k++){
-        if(m_OutsideLambdaRangeList[k]){
-            m_FittedAmplitudes[k] = -1.0;
-        }
-    }
 }
 
 /**
@@ -729,6 +823,7 @@ void CMultiLine::fitAmplitude(const CSpectrumSpectralAxis& spectralAxis, const C
     const Float64* fluxNoContinuum = noContinuumfluxAxis.GetSamples();
     const Float64* spectral = spectralAxis.GetSamples();
     const TFloat64List& error = noContinuumfluxAxis.GetError();
+    const Float64* invErr2 = noContinuumfluxAxis.GetInverseVariance();
 
     if(m_verbose)
     {
@@ -802,7 +897,7 @@ void CMultiLine::fitAmplitude(const CSpectrumSpectralAxis& spectralAxis, const C
                 }
             }
             num++;
-            err2 = 1.0 / (error[i] * error[i]);
+            err2 = invErr2[i];
             m_dtmFree += yg*y*err2;
             m_sumGauss += yg*yg*err2;
         }
@@ -822,6 +917,16 @@ void CMultiLine::fitAmplitude(const CSpectrumSpectralAxis& spectralAxis, const C
         return;
       }
 
+    setFittedAmplitudesFromSums();
+    return;
+}
+
+/**
+ * \brief Sets the element amplitude and the rays fitted amplitudes from m_dtmFree and m_sumGauss.
+ **/
+void CMultiLine::setFittedAmplitudesFromSums()
+{
+    Int32 nRays = m_Rays.size();
     m_sumCross = std::max(0.0, m_dtmFree);
     Float64 A = m_sumCross / m_sumGauss;
     m_fitAmplitude = A; //todo: warning m_fitAmplitude should be updated when modifying sub-elements amplitudes: ex. rules.
@@ -854,6 +959,185 @@ void CMultiLine::fitAmplitude(const CSpectrumSpectralAxis& spectralAxis, const C
     return;
 }
 
+/**
+ * \brief Computes the cross products, on the current supports, of the unit profiles of the rays with the flux without continuum (dtm per ray) and with each other (mtm per pair of rays).
+ * The unit profiles only depend on the redshift and the line widths, not on the nominal amplitudes: fitAmplitudeFromBasis can then fit the element for any set of nominal amplitudes (ex. tpl-ratios) without synthesizing the profiles again.
+ **/
+void CMultiLine::prepareAmplitudeFitBasis(const CSpectrumSpectralAxis& spectralAxis, const CSpectrumFluxAxis& noContinuumfluxAxis, const CSpectrumFluxAxis &continuumfluxAxis, Float64 redshift)
+{
+    Int32 nRays = m_Rays.size();
+    getLineProfilesKey(redshift, m_basisKey);
+    m_basisDtm.assign(nRays, 0.0);
+    m_basisMtm.assign(nRays*nRays, 0.0);
+    m_basisProfiles.resize(nRays);
+    m_basisNum = 0;
+
+    if(m_OutsideLambdaRange)
+    {
+        return;
+    }
+    const Float64* fluxNoContinuum = noContinuumfluxAxis.GetSamples();
+    const Float64* spectral = spectralAxis.GetSamples();
+    const Float64* invErr2 = noContinuumfluxAxis.GetInverseVariance();
+    const Float64* fluxContinuum = continuumfluxAxis.GetSamples();
+
+    for(Int32 k2=0; k2<nRays; k2++)
+    {
+        mBuffer_mu[k2] = GetObservedPosition(k2, redshift);
+        mBuffer_c[k2] = GetLineWidth(mBuffer_mu[k2], redshift, m_Rays[k2].GetIsEmission(), m_profile[k2]);
+    }
+
+    for(Int32 k=0; k<nRays; k++)
+    { //loop for the intervals
+        if(m_OutsideLambdaRangeList[k])
+        {
+            continue;
+        }
+
+        for ( Int32 i = m_StartNoOverlap[k]; i <= m_EndNoOverlap[k]; i++)
+        {
+            Float64 c = fluxContinuum[i];
+            Float64 y = fluxNoContinuum[i];
+            Float64 x = spectral[i];
+            Float64 err2 = invErr2[i];
+
+            for(Int32 k2=0; k2<nRays; k2++)
+            { //unit profiles on this interval
+                m_basisProfiles[k2] = 0.0;
+                if(m_OutsideLambdaRangeList[k2] || m_RayIsActiveOnSupport[k2][k]==0)
+                {
+                    continue;
+                }
+                if(m_SignFactors[k2]==-1){
+                    m_basisProfiles[k2] = m_SignFactors[k2] * c * GetLineProfile(m_profile[k2], x, mBuffer_mu[k2], mBuffer_c[k2]);
+                }else{
+                    m_basisProfiles[k2] = m_SignFactors[k2] * GetLineProfile(m_profile[k2], x, mBuffer_mu[k2], mBuffer_c[k2]);
+                }
+            }
+            m_basisNum++;
+
+            for(Int32 k2=0; k2<nRays; k2++)
+            {
+                Float64 g2 = m_basisProfiles[k2]*err2;
+                if(g2==0.0)
+                {
+                    continue;
+                }
+                m_basisDtm[k2] += g2*y;
+                for(Int32 k3=0; k3<=k2; k3++)
+                {
+                    m_basisMtm[k2*nRays+k3] += g2*m_basisProfiles[k3];
+                }
+            }
+        }
+    }
+
+    for(Int32 k2=0; k2<nRays; k2++)
+    {
+        for(Int32 k3=0; k3<k2; k3++)
+        {
+            m_basisMtm[k3*nRays+k2] = m_basisMtm[k2*nRays+k3];
+        }
+    }
+}
+
+/**
+ * \brief Same fit as fitAmplitude (lineIdx=-1) with the current nominal amplitudes, using the cross products computed by prepareAmplitudeFitBasis.
+ * The flux axes must not have changed since prepareAmplitudeFitBasis was called.
+ * Returns false, without fitting, if the redshift or the line profiles differ from the ones of the basis.
+ **/
+bool CMultiLine::fitAmplitudeFromBasis(Float64 redshift)
+{
+    getLineProfilesKey(redshift, m_basisKeyBuffer);
+    if(m_basisKeyBuffer != m_basisKey)
+    {
+        return false;
+    }
+
+    Int32 nRays = m_Rays.size();
+    m_sumCross = 0.0;
+    m_sumGauss = 0.0;
+    m_dtmFree = 0.0;
+    for(Int32 k=0; k<nRays; k++)
+    {
+        m_FittedAmplitudes[k] = -1.0;
+        m_FittedAmplitudeErrorSigmas[k] = -1.0;
+    }
+    if(m_OutsideLambdaRange)
+    {
+        return true;
+    }
+
+    for(Int32 k2=0; k2<nRays; k2++)
+    {
+        Float64 a2 = m_NominalAmplitudes[k2];
+        m_dtmFree += a2*m_basisDtm[k2];
+        for(Int32 k3=0; k3<nRays; k3++)
+        {
+            m_sumGauss += a2*m_NominalAmplitudes[k3]*m_basisMtm[k2*nRays+k3];
+        }
+    }
+
+    if ( m_basisNum==0 || m_sumGauss==0 )
+    {
+        return true;
+    }
+    setFittedAmplitudesFromSums();
+    return true;
+}
+
+/**
+ * \brief Returns the largest chi2 decrease this element can bring on the basis prepared by prepareAmplitudeFitBasis, whatever the amplitudes of its rays.
+ * This is the squared norm of the projection of the data on the span of the unit profiles, dtm' mtm^-1 dtm, computed with a Cholesky factorization
+ * of the cross products matrix. The rays whose profile depends on the previous ones are skipped, which leaves the projection unchanged.
+ **/
+Float64 CMultiLine::GetBasisMaxChi2Reduction()
+{
+    Int32 nRays = m_Rays.size();
+    if(m_OutsideLambdaRange || m_basisNum==0 || m_basisDtm.size()!=nRays)
+    {
+        return 0.0;
+    }
+
+    m_basisCholesky.assign(nRays*nRays, 0.0);
+    m_basisProjection.assign(nRays, 0.0);
+    Float64 reduction = 0.0;
+    for(Int32 j=0; j<nRays; j++)
+    {
+        Float64 diag = m_basisMtm[j*nRays+j];
+        Float64 s = diag;
+        for(Int32 k=0; k<j; k++)
+        {
+            s -= m_basisCholesky[j*nRays+k]*m_basisCholesky[j*nRays+k];
+        }
+        if(diag<=0.0 || s<=1e-12*diag)
+        {
+            continue;
+        }
+        Float64 ljj = sqrt(s);
+        m_basisCholesky[j*nRays+j] = ljj;
+        for(Int32 i=j+1; i<nRays; i++)
+        {
+            Float64 v = m_basisMtm[i*nRays+j];
+            for(Int32 k=0; k<j; k++)
+            {
+                v -= m_basisCholesky[i*nRays+k]*m_basisCholesky[j*nRays+k];
+            }
+            m_basisCholesky[i*nRays+j] = v/ljj;
+        }
+
+        Float64 z = m_basisDtm[j];
+        for(Int32 k=0; k<j; k++)
+        {
+            z -= m_basisCholesky[j*nRays+k]*m_basisProjection[k];
+        }
+        z /= ljj;
+        m_basisProjection[j] = z;
+        reduction += z*z;
+    }
+    return reduction;
+}
+
 /**
  * \brief Adds to the model's flux, at each ray not outside lambda range, the value contained in the corresponding lambda for each catalog line.
  **/
@@ -1117,6 +1401,40 @@ void CMultiLine::initSpectrumModel( CSpectrumFluxAxis &modelfluxAxis, CSpectrumF
     return;
 }
 
+/**
+ * \brief Fills key with every parameter addToSpectrumModel depends on, apart from the continuum.
+ * Two identical keys mean the element adds the same profile to the model.
+ **/
+void CMultiLine::GetModelStateKey(Float64 redshift, TFloat64List& key)
+{
+    key.clear();
+    key.push_back(redshift);
+    key.push_back(m_OutsideLambdaRange);
+    key.push_back(m_SourceSizeDispersion);
+    key.push_back(m_asymfit_sigma_coeff);
+    key.push_back(m_asymfit_alpha);
+    key.push_back(m_asymfit_delta);
+    if(m_OutsideLambdaRange)
+    {
+        return;
+    }
+    for(Int32 k=0; k<m_Rays.size(); k++)
+    {
+        key.push_back(m_OutsideLambdaRangeList[k]);
+        if(m_OutsideLambdaRangeList[k])
+        {
+            continue;
+        }
+        key.push_back(m_StartNoOverlap[k]);
+        key.push_back(m_EndNoOverlap[k]);
+        key.push_back(m_FittedAmplitudes[k]);
+        key.push_back(m_SignFactors[k]);
+        key.push_back(m_profile[k]);
+        key.push_back(GetObservedPosition(k, redshift));
+        key.push_back(GetWidth(k, redshift));
+    }
+}
+
 /**
  * \brief Returns the index corresponding to the first ray whose GetName method returns LineTagStr.
  **/
@@ -2,17 +2,26 @@
 #include <RedshiftLibrary/linemodel/elementlist.h>
 
 #include <float.h>
+#include <math.h>
+#include <algorithm>
 
 using namespace NSEpic;
 
 
-CTemplatesFitStore::CTemplatesFitStore(Float64 minRedshift, Float64 maxRedshift, Float64 stepRedshift, std::string opt_sampling)
+CTemplatesFitStore::CTemplatesFitStore(Float64 minRedshift, Float64 maxRedshift, Float64 stepRedshift, std::string opt_sampling, Int32 maxContinuumCandidates)
 {
     Float64 marginRedshiftSteps = 3.0;
     m_minRedshift = minRedshift - marginRedshiftSteps*stepRedshift;
     m_maxRedshift = maxRedshift + marginRedshiftSteps*stepRedshift;
     m_stepRedshift = stepRedshift;
     m_samplingRedshift = opt_sampling;
+    m_logStepRedshift = log(1.0+stepRedshift);
+    n_max_continuum_candidates = std::max(maxContinuumCandidates, 1);
+
+    for(Int32 k=0; k<m_nLockStripes; k++)
+    {
+        m_lockStripes.push_back(std::make_shared<boost::mutex>());
+    }
 
     prepareRedshiftList();
 
@@ -28,7 +37,7 @@ CTemplatesFitStore::~CTemplatesFitStore()
 
 /**
  * @brief CTemplatesFitStore::prepareRedshiftList
- * prepare the redshift grid and the redshift map
+ * prepare the redshift grid, and check that the closed-form redshift index computation matches it
  * @return
  */
 void CTemplatesFitStore::prepareRedshiftList()
@@ -52,13 +61,11 @@ void CTemplatesFitStore::prepareRedshiftList()
 
     for(UInt32 kz=0; kz<redshiftgrid.size(); kz++)
     {
-        UInt32 redshiftscaledInt = (UInt32)(redshiftgrid[kz]/redshiftgridmapPrecision+0.5);
-        redshiftgridmap.insert(std::make_pair(redshiftscaledInt, kz));
-    }
-    if(redshiftgridmap.size()!=redshiftgrid.size())
-    {
-        Log.LogError("Failed to Initialize the template fit store redshift map (n-zgrid=%d, n-zmap=%d). Aborting", redshiftgrid.size(), redshiftgridmap.size());
-        throw std::runtime_error("Failed to Initialize the template fit store redshift map");
+        if(GetRedshiftIndex(redshiftgrid[kz])!=kz)
+        {
+            Log.LogError("Failed to Initialize the template fit store redshift map (n-zgrid=%d, failed at kz=%d). Aborting", redshiftgrid.size(), kz);
+            throw std::runtime_error("Failed to Initialize the template fit store redshift map");
+        }
     }
     return;
 }
@@ -69,13 +76,16 @@ void CTemplatesFitStore::prepareRedshiftList()
  */
 void CTemplatesFitStore::initFitValues()
 {
-    for(Int32 kz=0; kz<redshiftgrid.size(); kz++)
-    {
-        SValues values_unused;
-        values_unused.merit = DBL_MAX;
-        std::vector<SValues> zfitvals;//(n_max_continuum_candidates, values_unused);
-        m_fitValues.push_back(zfitvals);
-    }
+    SValues values_unused;
+    values_unused.tplId = -1;
+    values_unused.ismDustCoeff = -1.0;
+    values_unused.igmMeiksinIdx = -1;
+    values_unused.merit = DBL_MAX;
+    values_unused.fitAmplitude = -1.0;
+    values_unused.fitDtM = -1.0;
+    values_unused.fitMtM = -1.0;
+    m_fitValues.assign(redshiftgrid.size()*n_max_continuum_candidates, values_unused);
+    m_fitCount.assign(redshiftgrid.size(), 0);
 }
 
 std::vector<Float64> CTemplatesFitStore::GetRedshiftList()
@@ -83,22 +93,61 @@ std::vector<Float64> CTemplatesFitStore::GetRedshiftList()
     return redshiftgrid;
 }
 
-Int32 CTemplatesFitStore::GetRedshiftIndex(Float64 z)
+/**
+ * @brief CTemplatesFitStore::GetRedshiftIndexClosedForm
+ * nearest grid index, from the lin or log sampling definition (not bound checked)
+ */
+Int32 CTemplatesFitStore::GetRedshiftIndexClosedForm(Float64 z) const
 {
-    UInt32 redshiftscaledInt = (UInt32)(z/redshiftgridmapPrecision+0.5);
-    std::map<UInt32,UInt32>::iterator it = redshiftgridmap.find(redshiftscaledInt);
-    if(it != redshiftgridmap.end())
+    Float64 fidx;
+    if(m_samplingRedshift=="log")
     {
-        Int32 outputIdx = (Int32)(it->second);
-        return outputIdx;
-    }else{
-        return -1;
+        // log sampling: 1+z_k = (1+z_0)*(1+step)^k
+        fidx = log((1.0+z)/(1.0+m_minRedshift))/m_logStepRedshift;
+    }else
+    {
+        fidx = (z-m_minRedshift)/m_stepRedshift;
     }
+    return (Int32)floor(fidx+0.5);
+}
+
+/**
+ * @brief CTemplatesFitStore::GetRedshiftIndex
+ * @return the index of z in the redshift grid, or -1 if z is not a grid value (at redshiftgridmapPrecision)
+ */
+Int32 CTemplatesFitStore::GetRedshiftIndex(Float64 z) const
+{
+    Int32 nz = redshiftgrid.size();
+    Int32 idx = GetRedshiftIndexClosedForm(z);
+    // the grid is built by accumulation: allow for a one step rounding drift
+    for(Int32 k=std::max(idx-1, 0); k<=std::min(idx+1, nz-1); k++)
+    {
+        if(std::abs(redshiftgrid[k]-z)<redshiftgridmapPrecision)
+        {
+            return k;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief CTemplatesFitStore::RegisterTemplate
+ * @return the id of the template name, to be used with Add
+ */
+Int32 CTemplatesFitStore::RegisterTemplate(const std::string& tplName)
+{
+    m_tplNames.push_back(tplName);
+    return m_tplNames.size()-1;
+}
+
+const std::string& CTemplatesFitStore::GetTplName(Int32 tplId) const
+{
+    return m_tplNames.at(tplId);
 }
 
 /**
  * @brief CTemplatesFitStore::Add
- * @param tplName
+ * @param tplId, as returned by RegisterTemplate
  * @param ismDustCoeff
  * @param igmMeiksinIdx
  * @param redshift
@@ -109,11 +158,11 @@ Int32 CTemplatesFitStore::GetRedshiftIndex(Float64 z)
  *
  * brief: try to insert the fit values into the mFitValues table at the correct idxz:
  *   - no insertion if redshift can't be found in the redshiftgrid
- *   - no insertion if the merit is higher than the highest rank continuum candidate
- *   - insertion is done at a given continuum_candidate_rank position wrt merit value
+ *   - no insertion if the merit is higher than the highest rank continuum candidate and the store is full at this z
+ *   - insertion is done in place at a given continuum_candidate_rank position wrt merit value
  * @return False if there was a problem.
  */
-bool CTemplatesFitStore::Add(std::string tplName,
+bool CTemplatesFitStore::Add(Int32 tplId,
                              Float64 ismDustCoeff,
                              Int32 igmMeiksinIdx,
                              Float64 redshift,
@@ -123,13 +172,13 @@ bool CTemplatesFitStore::Add(std::string tplName,
                              Float64 fitMtM)
 {
     SValues tmpSValues;
+    tmpSValues.tplId = tplId;
     tmpSValues.merit = merit;
     tmpSValues.fitAmplitude = fitAmplitude;
     tmpSValues.fitDtM = fitDtM;
     tmpSValues.fitMtM = fitMtM;
     tmpSValues.ismDustCoeff = ismDustCoeff;
     tmpSValues.igmMeiksinIdx = igmMeiksinIdx;
-    tmpSValues.tplName = tplName;
 
     //
     Int32 idxz=GetRedshiftIndex(redshift);
@@ -141,92 +190,81 @@ bool CTemplatesFitStore::Add(std::string tplName,
     }
     //
 
-    //if chi2 val is the lowest, and condition on tplName, insert at position ipos
-    Int32 ipos=-1;
-    for(Int32 kpos=0; kpos<m_fitValues[idxz].size(); kpos++)
+    boost::mutex::scoped_lock lock(*m_lockStripes[idxz%m_nLockStripes]);
+
+    SValues* zfitvals = &m_fitValues[idxz*n_max_continuum_candidates];
+    Int32& count = m_fitCount[idxz];
+
+    //if chi2 val is the lowest, insert at position ipos (after the candidates with an equal merit)
+    Int32 ipos=count;
+    for(Int32 kpos=0; kpos<count; kpos++)
     {
-        if(tmpSValues.merit < m_fitValues[idxz][kpos].merit)
+        if(tmpSValues.merit < zfitvals[kpos].merit)
         {
             ipos = kpos;
             break;
         }
     }
 
-    if(ipos<0 && m_fitValues[idxz].size()<n_max_continuum_candidates)
-    {
-        Log.LogDebug("CTemplatesFitStore::Add iz=%d (z=%f) - adding at end position %d (merit=%e, ebmv=%e, imeiksin=%d)",
-                     idxz,
-                     redshift,
-                     m_fitValues[idxz].size(),
-                     tmpSValues.merit,
-                     tmpSValues.ismDustCoeff,
-                     tmpSValues.igmMeiksinIdx);
-
-        m_fitValues[idxz].push_back(tmpSValues);
-
-    }else if(ipos<0)
+    if(ipos>=n_max_continuum_candidates)
     {
         //nothing to do, merit doesn't qualify the fit result to be stored
-    }else{
-        Log.LogDebug("CTemplatesFitStore::Add iz=%d (z=%f) - adding at pos=%d (merit=%e, ebmv=%e, imeiksin=%d)",
-                     idxz,
-                     redshift,
-                     ipos,
-                     tmpSValues.merit,
-                     tmpSValues.ismDustCoeff,
-                     tmpSValues.igmMeiksinIdx);
-
-        //insert the new SValue and move all the older candidates position according to ipos found
-        std::vector<SValues>  tmpBufferValues;
-        for(UInt32 ktmp=0; ktmp<m_fitValues[idxz].size(); ktmp++)
-        {
-            tmpBufferValues.push_back(m_fitValues[idxz][ktmp]);
-        }
-        SValues values_unused;
-        values_unused.merit = DBL_MAX;
-        tmpBufferValues.push_back(values_unused);
-
-        UInt32 iOld=0;
-        for(UInt32 ktmp=0; ktmp<m_fitValues[idxz].size(); ktmp++)
-        {
-            if(ipos==ktmp)
-            {
-                m_fitValues[idxz][ktmp] = tmpSValues;
-            }else{
-                m_fitValues[idxz][ktmp] = tmpBufferValues[iOld];
-                iOld++;
-            }
-        }
-        m_fitValues[idxz].push_back(tmpBufferValues[iOld]);
+        return true;
     }
 
-    //this is not very secure. it should be checked that all redshifts have the same fitValues count
-    if(n_continuum_candidates<m_fitValues[idxz].size())
+    Log.LogDebug("CTemplatesFitStore::Add iz=%d (z=%f) - adding at pos=%d (merit=%e, ebmv=%e, imeiksin=%d)",
+                 idxz,
+                 redshift,
+                 ipos,
+                 tmpSValues.merit,
+                 tmpSValues.ismDustCoeff,
+                 tmpSValues.igmMeiksinIdx);
+
+    //move the lower ranked candidates by one position, the last one is dropped if the store is full at this z
+    Int32 iend = std::min(count, n_max_continuum_candidates-1);
+    for(Int32 ktmp=iend; ktmp>ipos; ktmp--)
     {
-        n_continuum_candidates=m_fitValues[idxz].size();
-        Log.LogDebug("CTemplatesFitStore::n_continuum_candidates set to %d)", n_continuum_candidates);
+        zfitvals[ktmp] = zfitvals[ktmp-1];
+    }
+    zfitvals[ipos] = tmpSValues;
+    if(count<n_max_continuum_candidates)
+    {
+        count++;
     }
-
 
     return true;
 }
 
+/**
+ * @brief CTemplatesFitStore::GetContinuumCount
+ * @return the highest number of continuum candidates stored for a redshift
+ */
 Int32 CTemplatesFitStore::GetContinuumCount()
 {
+    Int32 n_continuum_candidates = 0;
+    for(Int32 kz=0; kz<m_fitCount.size(); kz++)
+    {
+        n_continuum_candidates = std::max(n_continuum_candidates, m_fitCount[kz]);
+    }
     return n_continuum_candidates;
 }
 
 CTemplatesFitStore::TemplateFitValues CTemplatesFitStore::GetFitValues(Float64 redshiftVal, Int32 continuumCandidateRank)
 {
-    if(continuumCandidateRank>n_continuum_candidates-1)
+    SValues sval_unset;
+    sval_unset.tplId=-1;
+
+    if(continuumCandidateRank>n_max_continuum_candidates-1)
     {
-        Log.LogError("CTemplatesFitStore::GetFitValues - cannot find the correct pre-computed continuum: candidateRank (%d) >= n_continuum_candidates (%d)",
+        Log.LogError("CTemplatesFitStore::GetFitValues - cannot find the correct pre-computed continuum: candidateRank (%d) >= n_max_continuum_candidates (%d)",
                      continuumCandidateRank,
-                     n_continuum_candidates);
+                     n_max_continuum_candidates);
+        return sval_unset;
     }else if(continuumCandidateRank<0)
     {
         Log.LogError("CTemplatesFitStore::GetFitValues - cannot find the correct pre-computed continuum: candidateRank (%d) <0",
                      continuumCandidateRank);
+        return sval_unset;
     }
 
     if(redshiftVal<redshiftgrid[0])
@@ -234,55 +272,35 @@ CTemplatesFitStore::TemplateFitValues CTemplatesFitStore::GetFitValues(Float64 r
         Log.LogError("CTemplatesFitStore - GetFitValues, looking for redshiftVal=%f, but lt redshiftgrid[0]=%f",
                      redshiftVal,
                      redshiftgrid[0]);
-        SValues sval;
-        sval.tplName="";
-        return sval;
+        return sval_unset;
     }
     if(redshiftVal>redshiftgrid[redshiftgrid.size()-1])
     {
         Log.LogError("CTemplatesFitStore - GetFitValues, looking for redshiftVal=%f, but ht redshiftgrid[redshiftgrid.size()-1]=%f",
                      redshiftVal,
                      redshiftgrid[redshiftgrid.size()-1]);
-        SValues sval;
-        sval.tplName="";
-        return sval;
+        return sval_unset;
     }
 
-
-    //find the idxz
-    Int32 idxz=-1;
-    if(m_samplingRedshift=="log")
+    //find the idxz: the grid value itself, or the lower bound of the enclosing grid interval
+    Int32 idxz=GetRedshiftIndex(redshiftVal);
+    if(idxz<0)
     {
-        for(Int32 k=0; k<redshiftgrid.size()-1; k++)
+        idxz = GetRedshiftIndexClosedForm(redshiftVal);
+        idxz = std::max(0, std::min(idxz, Int32(redshiftgrid.size())-1));
+        if(redshiftgrid[idxz]>redshiftVal && idxz>0)
         {
-            if(redshiftVal >= redshiftgrid[k] && redshiftVal <= redshiftgrid[k+1] )
-            {
-                idxz = k;
-                break;
-            }
+            idxz--;
         }
-    }else{
-        idxz = (redshiftVal-m_minRedshift)/m_stepRedshift;
     }
 
-    if(idxz<0)
+    if(continuumCandidateRank>=m_fitCount[idxz])
     {
-        Log.LogError("CTemplatesFitStore::GetFitValues - cannot find the correct pre-computed continuum.");
-        Log.LogError("CTemplatesFitStore::GetFitValues - redshiftVal=%e, but lt m_fitValues[0].redshift=%e",
-                     redshiftVal,
-                     redshiftgrid[0]);
-        Log.LogError("CTemplatesFitStore::GetFitValues - redshiftVal=%e, but ht m_fitValues[m_fitValues.size()-1].redshift=%e",
-                     redshiftVal,
-                     redshiftgrid[redshiftgrid.size()-1]);
-
-        for(Int32 k=0; k<10; k++)
-        {
-            Log.LogError("CTemplatesFitStore::GetFitValues - redshiftVal=%e, but lt m_fitValues[%d].redshift=%e",
-                         redshiftVal,
-                         k,
-                         redshiftgrid[k]);
-        }
-
+        Log.LogError("CTemplatesFitStore::GetFitValues - cannot find the correct pre-computed continuum: candidateRank (%d) >= n_continuum_candidates (%d) at redshiftVal=%e",
+                     continuumCandidateRank,
+                     m_fitCount[idxz],
+                     redshiftVal);
+        return sval_unset;
     }
-    return m_fitValues[idxz][continuumCandidateRank];
+    return m_fitValues[idxz*n_max_continuum_candidates+continuumCandidateRank];
 }
@@ -30,6 +30,7 @@ const std::string COperatorBlindSolve::GetDescription()
 
     desc.append("\tparam: blindsolve.overlapThreshold = <float value>\n");
     desc.append("\tparam: blindsolve.correlationExtremumCount = <float value>\n");
+    desc.append("\tparam: blindsolve.fft = {""no"", ""yes""}\n");
 
     return desc;
 
@@ -52,6 +53,7 @@ std::shared_ptr<CBlindSolveResult> COperatorBlindSolve::Compute(  CDataStore& re
     if(overlapThreshold==-1.0){
         resultStore.GetScopedParam( "overlapThreshold", overlapThreshold, 1.0 );
     }
+    resultStore.GetScopedParam( "fft", m_opt_fft, "no" );
 
     for( UInt32 i=0; i<tplCategoryList.size(); i++ )
     {
@@ -97,6 +99,7 @@ Bool COperatorBlindSolve::BlindSolve( CDataStore& resultStore, const CSpectrum&
 
     // Compute correlation factor at each of those redshifts
     COperatorCorrelation correlation;
+    correlation.EnableFFT( m_opt_fft == "yes" );
     std::shared_ptr<const CCorrelationResult> correlationResult = dynamic_pointer_cast<const CCorrelationResult> ( correlation.Compute( spcWithoutCont, tplWithoutCont, lambdaRange, redshifts, overlapThreshold, maskList ) );
 
     if( !correlationResult )
@@ -51,6 +51,15 @@ void CBlindSolveResult::SaveLine( const CDataStore& store, std::ostream& stream
                 << "-1" << std::endl; //reliability label
 }
 
+/**
+ * Gets the best redshift and merit, selected as in SaveLine.
+ */
+Bool CBlindSolveResult::GetRedshiftResult( const CDataStore& store, Float64& redshift, Float64& merit ) const
+{
+    std::string tplName;
+    return GetBestFitResult( store, redshift, merit, tplName );
+}
+
 Bool CBlindSolveResult::GetBestFitResult( const CDataStore& store, Float64& redshift, Float64& merit, std::string& tplName ) const
 {
     std::string scope_corr = store.GetScope( *this ) + "blindsolve.correlation";
@@ -1,4 +1,5 @@
 #include <RedshiftLibrary/method/chisquare2solve.h>
+#include <RedshiftLibrary/method/chisquarecoarsetofine.h>
 
 #include <RedshiftLibrary/log/log.h>
 #include <RedshiftLibrary/debug/assert.h>
@@ -8,6 +9,7 @@
 #include <RedshiftLibrary/extremum/extremum.h>
 #include <RedshiftLibrary/processflow/datastore.h>
 #include <RedshiftLibrary/statistics/pdfz.h>
+#include <RedshiftLibrary/statistics/pdfzmarginalizer.h>
 
 #include <RedshiftLibrary/spectrum/io/fitswriter.h>
 #include <float.h>
@@ -38,6 +40,9 @@ const std::string CMethodChisquare2Solve::GetDescription()
     desc.append("\tparam: chisquare2solve.dustfit = {""yes"", ""no""}\n");
     desc.append("\tparam: chisquare2solve.pdfcombination = {""marg"", ""bestchi2""}\n");
     desc.append("\tparam: chisquare2solve.saveintermediateresults = {""yes"", ""no""}\n");
+    desc.append("\tparam: chisquare2solve.coarsegrid.stepfactor = <int value>, fit every n-th redshift first, then refine around the minima (0 or 1: fit all the redshifts)\n");
+    desc.append("\tparam: chisquare2solve.coarsegrid.extremacount = <int value>, number of coarse minima refined on the full grid\n");
+    desc.append("\tparam: chisquare2solve.coarsegrid.tolerance = <float value>, max chi2 error allowed for the interpolated redshifts, as estimated from the coarse chi2 curvature (not a strict bound)\n");
 
 
     return desc;
@@ -88,6 +93,9 @@ std::shared_ptr<CChisquare2SolveResult> CMethodChisquare2Solve::Compute(CDataSto
     }else{
         m_opt_enableSaveIntermediateChisquareResults = false;
     }
+    resultStore.GetScopedParam( "coarsegrid.stepfactor", m_opt_coarseStepFactor, 0 );
+    resultStore.GetScopedParam( "coarsegrid.extremacount", m_opt_coarseExtremaCount, 5 );
+    resultStore.GetScopedParam( "coarsegrid.tolerance", m_opt_coarseTolerance, 1.0 );
 
     Log.LogInfo( "Method parameters:");
     Log.LogInfo( "    -overlapThreshold: %.3f", overlapThreshold);
@@ -97,8 +105,14 @@ std::shared_ptr<CChisquare2SolveResult> CMethodChisquare2Solve::Compute(CDataSto
     Log.LogInfo( "    -ISM dust-fit: %s", opt_dustFit.c_str());
     Log.LogInfo( "    -pdfcombination: %s", m_opt_pdfcombination.c_str());
     Log.LogInfo( "    -saveintermediateresults: %d", (int)m_opt_enableSaveIntermediateChisquareResults);
+    if( m_opt_coarseStepFactor>1 )
+    {
+        Log.LogInfo( "    -coarsegrid: step factor %d, %d extrema, tolerance %.3f", (Int32)m_opt_coarseStepFactor, (Int32)m_opt_coarseExtremaCount, m_opt_coarseTolerance );
+    }
     Log.LogInfo( "");
 
+    CPdfzMarginalizer marginalizer;
+    Float64 margCstLog = -1;
     for( UInt32 i=0; i<tplCategoryList.size(); i++ )
     {
         std::string category = tplCategoryList[i];
@@ -110,6 +124,17 @@ std::shared_ptr<CChisquare2SolveResult> CMethodChisquare2Solve::Compute(CDataSto
 
             Solve( resultStore, spc, spcWithoutCont, tpl, tplWithoutCont, lambdaRange, redshifts, overlapThreshold, maskList, _type, opt_interp, opt_extinction, opt_dustFit);
 
+            if(m_opt_pdfcombination=="marg")
+            {
+                //stream the merit curves of this template into the marginalization right after its fit
+                std::shared_ptr<const CChisquareResult> meritResult = std::dynamic_pointer_cast<const CChisquareResult>(
+                    resultStore.GetPerTemplateResult( tpl, resultStore.GetCurrentScopeName() + "." + scopeStr ).lock() );
+                if( meritResult )
+                {
+                    MarginalizeMerits( marginalizer, *meritResult, tpl.GetName(), margCstLog );
+                }
+            }
+
             storeResult = true;
         }
     }
@@ -121,7 +146,7 @@ std::shared_ptr<CChisquare2SolveResult> CMethodChisquare2Solve::Compute(CDataSto
         ChisquareSolveResult->m_type = _type;
 
         std::shared_ptr<CPdfMargZLogResult> postmargZResult = std::shared_ptr<CPdfMargZLogResult>(new CPdfMargZLogResult());
-        Int32 retCombinePdf = CombinePDF(resultStore, scopeStr, m_opt_pdfcombination, postmargZResult);
+        Int32 retCombinePdf = CombinePDF(resultStore, scopeStr, m_opt_pdfcombination, marginalizer, postmargZResult);
 
         if(retCombinePdf==0)
         {
@@ -235,15 +260,24 @@ Bool CMethodChisquare2Solve::Solve(CDataStore& resultStore,
 
         // Compute merit function
         //CRef<CChisquareResult>  chisquareResult = (CChisquareResult*)chiSquare.ExportChi2versusAZ( _spc, _tpl, lambdaRange, redshifts, overlapThreshold );
-        auto  chisquareResult = std::dynamic_pointer_cast<CChisquareResult>( m_chiSquareOperator->Compute( _spc,
-                                                                                                           _tpl,
-                                                                                                           lambdaRange,
-                                                                                                           redshifts,
-                                                                                                           overlapThreshold,
-                                                                                                           maskList,
-                                                                                                           opt_interp,
-                                                                                                           enable_extinction,
-                                                                                                           option_dustFitting ) );
+        std::shared_ptr<CChisquareResult> chisquareResult;
+        CChisquareCoarseToFine coarseToFine( m_opt_coarseStepFactor, m_opt_coarseExtremaCount, m_opt_coarseTolerance );
+        if( coarseToFine.IsApplicable( redshifts ) )
+        {
+            chisquareResult = coarseToFine.Compute( *m_chiSquareOperator, _spc, _tpl, lambdaRange, redshifts, overlapThreshold, maskList,
+                                                    opt_interp, enable_extinction, option_dustFitting );
+        }else
+        {
+            chisquareResult = std::dynamic_pointer_cast<CChisquareResult>( m_chiSquareOperator->Compute( _spc,
+                                                                                                         _tpl,
+                                                                                                         lambdaRange,
+                                                                                                         redshifts,
+                                                                                                         overlapThreshold,
+                                                                                                         maskList,
+                                                                                                         opt_interp,
+                                                                                                         enable_extinction,
+                                                                                                         option_dustFitting ) );
+        }
 
         if( !chisquareResult )
         {
@@ -285,8 +319,49 @@ Bool CMethodChisquare2Solve::Solve(CDataStore& resultStore,
     return true;
 }
 
+/**
+ * Adds the merit curves of one template, one per ism/igm combination, to the z-pdf marginalization with a constant
+ * z prior. Called from the fit loop so that the curves are marginalized as soon as the template is fitted.
+ */
+void CMethodChisquare2Solve::MarginalizeMerits(CPdfzMarginalizer& marginalizer, const CChisquareResult& meritResult, const std::string& tplName, Float64& cstLog)
+{
+    Int32 nISM = -1;
+    Int32 nIGM = -1;
+    if(meritResult.ChiSquareIntermediate.size()>0)
+    {
+        nISM = meritResult.ChiSquareIntermediate[0].size();
+        if(meritResult.ChiSquareIntermediate[0].size()>0)
+        {
+            nIGM = meritResult.ChiSquareIntermediate[0][0].size();
+        }
+    }
+    if(cstLog==-1)
+    {
+        cstLog = meritResult.CstLog;
+        Log.LogInfo("chisquare2solve: using cstLog = %f", cstLog);
+    }else if ( cstLog != meritResult.CstLog)
+    {
+        Log.LogError("chisquare2solve: Found different cstLog values in results... val-1=%f != val-2=%f", cstLog, meritResult.CstLog);
+    }
 
-Int32 CMethodChisquare2Solve::CombinePDF(CDataStore &store, std::string scopeStr, std::string opt_combine, std::shared_ptr<CPdfMargZLogResult> postmargZResult)
+    CPdfz pdfz;
+    for(Int32 kism=0; kism<nISM; kism++)
+    {
+        for(Int32 kigm=0; kigm<nIGM; kigm++)
+        {
+            TFloat64List _prior = pdfz.GetConstantLogZPrior(meritResult.Redshifts.size());
+            TFloat64List logLikelihoodCorrected(meritResult.Redshifts.size(), DBL_MAX);
+            for ( UInt32 kz=0; kz<meritResult.Redshifts.size(); kz++)
+            {
+                logLikelihoodCorrected[kz] = meritResult.ChiSquareIntermediate[kz][kism][kigm];
+            }
+            marginalizer.Add(meritResult.Redshifts, logLikelihoodCorrected, _prior, cstLog);
+            Log.LogDetail("    chisquare2solve: Pdfz combine - prepared merit  #%d for model : %s", marginalizer.GetModelCount()-1, tplName.c_str());
+        }
+    }
+}
+
+Int32 CMethodChisquare2Solve::CombinePDF(CDataStore &store, std::string scopeStr, std::string opt_combine, CPdfzMarginalizer& marginalizer, std::shared_ptr<CPdfMargZLogResult> postmargZResult)
 {
     Log.LogInfo("chisquare2solve: Pdfz computation");
     std::string scope = store.GetCurrentScopeName() + ".";
@@ -301,58 +376,67 @@ Int32 CMethodChisquare2Solve::CombinePDF(CDataStore &store, std::string scopeStr
     std::vector<TFloat64List> priors;
     std::vector<TFloat64List> chiSquares;
     std::vector<Float64> redshifts;
-    for( TOperatorResultMap::const_iterator it = meritResults.begin(); it != meritResults.end(); it++ )
+    Int32 nMerits = 0;
+    if(opt_combine=="marg")
     {
-        auto meritResult = std::dynamic_pointer_cast<const CChisquareResult>( (*it).second );
-        Int32 nISM = -1;
-        Int32 nIGM = -1;
-        if(meritResult->ChiSquareIntermediate.size()>0)
+        //the merit curves were streamed into the marginalizer from the fit loop, see MarginalizeMerits
+        nMerits = marginalizer.GetModelCount();
+    }else
+    {
+        for( TOperatorResultMap::const_iterator it = meritResults.begin(); it != meritResults.end(); it++ )
         {
-            nISM = meritResult->ChiSquareIntermediate[0].size();
-            if(meritResult->ChiSquareIntermediate[0].size()>0)
+            auto meritResult = std::dynamic_pointer_cast<const CChisquareResult>( (*it).second );
+            Int32 nISM = -1;
+            Int32 nIGM = -1;
+            if(meritResult->ChiSquareIntermediate.size()>0)
             {
-                nIGM = meritResult->ChiSquareIntermediate[0][0].size();
+                nISM = meritResult->ChiSquareIntermediate[0].size();
+                if(meritResult->ChiSquareIntermediate[0].size()>0)
+                {
+                    nIGM = meritResult->ChiSquareIntermediate[0][0].size();
+                }
             }
-        }
-        if(cstLog==-1)
-        {
-            cstLog = meritResult->CstLog;
-            Log.LogInfo("chisquare2solve: using cstLog = %f", cstLog);
-        }else if ( cstLog != meritResult->CstLog)
-        {
-            Log.LogError("chisquare2solve: Found different cstLog values in results... val-1=%f != val-2=%f", cstLog, meritResult->CstLog);
-        }
-        if(redshifts.size()==0)
-        {
-            redshifts = meritResult->Redshifts;
-        }
-
-        for(Int32 kism=0; kism<nISM; kism++)
-        {
-            for(Int32 kigm=0; kigm<nIGM; kigm++)
+            if(cstLog==-1)
+            {
+                cstLog = meritResult->CstLog;
+                Log.LogInfo("chisquare2solve: using cstLog = %f", cstLog);
+            }else if ( cstLog != meritResult->CstLog)
+            {
+                Log.LogError("chisquare2solve: Found different cstLog values in results... val-1=%f != val-2=%f", cstLog, meritResult->CstLog);
+            }
+            if(redshifts.size()==0)
             {
-                TFloat64List _prior;
-                _prior = pdfz.GetConstantLogZPrior(meritResult->Redshifts.size());
-                priors.push_back(_prior);
+                redshifts = meritResult->Redshifts;
+            }
 
-                //correct chi2 for ampl. marg. if necessary: todo add switch, currently deactivated
-                TFloat64List logLikelihoodCorrected(meritResult->ChiSquareIntermediate.size(), DBL_MAX);
-                for ( UInt32 kz=0; kz<meritResult->Redshifts.size(); kz++)
+            for(Int32 kism=0; kism<nISM; kism++)
+            {
+                for(Int32 kigm=0; kigm<nIGM; kigm++)
                 {
-                    logLikelihoodCorrected[kz] = meritResult->ChiSquareIntermediate[kz][kism][kigm];// + resultXXX->ScaleMargCorrectionTplshapes[][]?;
+                    TFloat64List _prior;
+                    _prior = pdfz.GetConstantLogZPrior(meritResult->Redshifts.size());
+
+                    //correct chi2 for ampl. marg. if necessary: todo add switch, currently deactivated
+                    TFloat64List logLikelihoodCorrected(meritResult->ChiSquareIntermediate.size(), DBL_MAX);
+                    for ( UInt32 kz=0; kz<meritResult->Redshifts.size(); kz++)
+                    {
+                        logLikelihoodCorrected[kz] = meritResult->ChiSquareIntermediate[kz][kism][kigm];// + resultXXX->ScaleMargCorrectionTplshapes[][]?;
+                    }
+                    priors.push_back(_prior);
+                    chiSquares.push_back(logLikelihoodCorrected);
+                    nMerits++;
+                    Log.LogDetail("    chisquare2solve: Pdfz combine - prepared merit  #%d for model : %s", nMerits-1, ((*it).first).c_str());
                 }
-                chiSquares.push_back(logLikelihoodCorrected);
-                Log.LogDetail("    chisquare2solve: Pdfz combine - prepared merit  #%d for model : %s", chiSquares.size()-1, ((*it).first).c_str());
             }
         }
     }
 
-    if(chiSquares.size()>0)
+    if(nMerits>0)
     {
         if(opt_combine=="marg")
         {
             Log.LogInfo("    chisquare2solve: Pdfz combination - Marginalization");
-            retPdfz = pdfz.Marginalize( redshifts, chiSquares, priors, cstLog, postmargZResult);
+            retPdfz = marginalizer.Finalize(postmargZResult);
         }else if(opt_combine=="bestchi2")
         {
             Log.LogInfo("    chisquare2solve: Pdfz combination - BestChi2");
@@ -362,7 +446,7 @@ Int32 CMethodChisquare2Solve::CombinePDF(CDataStore &store, std::string scopeStr
         }
     }else
     {
-        Log.LogError("    chisquare2solve: Unable to find any chisquares prepared for combination. chiSquares.size()=%d", chiSquares.size());
+        Log.LogError("    chisquare2solve: Unable to find any chisquares prepared for combination. chiSquares.size()=%d", nMerits);
     }
 
 
@@ -0,0 +1,284 @@
+#include <RedshiftLibrary/method/chisquarecoarsetofine.h>
+
+#include <RedshiftLibrary/log/log.h>
+#include <RedshiftLibrary/extremum/extremum.h>
+#include <RedshiftLibrary/operator/chisquare2.h>
+#include <RedshiftLibrary/operator/chisquareresult.h>
+
+#include <algorithm>
+#include <cmath>
+
+using namespace NSEpic;
+using namespace std;
+
+CChisquareCoarseToFine::CChisquareCoarseToFine( Int32 stepFactor, Int32 extremaCount, Float64 tolerance ) :
+    m_StepFactor( stepFactor ),
+    m_ExtremaCount( extremaCount ),
+    m_Tolerance( tolerance ),
+    m_FittedCount( 0 )
+{
+
+}
+
+CChisquareCoarseToFine::~CChisquareCoarseToFine()
+{
+
+}
+
+/**
+ * The coarse grid is used for a step factor above 1 and a sorted redshifts list spanning at least two coarse intervals.
+ */
+Bool CChisquareCoarseToFine::IsApplicable( const TFloat64List& redshifts ) const
+{
+    return m_StepFactor>1 && redshifts.size()>2*m_StepFactor && std::is_sorted( redshifts.begin(), redshifts.end() );
+}
+
+/**
+ * Number of redshifts actually fitted by the last Compute call.
+ */
+Int32 CChisquareCoarseToFine::GetFittedCount() const
+{
+    return m_FittedCount;
+}
+
+/**
+ * Fits the template on a coarse grid first, every m_StepFactor-th redshift and the last one, then fits on the full
+ * grid only the coarse intervals that NeedsRefinement() selects: around the m_ExtremaCount lowest coarse minima,
+ * and wherever the chi2 interpolation error may exceed m_Tolerance.
+ * The other redshifts are interpolated from their computed neighbours, so that the result covers the whole redshifts list,
+ * as COperatorChiSquare2::Compute does, for the pdf and the candidates.
+ */
+std::shared_ptr<CChisquareResult> CChisquareCoarseToFine::Compute( COperatorChiSquare2& chiSquareOperator,
+                                                                   const CSpectrum& spc,
+                                                                   const CTemplate& tpl,
+                                                                   const TFloat64Range& lambdaRange,
+                                                                   const TFloat64List& redshifts,
+                                                                   Float64 overlapThreshold,
+                                                                   const std::vector<CMask>& maskList,
+                                                                   std::string opt_interp,
+                                                                   Int32 opt_extinction,
+                                                                   Int32 opt_dustFitting )
+{
+    Int32 n = redshifts.size();
+    m_FittedCount = 0;
+    TInt32List coarseIndexes;
+    for( Int32 i=0; i<n; i+=m_StepFactor )
+    {
+        coarseIndexes.push_back( i );
+    }
+    if( coarseIndexes.back()!=n-1 )
+    {
+        coarseIndexes.push_back( n-1 );
+    }
+
+    std::shared_ptr<CChisquareResult> coarse = ComputeOnGrid( chiSquareOperator, spc, tpl, lambdaRange, redshifts, coarseIndexes, overlapThreshold,
+                                                              maskList, opt_interp, opt_extinction, opt_dustFitting );
+    if( !coarse )
+    {
+        return NULL;
+    }
+    Int32 nCoarse = coarseIndexes.size();
+
+    // coarse intervals to refine: the ones on each side of the lowest minima, then the ones with a large interpolation error
+    std::vector<Bool> refine( nCoarse-1, false );
+    CExtremum extremum( TFloat64Range( coarse->Redshifts.front(), coarse->Redshifts.back() ), m_ExtremaCount, true );
+    TPointList extremumList;
+    extremum.Find( coarse->Redshifts, coarse->ChiSquare, extremumList );
+    for( Int32 k=0; k<extremumList.size(); k++ )
+    {
+        Int32 j = std::lower_bound( coarse->Redshifts.begin(), coarse->Redshifts.end(), extremumList[k].X ) - coarse->Redshifts.begin();
+        if( j>0 )
+        {
+            refine[j-1] = true;
+        }
+        if( j<nCoarse-1 )
+        {
+            refine[j] = true;
+        }
+    }
+    for( Int32 j=0; j<nCoarse-1; j++ )
+    {
+        if( !refine[j] )
+        {
+            refine[j] = NeedsRefinement( *coarse, j );
+        }
+    }
+
+    TInt32List fineIndexes;
+    for( Int32 j=0; j<nCoarse-1; j++ )
+    {
+        if( refine[j] )
+        {
+            for( Int32 i=coarseIndexes[j]+1; i<coarseIndexes[j+1]; i++ )
+            {
+                fineIndexes.push_back( i );
+            }
+        }
+    }
+    std::shared_ptr<CChisquareResult> fine;
+    if( fineIndexes.size()>0 )
+    {
+        fine = ComputeOnGrid( chiSquareOperator, spc, tpl, lambdaRange, redshifts, fineIndexes, overlapThreshold,
+                              maskList, opt_interp, opt_extinction, opt_dustFitting );
+        if( !fine )
+        {
+            return NULL;
+        }
+    }
+    m_FittedCount = nCoarse + fineIndexes.size();
+    Log.LogInfo( "chisquare2solve: coarse-to-fine grid, %d coarse and %d refined redshifts fitted out of %d", nCoarse, (Int32)fineIndexes.size(), n );
+
+    // merge the computed redshifts, then interpolate the others
+    Int32 nISM = coarse->ChiSquareIntermediate[0].size();
+    Int32 nIGM = nISM>0 ? coarse->ChiSquareIntermediate[0][0].size() : 0;
+    std::shared_ptr<CChisquareResult> result = std::shared_ptr<CChisquareResult>( new CChisquareResult() );
+    result->Init( n, nISM, nIGM );
+    result->Redshifts = redshifts;
+    result->CstLog = coarse->CstLog;
+
+    std::vector<Bool> computed( n, false );
+    for( Int32 k=0; k<nCoarse; k++ )
+    {
+        CopyRedshiftResult( *coarse, k, *result, coarseIndexes[k] );
+        computed[coarseIndexes[k]] = true;
+    }
+    for( Int32 k=0; k<fineIndexes.size(); k++ )
+    {
+        CopyRedshiftResult( *fine, k, *result, fineIndexes[k] );
+        computed[fineIndexes[k]] = true;
+    }
+    Int32 iLeft = 0;
+    for( Int32 i=1; i<n; i++ )
+    {
+        if( !computed[i] )
+        {
+            continue;
+        }
+        for( Int32 k=iLeft+1; k<i; k++ )
+        {
+            InterpolateRedshiftResult( *result, iLeft, i, k );
+        }
+        iLeft = i;
+    }
+
+    chiSquareOperator.EstimateExtrema( *result );
+    return result;
+}
+
+/**
+ * Runs the chisquare operator on the redshifts of the given indexes only, with their masks when there is one mask per redshift.
+ */
+std::shared_ptr<CChisquareResult> CChisquareCoarseToFine::ComputeOnGrid( COperatorChiSquare2& chiSquareOperator,
+                                                                         const CSpectrum& spc,
+                                                                         const CTemplate& tpl,
+                                                                         const TFloat64Range& lambdaRange,
+                                                                         const TFloat64List& redshifts,
+                                                                         const TInt32List& indexes,
+                                                                         Float64 overlapThreshold,
+                                                                         const std::vector<CMask>& maskList,
+                                                                         std::string opt_interp,
+                                                                         Int32 opt_extinction,
+                                                                         Int32 opt_dustFitting )
+{
+    TFloat64List gridRedshifts( indexes.size() );
+    std::vector<CMask> gridMaskList;
+    for( Int32 k=0; k<indexes.size(); k++ )
+    {
+        gridRedshifts[k] = redshifts[indexes[k]];
+        if( maskList.size()==redshifts.size() )
+        {
+            gridMaskList.push_back( maskList[indexes[k]] );
+        }
+    }
+
+    return std::dynamic_pointer_cast<CChisquareResult>( chiSquareOperator.Compute( spc, tpl, lambdaRange, gridRedshifts, overlapThreshold,
+                                                                                      gridMaskList, opt_interp, opt_extinction, opt_dustFitting ) );
+}
+
+/**
+ * Returns true if the coarse interval [j, j+1] has to be fitted on the full grid: an invalid fit or a non finite chi2 at
+ * one of its ends, or a chi2 interpolation error (dz^2/8 * max|chi2''|) above m_Tolerance.
+ * The second derivative is estimated by the divided differences at the interval ends, so the error is an estimate and
+ * not a strict bound: a feature narrower than the coarse step, missed by the coarse redshifts, is not detected.
+ */
+Bool CChisquareCoarseToFine::NeedsRefinement( const CChisquareResult& coarse, Int32 j ) const
+{
+    const TFloat64List& z = coarse.Redshifts;
+    const TFloat64List& chi2 = coarse.ChiSquare;
+    Int32 nCoarse = z.size();
+
+    for( Int32 k=std::max( 0, j-1 ); k<=std::min( nCoarse-1, j+2 ); k++ )
+    {
+        if( coarse.Status[k]!=COperator::nStatus_OK || !std::isfinite( chi2[k] ) )
+        {
+            return true;
+        }
+    }
+
+    Float64 maxCurvature = -1.0;
+    for( Int32 k=j; k<=j+1; k++ )
+    {
+        if( k<1 || k>nCoarse-2 )
+        {
+            continue;
+        }
+        Float64 slopeLeft = ( chi2[k]-chi2[k-1] )/( z[k]-z[k-1] );
+        Float64 slopeRight = ( chi2[k+1]-chi2[k] )/( z[k+1]-z[k] );
+        Float64 curvature = fabs( 2.0*( slopeRight-slopeLeft )/( z[k+1]-z[k-1] ) );
+        maxCurvature = std::max( maxCurvature, curvature );
+    }
+    if( maxCurvature<0.0 )
+    {
+        return true;
+    }
+
+    Float64 dz = z[j+1]-z[j];
+    return dz*dz/8.0*maxCurvature > m_Tolerance;
+}
+
+void CChisquareCoarseToFine::CopyRedshiftResult( const CChisquareResult& from, Int32 iFrom, CChisquareResult& to, Int32 iTo )
+{
+    to.ChiSquare[iTo] = from.ChiSquare[iFrom];
+    to.FitAmplitude[iTo] = from.FitAmplitude[iFrom];
+    to.FitDustCoeff[iTo] = from.FitDustCoeff[iFrom];
+    to.FitMeiksinIdx[iTo] = from.FitMeiksinIdx[iFrom];
+    to.FitDtM[iTo] = from.FitDtM[iFrom];
+    to.FitMtM[iTo] = from.FitMtM[iFrom];
+    to.Overlap[iTo] = from.Overlap[iFrom];
+    to.Status[iTo] = from.Status[iFrom];
+    to.ChiSquareIntermediate[iTo] = from.ChiSquareIntermediate[iFrom];
+    to.IsmDustCoeffIntermediate[iTo] = from.IsmDustCoeffIntermediate[iFrom];
+    to.IgmMeiksinIdxIntermediate[iTo] = from.IgmMeiksinIdxIntermediate[iFrom];
+}
+
+/**
+ * Sets the redshift i, between the computed redshifts iLeft and iRight, by linear interpolation in z of the chi2 and of
+ * the fitted amplitude and scalar products; the dust, igm, overlap and status values are the nearest computed ones.
+ */
+void CChisquareCoarseToFine::InterpolateRedshiftResult( CChisquareResult& result, Int32 iLeft, Int32 iRight, Int32 i )
+{
+    const TFloat64List& z = result.Redshifts;
+    Float64 t = ( z[i]-z[iLeft] )/( z[iRight]-z[iLeft] );
+    Int32 iNearest = t<=0.5 ? iLeft : iRight;
+
+    result.ChiSquare[i] = (1.0-t)*result.ChiSquare[iLeft] + t*result.ChiSquare[iRight];
+    result.FitAmplitude[i] = (1.0-t)*result.FitAmplitude[iLeft] + t*result.FitAmplitude[iRight];
+    result.FitDtM[i] = (1.0-t)*result.FitDtM[iLeft] + t*result.FitDtM[iRight];
+    result.FitMtM[i] = (1.0-t)*result.FitMtM[iLeft] + t*result.FitMtM[iRight];
+    result.FitDustCoeff[i] = result.FitDustCoeff[iNearest];
+    result.FitMeiksinIdx[i] = result.FitMeiksinIdx[iNearest];
+    result.Overlap[i] = result.Overlap[iNearest];
+    result.Status[i] = result.Status[iNearest];
+
+    result.ChiSquareIntermediate[i] = result.ChiSquareIntermediate[iNearest];
+    for( Int32 kism=0; kism<result.ChiSquareIntermediate[i].size(); kism++ )
+    {
+        for( Int32 kigm=0; kigm<result.ChiSquareIntermediate[i][kism].size(); kigm++ )
+        {
+            result.ChiSquareIntermediate[i][kism][kigm] = (1.0-t)*result.ChiSquareIntermediate[iLeft][kism][kigm]
+                                                        + t*result.ChiSquareIntermediate[iRight][kism][kigm];
+        }
+    }
+    result.IsmDustCoeffIntermediate[i] = result.IsmDustCoeffIntermediate[iNearest];
+    result.IgmMeiksinIdxIntermediate[i] = result.IgmMeiksinIdxIntermediate[iNearest];
+}
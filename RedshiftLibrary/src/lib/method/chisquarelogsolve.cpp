@@ -8,6 +8,7 @@
 #include <RedshiftLibrary/extremum/extremum.h>
 #include <RedshiftLibrary/processflow/datastore.h>
 #include <RedshiftLibrary/statistics/pdfz.h>
+#include <RedshiftLibrary/statistics/pdfzmarginalizer.h>
 #include <RedshiftLibrary/operator/pdfLogresult.h>
 
 #include <RedshiftLibrary/spectrum/io/fitswriter.h>
@@ -108,6 +109,8 @@ std::shared_ptr<CChisquareLogSolveResult> CMethodChisquareLogSolve::Compute(CDat
     }
 
     Log.LogInfo( "Iterating over %d tplCategories", tplCategoryList.size());
+    CPdfzMarginalizer marginalizer;
+    Float64 margCstLog = -1;
     for( UInt32 i=0; i<tplCategoryList.size(); i++ )
     {
         std::string category = tplCategoryList[i];
@@ -120,6 +123,17 @@ std::shared_ptr<CChisquareLogSolveResult> CMethodChisquareLogSolve::Compute(CDat
 
             Solve( resultStore, spc, spcWithoutCont, tpl, tplWithoutCont, lambdaRange, redshifts, overlapThreshold, maskList, _type, opt_interp, opt_extinction, opt_dustFit);
 
+            if(m_opt_pdfcombination=="marg")
+            {
+                //stream the merit curves of this template into the marginalization right after its fit
+                std::shared_ptr<const CChisquareResult> meritResult = std::dynamic_pointer_cast<const CChisquareResult>(
+                    resultStore.GetPerTemplateResult( tpl, resultStore.GetCurrentScopeName() + "." + scopeStr ).lock() );
+                if( meritResult )
+                {
+                    MarginalizeMerits( marginalizer, *meritResult, tpl.GetName(), margCstLog );
+                }
+            }
+
             storeResult = true;
         }
     }
@@ -131,7 +145,7 @@ std::shared_ptr<CChisquareLogSolveResult> CMethodChisquareLogSolve::Compute(CDat
         ChisquareSolveResult->m_type = _type;
 
         std::shared_ptr<CPdfMargZLogResult> postmargZResult = std::shared_ptr<CPdfMargZLogResult>(new CPdfMargZLogResult());
-        Int32 retCombinePdf = CombinePDF(resultStore, scopeStr, m_opt_pdfcombination, postmargZResult);
+        Int32 retCombinePdf = CombinePDF(resultStore, scopeStr, m_opt_pdfcombination, marginalizer, postmargZResult);
 
         if(retCombinePdf==0)
         {
@@ -282,7 +296,59 @@ Bool CMethodChisquareLogSolve::Solve(CDataStore& resultStore,
 }
 
 
-Int32 CMethodChisquareLogSolve::CombinePDF(CDataStore &store, std::string scopeStr, std::string opt_combine, std::shared_ptr<CPdfMargZLogResult> postmargZResult )
+/**
+ * Adds the merit curves of one template, one per ism/igm combination, to the z-pdf marginalization with a constant
+ * z prior. Called from the fit loop so that the curves are marginalized as soon as the template is fitted.
+ */
+void CMethodChisquareLogSolve::MarginalizeMerits(CPdfzMarginalizer& marginalizer, const CChisquareResult& meritResult, const std::string& tplName, Float64& cstLog)
+{
+    Int32 nISM = -1;
+    Int32 nIGM = -1;
+    if(meritResult.ChiSquareIntermediate.size()>0)
+    {
+        nISM = meritResult.ChiSquareIntermediate[0].size();
+        if(meritResult.ChiSquareIntermediate[0].size()>0)
+        {
+            nIGM = meritResult.ChiSquareIntermediate[0][0].size();
+        }
+    }
+    if(cstLog==-1)
+    {
+        cstLog = meritResult.CstLog;
+        Log.LogInfo("chisquarelogsolve: using cstLog = %f", cstLog);
+    }else if ( cstLog != meritResult.CstLog)
+    {
+        Log.LogError("chisquarelogsolve: Found different cstLog values in results... val-1=%f != val-2=%f", cstLog, meritResult.CstLog);
+    }
+
+    //check chi2 results status for this template
+    for ( UInt32 kz=0; kz<meritResult.Redshifts.size(); kz++)
+    {
+        if(meritResult.Status[kz]!=COperator::nStatus_OK)
+        {
+            Log.LogError("chisquarelogsolve: Found bad status result... fot tpl=%s", tplName.c_str());
+            break;
+        }
+    }
+
+    CPdfz pdfz;
+    for(Int32 kism=0; kism<nISM; kism++)
+    {
+        for(Int32 kigm=0; kigm<nIGM; kigm++)
+        {
+            TFloat64List _prior = pdfz.GetConstantLogZPrior(meritResult.Redshifts.size());
+            TFloat64List logLikelihoodCorrected(meritResult.Redshifts.size(), DBL_MAX);
+            for ( UInt32 kz=0; kz<meritResult.Redshifts.size(); kz++)
+            {
+                logLikelihoodCorrected[kz] = meritResult.ChiSquareIntermediate[kz][kism][kigm];
+            }
+            marginalizer.Add(meritResult.Redshifts, logLikelihoodCorrected, _prior, cstLog);
+            Log.LogDetail("    chisquarelogsolve: Pdfz combine - prepared merit  #%d for model : %s, ism=%d, igm=%d", marginalizer.GetModelCount()-1, tplName.c_str(), kism, kigm);
+        }
+    }
+}
+
+Int32 CMethodChisquareLogSolve::CombinePDF(CDataStore &store, std::string scopeStr, std::string opt_combine, CPdfzMarginalizer& marginalizer, std::shared_ptr<CPdfMargZLogResult> postmargZResult)
 {
     Log.LogInfo("    chisquarelogsolve: Pdfz computation");
     std::string scope = store.GetCurrentScopeName() + ".";
@@ -299,76 +365,85 @@ Int32 CMethodChisquareLogSolve::CombinePDF(CDataStore &store, std::string scopeS
     std::vector<TFloat64List> priors;
     std::vector<TFloat64List> chiSquares;
     std::vector<Float64> redshifts;
-    for( TOperatorResultMap::const_iterator it = meritResults.begin(); it != meritResults.end(); it++ )
+    Int32 nMerits = 0;
+    if(opt_combine=="marg")
+    {
+        //the merit curves were streamed into the marginalizer from the fit loop, see MarginalizeMerits
+        nMerits = marginalizer.GetModelCount();
+    }else
     {
-        auto meritResult = std::dynamic_pointer_cast<const CChisquareResult>( (*it).second );
-        Int32 nISM = -1;
-        Int32 nIGM = -1;
-        if(meritResult->ChiSquareIntermediate.size()>0)
+        for( TOperatorResultMap::const_iterator it = meritResults.begin(); it != meritResults.end(); it++ )
         {
-            nISM = meritResult->ChiSquareIntermediate[0].size();
-            if(meritResult->ChiSquareIntermediate[0].size()>0)
+            auto meritResult = std::dynamic_pointer_cast<const CChisquareResult>( (*it).second );
+            Int32 nISM = -1;
+            Int32 nIGM = -1;
+            if(meritResult->ChiSquareIntermediate.size()>0)
             {
-                nIGM = meritResult->ChiSquareIntermediate[0][0].size();
+                nISM = meritResult->ChiSquareIntermediate[0].size();
+                if(meritResult->ChiSquareIntermediate[0].size()>0)
+                {
+                    nIGM = meritResult->ChiSquareIntermediate[0][0].size();
+                }
+            }
+            if(cstLog==-1)
+            {
+                cstLog = meritResult->CstLog;
+                Log.LogInfo("chisquarelogsolve: using cstLog = %f", cstLog);
+            }else if ( cstLog != meritResult->CstLog)
+            {
+                Log.LogError("chisquarelogsolve: Found different cstLog values in results... val-1=%f != val-2=%f", cstLog, meritResult->CstLog);
+            }
+            if(redshifts.size()==0)
+            {
+                redshifts = meritResult->Redshifts;
             }
-        }
-        if(cstLog==-1)
-        {
-            cstLog = meritResult->CstLog;
-            Log.LogInfo("chisquarelogsolve: using cstLog = %f", cstLog);
-        }else if ( cstLog != meritResult->CstLog)
-        {
-            Log.LogError("chisquarelogsolve: Found different cstLog values in results... val-1=%f != val-2=%f", cstLog, meritResult->CstLog);
-        }
-        if(redshifts.size()==0)
-        {
-            redshifts = meritResult->Redshifts;
-        }
 
 
-        //check chi2 results status for this template
-        {
-            Bool foundBadStatus=0;
-            for ( UInt32 kz=0; kz<meritResult->Redshifts.size(); kz++)
+            //check chi2 results status for this template
             {
-                if(meritResult->Status[kz]!=COperator::nStatus_OK)
+                Bool foundBadStatus=0;
+                for ( UInt32 kz=0; kz<meritResult->Redshifts.size(); kz++)
                 {
-                    foundBadStatus = 1;
-                    break;
+                    if(meritResult->Status[kz]!=COperator::nStatus_OK)
+                    {
+                        foundBadStatus = 1;
+                        break;
+                    }
+                }
+                if(foundBadStatus)
+                {
+                    Log.LogError("chisquarelogsolve: Found bad status result... fot tpl=%s", (*it).first.c_str());
                 }
             }
-            if(foundBadStatus)
-            {
-                Log.LogError("chisquarelogsolve: Found bad status result... fot tpl=%s", (*it).first.c_str());
-            }
-        }
 
-        for(Int32 kism=0; kism<nISM; kism++)
-        {
-            for(Int32 kigm=0; kigm<nIGM; kigm++)
+            for(Int32 kism=0; kism<nISM; kism++)
             {
-                TFloat64List _prior;
-                _prior = pdfz.GetConstantLogZPrior(meritResult->Redshifts.size());
-                priors.push_back(_prior);
-
-                //correct chi2 for ampl. marg. if necessary: todo add switch, currently deactivated
-                TFloat64List logLikelihoodCorrected(meritResult->ChiSquareIntermediate.size(), DBL_MAX);
-                for ( UInt32 kz=0; kz<meritResult->Redshifts.size(); kz++)
+                for(Int32 kigm=0; kigm<nIGM; kigm++)
                 {
-                    logLikelihoodCorrected[kz] = meritResult->ChiSquareIntermediate[kz][kism][kigm];// + resultXXX->ScaleMargCorrectionTplshapes[][]?;
+                    TFloat64List _prior;
+                    _prior = pdfz.GetConstantLogZPrior(meritResult->Redshifts.size());
+
+                    //correct chi2 for ampl. marg. if necessary: todo add switch, currently deactivated
+                    TFloat64List logLikelihoodCorrected(meritResult->ChiSquareIntermediate.size(), DBL_MAX);
+                    for ( UInt32 kz=0; kz<meritResult->Redshifts.size(); kz++)
+                    {
+                        logLikelihoodCorrected[kz] = meritResult->ChiSquareIntermediate[kz][kism][kigm];// + resultXXX->ScaleMargCorrectionTplshapes[][]?;
+                    }
+                    priors.push_back(_prior);
+                    chiSquares.push_back(logLikelihoodCorrected);
+                    nMerits++;
+                    Log.LogDetail("    chisquarelogsolve: Pdfz combine - prepared merit  #%d for model : %s, ism=%d, igm=%d", nMerits-1, ((*it).first).c_str(), kism, kigm);
                 }
-                chiSquares.push_back(logLikelihoodCorrected);
-                Log.LogDetail("    chisquarelogsolve: Pdfz combine - prepared merit  #%d for model : %s, ism=%d, igm=%d", chiSquares.size()-1, ((*it).first).c_str(), kism, kigm);
             }
         }
     }
 
-    if(chiSquares.size()>0)
+    if(nMerits>0)
     {
         if(opt_combine=="marg")
         {
             Log.LogInfo("    chisquarelogsolve: Pdfz combination - Marginalization");
-            retPdfz = pdfz.Marginalize( redshifts, chiSquares, priors, cstLog, postmargZResult);
+            retPdfz = marginalizer.Finalize(postmargZResult);
         }else if(opt_combine=="bestchi2")
         {
             Log.LogInfo("    chisquarelogsolve: Pdfz combination - BestChi2");
@@ -378,7 +453,7 @@ Int32 CMethodChisquareLogSolve::CombinePDF(CDataStore &store, std::string scopeS
         }
     }else
     {
-        Log.LogError("    chisquarelogsolve: Unable to find any chisquares prepared for combination. chiSquares.size()=%d", chiSquares.size());
+        Log.LogError("    chisquarelogsolve: Unable to find any chisquares prepared for combination. chiSquares.size()=%d", nMerits);
     }
 
 
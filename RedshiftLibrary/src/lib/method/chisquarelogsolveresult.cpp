@@ -168,6 +168,27 @@ void CChisquareLogSolveResult::SaveLine( const CDataStore& store, std::ostream&
 
 }
 
+/**
+ * Gets the best redshift and merit, selected as in SaveLine.
+ */
+Bool CChisquareLogSolveResult::GetRedshiftResult( const CDataStore& store, Float64& redshift, Float64& merit ) const
+{
+    std::string tplName;
+    Float64 amplitude;
+    Float64 dustCoeff;
+    Int32 meiksinIdx;
+    Float64 evidence;
+
+    if(m_bestRedshiftMethod==0)
+    {
+        return GetBestRedshift( store, redshift, merit, tplName, amplitude, dustCoeff, meiksinIdx );
+    }else if(m_bestRedshiftMethod==2)
+    {
+        return GetBestRedshiftFromPdf( store, redshift, merit, evidence );
+    }
+    return false;
+}
+
 Bool CChisquareLogSolveResult::GetBestRedshift(const CDataStore& store, Float64& redshift, Float64& merit, std::string& tplName, Float64 &amplitude, Float64 &dustCoeff, Int32 &meiksinIdx ) const
 {
     std::string scopeStr;
@@ -105,6 +105,15 @@ void CChisquareSolveResult::SaveLine( const CDataStore& store, std::ostream& str
                 << "-1" << std::endl; //reliability label
 }
 
+/**
+ * Gets the best redshift and merit, selected as in SaveLine.
+ */
+Bool CChisquareSolveResult::GetRedshiftResult( const CDataStore& store, Float64& redshift, Float64& merit ) const
+{
+    std::string tplName;
+    return GetBestRedshift( store, redshift, merit, tplName );
+}
+
 Bool CChisquareSolveResult::GetBestRedshift( const CDataStore& store, Float64& redshift, Float64& merit, std::string& tplName ) const
 {
 
@@ -33,6 +33,7 @@ std::shared_ptr<CCorrelationSolveResult>  COperatorCorrelationSolve::Compute(  C
     if(overlapThreshold==-1.0){
         resultStore.GetScopedParam( "overlapThreshold", overlapThreshold, 1.0 );
     }
+    resultStore.GetScopedParam( "fft", m_opt_fft, "no" );
 
     for( UInt32 i=0; i<tplCategoryList.size(); i++ )
     {
@@ -77,6 +78,7 @@ Bool COperatorCorrelationSolve::Solve( CDataStore& resultStore, const CSpectrum&
 
     // Compute correlation factor at each of those redshifts
     COperatorCorrelation correlation;
+    correlation.EnableFFT( m_opt_fft == "yes" );
     auto result = dynamic_pointer_cast<CCorrelationResult>( correlation.Compute( spcWithoutCont, tplWithoutCont, lambdaRange, redshifts, overlapThreshold, maskList ) );
 
     if( !result )
@@ -54,6 +54,15 @@ void CCorrelationSolveResult::SaveLine( const CDataStore& store, std::ostream& s
                 << "-1" << std::endl; //reliability label
 }
 
+/**
+ * Gets the best redshift and merit, selected as in SaveLine.
+ */
+Bool CCorrelationSolveResult::GetRedshiftResult( const CDataStore& store, Float64& redshift, Float64& merit ) const
+{
+    std::string tplName;
+    return GetBestCorrelationResult( store, redshift, merit, tplName );
+}
+
 
 Bool CCorrelationSolveResult::GetBestCorrelationResult( const CDataStore& store, Float64& redshift, Float64& merit, std::string& tplName ) const
 {
@@ -32,6 +32,20 @@ void CDTree7SolveResult::SaveLine( const CDataStore& store, std::ostream& stream
     Results.lock()->SaveLine(store, stream);
 }
 
+/**
+ * Gets the best redshift and merit, selected as in SaveLine.
+ */
+Bool CDTree7SolveResult::GetRedshiftResult( const CDataStore& store, Float64& redshift, Float64& merit ) const
+{
+    std::string scope = store.GetScope( *this ) + "dtree7solve.redshiftresult";
+    auto result = store.GetGlobalResult( scope.c_str() ).lock();
+    if( !result )
+    {
+        return false;
+    }
+    return result->GetRedshiftResult( store, redshift, merit );
+}
+
 
 
 
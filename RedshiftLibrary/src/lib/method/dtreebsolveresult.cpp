@@ -62,6 +62,15 @@ void CDTreeBSolveResult::SaveLine( const CDataStore& store, std::ostream& stream
     Log.LogInfo( "DecisionalTreeB Solution: best z found = %.5f", redshift);
 }
 
+/**
+ * Gets the best redshift and merit, selected as in SaveLine.
+ */
+Bool CDTreeBSolveResult::GetRedshiftResult( const CDataStore& store, Float64& redshift, Float64& merit ) const
+{
+    std::string dtreepath;
+    return GetBestRedshift( store, redshift, merit, dtreepath );
+}
+
 
 Bool CDTreeBSolveResult::GetBestRedshift(const CDataStore& store, Float64& redshift, Float64& merit , std::string &dtreepath) const
 {
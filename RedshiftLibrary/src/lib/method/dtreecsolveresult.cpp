@@ -65,6 +65,16 @@ void CDTreeCSolveResult::SaveLine( const CDataStore& store, std::ostream& stream
     Log.LogInfo( "DecisionalTreeC Solution: best z found = %.5f", redshift);
 }
 
+/**
+ * Gets the best redshift and merit, selected as in SaveLine.
+ */
+Bool CDTreeCSolveResult::GetRedshiftResult( const CDataStore& store, Float64& redshift, Float64& merit ) const
+{
+    std::string tplName;
+    std::string dtreepath;
+    return GetBestRedshift( store, redshift, merit, tplName, dtreepath );
+}
+
 
 Bool CDTreeCSolveResult::GetBestRedshift(const CDataStore& store, Float64& redshift, Float64& merit , std::string &tplName, std::string &dtreepath) const
 {
@@ -54,6 +54,14 @@ void CLineMatching2SolveResult::SaveLine( const CDataStore& store, std::ostream&
 	   << "LineMatching2Solve" << std::endl;
 }
 
+/**
+ * Gets the best redshift and merit, selected as in SaveLine.
+ */
+Bool CLineMatching2SolveResult::GetRedshiftResult( const CDataStore& store, Float64& redshift, Float64& merit ) const
+{
+    return GetBestResult( store, redshift, merit );
+}
+
 /**
  * Wrapper around CRayMatchingResult::GetBestRedshift.
  */
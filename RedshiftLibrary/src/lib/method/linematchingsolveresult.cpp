@@ -46,6 +46,14 @@ void CLineMatchingSolveResult::SaveLine( const CDataStore& store, std::ostream&
                 << "LineMatchingSolve" << std::endl;
 }
 
+/**
+ * Gets the best redshift and merit, selected as in SaveLine.
+ */
+Bool CLineMatchingSolveResult::GetRedshiftResult( const CDataStore& store, Float64& redshift, Float64& merit ) const
+{
+    return GetBestResult( store, redshift, merit );
+}
+
 Bool CLineMatchingSolveResult::GetBestResult(const CDataStore& store, Float64& redshift, Float64& merit) const
 {
     std::string scope = store.GetScope( *this ) + "linematchingsolve.raymatching";
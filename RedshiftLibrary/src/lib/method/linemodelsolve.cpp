@@ -1,4 +1,5 @@
 #include <RedshiftLibrary/method/linemodelsolve.h>
+#include <RedshiftLibrary/processflow/referencecatalog.h>
 
 #include <RedshiftLibrary/log/log.h>
 
@@ -8,6 +9,7 @@
 #include <RedshiftLibrary/processflow/datastore.h>
 
 #include <RedshiftLibrary/statistics/pdfz.h>
+#include <RedshiftLibrary/statistics/pdfzmarginalizer.h>
 #include <RedshiftLibrary/operator/pdfLogresult.h>
 
 #include <boost/tokenizer.hpp>
@@ -74,12 +76,16 @@ const std::string CLineModelSolve::GetDescription()
     desc.append("\tparam: linemodel.absvelocityfitmin = <float value>\n");
     desc.append("\tparam: linemodel.absvelocityfitmax = <float value>\n");
     desc.append("\tparam: linemodel.absvelocityfitstep = <float value>\n");
+    desc.append("\tparam: linemodel.velocityfitsearch = {""grid"", ""coarsetofine""}\n");
     //first pass
     desc.append("\tparam: linemodel.firstpass.largegridstep = <float value>, deactivated if negative or zero\n");
     desc.append("\tparam: linemodel.firstpass.tplratio_ismfit = {""no"", ""yes""}\n");
     desc.append("\tparam: linemodel.firstpass.multiplecontinuumfit_disable = {""no"", ""yes""}\n");
+    desc.append("\tparam: linemodel.firstpass.pruning = {""no"", ""yes""}\n");
+    desc.append("\tparam: linemodel.firstpass.pruningtolerance = <float value>, chi2 margin above the best merit\n");
 
     desc.append("\tparam: linemodel.skipsecondpass = {""no"", ""yes""}\n");
+    desc.append("\tparam: linemodel.secondpass.threadcount = <int value>, number of candidates refined concurrently, 0 to refine them one after the other\n");
 
     desc.append("\tparam: linemodel.pdfcombination = {""marg"", ""bestchi2""}\n");
     desc.append("\tparam: linemodel.stronglinesprior = <float value>, penalization factor = positive value or -1 to deactivate\n");
@@ -104,10 +110,13 @@ Bool CLineModelSolve::PopulateParameters( CDataStore& dataStore )
     dataStore.GetScopedParam( "linemodel.fittingmethod", m_opt_fittingmethod, "hybrid" );
     dataStore.GetScopedParam( "linemodel.secondpasslcfittingmethod", m_opt_secondpasslcfittingmethod, "no" );
     dataStore.GetScopedParam( "linemodel.skipsecondpass", m_opt_skipsecondpass, "no" );
+    dataStore.GetScopedParam( "linemodel.secondpass.threadcount", m_opt_secondpass_threadcount, 0 );
     dataStore.GetScopedParam( "linemodel.firstpass.fittingmethod", m_opt_firstpass_fittingmethod, "hybrid" );
     dataStore.GetScopedParam( "linemodel.firstpass.largegridstep", m_opt_firstpass_largegridstep, 0.001 );
     dataStore.GetScopedParam( "linemodel.firstpass.tplratio_ismfit", m_opt_firstpass_tplratio_ismfit, "no" );
     dataStore.GetScopedParam( "linemodel.firstpass.multiplecontinuumfit_disable", m_opt_firstpass_disablemultiplecontinuumfit, "yes" );
+    dataStore.GetScopedParam( "linemodel.firstpass.pruning", m_opt_firstpass_pruning, "no" );
+    dataStore.GetScopedParam( "linemodel.firstpass.pruningtolerance", m_opt_firstpass_pruningtolerance, 100.0 );
 
     std::string redshiftSampling;
     dataStore.GetParam( "redshiftsampling", redshiftSampling, "lin" ); //TODO: sampling in log cannot be used for now as zqual descriptors assume constant dz.
@@ -146,6 +155,7 @@ Bool CLineModelSolve::PopulateParameters( CDataStore& dataStore )
         dataStore.GetScopedParam( "linemodel.absvelocityfitmin", m_opt_abs_velocity_fit_min, 150.0 );
         dataStore.GetScopedParam( "linemodel.absvelocityfitmax", m_opt_abs_velocity_fit_max, 500.0 );
         dataStore.GetScopedParam( "linemodel.absvelocityfitstep", m_opt_abs_velocity_fit_step, 20.0 );
+        dataStore.GetScopedParam( "linemodel.velocityfitsearch", m_opt_velocity_fit_search, "grid" );
     }
     dataStore.GetScopedParam( "linemodel.continuumreestimation", m_opt_continuumreest, "no" );
     dataStore.GetScopedParam( "linemodel.rules", m_opt_rules, "all" );
@@ -203,6 +213,7 @@ Bool CLineModelSolve::PopulateParameters( CDataStore& dataStore )
         Log.LogInfo( "    -abs velocity fit min : %.1f", m_opt_abs_velocity_fit_min);
         Log.LogInfo( "    -abs velocity fit max : %.1f", m_opt_abs_velocity_fit_max);
         Log.LogInfo( "    -abs velocity fit step : %.1f", m_opt_abs_velocity_fit_step);
+        Log.LogInfo( "    -velocity fit search : %s", m_opt_velocity_fit_search.c_str());
     }
 
     Log.LogInfo( "    -rigidity: %s", m_opt_rigidity.c_str());
@@ -231,9 +242,15 @@ Bool CLineModelSolve::PopulateParameters( CDataStore& dataStore )
     Log.LogInfo( "      -fittingmethod: %s", m_opt_firstpass_fittingmethod.c_str());
     Log.LogInfo( "      -tplratio_ismfit: %s", m_opt_firstpass_tplratio_ismfit.c_str());
     Log.LogInfo( "      -multiplecontinuumfit_disable: %s", m_opt_firstpass_disablemultiplecontinuumfit.c_str());
+    Log.LogInfo( "      -pruning: %s", m_opt_firstpass_pruning.c_str());
+    if(m_opt_firstpass_pruning=="yes")
+    {
+        Log.LogInfo( "      -pruningtolerance: %.1f", m_opt_firstpass_pruningtolerance);
+    }
 
 
     Log.LogInfo( "    -skip second pass: %s", m_opt_skipsecondpass.c_str());
+    Log.LogInfo( "    -second pass threadcount: %d", (Int32)m_opt_secondpass_threadcount);
 
     Log.LogInfo( "    -pdf-stronglinesprior: %e", m_opt_stronglinesprior);
     Log.LogInfo( "    -pdf-euclidNHaEmittersPriorStrength: %e", m_opt_euclidNHaEmittersPriorStrength);
@@ -436,7 +453,10 @@ Int32 CLineModelSolve::CombinePDF(std::shared_ptr<const CLineModelResult> result
     else if(opt_combine=="bestproba" || opt_combine=="marg"){
 
         Log.LogInfo("Linemodel: Pdfz computation - combination: method=%s, n=%d", opt_combine.c_str(), result->ChiSquareTplshapes.size());
+        Bool useModelPriors = (result->PriorTplshapes.size()==result->ChiSquareTplshapes.size());
+        CPdfzMarginalizer marginalizer;
         std::vector<TFloat64List> zpriorsTplshapes;
+        std::vector<TFloat64List> ChiSquareTplshapesCorrected;
         for(Int32 k=0; k<result->ChiSquareTplshapes.size(); k++)
         {
             TFloat64List _prior;
@@ -454,24 +474,27 @@ Int32 CLineModelSolve::CombinePDF(std::shared_ptr<const CLineModelResult> result
                 std::vector<Float64> zlogPriorNHa = pdfz.GetEuclidNhaLogZPrior(result->Redshifts, opt_euclidNHaEmittersPriorStrength);
                 _prior = pdfz.CombineLogZPrior(_prior, zlogPriorNHa);
             }
-            zpriorsTplshapes.push_back(_prior);
-        }
 
-        //correct chi2 if necessary: todo add switch
-        std::vector<TFloat64List> ChiSquareTplshapesCorrected;
-        for(Int32 k=0; k<result->ChiSquareTplshapes.size(); k++)
-        {
-            TFloat64List logLikelihoodCorrected(result->ChiSquareTplshapes[k].size(), DBL_MAX);
-            for ( UInt32 kz=0; kz<result->Redshifts.size(); kz++)
+            //correct chi2 if necessary: todo add switch
+            if(opt_combine=="marg")
             {
-                logLikelihoodCorrected[kz] = result->ChiSquareTplshapes[k][kz];// + result->ScaleMargCorrectionTplshapes[k][kz];
+                //streamed into the marginalization, neither the prior nor the merit curve are kept
+                marginalizer.Add(result->Redshifts, result->ChiSquareTplshapes[k], _prior, cstLog, useModelPriors ? result->PriorTplshapes[k] : -1.0);
+            }else
+            {
+                TFloat64List logLikelihoodCorrected(result->ChiSquareTplshapes[k].size(), DBL_MAX);
+                for ( UInt32 kz=0; kz<result->Redshifts.size(); kz++)
+                {
+                    logLikelihoodCorrected[kz] = result->ChiSquareTplshapes[k][kz];// + result->ScaleMargCorrectionTplshapes[k][kz];
+                }
+                ChiSquareTplshapesCorrected.push_back(logLikelihoodCorrected);
+                zpriorsTplshapes.push_back(_prior);
             }
-            ChiSquareTplshapesCorrected.push_back(logLikelihoodCorrected);
         }
 
         if(opt_combine=="marg")
         {
-            retPdfz = pdfz.Marginalize( result->Redshifts, ChiSquareTplshapesCorrected, zpriorsTplshapes, cstLog, postmargZResult, result->PriorTplshapes);
+            retPdfz = marginalizer.Finalize(postmargZResult);
         }else{
             retPdfz = pdfz.BestProba( result->Redshifts, ChiSquareTplshapesCorrected, zpriorsTplshapes, cstLog, postmargZResult);
         }
@@ -541,79 +564,22 @@ Int32 CLineModelSolve::SaveContinuumPDF(CDataStore &store, std::shared_ptr<const
  **/
 Int32 getVelocitiesFromRefFile( const char* filePath, std::string spcid, Float64& elv, Float64& alv )
 {
-    ifstream file;
-
-    file.open( filePath, ifstream::in );
-    if( file.rdstate() & ios_base::failbit )
+    std::shared_ptr<const CReferenceCatalog> refCatalog = CReferenceCatalog::GetShared( filePath );
+    if( !refCatalog )
         return false;
 
-    string line;
-
-    // Read file line by line
-    while( getline( file, line ) )
+    // the velocities are in columns 8 and 9, each one read from the spectrum row that FindRow gives for its column. A
+    // velocity missing from all the spectrum rows is left untouched
+    if( refCatalog->FindRow( spcid, 0, 8 )>=0 && !refCatalog->GetValue( spcid, 8, elv ) )
     {
-        // remove comments
-        if(line.compare(0,1,"#",1)==0){
-            continue;
-        }
-        char_separator<char> sep(" \t");
-
-        // Tokenize each line
-        typedef tokenizer< char_separator<char> > ttokenizer;
-        ttokenizer tok( line, sep );
-
-        // Check if it's not a comment
-        ttokenizer::iterator it = tok.begin();
-        if( it != tok.end() && *it != "#" )
-        {
-            string name;
-            if( it != tok.end() )
-            {
-                name = *it;
-            }
-            std::size_t foundstr = name.find(spcid.c_str());
-            if (foundstr==std::string::npos){
-                continue;
-            }
-
-            // Found the correct spectrum ID: now read the ref values
-            Int32 nskip = 7;
-            for(Int32 i=0; i<nskip; i++)
-            {
-                ++it;
-            }
-            if( it != tok.end() )
-            {
-
-                elv = 0.0;
-                try
-                {
-                    elv = lexical_cast<double>(*it);
-                }
-                catch (bad_lexical_cast&)
-                {
-                    elv = 0.0;
-                    return false;
-                }
-            }
-            ++it;
-            if( it != tok.end() )
-            {
-                alv = 0.0;
-                try
-                {
-                    alv = lexical_cast<double>(*it);
-                }
-                catch (bad_lexical_cast&)
-                {
-                    alv = 0.0;
-                    return false;
-                }
-
-            }
-        }
+        elv = 0.0;
+        return false;
+    }
+    if( refCatalog->FindRow( spcid, 0, 9 )>=0 && !refCatalog->GetValue( spcid, 9, alv ) )
+    {
+        alv = 0.0;
+        return false;
     }
-    file.close();
     return true;
 }
 
@@ -674,6 +640,10 @@ Bool CLineModelSolve::Solve( CDataStore& dataStore,
         return false;
     }
     linemodel.m_opt_firstpass_fittingmethod=m_opt_firstpass_fittingmethod;
+    linemodel.m_opt_firstpass_pruning=Int32(m_opt_firstpass_pruning=="yes");
+    linemodel.m_opt_firstpass_pruningTolerance=m_opt_firstpass_pruningtolerance;
+    linemodel.m_opt_secondpass_threadCount=m_opt_secondpass_threadcount;
+    linemodel.m_opt_secondpass_velfitSearch=m_opt_velocity_fit_search;
     //
     if(m_opt_continuumcomponent=="tplfit"){
         linemodel.m_opt_tplfit_dustFit = Int32(m_opt_tplfit_dustfit=="yes");
@@ -112,6 +112,29 @@ void CLineModelSolveResult::SaveLine( const CDataStore& store, std::ostream& str
         << m_TypeLabel << std::endl;
 }
 
+/**
+ * Gets the best redshift and merit, selected as in SaveLine.
+ */
+Bool CLineModelSolveResult::GetRedshiftResult( const CDataStore& store, Float64& redshift, Float64& merit ) const
+{
+    std::string tplratioName;
+    std::string tplcontinuumName;
+    Float64 sigma;
+    Float64 snrHa;
+    Float64 lfHa;
+    Float64 snrOII;
+    Float64 lfOII;
+
+    if(m_bestRedshiftMethod==0)
+    {
+        return GetBestRedshift( store, redshift, merit, sigma, snrHa, lfHa, snrOII, lfOII );
+    }else if(m_bestRedshiftMethod==2)
+    {
+        return GetBestRedshiftFromPdf( store, redshift, merit, sigma, snrHa, lfHa, snrOII, lfOII, tplratioName, tplcontinuumName );
+    }
+    return false;
+}
+
 /**
  * \brief Searches all the results for the first one with the lowest value of merit, and uses it to update the argument references.
  * Construct the scope string for the Linemodel results.
@@ -68,6 +68,15 @@ void CLineModelTplshapeSolveResult::SaveLine( const CDataStore& store, std::ostr
         << "LineModeltplshapeSolve" << std::endl;
 }
 
+/**
+ * Gets the best redshift and merit, selected as in SaveLine.
+ */
+Bool CLineModelTplshapeSolveResult::GetRedshiftResult( const CDataStore& store, Float64& redshift, Float64& merit ) const
+{
+    std::string tplName;
+    return GetBestRedshift( store, redshift, merit, tplName );
+}
+
 /**
  * \brief Searches all the results for the first one with the lowest value of merit, and uses it to update the argument references.
  * Construct the scope string for the Linemodel results.
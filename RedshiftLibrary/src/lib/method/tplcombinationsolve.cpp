@@ -8,6 +8,7 @@
 #include <RedshiftLibrary/extremum/extremum.h>
 #include <RedshiftLibrary/processflow/datastore.h>
 #include <RedshiftLibrary/statistics/pdfz.h>
+#include <RedshiftLibrary/statistics/pdfzmarginalizer.h>
 
 #include <RedshiftLibrary/spectrum/io/fitswriter.h>
 #include <float.h>
@@ -38,6 +39,7 @@ const std::string CMethodTplcombinationSolve::GetDescription()
     //desc.append("\tparam: tplcombinationsolve.dustfit = {""yes"", ""no""}\n");
     //desc.append("\tparam: tplcombinationsolve.pdfcombination = {""marg"", ""bestchi2""}\n");
     desc.append("\tparam: tplcombinationsolve.saveintermediateresults = {""yes"", ""no""}\n");
+    desc.append("\tparam: tplcombinationsolve.threadcount = <int value>\n");
 
 
     return desc;
@@ -82,6 +84,9 @@ std::shared_ptr<CTplcombinationSolveResult> CMethodTplcombinationSolve::Compute(
 
     resultStore.GetScopedParam( "pdfcombination", m_opt_pdfcombination, "marg");
     resultStore.GetScopedParam( "saveintermediateresults", m_opt_saveintermediateresults, "no");
+    Int64 threadCount;
+    resultStore.GetScopedParam( "threadcount", threadCount, 0 );
+    m_tplcombinationOperator->m_opt_threadCount = threadCount;
     if(m_opt_saveintermediateresults=="yes")
     {
         m_opt_enableSaveIntermediateChisquareResults = true;
@@ -189,17 +194,12 @@ Bool CMethodTplcombinationSolve::Solve(CDataStore& resultStore,
     }
 
     //prepare the list of components/templates
-    std::vector<CTemplate> tplList;
-    for( UInt32 i=0; i<tplCategoryList.size(); i++ )
+    // the templates are shared with the catalog (no copy), so that their precomputed fine grids are reused
+    TTemplateConstRefList tplList;
+    TTemplateRefList catalogTplList = tplCatalog.GetTemplate( tplCategoryList );
+    for( UInt32 i=0; i<catalogTplList.size(); i++ )
     {
-        std::string category = tplCategoryList[i];
-
-        for( UInt32 j=0; j<tplCatalog.GetTemplateCount( category ); j++ )
-        {
-            const CTemplate& tpl = tplCatalog.GetTemplate( category, j );
-            CTemplate _tpl=tpl;
-            tplList.push_back(_tpl);
-        }
+        tplList.push_back( catalogTplList[i] );
     }
 
     //case: nType_all
@@ -279,6 +279,8 @@ Int32 CMethodTplcombinationSolve::CombinePDF(CDataStore &store, std::string scop
     std::vector<TFloat64List> priors;
     std::vector<TFloat64List> chiSquares;
     std::vector<Float64> redshifts;
+    CPdfzMarginalizer marginalizer;
+    Int32 nMerits = 0;
     {
         Int32 nISM = -1;
         Int32 nIGM = -1;
@@ -309,7 +311,6 @@ Int32 CMethodTplcombinationSolve::CombinePDF(CDataStore &store, std::string scop
             {
                 TFloat64List _prior;
                 _prior = pdfz.GetConstantLogZPrior(result->Redshifts.size());
-                priors.push_back(_prior);
 
                 //correct chi2 for ampl. marg. if necessary: todo add switch, currently deactivated
                 TFloat64List logLikelihoodCorrected(result->ChiSquareIntermediate.size(), DBL_MAX);
@@ -317,18 +318,27 @@ Int32 CMethodTplcombinationSolve::CombinePDF(CDataStore &store, std::string scop
                 {
                     logLikelihoodCorrected[kz] = result->ChiSquareIntermediate[kz][kism][kigm];// + resultXXX->ScaleMargCorrectionTplshapes[][]?;
                 }
-                chiSquares.push_back(logLikelihoodCorrected);
-                Log.LogDetail("    tplcombinationsolve: Pdfz combine - prepared merit #%d for ism=%d, igm=%d", chiSquares.size()-1, kism, kigm);
+                if(opt_combine=="marg")
+                {
+                    //streamed into the marginalization, the merit curve is not kept
+                    marginalizer.Add(redshifts, logLikelihoodCorrected, _prior, cstLog);
+                }else
+                {
+                    priors.push_back(_prior);
+                    chiSquares.push_back(logLikelihoodCorrected);
+                }
+                nMerits++;
+                Log.LogDetail("    tplcombinationsolve: Pdfz combine - prepared merit #%d for ism=%d, igm=%d", nMerits-1, kism, kigm);
             }
         }
     }
 
-    if(chiSquares.size()>0)
+    if(nMerits>0)
     {
         if(opt_combine=="marg")
         {
             Log.LogInfo("    tplcombinationsolve: Pdfz combination - Marginalization");
-            retPdfz = pdfz.Marginalize( redshifts, chiSquares, priors, cstLog, postmargZResult);
+            retPdfz = marginalizer.Finalize(postmargZResult);
         }else if(opt_combine=="bestchi2")
         {
             Log.LogInfo("    tplcombinationsolve: Pdfz combination - BestChi2");
@@ -338,7 +348,7 @@ Int32 CMethodTplcombinationSolve::CombinePDF(CDataStore &store, std::string scop
         }
     }else
     {
-        Log.LogError("    tplcombinationsolve: Unable to find any chisquares prepared for combination. chiSquares.size()=%d", chiSquares.size());
+        Log.LogError("    tplcombinationsolve: Unable to find any chisquares prepared for combination. chiSquares.size()=%d", nMerits);
     }
 
 
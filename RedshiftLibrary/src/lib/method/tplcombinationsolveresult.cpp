@@ -164,6 +164,27 @@ void CTplcombinationSolveResult::SaveLine( const CDataStore& store, std::ostream
 
 }
 
+/**
+ * Gets the best redshift and merit, selected as in SaveLine.
+ */
+Bool CTplcombinationSolveResult::GetRedshiftResult( const CDataStore& store, Float64& redshift, Float64& merit ) const
+{
+    std::string tplName;
+    Float64 amplitude;
+    Float64 dustCoeff;
+    Int32 meiksinIdx;
+    Float64 evidence;
+
+    if(m_bestRedshiftMethod==0)
+    {
+        return GetBestRedshift( store, redshift, merit, tplName, amplitude, dustCoeff, meiksinIdx );
+    }else if(m_bestRedshiftMethod==2)
+    {
+        return GetBestRedshiftFromPdf( store, redshift, merit, evidence );
+    }
+    return false;
+}
+
 Bool CTplcombinationSolveResult::GetBestRedshift( const CDataStore& store, Float64& redshift, Float64& merit, std::string& tplName, Float64& amplitude, Float64& dustCoeff, Int32& meiksinIdx ) const
 {
     std::string scopeStr;
@@ -1,4 +1,5 @@
 #include <RedshiftLibrary/method/zweimodelsolve.h>
+#include <RedshiftLibrary/processflow/referencecatalog.h>
 
 #include <RedshiftLibrary/log/log.h>
 #include <RedshiftLibrary/spectrum/io/genericreader.h>
@@ -450,161 +451,22 @@ Int32 CZweiModelSolve::SaveContinuumPDF(CDataStore &store, std::shared_ptr<const
  **/
 Int32 CZweiModelSolve::getVelocitiesFromRefFile( const char* filePath, std::string spcid, Float64& elv, Float64& alv )
 {
-    ifstream file;
-
-    file.open( filePath, ifstream::in );
-    if( file.rdstate() & ios_base::failbit )
+    std::shared_ptr<const CReferenceCatalog> refCatalog = CReferenceCatalog::GetShared( filePath );
+    if( !refCatalog )
         return false;
 
-    string line;
-
-    // Read file line by line
-    while( getline( file, line ) )
+    // the velocities are in columns 8 and 9, each one read from the spectrum row that FindRow gives for its column. A
+    // velocity missing from all the spectrum rows is left untouched
+    if( refCatalog->FindRow( spcid, 0, 8 )>=0 && !refCatalog->GetValue( spcid, 8, elv ) )
     {
-        // remove comments
-        if(line.compare(0,1,"#",1)==0){
-            continue;
-        }
-        char_separator<char> sep(" \t");
-
-        // Tokenize each line
-        typedef tokenizer< char_separator<char> > ttokenizer;
-        ttokenizer tok( line, sep );
-
-        // Check if it's not a comment
-        ttokenizer::iterator it = tok.begin();
-        if( it != tok.end() && *it != "#" )
-        {
-            string name;
-            if( it != tok.end() )
-            {
-                name = *it;
-            }
-            std::size_t foundstr = name.find(spcid.c_str());
-            if (foundstr==std::string::npos){
-                continue;
-            }
-
-            // Found the correct spectrum ID: now read the ref values
-            Int32 nskip = 7;
-            for(Int32 i=0; i<nskip; i++)
-            {
-                ++it;
-            }
-            if( it != tok.end() )
-            {
-
-                elv = 0.0;
-                try
-                {
-                    elv = lexical_cast<double>(*it);
-                }
-                catch (bad_lexical_cast&)
-                {
-                    elv = 0.0;
-                    return false;
-                }
-            }
-            ++it;
-            if( it != tok.end() )
-            {
-                alv = 0.0;
-                try
-                {
-                    alv = lexical_cast<double>(*it);
-                }
-                catch (bad_lexical_cast&)
-                {
-                    alv = 0.0;
-                    return false;
-                }
-
-            }
-        }
-    }
-    file.close();
-    return true;
-}
-
-
-/**
- * \brief
- * Retrieve the true-redshift from a hardcoded ref file path
- * nb: this is a hack for development purposes/line measurement at zref
- * reverseInclusion=0 (default): spcId is searched to be included in the Ref-File-Id
- * reverseInclusion=1 : Ref-File-Id is searched to be included in the spcId
- **/
-Int32 CZweiModelSolve::getValueFromRefFile( const char* filePath, std::string spcid, Int32 colID, Float64& zref, Int32 reverseInclusion )
-{
-    ifstream file;
-
-    file.open( filePath, ifstream::in );
-    if( file.rdstate() & ios_base::failbit )
+        elv = 0.0;
         return false;
-
-    string line;
-
-    // Read file line by line
-    while( getline( file, line ) )
+    }
+    if( refCatalog->FindRow( spcid, 0, 9 )>=0 && !refCatalog->GetValue( spcid, 9, alv ) )
     {
-        // remove comments
-        if(line.compare(0,1,"#",1)==0){
-            continue;
-        }
-        char_separator<char> sep(" \t");
-
-        // Tokenize each line
-        typedef tokenizer< char_separator<char> > ttokenizer;
-        ttokenizer tok( line, sep );
-
-        // Check if it's not a comment
-        ttokenizer::iterator it = tok.begin();
-        if( it != tok.end() && *it != "#" )
-        {
-            string name;
-            if( it != tok.end() )
-            {
-                name = *it;
-            }
-
-            if(reverseInclusion==0)
-            {
-                std::size_t foundstr = name.find(spcid.c_str());
-                if (foundstr==std::string::npos){
-                    continue;
-                }
-            }else{
-                std::size_t foundstr = spcid.find(name.c_str());
-                if (foundstr==std::string::npos){
-                    continue;
-                }
-            }
-
-            // Found the correct spectrum ID: now read the ref values
-            Int32 nskip = colID-1;
-            for(Int32 i=0; i<nskip; i++)
-            {
-                ++it;
-            }
-            if( it != tok.end() )
-            {
-
-                zref = 0.0;
-                try
-                {
-                    zref = lexical_cast<double>(*it);
-                    return true;
-                }
-                catch (bad_lexical_cast&)
-                {
-                    zref = 0.0;
-                    return false;
-                }
-            }
-
-        }
+        alv = 0.0;
+        return false;
     }
-    file.close();
     return true;
 }
 
@@ -710,7 +572,11 @@ Bool CZweiModelSolve::Solve( CDataStore& dataStore,
         {
             std::string spcSubStringId = spc.GetName().substr(substring_start, substring_n);
             Log.LogInfo( "Linemodel - hack - using substring %s", spcSubStringId.c_str());
-            getValueFromRefFile( refFilePath.c_str(), spcSubStringId, colId, zref, reverseInclusionForIdMatching);
+            std::shared_ptr<const CReferenceCatalog> refCatalog = CReferenceCatalog::GetShared( refFilePath.string() );
+            if( refCatalog )
+            {
+                refCatalog->GetValue( spcSubStringId, colId, zref, reverseInclusionForIdMatching );
+            }
         }
         if(zref==-1)
         {
@@ -1185,102 +1051,31 @@ Int32 CZweiModelSolve::getContaminantNameFromFile( const char* filePath, std::st
     contSpcFileName = "";
     contErrorFileName = "";
 
-    ifstream file;
-
-    file.open( filePath, ifstream::in );
-    if( file.rdstate() & ios_base::failbit )
+    std::shared_ptr<const CReferenceCatalog> refCatalog = CReferenceCatalog::GetShared( filePath );
+    if( !refCatalog )
         return false;
 
-    string line;
-
-    // Read file line by line
-    while( getline( file, line ) )
+    // the contaminant spectrum name follows column colID+1 of the spectrum row, then the lambda offset
+    if( !refCatalog->GetValue( spcid, colID+1, contSpcFileName, reverseInclusion ) )
     {
-        // remove comments
-        if(line.compare(0,1,"#",1)==0){
-            continue;
-        }
-        char_separator<char> sep(" \t");
-
-        // Tokenize each line
-        typedef tokenizer< char_separator<char> > ttokenizer;
-        ttokenizer tok( line, sep );
-
-        // Check if it's not a comment
-        ttokenizer::iterator it = tok.begin();
-        if( it != tok.end() && *it != "#" )
-        {
-            string name;
-            if( it != tok.end() )
-            {
-                name = *it;
-            }
-
-            if(reverseInclusion==0)
-            {
-                std::size_t foundstr = name.find(spcid.c_str());
-                if (foundstr==std::string::npos){
-                    continue;
-                }
-            }else{
-                std::size_t foundstr = spcid.find(name.c_str());
-                if (foundstr==std::string::npos){
-                    continue;
-                }
-            }
-
-            // Found the correct spectrum ID: now read the ref values
-            Int32 nskip = colID;
-            for(Int32 i=0; i<nskip; i++)
-            {
-                ++it;
-            }
-            if( it != tok.end() )
-            {
-
-                try
-                {
-                    contSpcFileName = *it;
-
-                    size_t pos = contSpcFileName.find( "_F" );
-                    if ( pos != string::npos ) {
-                        contErrorFileName = contSpcFileName;
-                        contErrorFileName.replace( pos, 2, "_ErrF" );
-                    }else{
-                        contErrorFileName = "";
-                        Log.LogError( "Failed to find spc tag in contaminant name" );
-                        return false;
-                    }
-
-                    //now read the lambda offset
-                    ++it;
-                    if( it != tok.end() )
-                    {
-                        try
-                        {
-                            offsetLambdaContaminant = lexical_cast<double>(*it);
-                        }
-                        catch (bad_lexical_cast&)
-                        {
-                            return false;
-                        }
-                    }else{
-                        Log.LogError( "Failed to find offsetLambdaContaminant value for the given contaminant spectrum" );
-                        return false;
-                    }
-
-                    file.close();
-                    return true;
-                }
-                catch (bad_lexical_cast&)
-                {
-                    return false;
-                }
-            }
+        return true;
+    }
 
-        }
+    size_t pos = contSpcFileName.find( "_F" );
+    if ( pos != string::npos ) {
+        contErrorFileName = contSpcFileName;
+        contErrorFileName.replace( pos, 2, "_ErrF" );
+    }else{
+        contErrorFileName = "";
+        Log.LogError( "Failed to find spc tag in contaminant name" );
+        return false;
     }
-    file.close();
 
+    //now read the lambda offset
+    if( !refCatalog->GetValue( spcid, colID+2, offsetLambdaContaminant, reverseInclusion ) )
+    {
+        Log.LogError( "Failed to read offsetLambdaContaminant value for the given contaminant spectrum" );
+        return false;
+    }
     return true;
 }
@@ -113,13 +113,14 @@ void COperatorChiSquare::BasicFit( const CSpectrum& spectrum, const CTemplate& t
     Float64 err2 = 0.0;
     Float64 fit = 0;
     Int32 numDevs = 0;
-    const TFloat64List& error = spcFluxAxis.GetError();
+    const Float64* invErr2 = spcFluxAxis.GetInverseVariance();
+    const Float64* YspcOverErr2 = spcFluxAxis.GetWeightedFlux();
 
     while( j<spcSpectralAxis.GetSamplesCount() && Xspc[j] <= currentRange.GetEnd() )
     {
         numDevs++;
-        err2 = 1.0 / (error[j] * error[j]);
-        sumYDevs+=Yspc[j]*err2;
+        err2 = invErr2[j];
+        sumYDevs+=YspcOverErr2[j];
         sumXDevs+=Ytpl[j]*err2;
 
         j++;
@@ -145,7 +146,7 @@ void COperatorChiSquare::BasicFit( const CSpectrum& spectrum, const CTemplate& t
         int k=j;
         {
             // fit
-            fit += pow( Yspc[j] - ampl * Ytpl[k] , 2.0 ) / pow( error[j], 2.0 );
+            fit += pow( Yspc[j] - ampl * Ytpl[k] , 2.0 ) * invErr2[j];
             s += Yspc[j];
         }
         j++;
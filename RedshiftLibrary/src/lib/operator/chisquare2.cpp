@@ -59,8 +59,7 @@ COperatorChiSquare2::~COperatorChiSquare2()
 /**
  * @brief COperatorChiSquare2::BasicFit
  * @param spectrum
- * @param tpl
- * @param pfgTplBuffer
+ * @param tpl : with opt_interp='precomputedfinegrid', its precomputed fine grid is used (built on first use)
  * @param lambdaRange
  * @param redshift
  * @param overlapThreshold
@@ -83,7 +82,6 @@ COperatorChiSquare2::~COperatorChiSquare2()
  */
 void COperatorChiSquare2::BasicFit(const CSpectrum& spectrum,
                                    const CTemplate& tpl,
-                                   Float64* pfgTplBuffer,
                                    const TFloat64Range& lambdaRange,
                                    Float64 redshift,
                                    Float64 overlapThreshold,
@@ -161,7 +159,18 @@ void COperatorChiSquare2::BasicFit(const CSpectrum& spectrum,
     CMask& itplMask = m_mskRebined_bf;
 
     //CSpectrumFluxAxis::Rebin( intersectedLambdaRange, tplFluxAxis, shiftedTplSpectralAxis, spcSpectralAxis, itplTplFluxAxis, itplTplSpectralAxis, itplMask );
-    CSpectrumFluxAxis::Rebin2( intersectedLambdaRange, tplFluxAxis, pfgTplBuffer, redshift, m_shiftedTplSpectralAxis_bf, spcSpectralAxis, itplTplFluxAxis, itplTplSpectralAxis, itplMask, opt_interp );
+    if( opt_interp=="precomputedfinegrid" && tpl.GetFineGridSinglePrecision() )
+    {
+        CSpectrumFluxAxis::Rebin2SinglePrecision( intersectedLambdaRange, tplFluxAxis, tpl.GetFineGridFluxSinglePrecision(), redshift, m_shiftedTplSpectralAxis_bf, spcSpectralAxis, itplTplFluxAxis, itplTplSpectralAxis, itplMask, opt_interp );
+    }else
+    {
+        const Float64* pfgTplBuffer = NULL;
+        if( opt_interp=="precomputedfinegrid" )
+        {
+            pfgTplBuffer = tpl.GetFineGridFlux();
+        }
+        CSpectrumFluxAxis::Rebin2( intersectedLambdaRange, tplFluxAxis, pfgTplBuffer, redshift, m_shiftedTplSpectralAxis_bf, spcSpectralAxis, itplTplFluxAxis, itplTplSpectralAxis, itplMask, opt_interp );
+    }
 
 
     /*//overlapRate, Method 1
@@ -460,6 +469,8 @@ void COperatorChiSquare2::BasicFit(const CSpectrum& spectrum,
             Int32 numDevs = 0;
             Int32 numDevsFull = 0;
             const TFloat64List& error = spcFluxAxis.GetError();
+            const Float64* invErr2 = spcFluxAxis.GetInverseVariance();
+            const Float64* YspcOverErr2 = spcFluxAxis.GetWeightedFlux();
 
             for(Int32 j=kStart; j<=kEnd; j++)
             {
@@ -476,15 +487,15 @@ void COperatorChiSquare2::BasicFit(const CSpectrum& spectrum,
                     //*/
 
                     numDevs++;
-                    err2 = 1.0 / (error[j] * error[j]);
+                    err2 = invErr2[j];
 
                     // Tonry&Davis formulation
-                    sumCross+=Yspc[j]*Ytpl[j]*err2;
+                    sumCross+=YspcOverErr2[j]*Ytpl[j];
                     sumT+=Ytpl[j]*Ytpl[j]*err2;
                     //sumCross+=Yspc[j]*Ytpl[j];
                     //sumT+=Ytpl[j]*Ytpl[j];
 
-                    sumS+= Yspc[j]*Yspc[j]*err2;
+                    sumS+= Yspc[j]*YspcOverErr2[j];
 
                     if( std::isinf(err2) || std::isnan(err2) ){
                         Log.LogError("  Operator-Chisquare2: found invalid inverse variance : err2=%e, for index=%d at wl=%f", err2, j, spcSpectralAxis[j]);
@@ -709,66 +720,18 @@ std::shared_ptr<COperatorResult> COperatorChiSquare2::Compute(const CSpectrum& s
     m_mskRebined_bf.SetSize(spectrum.GetSampleCount());
     m_shiftedTplSpectralAxis_bf.SetSize( tpl.GetSampleCount());
 
-    Float64* precomputedFineGridTplFlux;
-    if(opt_interp=="precomputedfinegrid"){
-        //*/
-        // Precalculate a fine grid template to be used for the 'closest value' rebin method
-        Int32 n = tpl.GetSampleCount();
-        CSpectrumFluxAxis tplFluxAxis = tpl.GetFluxAxis();
-        CSpectrumSpectralAxis tplSpectralAxis = tpl.GetSpectralAxis();
-        //Float64 dLambdaTgt =  1.0 * ( spectrum.GetMeanResolution()*0.9 )/( 1+sortedRedshifts[sortedRedshifts.size()-1] );
-        Float64 dLambdaTgt =  0.1;
-        //Float64 lmin = tplSpectralAxis[0];
-        Float64 lmin = 0;
-        Float64 lmax = tplSpectralAxis[n-1];
-        Int32 nTgt = (lmax-lmin)/dLambdaTgt + 2.0/dLambdaTgt;
-
-        // pfg with std::vector
-        //CTemplate       templateFine;
-        //templateFine.GetSpectralAxis().SetSize(nTgt);
-        //templateFine.GetFluxAxis().SetSize(nTgt);
-        //Float64* precomputedFineGridTplFlux = templateFine.GetFluxAxis().GetSamples();
-        // pfg with malloc
-        precomputedFineGridTplFlux = (Float64*)malloc(nTgt*sizeof(Float64));
-        if(precomputedFineGridTplFlux == NULL)
+    // the precomputed fine grid is owned by the template (and thus by the template catalog): built once and
+    // reused for every spectrum
+    if(opt_interp=="precomputedfinegrid")
+    {
+        if( ( tpl.GetFineGridSinglePrecision() && tpl.GetFineGridFluxSinglePrecision()==NULL ) ||
+            ( !tpl.GetFineGridSinglePrecision() && tpl.GetFineGridFlux()==NULL ) )
         {
             Log.LogError("  Operator-Chisquare2: unable to allocate the precomputed fine grid buffer... aborting!");
             return NULL;
         }
-        // pfg with static array => doesn't work
-        //nTgt = 999999;
-        //Float64 precomputedFineGridTplFlux[999999];
-        //Log.LogInfo( "nTgt: %d samples", nTgt);
-
-        //inialise and allocate the gsl objects
-        Float64* Ysrc = tplFluxAxis.GetSamples();
-        Float64* Xsrc = tplSpectralAxis.GetSamples();
-        // linear
-        //gsl_interp *interpolation = gsl_interp_alloc (gsl_interp_linear,n);
-        //gsl_interp_init(interpolation, Xsrc, Ysrc, n);
-        //gsl_interp_accel * accelerator =  gsl_interp_accel_alloc();
-
-        //spline
-        gsl_spline *spline = gsl_spline_alloc (gsl_interp_cspline, n);
-        gsl_spline_init (spline, Xsrc, Ysrc, n);
-        gsl_interp_accel * accelerator =  gsl_interp_accel_alloc();
-
-        Int32 k = 0;
-        Float64 x = 0.0;
-        for(k=0; k<nTgt; k++){
-            x = lmin + k*dLambdaTgt;
-            if(x < tplSpectralAxis[0] || x > tplSpectralAxis[n-1]){
-                precomputedFineGridTplFlux[k] = 0.0;
-            }else{
-                //precomputedFineGridTplFlux[k] = gsl_interp_eval(interpolation, Xsrc, Ysrc, x, accelerator);
-                precomputedFineGridTplFlux[k] = gsl_spline_eval (spline, x, accelerator);
-            }
-        }
-
-        gsl_spline_free (spline);
-        gsl_interp_accel_free (accelerator);
-        //*/
     }
+
     /*//debug:
     // save templateFine
     FILE* f = fopen( "template_fine.txt", "w+" );
@@ -844,7 +807,6 @@ std::shared_ptr<COperatorResult> COperatorChiSquare2::Compute(const CSpectrum& s
 
         BasicFit( spectrum,
                   tpl,
-                  precomputedFineGridTplFlux,
                   lambdaRange,
                   redshift,
                   overlapThreshold,
@@ -932,13 +894,26 @@ std::shared_ptr<COperatorResult> COperatorChiSquare2::Compute(const CSpectrum& s
     result->CstLog = EstimateLikelihoodCstLog(spectrum, lambdaRange);
 
     // extrema
+    EstimateExtrema( *result );
+
+    return result;
+
+}
+
+
+/**
+ * Sets result.Extrema: the redshifts of the 10 lowest chi2 minima, each one refined within 0.001 in z, or all the
+ * redshifts sorted by chi2 for a shorter grid.
+ */
+void COperatorChiSquare2::EstimateExtrema( CChisquareResult& result ) const
+{
     Int32 extremumCount = 10;
-    if(result->Redshifts.size()>extremumCount)
+    if(result.Redshifts.size()>extremumCount)
     {
         TPointList extremumList;
-        TFloat64Range redshiftsRange(result->Redshifts[0], result->Redshifts[result->Redshifts.size()-1]);
+        TFloat64Range redshiftsRange(result.Redshifts[0], result.Redshifts[result.Redshifts.size()-1]);
         CExtremum extremum( redshiftsRange, extremumCount, true);
-        extremum.Find( result->Redshifts, result->ChiSquare, extremumList );
+        extremum.Find( result.Redshifts, result.ChiSquare, extremumList );
         // Refine Extremum with a second maximum search around the z candidates:
         // This corresponds to the finer xcorrelation in EZ Pandora (in standard_DP fctn in SolveKernel.py)
         Float64 radius = 0.001;
@@ -951,49 +926,43 @@ std::shared_ptr<COperatorResult> COperatorChiSquare2::Compute(const CSpectrum& s
             TPointList extremumListFine;
             TFloat64Range rangeFine = TFloat64Range( left_border, right_border );
             CExtremum extremumFine( rangeFine , 1, true);
-            extremumFine.Find( result->Redshifts, result->ChiSquare, extremumListFine );
+            extremumFine.Find( result.Redshifts, result.ChiSquare, extremumListFine );
             if(extremumListFine.size()>0){
                 extremumList[i] = extremumListFine[0];
             }
         }
         // store extrema results
-        result->Extrema.resize( extremumCount );
+        result.Extrema.resize( extremumCount );
         for( Int32 i=0; i<extremumList.size(); i++ )
         {
-            result->Extrema[i] = extremumList[i].X;
+            result.Extrema[i] = extremumList[i].X;
         }
 
         Log.LogDebug("  Operator-Chisquare2: EXTREMA found n=%d", extremumList.size());
     }else
     {
         // store extrema results
-        result->Extrema.resize( result->Redshifts.size() );
+        result.Extrema.resize( result.Redshifts.size() );
         TFloat64List tmpX;
         TFloat64List tmpY;
-        for( Int32 i=0; i<result->Redshifts.size(); i++ )
+        for( Int32 i=0; i<result.Redshifts.size(); i++ )
         {
-            tmpX.push_back(result->Redshifts[i]);
-            tmpY.push_back(result->ChiSquare[i]);
+            tmpX.push_back(result.Redshifts[i]);
+            tmpY.push_back(result.ChiSquare[i]);
         }
         // sort the results by merit
         CQuickSort<Float64> sort;
-        vector<Int32> sortedIndexes( result->Redshifts.size() );
+        vector<Int32> sortedIndexes( result.Redshifts.size() );
         sort.SortIndexes( tmpY.data(), sortedIndexes.data(), sortedIndexes.size() );
-        for( Int32 i=0; i<result->Redshifts.size(); i++ )
+        for( Int32 i=0; i<result.Redshifts.size(); i++ )
         {
-            result->Extrema[i] = tmpX[sortedIndexes[i]];
+            result.Extrema[i] = tmpX[sortedIndexes[i]];
         }
-        Log.LogDebug("  Operator-Chisquare2: EXTREMA forced n=%d", result->Extrema.size());
-    }
-
-    if(opt_interp=="precomputedfinegrid"){
-        free(precomputedFineGridTplFlux);
+        Log.LogDebug("  Operator-Chisquare2: EXTREMA forced n=%d", result.Extrema.size());
     }
-    return result;
 
 }
 
-
 /* @brief COperatorChiSquare2::getDustCoeff: get the dust coeff at a fixed resolution of 1A
 * @param dustCoeff
 * @param maxLambda
@@ -1092,69 +1061,6 @@ const COperatorResult* COperatorChiSquare2::ExportChi2versusAZ(const CSpectrum&
     m_shiftedTplSpectralAxis_bf.SetSize( tpl.GetSampleCount());
 
 
-    //*/
-    // Precalculate a fine grid template to be used for the 'closest value' rebin method
-    Int32 n = tpl.GetSampleCount();
-    CSpectrumFluxAxis tplFluxAxis = tpl.GetFluxAxis();
-    CSpectrumSpectralAxis tplSpectralAxis = tpl.GetSpectralAxis();
-    //Float64 dLambdaTgt =  1.0 * ( spectrum.GetMeanResolution()*0.9 )/( 1+sortedRedshifts[sortedRedshifts.size()-1] );
-    Float64 dLambdaTgt =  0.1;
-    //Float64 lmin = tplSpectralAxis[0];
-    Float64 lmin = 0;
-    Float64 lmax = tplSpectralAxis[n-1];
-    Int32 nTgt = (lmax-lmin)/dLambdaTgt + 2.0/dLambdaTgt;
-
-    // pfg with std::vector
-    //CTemplate       templateFine;
-    //templateFine.GetSpectralAxis().SetSize(nTgt);
-    //templateFine.GetFluxAxis().SetSize(nTgt);
-    //Float64* precomputedFineGridTplFlux = templateFine.GetFluxAxis().GetSamples();
-    // pfg with malloc
-    Float64* precomputedFineGridTplFlux = (Float64*)malloc(nTgt*sizeof(Float64));
-    // pfg with static array => doesn't work
-    //nTgt = 999999;
-    //Float64 precomputedFineGridTplFlux[999999];
-    //Log.LogInfo( "nTgt: %d samples", nTgt);
-
-    //inialise and allocate the gsl objects
-    Float64* Ysrc = tplFluxAxis.GetSamples();
-    Float64* Xsrc = tplSpectralAxis.GetSamples();
-    // linear
-    //gsl_interp *interpolation = gsl_interp_alloc (gsl_interp_linear,n);
-    //gsl_interp_init(interpolation, Xsrc, Ysrc, n);
-    //gsl_interp_accel * accelerator =  gsl_interp_accel_alloc();
-
-    //spline
-    gsl_spline *spline = gsl_spline_alloc (gsl_interp_cspline, n);
-    gsl_spline_init (spline, Xsrc, Ysrc, n);
-    gsl_interp_accel * accelerator =  gsl_interp_accel_alloc();
-
-    Int32 k = 0;
-    Float64 x = 0.0;
-    for(k=0; k<nTgt; k++){
-        x = lmin + k*dLambdaTgt;
-        if(x < tplSpectralAxis[0] || x > tplSpectralAxis[n-1]){
-            precomputedFineGridTplFlux[k] = 0.0;
-        }else{
-            //precomputedFineGridTplFlux[k] = gsl_interp_eval(interpolation, Xsrc, Ysrc, x, accelerator);
-            precomputedFineGridTplFlux[k] = gsl_spline_eval (spline, x, accelerator);
-        }
-    }
-    //*/
-
-    /*//debug:
-    // save templateFine
-    FILE* f = fopen( "template_fine.txt", "w+" );
-    for(Int32 m=0; m<nTgt; m++){
-        if( Yfine[m] < 0.0001 ){
-            fprintf( f, "%e %e\n", Xfine[m], Yfine[m]);
-        }else{
-            fprintf( f, "%f %f\n", Xfine[m], Yfine[m]);
-        }
-    }
-    fclose( f );
-    //*/
-
     TFloat64List sortedRedshifts;// = redshifts;
     // for sc_020086471_F02P016_vmM1_red_107_1_atm_clean : zref = 1.3455, aref=4.6772031621836956e-17, zcalc = 2.1634
     Float64 zcenter = 1.3455;
@@ -1231,7 +1137,7 @@ const COperatorResult* COperatorChiSquare2::ExportChi2versusAZ(const CSpectrum&
         for (Int32 j=0;j<sortedAmplitudes.size();j++)
         {
             Float64 ampl = sortedAmplitudes[j];
-            BasicFit( spectrum, tpl, precomputedFineGridTplFlux, lambdaRange, result->Redshifts[i], overlapThreshold,
+            BasicFit( spectrum, tpl, lambdaRange, result->Redshifts[i], overlapThreshold,
                       result->Overlap[i],
                       result->ChiSquare[i],
                       result->FitAmplitude[i],
@@ -1255,9 +1161,6 @@ const COperatorResult* COperatorChiSquare2::ExportChi2versusAZ(const CSpectrum&
     }
     fclose( f );
 
-
-
-    free(precomputedFineGridTplFlux);
     return result;
 
 }
@@ -1,5 +1,6 @@
 #include <RedshiftLibrary/operator/chisquareloglambda.h>
 
+#include <RedshiftLibrary/common/fftwplanner.h>
 #include <RedshiftLibrary/common/mask.h>
 #include <RedshiftLibrary/common/quicksort.h>
 #include <RedshiftLibrary/extremum/extremum.h>
@@ -381,7 +382,10 @@ Int32 COperatorChiSquareLogLambda::InitFFT(Int32 nPadded)
 
     inSpc = (Float64 *)fftw_malloc(sizeof(Float64) * nPadded);
     outSpc = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * nPadded);
-    pSpc = fftw_plan_dft_r2c_1d(nPadded, inSpc, outSpc, FFTW_ESTIMATE);
+    {
+        boost::mutex::scoped_lock lock(GetFFTWPlannerMutex());
+        pSpc = fftw_plan_dft_r2c_1d(nPadded, inSpc, outSpc, FFTW_ESTIMATE);
+    }
     if (inSpc == 0)
     {
         Log.LogError(
@@ -398,7 +402,10 @@ Int32 COperatorChiSquareLogLambda::InitFFT(Int32 nPadded)
     inTpl_padded = (Float64 *)fftw_malloc(sizeof(Float64) * nPadded);
     inTpl = (Float64 *)fftw_malloc(sizeof(Float64) * nPadded);
     outTpl = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * nPadded);
-    pTpl = fftw_plan_dft_r2c_1d(nPadded, inTpl, outTpl, FFTW_ESTIMATE);
+    {
+        boost::mutex::scoped_lock lock(GetFFTWPlannerMutex());
+        pTpl = fftw_plan_dft_r2c_1d(nPadded, inTpl, outTpl, FFTW_ESTIMATE);
+    }
     if (inTpl_padded == 0)
     {
         Log.LogError("  Operator-ChisquareLog: InitFFT: Unable to allocate "
@@ -420,8 +427,11 @@ Int32 COperatorChiSquareLogLambda::InitFFT(Int32 nPadded)
 
     outCombined = (fftw_complex *)fftw_malloc(sizeof(fftw_complex) * nPadded);
     inCombined = (Float64 *)fftw_malloc(sizeof(Float64) * nPadded);
-    pBackward =
-        fftw_plan_dft_c2r_1d(nPadded, outCombined, inCombined, FFTW_ESTIMATE);
+    {
+        boost::mutex::scoped_lock lock(GetFFTWPlannerMutex());
+        pBackward =
+            fftw_plan_dft_c2r_1d(nPadded, outCombined, inCombined, FFTW_ESTIMATE);
+    }
     if (outCombined == 0)
     {
         Log.LogError(
@@ -457,6 +467,8 @@ void COperatorChiSquareLogLambda::freeFFTPrecomputedBuffers()
 
 void COperatorChiSquareLogLambda::freeFFTPlans()
 {
+    // the plans are destroyed under the planner lock, other operators may plan concurrently
+    boost::mutex::scoped_lock lock(GetFFTWPlannerMutex());
     if (pSpc)
     {
         fftw_destroy_plan(pSpc);
@@ -531,7 +543,10 @@ Int32 COperatorChiSquareLogLambda::FitAllz(const TFloat64Range &lambdaRange,
 
     CSpectrumFluxAxis &spectrumRebinedFluxAxis =
         m_spectrumRebinedLog.GetFluxAxis();
-    Float64 *error = m_errorRebinedLog.GetSamples();
+    const Float64 *spcRebinedFluxOverErr2 = m_spectrumRebinedLogWeights.GetWeightedFlux();
+    const Float64 *oneSpcRebinedFluxOverErr2 = m_spectrumRebinedLogWeights.GetInverseVariance();
+    Float64 dtd = m_spectrumRebinedLogWeights.GetSquaredWeightedFluxSum(
+        0, m_spectrumRebinedLogWeights.GetSamplesCount());
     CSpectrumSpectralAxis &spectrumRebinedSpectralAxis =
         m_spectrumRebinedLog.GetSpectralAxis();
     CSpectrumFluxAxis &tplRebinedFluxAxis = m_templateRebinedLog.GetFluxAxis();
@@ -727,7 +742,8 @@ Int32 COperatorChiSquareLogLambda::FitAllz(const TFloat64Range &lambdaRange,
         }
 
         //*
-        FitRangez(spectrumRebinedLambda, spectrumRebinedFluxRaw, error,
+        FitRangez(spectrumRebinedLambda, spectrumRebinedFluxRaw,
+                  spcRebinedFluxOverErr2, oneSpcRebinedFluxOverErr2, dtd,
                   tplRebinedLambda, tplRebinedFluxRaw, nSpc, nTpl, subresult,
                   igmMeiksinCoeffs, ismEbmvCoeffs);
         //*/
@@ -776,7 +792,9 @@ Int32 COperatorChiSquareLogLambda::FitAllz(const TFloat64Range &lambdaRange,
  * @brief COperatorChiSquareLogLambda::FitRangez
  * @param spectrumRebinedLambda
  * @param spectrumRebinedFluxRaw
- * @param error
+ * @param spcRebinedFluxOverErr2: flux/err^2 of the rebined spectrum
+ * @param oneSpcRebinedFluxOverErr2: 1/err^2 of the rebined spectrum
+ * @param dtd: sum of flux^2/err^2 of the rebined spectrum
  * @param tplRebinedLambda
  * @param tplRebinedFluxRaw
  * @param nSpc
@@ -788,7 +806,9 @@ Int32 COperatorChiSquareLogLambda::FitAllz(const TFloat64Range &lambdaRange,
  */
 Int32 COperatorChiSquareLogLambda::FitRangez(Float64 *spectrumRebinedLambda,
                                              Float64 *spectrumRebinedFluxRaw,
-                                             Float64 *error,
+                                             const Float64 *spcRebinedFluxOverErr2,
+                                             const Float64 *oneSpcRebinedFluxOverErr2,
+                                             Float64 dtd,
                                              Float64 *tplRebinedLambda,
                                              Float64 *tplRebinedFluxRaw,
                                              UInt32 nSpc,
@@ -861,23 +881,8 @@ Int32 COperatorChiSquareLogLambda::FitRangez(Float64 *spectrumRebinedLambda,
     //        spectrumRebinedFluxRaw[k]*spectrumRebinedFluxRaw[k];
     //    }
     //    EstimateXtY(OneFluxAxis, spcSquareFluxAxis, dtd_vec);
-    Float64 dtd = 0.0;
-    Float64 inv_err2 = 1.0;
-    for (Int32 j = 0; j < nSpc; j++)
-    {
-        inv_err2 = 1.0 / (error[j] * error[j]);
-        dtd += spectrumRebinedFluxRaw[j] * spectrumRebinedFluxRaw[j] * inv_err2;
-    }
-
-    // prepare arrays
-    Float64 *spcRebinedFluxOverErr2 = new Float64[nSpc]();
-    Float64 *oneSpcRebinedFluxOverErr2 = new Float64[nSpc]();
-    for (Int32 j = 0; j < nSpc; j++)
-    {
-        inv_err2 = 1.0 / (error[j] * error[j]);
-        spcRebinedFluxOverErr2[j] = spectrumRebinedFluxRaw[j] * inv_err2;
-        oneSpcRebinedFluxOverErr2[j] = inv_err2;
-    }
+    // dtd and the inverse variance weighted arrays are computed once per
+    // spectrum, see m_spectrumRebinedLogWeights
 
     if (verboseExportFitRangez)
     {
@@ -1207,8 +1212,6 @@ Int32 COperatorChiSquareLogLambda::FitRangez(Float64 *spectrumRebinedLambda,
 
     if (errorWhileFitting != 0)
     {
-      delete[] spcRebinedFluxOverErr2;
-      delete[] oneSpcRebinedFluxOverErr2;
       delete[] tplRebinedFlux;
       delete[] tpl2RebinedFlux;
       delete[] tplRebinedFluxIgm;
@@ -1331,8 +1334,6 @@ Int32 COperatorChiSquareLogLambda::FitRangez(Float64 *spectrumRebinedLambda,
     delete[] ismCoeffreversed_array;
     delete[] igmIdxreversed_array;
 
-    delete[] spcRebinedFluxOverErr2;
-    delete[] oneSpcRebinedFluxOverErr2;
     delete[] tplRebinedFlux;
     delete[] tpl2RebinedFlux;
     delete[] tplRebinedFluxIgm;
@@ -1893,6 +1894,12 @@ std::shared_ptr<COperatorResult> COperatorChiSquareLogLambda::Compute(
         }
     }
 
+    // flux and error of the rebined spectrum together, for the inverse
+    // variance weights shared by all the z ranges
+    m_spectrumRebinedLogWeights = CSpectrumFluxAxis(
+        spectrumRebinedFluxAxis.GetSamples(), loglbdaCount,
+        m_errorRebinedLog.GetSamples(), loglbdaCount);
+
     // Create the Template Log-Rebined spectral axis
     {
 
@@ -8,10 +8,13 @@
 #include <RedshiftLibrary/spectrum/template/template.h>
 #include <RedshiftLibrary/spectrum/tools.h>
 #include <RedshiftLibrary/common/mask.h>
+#include <RedshiftLibrary/common/fftwplanner.h>
 #include <RedshiftLibrary/operator/correlationresult.h>
 
 #include <math.h>
 #include <assert.h>
+#include <fftw3.h>
+#include <algorithm>
 
 
 #include <boost/date_time/posix_time/posix_time.hpp>
@@ -25,6 +28,7 @@ using namespace std;
 COperatorCorrelation::COperatorCorrelation()
 {
     m_TotalDuration = -1.0f;
+    m_enableFFT = false;
 }
 
 COperatorCorrelation::~COperatorCorrelation()
@@ -37,6 +41,14 @@ Float64 COperatorCorrelation::GetComputationDuration() const
     return m_TotalDuration;
 }
 
+/**
+ * When enabled, Compute uses the FFT based algorithm (see ComputeFFT) instead of the direct loop over the redshifts.
+ */
+void COperatorCorrelation::EnableFFT( Bool enable )
+{
+    m_enableFFT = enable;
+}
+
 #include <fstream>
 
 /**
@@ -65,6 +77,20 @@ Float64 COperatorCorrelation::GetComputationDuration() const
 
     DebugAssert( overlapThreshold > 0.0 && overlapThreshold <= 1.0 );
 
+    if( m_enableFFT )
+    {
+        std::shared_ptr<CCorrelationResult> result = std::shared_ptr<CCorrelationResult>( new CCorrelationResult() );
+        if( !ComputeFFT( spectrum, tpl, lambdaRange, redshifts, overlapThreshold, *result ) )
+        {
+            return NULL;
+        }
+
+        boost::posix_time::time_duration diff = boost::posix_time::microsec_clock::local_time() - startTime;
+        m_TotalDuration = diff.total_seconds();
+
+        return result;
+    }
+
     CSpectrumSpectralAxis shiftedTplSpectralAxis( tpl.GetSampleCount(), true );
 
     const CSpectrumSpectralAxis& spcSpectralAxis = spectrum.GetSpectralAxis();
@@ -198,4 +224,283 @@ Float64 COperatorCorrelation::GetComputationDuration() const
     return result;
 }
 
+/**
+ * Linear interpolation of (X,Y) on the regular grid x0 + k*step, k=0..nOut-1.
+ * X must be sorted, the grid is clamped to the X range.
+ */
+static void ResampleOnRegularGrid( const Float64* X, const Float64* Y, Int32 n, Float64 x0, Float64 step, Int32 nOut, TFloat64List& out )
+{
+    out.resize( nOut );
+    Int32 k = 0;
+    for( Int32 i=0; i<nOut; i++ )
+    {
+        Float64 x = x0 + i*step;
+        while( k < n-2 && X[k+1] < x )
+            k++;
+
+        Float64 t = ( x - X[k] ) / ( X[k+1] - X[k] );
+        t = std::min( std::max( t, 0.0 ), 1.0 );
+        out[i] = Y[k] + ( Y[k+1] - Y[k] ) * t;
+    }
+}
+
+/**
+ * Forward real FFT of x, zero padded to the plan size. The nFFT/2+1 complex values are stored interleaved in spectrum.
+ */
+static void ForwardFFT( fftw_plan plan, Float64* in, fftw_complex* out, Int32 nFFT, const TFloat64List& x, TFloat64List& spectrum )
+{
+    for( Int32 i=0; i<nFFT; i++ )
+        in[i] = i<x.size() ? x[i] : 0.0;
+
+    fftw_execute( plan );
+
+    Int32 nFreq = nFFT/2 + 1;
+    spectrum.resize( 2*nFreq );
+    for( Int32 i=0; i<nFreq; i++ )
+    {
+        spectrum[2*i] = out[i][0];
+        spectrum[2*i+1] = out[i][1];
+    }
+}
+
+/**
+ * Circular cross correlation r[L] = sum_n a[n] b[n-L], computed from the transforms of a and b.
+ * Negative lags L are stored at index nFFT+L.
+ */
+static void CrossCorrelateFFT( fftw_plan plan, fftw_complex* in, Float64* out, Int32 nFFT, const TFloat64List& fftA, const TFloat64List& fftB, TFloat64List& r )
+{
+    Int32 nFreq = nFFT/2 + 1;
+    for( Int32 i=0; i<nFreq; i++ )
+    {
+        // A * conj(B)
+        in[i][0] = fftA[2*i] * fftB[2*i] + fftA[2*i+1] * fftB[2*i+1];
+        in[i][1] = fftA[2*i+1] * fftB[2*i] - fftA[2*i] * fftB[2*i+1];
+    }
+
+    fftw_execute( plan );
+
+    r.resize( nFFT );
+    for( Int32 i=0; i<nFFT; i++ )
+        r[i] = out[i] / nFFT;
+}
+
+/**
+ * FFT based computation of the correlation factor between spectrum and tpl for each value specified in redshifts.
+ *
+ * In log scale, a redshift is a translation of the template. The spectrum (restricted to lambdaRange) and the template
+ * are resampled on a common log-lambda regular grid, using the mean spectrum step (this is a no-op for log-regular spectra).
+ * All the sums needed by the direct algorithm (overlap count, weighted means, variances and the weighted cross product)
+ * are then written as cross correlations of the spectrum terms with the template terms (1, t and t^2),
+ * and computed for every integer lag with FFTs. The redshifts falling between two lags use the linear interpolation of these sums.
+ * \note Spectrum AND template MUST be in log scale
+ */
+Bool COperatorCorrelation::ComputeFFT( const CSpectrum& spectrum,
+                                       const CTemplate& tpl,
+                                       const TFloat64Range& lambdaRange,
+                                       const TFloat64List& redshifts,
+                                       Float64 overlapThreshold,
+                                       CCorrelationResult& result )
+{
+    if( spectrum.GetSpectralAxis().IsInLogScale() == false || tpl.GetSpectralAxis().IsInLogScale() == false )
+    {
+        Log.LogError("Failed to compute Cross correlation, input spectrum or template are not in log scale");
+        return false;
+    }
+
+    const CSpectrumSpectralAxis& spcSpectralAxis = spectrum.GetSpectralAxis();
+    const CSpectrumFluxAxis& spcFluxAxis = spectrum.GetFluxAxis();
+    const CSpectrumSpectralAxis& tplSpectralAxis = tpl.GetSpectralAxis();
+    const CSpectrumFluxAxis& tplFluxAxis = tpl.GetFluxAxis();
+    const TFloat64List& error = spcFluxAxis.GetError();
+
+    DebugAssert( !error.empty() );
+
+    result.Redshifts = redshifts;
+    result.Correlation.assign( redshifts.size(), NAN );
+    result.Overlap.assign( redshifts.size(), 0.0 );
+    result.Status.assign( redshifts.size(), nStatus_DataError );
+
+    // Spectrum samples in the lambda range
+    CMask mask;
+    spcSpectralAxis.GetMask( lambdaRange, mask );
+    Int32 jStart = -1;
+    Int32 jEnd = -1;
+    for( Int32 j=0; j<mask.GetMasksCount(); j++ )
+    {
+        if( mask[j] )
+        {
+            if( jStart == -1 )
+                jStart = j;
+            jEnd = j;
+        }
+    }
+    if( jStart == -1 || jEnd-jStart < 1 || tpl.GetSampleCount() < 2 )
+    {
+        return true;
+    }
+
+    // Common log-lambda regular grid
+    const Float64* Xspc = spcSpectralAxis.GetSamples();
+    const Float64* Xtpl = tplSpectralAxis.GetSamples();
+    Int32 nSpc = jEnd - jStart + 1;
+    Float64 logStep = ( Xspc[jEnd] - Xspc[jStart] ) / ( nSpc - 1 );
+    Float64 spcX0 = Xspc[jStart];
+    Float64 tplX0 = Xtpl[0];
+    Int32 nTpl = (Int32)floor( ( Xtpl[tpl.GetSampleCount()-1] - tplX0 ) / logStep ) + 1;
+    if( nTpl < 2 )
+    {
+        return true;
+    }
+
+    TFloat64List spc;
+    TFloat64List err;
+    TFloat64List t;
+    ResampleOnRegularGrid( Xspc + jStart, spcFluxAxis.GetSamples() + jStart, nSpc, spcX0, logStep, nSpc, spc );
+    ResampleOnRegularGrid( Xspc + jStart, error.data() + jStart, nSpc, spcX0, logStep, nSpc, err );
+    ResampleOnRegularGrid( Xtpl, tplFluxAxis.GetSamples(), tpl.GetSampleCount(), tplX0, logStep, nTpl, t );
+
+    // Remove the global means: the correlation and the standard deviations are invariant, and this limits the round-off
+    // errors of the sums of squares.
+    Float64 spcOffset = 0.0;
+    Float64 sumInvErr2 = 0.0;
+    for( Int32 j=0; j<nSpc; j++ )
+    {
+        spcOffset += spc[j] / ( err[j] * err[j] );
+        sumInvErr2 += 1.0 / ( err[j] * err[j] );
+    }
+    spcOffset /= sumInvErr2;
+    Float64 tplOffset = 0.0;
+    for( Int32 k=0; k<nTpl; k++ )
+        tplOffset += t[k];
+    tplOffset /= nTpl;
+
+    // Spectrum terms: 1, s/e^2, 1/e^2, s, s^2, s/e, 1/e
+    enum { iOne=0, iWS, iW, iS, iSS, iVS, iV, nSpcTerms };
+    std::vector<TFloat64List> spcTerms( nSpcTerms, TFloat64List( nSpc ) );
+    for( Int32 j=0; j<nSpc; j++ )
+    {
+        Float64 s = spc[j] - spcOffset;
+        Float64 v = 1.0 / err[j];
+        spcTerms[iOne][j] = 1.0;
+        spcTerms[iWS][j] = s * v * v;
+        spcTerms[iW][j] = v * v;
+        spcTerms[iS][j] = s;
+        spcTerms[iSS][j] = s * s;
+        spcTerms[iVS][j] = s * v;
+        spcTerms[iV][j] = v;
+    }
+    // Template terms: 1, t, t^2
+    enum { iTplOne=0, iTplT, iTplTT, nTplTerms };
+    std::vector<TFloat64List> tplTerms( nTplTerms, TFloat64List( nTpl ) );
+    for( Int32 k=0; k<nTpl; k++ )
+    {
+        Float64 tk = t[k] - tplOffset;
+        tplTerms[iTplOne][k] = 1.0;
+        tplTerms[iTplT][k] = tk;
+        tplTerms[iTplTT][k] = tk * tk;
+    }
+
+    // FFTs, the padding avoids the circular aliasing for all the lags in [-(nTpl-1), nSpc-1]
+    Int32 nFFT = nSpc + nTpl;
+    Int32 nFreq = nFFT/2 + 1;
+    Float64* realBuffer = (Float64*)fftw_malloc( sizeof(Float64) * nFFT );
+    fftw_complex* complexBuffer = (fftw_complex*)fftw_malloc( sizeof(fftw_complex) * nFreq );
+    fftw_plan pForward, pBackward;
+    {
+        boost::mutex::scoped_lock lock( GetFFTWPlannerMutex() );
+        pForward = fftw_plan_dft_r2c_1d( nFFT, realBuffer, complexBuffer, FFTW_ESTIMATE );
+        pBackward = fftw_plan_dft_c2r_1d( nFFT, complexBuffer, realBuffer, FFTW_ESTIMATE );
+    }
+
+    std::vector<TFloat64List> fftSpc( nSpcTerms );
+    for( Int32 i=0; i<nSpcTerms; i++ )
+        ForwardFFT( pForward, realBuffer, complexBuffer, nFFT, spcTerms[i], fftSpc[i] );
+    std::vector<TFloat64List> fftTpl( nTplTerms );
+    for( Int32 i=0; i<nTplTerms; i++ )
+        ForwardFFT( pForward, realBuffer, complexBuffer, nFFT, tplTerms[i], fftTpl[i] );
+
+    TFloat64List N, Sws, Sw, Ss, Sss, St, Stt, Sv, Svs, Svt, Svst;
+    CrossCorrelateFFT( pBackward, complexBuffer, realBuffer, nFFT, fftSpc[iOne], fftTpl[iTplOne], N );
+    CrossCorrelateFFT( pBackward, complexBuffer, realBuffer, nFFT, fftSpc[iWS], fftTpl[iTplOne], Sws );
+    CrossCorrelateFFT( pBackward, complexBuffer, realBuffer, nFFT, fftSpc[iW], fftTpl[iTplOne], Sw );
+    CrossCorrelateFFT( pBackward, complexBuffer, realBuffer, nFFT, fftSpc[iS], fftTpl[iTplOne], Ss );
+    CrossCorrelateFFT( pBackward, complexBuffer, realBuffer, nFFT, fftSpc[iSS], fftTpl[iTplOne], Sss );
+    CrossCorrelateFFT( pBackward, complexBuffer, realBuffer, nFFT, fftSpc[iOne], fftTpl[iTplT], St );
+    CrossCorrelateFFT( pBackward, complexBuffer, realBuffer, nFFT, fftSpc[iOne], fftTpl[iTplTT], Stt );
+    CrossCorrelateFFT( pBackward, complexBuffer, realBuffer, nFFT, fftSpc[iV], fftTpl[iTplOne], Sv );
+    CrossCorrelateFFT( pBackward, complexBuffer, realBuffer, nFFT, fftSpc[iVS], fftTpl[iTplOne], Svs );
+    CrossCorrelateFFT( pBackward, complexBuffer, realBuffer, nFFT, fftSpc[iV], fftTpl[iTplT], Svt );
+    CrossCorrelateFFT( pBackward, complexBuffer, realBuffer, nFFT, fftSpc[iVS], fftTpl[iTplT], Svst );
 
+    {
+        boost::mutex::scoped_lock lock( GetFFTWPlannerMutex() );
+        fftw_destroy_plan( pForward );
+        fftw_destroy_plan( pBackward );
+    }
+    fftw_free( realBuffer );
+    fftw_free( complexBuffer );
+
+    for( Int32 i=0; i<redshifts.size(); i++ )
+    {
+        // template sample k is at spectrum grid position k + lag
+        Float64 lag = ( tplX0 + log( 1.0 + redshifts[i] ) - spcX0 ) / logStep;
+        if( lag <= -nTpl || lag >= nSpc )
+        {
+            result.Status[i] = nStatus_NoOverlap;
+            continue;
+        }
+
+        Int32 lag0 = (Int32)floor( lag );
+        Float64 f = lag - lag0;
+        Int32 idx0 = ( lag0 + nFFT ) % nFFT;
+        Int32 idx1 = ( lag0 + 1 + nFFT ) % nFFT;
+        if( lag0 + 1 >= nSpc )
+            f = 0.0;
+
+#define LAG_INTERP( S ) ( ( 1.0 - f ) * S[idx0] + f * S[idx1] )
+        Float64 n = LAG_INTERP( N );
+        Float64 sumWS = LAG_INTERP( Sws );
+        Float64 sumW = LAG_INTERP( Sw );
+        Float64 sumS = LAG_INTERP( Ss );
+        Float64 sumSS = LAG_INTERP( Sss );
+        Float64 sumT = LAG_INTERP( St );
+        Float64 sumTT = LAG_INTERP( Stt );
+        Float64 sumWeight = LAG_INTERP( Sv );
+        Float64 sumVS = LAG_INTERP( Svs );
+        Float64 sumVT = LAG_INTERP( Svt );
+        Float64 sumVST = LAG_INTERP( Svst );
+#undef LAG_INTERP
+
+        result.Overlap[i] = std::max( n, 0.0 ) / nSpc;
+        if( result.Overlap[i] < overlapThreshold )
+        {
+            result.Status[i] = nStatus_NoOverlap;
+            continue;
+        }
+
+        if( n <= 1.0 || sumW <= 0.0 )
+        {
+            result.Status[i] = nStatus_DataError;
+            continue;
+        }
+
+        Float64 spcMean = sumWS / sumW;
+        Float64 spcVar = sumSS - 2.0 * spcMean * sumS + spcMean * spcMean * n;
+        Float64 spcSDev = sqrt( std::max( spcVar, 0.0 ) / ( n - 1.0 ) );
+
+        Float64 tplMean = sumT / n;
+        Float64 tplVar = sumTT - sumT * sumT / n;
+        Float64 tplSDev = sqrt( std::max( tplVar, 0.0 ) / ( n - 1.0 ) );
+
+        // sum over the overlap of ( t - moy(t) ) * ( s - moy(s) ) / error
+        Float64 sumCorr = sumVST - spcMean * sumVT - tplMean * sumVS + tplMean * spcMean * sumWeight;
+
+        if( sumWeight>0 )
+        {
+            result.Correlation[i] = sumCorr / ( tplSDev * spcSDev * sumWeight );
+            result.Status[i] = nStatus_OK;
+        }
+    }
+
+    return true;
+}
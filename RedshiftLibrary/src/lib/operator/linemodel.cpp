@@ -1,4 +1,5 @@
 #include <RedshiftLibrary/common/mask.h>
+#include <RedshiftLibrary/common/threadpool.h>
 #include <RedshiftLibrary/extremum/extremum.h>
 #include <RedshiftLibrary/linemodel/templatesfitstore.h>
 #include <RedshiftLibrary/linemodel/templatesortho.h>
@@ -18,6 +19,7 @@
 #include <RedshiftLibrary/spectrum/io/fitswriter.h>
 
 #include "boost/format.hpp"
+#include <boost/bind.hpp>
 #include <boost/chrono/thread_clock.hpp>
 #include <boost/numeric/conversion/bounds.hpp>
 #include <boost/progress.hpp>
@@ -198,25 +200,22 @@ Int32 COperatorLineModel::ComputeFirstPass(CDataStore &dataStore,
     Log.LogInfo("  Operator-Linemodel: Templates store prepared.");
     //*/
 
-    m_model = std::shared_ptr<CLineModelElementList>(new CLineModelElementList(
-                                                         spectrum,
-                                                         spectrumContinuum,
-                                                         tplCatalog,
-                                                         tplCategoryList,
-                                                         opt_calibrationPath,
-                                                         restRayList,
-                                                         opt_fittingmethod,
-                                                         opt_continuumcomponent,
-                                                         opt_lineWidthType,
-                                                         opt_resolution,
-                                                         opt_velocityEmission,
-                                                         opt_velocityAbsorption,
-                                                         opt_rules,
-                                                         opt_rigidity));
-    Float64 setssSizeInit = 0.1;
-    m_model->SetSourcesizeDispersion(setssSizeInit);
-    Log.LogInfo("  Operator-Linemodel: sourcesize init to: ss=%.2f",
-                setssSizeInit);
+    m_tplratioCatRelPath = opt_tplratioCatRelPath;
+    m_offsetCatRelPath = opt_offsetCatRelPath;
+    m_model = createModel(spectrum,
+                          spectrumContinuum,
+                          tplCatalog,
+                          tplCategoryList,
+                          opt_calibrationPath,
+                          restRayList,
+                          opt_fittingmethod,
+                          opt_continuumcomponent,
+                          opt_lineWidthType,
+                          opt_resolution,
+                          opt_velocityEmission,
+                          opt_velocityAbsorption,
+                          opt_rules,
+                          opt_rigidity);
 
     /*
     CMultiRollModel model( spectrum,
@@ -312,38 +311,6 @@ Int32 COperatorLineModel::ComputeFirstPass(CDataStore &dataStore,
     }
     //*/
 
-    //set some model parameters
-    m_model->m_opt_firstpass_fittingmethod = m_opt_firstpass_fittingmethod;
-    m_model->m_opt_secondpass_fittingmethod = opt_fittingmethod;
-
-    if (opt_rigidity == "tplshape")
-    {
-        // init catalog tplratios
-        Log.LogInfo("  Operator-Linemodel: Tpl-ratios init");
-        bool tplratioInitRet =
-            m_model->initTplratioCatalogs(opt_tplratioCatRelPath, m_opt_tplratio_ismFit);
-        if (!tplratioInitRet)
-        {
-            Log.LogError(
-                "  Operator-Linemodel: Failed to init tpl-ratios. aborting...");
-            throw runtime_error("  Operator-Linemodel: Failed to init tpl-ratios. aborting...");
-            return -1;
-        }
-
-        m_model->m_opt_firstpass_forcedisableTplratioISMfit = !m_opt_firstpass_tplratio_ismFit;
-    }
-
-    // init catalog offsets
-    Log.LogInfo("  Operator-Linemodel: Lambda offsets init");
-    try
-    {
-        m_model->initLambdaOffsets(opt_offsetCatRelPath);
-    } catch (std::exception const &e)
-    {
-        Log.LogError("  Operator-Linemodel: Failed to init lambda offsets. "
-                     "Continuing without offsets...");
-    }
-
     Int32 resultInitRet = m_result->Init(m_sortedRedshifts, restRayList,
                                          m_model->getTplshape_count(),
                                          m_model->getTplshape_priors());
@@ -428,11 +395,10 @@ Int32 COperatorLineModel::ComputeFirstPass(CDataStore &dataStore,
     }
 
     // Set model parameter: abs lines limit
-    Float64 absLinesLimit = 1.0; //-1 to disable, 1.0 is typical
-    m_model->SetAbsLinesLimit(absLinesLimit);
+    m_model->SetAbsLinesLimit(m_absLinesLimit);
     Log.LogInfo("  Operator-Linemodel: set abs lines limit to %f (ex: -1 means "
                 "disabled)",
-                absLinesLimit);
+                m_absLinesLimit);
 
     // Set model parameter: continuum least-square estimation fast
     // note: this fast method requires continuum templates and linemodels to be
@@ -468,6 +434,12 @@ Int32 COperatorLineModel::ComputeFirstPass(CDataStore &dataStore,
     boost::chrono::thread_clock::time_point start_mainloop =
         boost::chrono::thread_clock::now();
 
+    // pruning: the z whose merit lower bound is above the best merit so far
+    // (plus the tolerance) can neither be an extremum nor weigh in the pdf
+    Float64 bestFittedMerit = DBL_MAX;
+    Int32 nPruned = 0;
+    Int32 nPruningBoundUnavailable = 0;
+
     boost::progress_display show_progress(m_result->Redshifts.size());
     //#pragma omp parallel for
     for (Int32 i = 0; i < m_result->Redshifts.size(); i++)
@@ -475,37 +447,74 @@ Int32 COperatorLineModel::ComputeFirstPass(CDataStore &dataStore,
         if (m_enableFastFitLargeGrid == 0 || i == 0 ||
                 m_result->Redshifts[i] == largeGridRedshifts[indexLargeGrid])
         {
-            m_result->ChiSquare[i] = m_model->fit(m_result->Redshifts[i],
-                                                  lambdaRange,
-                                                  m_result->LineModelSolutions[i],
-                                                  m_result->ContinuumModelSolutions[i],
-                                                  contreest_iterations,
-                                                  false);
+            Float64 meritLowerBound = -DBL_MAX;
+            Float64 continuumMerit = DBL_MAX;
+            bool pruned = false;
+            if (m_opt_firstpass_pruning && bestFittedMerit < DBL_MAX)
+            {
+                if (m_model->getFitMeritLowerBound(m_result->Redshifts[i],
+                                                   lambdaRange,
+                                                   contreest_iterations,
+                                                   meritLowerBound,
+                                                   continuumMerit))
+                {
+                    pruned = meritLowerBound > bestFittedMerit + m_opt_firstpass_pruningTolerance;
+                } else
+                {
+                    nPruningBoundUnavailable++;
+                }
+            }
+
+            if (pruned)
+            {
+                // store the continuum-only merit, a pessimistic value which is
+                // still above the best merit + tolerance: the pruned z keep no
+                // weight in the pdf, and they are skipped by the candidates search
+                m_result->ChiSquare[i] = continuumMerit;
+                m_result->FirstpassPruned[i] = true;
+                m_result->ScaleMargCorrection[i] = 0.0;
+                Int32 nTplshapes = m_result->ChiSquareTplshapes.size();
+                m_result->SetChisquareTplshapeResult(i,
+                                                     TFloat64List(nTplshapes, continuumMerit),
+                                                     TFloat64List(nTplshapes, 0.0),
+                                                     std::vector<bool>(nTplshapes, false));
+                m_result->ChiSquareContinuum[i] = continuumMerit;
+                nPruned++;
+            } else
+            {
+                m_result->ChiSquare[i] = m_model->fit(m_result->Redshifts[i],
+                                                      lambdaRange,
+                                                      m_result->LineModelSolutions[i],
+                                                      m_result->ContinuumModelSolutions[i],
+                                                      contreest_iterations,
+                                                      false);
+                m_result->ScaleMargCorrection[i] = m_model->getScaleMargCorrection();
+                m_result->SetChisquareTplshapeResult(i,
+                                                     m_model->GetChisquareTplshape(),
+                                                     m_model->GetScaleMargTplshape(),
+                                                     m_model->GetStrongELPresentTplshape());
+                if (m_estimateLeastSquareFast)
+                {
+                    m_result->ChiSquareContinuum[i] =
+                            m_model->getLeastSquareContinuumMerit(lambdaRange);
+                } else
+                {
+                    m_result->ChiSquareContinuum[i] =
+                            m_model->getLeastSquareContinuumMeritFast();
+                }
+                bestFittedMerit = std::min(bestFittedMerit, m_result->ChiSquare[i]);
+            }
             calculatedLargeGridRedshifts.push_back(m_result->Redshifts[i]);
             calculatedLargeGridMerits.push_back(m_result->ChiSquare[i]);
-            m_result->ScaleMargCorrection[i] = m_model->getScaleMargCorrection();
-            m_result->SetChisquareTplshapeResult(i,
-                                                 m_model->GetChisquareTplshape(),
-                                                 m_model->GetScaleMargTplshape(),
-                                                 m_model->GetStrongELPresentTplshape());
             for (Int32 k = 0; k < m_result->ChiSquareTplshapes.size(); k++)
             {
                 calculatedChiSquareTplshapes[k].push_back(
                             m_result->ChiSquareTplshapes[k][i]);
             }
-            if (m_estimateLeastSquareFast)
-            {
-                m_result->ChiSquareContinuum[i] =
-                        m_model->getLeastSquareContinuumMerit(lambdaRange);
-            } else
-            {
-                m_result->ChiSquareContinuum[i] =
-                        m_model->getLeastSquareContinuumMeritFast();
-            }
             m_result->ScaleMargCorrectionContinuum[i] =
                     m_model->getContinuumScaleMargCorrection();
-            Log.LogDebug("  Operator-Linemodel: Z interval %d: Chi2 = %f", i,
-                         m_result->ChiSquare[i]);
+            Log.LogDebug("  Operator-Linemodel: Z interval %d: Chi2 = %f%s", i,
+                         m_result->ChiSquare[i], pruned ? " (pruned, continuum only)" : "");
             indexLargeGrid++;
             // Log.LogInfo( "\nLineModel Infos: large grid step %d", i);
         } else
@@ -537,6 +546,20 @@ Int32 COperatorLineModel::ComputeFirstPass(CDataStore &dataStore,
         ++show_progress;
     }
 
+    if (m_opt_firstpass_pruning)
+    {
+        Log.LogInfo("  Operator-Linemodel: first-pass pruning: %d z pruned out of %d "
+                    "fitted (tolerance=%.1f)",
+                    nPruned, calculatedLargeGridMerits.size(),
+                    m_opt_firstpass_pruningTolerance);
+        if (nPruningBoundUnavailable > 0)
+        {
+            Log.LogInfo("  Operator-Linemodel: first-pass pruning: no merit bound "
+                        "for this fitting configuration at %d z",
+                        nPruningBoundUnavailable);
+        }
+    }
+
     // now interpolate large grid merit results onto the fine grid
     if (m_result->Redshifts.size() > calculatedLargeGridMerits.size() &&
         calculatedLargeGridMerits.size() > 1)
@@ -577,6 +600,83 @@ Int32 COperatorLineModel::ComputeFirstPass(CDataStore &dataStore,
     return 0;
 }
 
+/**
+ * @brief COperatorLineModel::createModel
+ * Builds a line model and sets the parameters that do not depend on the pass:
+ * source size, fitting methods, tpl-ratio catalogs and lambda offsets.
+ */
+std::shared_ptr<CLineModelElementList> COperatorLineModel::createModel(const CSpectrum &spectrum,
+                                                                       const CSpectrum &spectrumContinuum,
+                                                                       const CTemplateCatalog &tplCatalog,
+                                                                       const TStringList &tplCategoryList,
+                                                                       const std::string opt_calibrationPath,
+                                                                       const CRayCatalog::TRayVector &restRayList,
+                                                                       const std::string &opt_fittingmethod,
+                                                                       const std::string &opt_continuumcomponent,
+                                                                       const std::string &opt_lineWidthType,
+                                                                       const Float64 opt_resolution,
+                                                                       const Float64 opt_velocityEmission,
+                                                                       const Float64 opt_velocityAbsorption,
+                                                                       const std::string &opt_rules,
+                                                                       const std::string &opt_rigidity)
+{
+    std::shared_ptr<CLineModelElementList> model =
+        std::shared_ptr<CLineModelElementList>(new CLineModelElementList(
+                                                   spectrum,
+                                                   spectrumContinuum,
+                                                   tplCatalog,
+                                                   tplCategoryList,
+                                                   opt_calibrationPath,
+                                                   restRayList,
+                                                   opt_fittingmethod,
+                                                   opt_continuumcomponent,
+                                                   opt_lineWidthType,
+                                                   opt_resolution,
+                                                   opt_velocityEmission,
+                                                   opt_velocityAbsorption,
+                                                   opt_rules,
+                                                   opt_rigidity));
+    model->SetSourcesizeDispersion(m_sourcesizeInit);
+    Log.LogInfo("  Operator-Linemodel: sourcesize init to: ss=%.2f",
+                m_sourcesizeInit);
+
+    // memoize the lines supports over the redshift grid: they are shared by the
+    // continuum mask preparation, the first pass and the second pass
+    model->SetSupportCacheSize(m_sortedRedshifts.size());
+
+    //set some model parameters
+    model->m_opt_firstpass_fittingmethod = m_opt_firstpass_fittingmethod;
+    model->m_opt_secondpass_fittingmethod = opt_fittingmethod;
+
+    if (opt_rigidity == "tplshape")
+    {
+        // init catalog tplratios
+        Log.LogInfo("  Operator-Linemodel: Tpl-ratios init");
+        bool tplratioInitRet =
+            model->initTplratioCatalogs(m_tplratioCatRelPath, m_opt_tplratio_ismFit);
+        if (!tplratioInitRet)
+        {
+            Log.LogError(
+                "  Operator-Linemodel: Failed to init tpl-ratios. aborting...");
+            throw runtime_error("  Operator-Linemodel: Failed to init tpl-ratios. aborting...");
+        }
+
+        model->m_opt_firstpass_forcedisableTplratioISMfit = !m_opt_firstpass_tplratio_ismFit;
+    }
+
+    // init catalog offsets
+    Log.LogInfo("  Operator-Linemodel: Lambda offsets init");
+    try
+    {
+        model->initLambdaOffsets(m_offsetCatRelPath);
+    } catch (std::exception const &e)
+    {
+        Log.LogError("  Operator-Linemodel: Failed to init lambda offsets. "
+                     "Continuing without offsets...");
+    }
+
+    return model;
+}
 
 void COperatorLineModel::PrecomputeContinuumFit(const CSpectrum &spectrum,
                                                  const CSpectrum &spectrumContinuum,
@@ -600,10 +700,22 @@ void COperatorLineModel::PrecomputeContinuumFit(const CSpectrum &spectrum,
                 minRedshift,
                 maxRedshift);
 
+    // the store keeps at most one candidate per template, and only the maxN best ones if requested
+    Int32 ntpl = 0;
+    for (UInt32 i = 0; i < tplCategoryList.size(); i++)
+    {
+        ntpl += tplCatalog.GetTemplateCount(tplCategoryList[i]);
+    }
+    Int32 maxContinuumCandidates = ntpl;
+    if(m_opt_fitcontinuum_maxN!=-1)
+    {
+        maxContinuumCandidates = std::min(m_opt_fitcontinuum_maxN, ntpl);
+    }
     CTemplatesFitStore *tplfitStore = new CTemplatesFitStore(minRedshift,
                                                              maxRedshift,
                                                              redshiftStep,
-                                                             zsampling);
+                                                             zsampling,
+                                                             maxContinuumCandidates);
     std::vector<Float64> redshiftsTplFit = tplfitStore->GetRedshiftList();
     Log.LogInfo("  Operator-Linemodel: continuum tpl redshift list n=%d",redshiftsTplFit.size());
     for(UInt32 kztplfit=0; kztplfit<std::min(Int32(redshiftsTplFit.size()), Int32(10)); kztplfit++)
@@ -613,7 +725,7 @@ void COperatorLineModel::PrecomputeContinuumFit(const CSpectrum &spectrum,
                     redshiftsTplFit[kztplfit]);
     }
     std::vector<std::shared_ptr<CChisquareResult>> chisquareResultsAllTpl;
-    std::vector<std::string> chisquareResultsTplName;
+    std::vector<Int32> chisquareResultsTplId;
 
     std::string opt_chi2operator = "chisquarelog"; //"chisquare2"; //
     if (redshiftsTplFit.size() < 100 && opt_chi2operator != "chisquare2")
@@ -718,7 +830,7 @@ void COperatorLineModel::PrecomputeContinuumFit(const CSpectrum &spectrum,
             } else
             {
                 chisquareResultsAllTpl.push_back(chisquareResult);
-                chisquareResultsTplName.push_back(tpl.GetName());
+                chisquareResultsTplId.push_back(tplfitStore->RegisterTemplate(tpl.GetName()));
             }
         }
     }
@@ -736,7 +848,7 @@ void COperatorLineModel::PrecomputeContinuumFit(const CSpectrum &spectrum,
                 std::dynamic_pointer_cast<CChisquareResult>(
                     chisquareResultsAllTpl[j]);
 
-            Int32 retAdd = tplfitStore->Add(chisquareResultsTplName[j],
+            Int32 retAdd = tplfitStore->Add(chisquareResultsTplId[j],
                              chisquareResult->FitDustCoeff[i],
                              chisquareResult->FitMeiksinIdx[i],
                              redshift,
@@ -753,6 +865,7 @@ void COperatorLineModel::PrecomputeContinuumFit(const CSpectrum &spectrum,
     }
 
     // Set tplFitStore if needed
+    m_tplfitStore = tplfitStore;
     m_model->SetFitContinuum_FitStore(tplfitStore);
 
     boost::chrono::thread_clock::time_point stop_tplfitprecompute =
@@ -806,6 +919,10 @@ Int32 COperatorLineModel::ComputeCandidates(const Int32 opt_extremacount,
     {
         for (Int32 ke = 0; ke < m_result->Redshifts.size(); ke++)
         {
+            if (m_result->FirstpassPruned[ke])
+            {
+                continue;
+            }
             m_firstpass_extremumList.push_back(
                 SPoint(m_result->Redshifts[ke], m_result->ChiSquare[ke]));
         }
@@ -822,9 +939,39 @@ Int32 COperatorLineModel::ComputeCandidates(const Int32 opt_extremacount,
         {
             invertForMinSearch = false;
         }
+
+        // the z skipped by the first pass pruning are set to the worst fitted
+        // value, so that they can't be found as extrema
+        std::vector<Float64> searchValues = floatValues;
+        if (searchValues.size() == m_result->FirstpassPruned.size())
+        {
+            Float64 worstFittedValue = invertForMinSearch ? -DBL_MAX : DBL_MAX;
+            for (Int32 ke = 0; ke < searchValues.size(); ke++)
+            {
+                if (m_result->FirstpassPruned[ke])
+                {
+                    continue;
+                }
+                if (invertForMinSearch)
+                {
+                    worstFittedValue = std::max(worstFittedValue, searchValues[ke]);
+                } else
+                {
+                    worstFittedValue = std::min(worstFittedValue, searchValues[ke]);
+                }
+            }
+            for (Int32 ke = 0; ke < searchValues.size(); ke++)
+            {
+                if (m_result->FirstpassPruned[ke])
+                {
+                    searchValues[ke] = worstFittedValue;
+                }
+            }
+        }
+
         CExtremum extremum(redshiftsRange, opt_extremacount, invertForMinSearch,
                            2);
-        extremum.Find(m_result->Redshifts, floatValues, m_firstpass_extremumList);
+        extremum.Find(m_result->Redshifts, searchValues, m_firstpass_extremumList);
         if (m_firstpass_extremumList.size() == 0)
         {
             Log.LogError("  Operator-Linemodel: Extremum find method failed");
@@ -985,6 +1132,19 @@ Int32 COperatorLineModel::ComputeSecondPass(CDataStore &dataStore,
     // Set model parameters to SECOND-PASS
     m_model->setPassMode(2);
     Int32 savedFitContinuumOption = m_model->GetFitContinuum_Option();
+    initSecondPassCandidateModels(spectrum,
+                                  spectrumContinuum,
+                                  tplCatalog,
+                                  tplCategoryList,
+                                  opt_calibrationPath,
+                                  opt_fittingmethod,
+                                  opt_continuumcomponent,
+                                  opt_lineWidthType,
+                                  opt_resolution,
+                                  opt_velocityEmission,
+                                  opt_velocityAbsorption,
+                                  opt_rules,
+                                  opt_rigidity);
 
     Log.LogInfo("  Operator-Linemodel: ---------- ---------- ---------- ----------");
     Log.LogInfo("  Operator-Linemodel: now computing second-pass");
@@ -1038,13 +1198,19 @@ Int32 COperatorLineModel::ComputeSecondPass(CDataStore &dataStore,
                 m_secondpass_parameters_extremaResult.FittedTplRedshift[i] = m_secondpass_parameters_extremaResult.Extrema[i];
             }
         }
-        m_model->SetFittingMethod(m_opt_secondpasslcfittingmethod);
+        for (Int32 i = 0; i < m_secondpass_candidateModels.size(); i++)
+        {
+            m_secondpass_candidateModels[i]->SetFittingMethod(m_opt_secondpasslcfittingmethod);
+        }
         RecomputeAroundCandidates(_secondpass_extremumList,
                                   lambdaRange,
                                   opt_continuumreest,
                                   2,
                                   true);
-        m_model->SetFittingMethod(opt_fittingmethod);
+        for (Int32 i = 0; i < m_secondpass_candidateModels.size(); i++)
+        {
+            m_secondpass_candidateModels[i]->SetFittingMethod(opt_fittingmethod);
+        }
 
         Log.LogInfo("  Operator-Linemodel: now re-computing the final chi2 for each candidate");
         RecomputeAroundCandidates(_secondpass_extremumList,
@@ -1053,6 +1219,7 @@ Int32 COperatorLineModel::ComputeSecondPass(CDataStore &dataStore,
                                   2);
 
     }
+    m_secondpass_candidateModels.clear();
 
     boost::chrono::thread_clock::time_point stop_secondpass =
         boost::chrono::thread_clock::now();
@@ -1408,6 +1575,119 @@ Int32 COperatorLineModel::ComputeSecondPass(CDataStore &dataStore,
     return 0;
 }
 
+/**
+ * @brief COperatorLineModel::initSecondPassCandidateModels
+ * Sets the model used by each first pass candidate in the second pass. With
+ * more than one candidate, each candidate gets its own model, built and set
+ * as m_model in the first pass: no velocity or continuum state is carried
+ * from a candidate to the next, and the results do not depend on
+ * m_opt_secondpass_threadCount, whether the candidates are refined serially
+ * or concurrently.
+ */
+void COperatorLineModel::initSecondPassCandidateModels(const CSpectrum &spectrum,
+                                                       const CSpectrum &spectrumContinuum,
+                                                       const CTemplateCatalog &tplCatalog,
+                                                       const TStringList &tplCategoryList,
+                                                       const std::string opt_calibrationPath,
+                                                       const std::string &opt_fittingmethod,
+                                                       const std::string &opt_continuumcomponent,
+                                                       const std::string &opt_lineWidthType,
+                                                       const Float64 opt_resolution,
+                                                       const Float64 opt_velocityEmission,
+                                                       const Float64 opt_velocityAbsorption,
+                                                       const std::string &opt_rules,
+                                                       const std::string &opt_rigidity)
+{
+    Int32 nCandidates = m_firstpass_extremumList.size();
+    m_secondpass_candidateModels.assign(nCandidates, m_model);
+    m_secondpass_candidateErrors.assign(nCandidates, "");
+    if (nCandidates < 2)
+    {
+        return;
+    }
+
+    Log.LogInfo("  Operator-Linemodel: Second pass - building one model per candidate (n=%d)", nCandidates);
+    for (Int32 i = 0; i < nCandidates; i++)
+    {
+        std::shared_ptr<CLineModelElementList> model = createModel(spectrum,
+                                                                   spectrumContinuum,
+                                                                   tplCatalog,
+                                                                   tplCategoryList,
+                                                                   opt_calibrationPath,
+                                                                   m_model->m_RestRayList,
+                                                                   opt_fittingmethod,
+                                                                   opt_continuumcomponent,
+                                                                   opt_lineWidthType,
+                                                                   opt_resolution,
+                                                                   opt_velocityEmission,
+                                                                   opt_velocityAbsorption,
+                                                                   opt_rules,
+                                                                   opt_rigidity);
+        if (m_tplfitStore != NULL)
+        {
+            model->SetFitContinuum_FitStore(m_tplfitStore);
+        }
+        model->m_opt_fitcontinuum_maxCount = m_model->m_opt_fitcontinuum_maxCount;
+        model->m_opt_firstpass_forcedisableMultipleContinuumfit = m_model->m_opt_firstpass_forcedisableMultipleContinuumfit;
+        model->SetAbsLinesLimit(m_absLinesLimit);
+        model->SetLeastSquareFastEstimationEnabled(m_estimateLeastSquareFast);
+        model->setPassMode(2);
+        model->SetFitContinuum_Option(m_model->GetFitContinuum_Option());
+        m_secondpass_candidateModels[i] = model;
+    }
+}
+
+/**
+ * @brief COperatorLineModel::runSecondPassCandidateTasks
+ * Runs one task per candidate: serially, or on m_opt_secondpass_threadCount
+ * threads. An exception raised by a task is rethrown once all the tasks are
+ * done.
+ */
+void COperatorLineModel::runSecondPassCandidateTasks(std::vector<boost::function<void ()>> &tasks)
+{
+    if (m_opt_secondpass_threadCount <= 0 || tasks.size() < 2)
+    {
+        for (Int32 i = 0; i < tasks.size(); i++)
+        {
+            tasks[i]();
+        }
+        return;
+    }
+
+    {
+        CThreadPool threadPool(std::min(m_opt_secondpass_threadCount, Int32(tasks.size())));
+        for (Int32 i = 0; i < tasks.size(); i++)
+        {
+            threadPool.AddTask(boost::bind(&COperatorLineModel::runSecondPassCandidateTask,
+                                           this,
+                                           tasks[i],
+                                           i));
+        }
+    }
+
+    for (Int32 i = 0; i < tasks.size(); i++)
+    {
+        if (!m_secondpass_candidateErrors[i].empty())
+        {
+            Log.LogError("  Operator-Linemodel: Second pass failed for candidate #%d: %s",
+                         i,
+                         m_secondpass_candidateErrors[i].c_str());
+            throw runtime_error(m_secondpass_candidateErrors[i]);
+        }
+    }
+}
+
+void COperatorLineModel::runSecondPassCandidateTask(boost::function<void ()> task, Int32 icandidate)
+{
+    try
+    {
+        task();
+    } catch (std::exception const &e)
+    {
+        m_secondpass_candidateErrors[icandidate] = e.what();
+    }
+}
+
 /**
  * @brief COperatorLineModel::estimateSecondPassParameters
  * - Estimates best parameters: elv and alv
@@ -1468,380 +1748,389 @@ Int32 COperatorLineModel::EstimateSecondPassParameters(const CSpectrum &spectrum
     }
 
     m_secondpass_parameters_extremaResult.Resize(m_firstpass_extremumList.size());
+    m_secondPass_velfitEnabled = enableVelocityFitting;
+    m_secondPass_velfitMinE = velfitMinE;
+    m_secondPass_velfitMaxE = velfitMaxE;
+    m_secondPass_velfitStepE = velfitStepE;
+    m_secondPass_velfitMinA = velfitMinA;
+    m_secondPass_velfitMaxA = velfitMaxA;
+    m_secondPass_velfitStepA = velfitStepA;
+
+    std::vector<boost::function<void ()>> tasks;
     for (Int32 i = 0; i < m_firstpass_extremumList.size(); i++)
     {
-        Log.LogInfo("");
-        Log.LogInfo("  Operator-Linemodel: Second pass - estimate parameters for candidate #%d", i);
-        Log.LogInfo("  Operator-Linemodel: ---------- /\\ ---------- ---------- ---------- Candidate #%d", i);
-        Float64 z = m_firstpass_extremumList[i].X;
-        Float64 m = m_firstpass_extremumList[i].Y;
-
-        m_secondpass_parameters_extremaResult.Extrema[i] = z;
-        m_secondpass_parameters_extremaResult.ExtremaMerit[i] = m;
+        tasks.push_back(boost::bind(&COperatorLineModel::estimateSecondPassParametersCandidate,
+                                    this,
+                                    i,
+                                    boost::cref(spectrum),
+                                    boost::cref(lambdaRange),
+                                    boost::cref(opt_continuumreest),
+                                    boost::cref(opt_fittingmethod),
+                                    boost::cref(opt_rigidity)));
+    }
+    runSecondPassCandidateTasks(tasks);
 
-        // fix the fitcontinuum values for this extremum : keep the 1st pass values
-        if(m_opt_secondpass_estimateParms_tplfit_fixfromfirstpass)
-        {
-            m_secondpass_parameters_extremaResult.FittedTplName[i] = m_firstpass_extremaResult.FittedTplName[i];
-            m_secondpass_parameters_extremaResult.FittedTplAmplitude[i] = m_firstpass_extremaResult.FittedTplAmplitude[i];
-            m_secondpass_parameters_extremaResult.FittedTplMerit[i] = m_firstpass_extremaResult.FittedTplMerit[i];
-            m_secondpass_parameters_extremaResult.FittedTplDustCoeff[i] = m_firstpass_extremaResult.FittedTplDustCoeff[i];
-            m_secondpass_parameters_extremaResult.FittedTplMeiksinIdx[i] = m_firstpass_extremaResult.FittedTplMeiksinIdx[i];
-            m_secondpass_parameters_extremaResult.FittedTplRedshift[i] = m_firstpass_extremaResult.FittedTplRedshift[i];
-            m_secondpass_parameters_extremaResult.FittedTplpCoeffs[i] = m_firstpass_extremaResult.FittedTplpCoeffs[i] ;
+    return 0;
+}
 
-            m_model->SetFitContinuum_FitValues(m_firstpass_extremaResult.FittedTplName[i],
-                                               m_firstpass_extremaResult.FittedTplAmplitude[i],
-                                               m_firstpass_extremaResult.FittedTplMerit[i],
-                                               m_firstpass_extremaResult.FittedTplDustCoeff[i],
-                                               m_firstpass_extremaResult.FittedTplMeiksinIdx[i],
-                                               m_firstpass_extremaResult.FittedTplRedshift[i],
-                                               -1.,
-                                               -1.,
-                                               m_firstpass_extremaResult.FittedTplpCoeffs[i]);
-            m_model->SetFitContinuum_Option(2);
+/**
+ * @brief COperatorLineModel::estimateSecondPassParametersCandidate
+ * Estimates the second pass parameters of the candidate #i, using the model
+ * of this candidate. The velocity fitting grid is set by EstimateSecondPassParameters.
+ */
+void COperatorLineModel::estimateSecondPassParametersCandidate(Int32 i,
+                                                               const CSpectrum &spectrum,
+                                                               const TFloat64Range &lambdaRange,
+                                                               const std::string &opt_continuumreest,
+                                                               const std::string &opt_fittingmethod,
+                                                               const std::string &opt_rigidity)
+{
+    std::shared_ptr<CLineModelElementList> model = m_secondpass_candidateModels[i];
+    bool enableVelocityFitting = m_secondPass_velfitEnabled;
+    Float64 velfitMinE = m_secondPass_velfitMinE;
+    Float64 velfitMaxE = m_secondPass_velfitMaxE;
+    Float64 velfitStepE = m_secondPass_velfitStepE;
+    Float64 velfitMinA = m_secondPass_velfitMinA;
+    Float64 velfitMaxA = m_secondPass_velfitMaxA;
+    Float64 velfitStepA = m_secondPass_velfitStepA;
+
+    Log.LogInfo("");
+    Log.LogInfo("  Operator-Linemodel: Second pass - estimate parameters for candidate #%d", i);
+    Log.LogInfo("  Operator-Linemodel: ---------- /\\ ---------- ---------- ---------- Candidate #%d", i);
+    Float64 z = m_firstpass_extremumList[i].X;
+    Float64 m = m_firstpass_extremumList[i].Y;
+
+    m_secondpass_parameters_extremaResult.Extrema[i] = z;
+    m_secondpass_parameters_extremaResult.ExtremaMerit[i] = m;
+
+    // fix the fitcontinuum values for this extremum : keep the 1st pass values
+    if(m_opt_secondpass_estimateParms_tplfit_fixfromfirstpass)
+    {
+        m_secondpass_parameters_extremaResult.FittedTplName[i] = m_firstpass_extremaResult.FittedTplName[i];
+        m_secondpass_parameters_extremaResult.FittedTplAmplitude[i] = m_firstpass_extremaResult.FittedTplAmplitude[i];
+        m_secondpass_parameters_extremaResult.FittedTplMerit[i] = m_firstpass_extremaResult.FittedTplMerit[i];
+        m_secondpass_parameters_extremaResult.FittedTplDustCoeff[i] = m_firstpass_extremaResult.FittedTplDustCoeff[i];
+        m_secondpass_parameters_extremaResult.FittedTplMeiksinIdx[i] = m_firstpass_extremaResult.FittedTplMeiksinIdx[i];
+        m_secondpass_parameters_extremaResult.FittedTplRedshift[i] = m_firstpass_extremaResult.FittedTplRedshift[i];
+        m_secondpass_parameters_extremaResult.FittedTplpCoeffs[i] = m_firstpass_extremaResult.FittedTplpCoeffs[i] ;
+
+        model->SetFitContinuum_FitValues(m_firstpass_extremaResult.FittedTplName[i],
+                                         m_firstpass_extremaResult.FittedTplAmplitude[i],
+                                         m_firstpass_extremaResult.FittedTplMerit[i],
+                                         m_firstpass_extremaResult.FittedTplDustCoeff[i],
+                                         m_firstpass_extremaResult.FittedTplMeiksinIdx[i],
+                                         m_firstpass_extremaResult.FittedTplRedshift[i],
+                                         -1.,
+                                         -1.,
+                                         m_firstpass_extremaResult.FittedTplpCoeffs[i]);
+        model->SetFitContinuum_Option(2);
+    }
+
+
+    // find the index in the zaxis results
+    Int32 idx = -1;
+    for (UInt32 i2 = 0; i2 < m_result->Redshifts.size(); i2++)
+    {
+        if (m_result->Redshifts[i2] == z)
+        {
+            idx = i2;
+            break;
         }
+    }
+    if (idx == -1)
+    {
+        Log.LogInfo("  Operator-Linemodel: Problem. could not find "
+                    "extrema solution index...");
+        return;
+    }
 
+    // reestimate the model (eventually with continuum reestimation) on
+    // the extrema selected
+    Int32 contreest_iterations = 0;
+    if (opt_continuumreest == "always")
+    {
+        contreest_iterations = 1;
+    } else
+    {
+        contreest_iterations = 0;
+    }
 
-        // find the index in the zaxis results
-        Int32 idx = -1;
-        for (UInt32 i2 = 0; i2 < m_result->Redshifts.size(); i2++)
-        {
-            if (m_result->Redshifts[i2] == z)
+    // model.LoadModelSolution(m_result->LineModelSolutions[idx]);
+    model->fit(m_result->Redshifts[idx],
+               lambdaRange,
+               m_result->LineModelSolutions[idx],
+               m_result->ContinuumModelSolutions[idx],
+               contreest_iterations, false);
+    // m = m_result->ChiSquare[idx];
+    if (enableVelocityFitting)
+    {
+        Bool enableManualStepVelocityFit = true;
+        Bool enableLMVelocityFit = false; //note: the lmfit results are shared by all the candidates, not to be enabled with m_opt_secondpass_threadCount>0
+        if (enableLMVelocityFit)
+        {
+            // fit the emission and absorption width using the linemodel
+            // lmfit strategy
+            model->SetFittingMethod("lmfit");
+            // m_model->SetElementIndexesDisabledAuto();
+
+            Log.LogInfo("  Operator-Linemodel: Lm fit for extrema %d",
+                        i);
+            model->fit(m_result->Redshifts[idx], lambdaRange,
+                       m_result->LineModelSolutions[idx],
+                       m_result->ContinuumModelSolutions[idx],
+                       contreest_iterations, true);
+            mlmfit_modelInfoSave = true;
+            // CModelSpectrumResult
+            std::shared_ptr<CModelSpectrumResult> resultspcmodel =
+                    std::shared_ptr<CModelSpectrumResult>(
+                        new CModelSpectrumResult(
+                            model->GetModelSpectrum()));
+            // std::shared_ptr<CModelSpectrumResult>  resultspcmodel =
+            // std::shared_ptr<CModelSpectrumResult>( new
+            // CModelSpectrumResult(model->GetObservedSpectrumWithLinesRemoved())
+            // );
+            mlmfit_savedModelSpectrumResults_lmfit.push_back(resultspcmodel);
+            // CModelFittingResult
+            std::shared_ptr<CModelFittingResult> resultfitmodel =
+                    std::shared_ptr<CModelFittingResult>(
+                        new CModelFittingResult(
+                            m_result->LineModelSolutions[idx],
+                            m_result->Redshifts[idx],
+                            m_result->ChiSquare[idx], m_result->restRayList,
+                            model->GetVelocityEmission(),
+                            model->GetVelocityAbsorption()));
+            mlmfit_savedModelFittingResults_lmfit.push_back(resultfitmodel);
+            // CModelRulesResult
+            std::shared_ptr<CModelRulesResult> resultrulesmodel =
+                    std::shared_ptr<CModelRulesResult>(
+                        new CModelRulesResult(model->GetModelRulesLog()));
+            mlmfit_savedModelRulesResults_lmfit.push_back(resultrulesmodel);
+
+            std::shared_ptr<CSpectraFluxResult> baselineResult_lmfit =
+                    (std::shared_ptr<
+                     CSpectraFluxResult>)new CSpectraFluxResult();
+            baselineResult_lmfit->m_optio = 0;
+            const CSpectrumFluxAxis &modelContinuumFluxAxis =
+                    model->GetModelContinuum();
+            UInt32 len = modelContinuumFluxAxis.GetSamplesCount();
+
+            baselineResult_lmfit->fluxes.resize(len);
+            baselineResult_lmfit->wavel.resize(len);
+            for (Int32 k = 0; k < len; k++)
             {
-                idx = i2;
-                break;
+                baselineResult_lmfit->fluxes[k] =
+                        modelContinuumFluxAxis[k];
+                baselineResult_lmfit->wavel[k] =
+                        (spectrum.GetSpectralAxis())[k];
             }
-        }
-        if (idx == -1)
-        {
-            Log.LogInfo("  Operator-Linemodel: Problem. could not find "
-                        "extrema solution index...");
-            continue;
-        }
+            mlmfit_savedBaselineResult_lmfit.push_back(baselineResult_lmfit);
 
-        // reestimate the model (eventually with continuum reestimation) on
-        // the extrema selected
-        Int32 contreest_iterations = 0;
-        if (opt_continuumreest == "always")
-        {
-            contreest_iterations = 1;
-        } else
-        {
-            contreest_iterations = 0;
+            z = m_result->LineModelSolutions[idx].Redshift;
+            m_result->ExtremaResult.lmfitPass.push_back(z);
+            // m_result->Redshifts[idx] = z;
+
+            model->SetFittingMethod(opt_fittingmethod);
+            model->ResetElementIndexesDisabled();
+            Int32 velocityHasBeenReset =
+                    model->ApplyVelocityBound(velfitMinE, velfitMaxE);
+            enableManualStepVelocityFit = velocityHasBeenReset;
         }
 
-        // model.LoadModelSolution(m_result->LineModelSolutions[idx]);
-        m_model->fit(m_result->Redshifts[idx],
-                     lambdaRange,
-                     m_result->LineModelSolutions[idx],
-                     m_result->ContinuumModelSolutions[idx],
-                     contreest_iterations, false);
-        // m = m_result->ChiSquare[idx];
-        if (enableVelocityFitting)
+        if (enableManualStepVelocityFit)
         {
-            Bool enableManualStepVelocityFit = true;
-            Bool enableLMVelocityFit = false;
-            if (enableLMVelocityFit)
+            // fit the emission and absorption width by minimizing the
+            // linemodel merit with linemodel "hybrid" fitting method
+            model->SetFittingMethod("hybrid");
+            if (opt_rigidity == "tplshape")
             {
-                // fit the emission and absorption width using the linemodel
-                // lmfit strategy
-                m_model->SetFittingMethod("lmfit");
-                // m_model->SetElementIndexesDisabledAuto();
-
-                Log.LogInfo("  Operator-Linemodel: Lm fit for extrema %d",
-                            i);
-                m_model->fit(m_result->Redshifts[idx], lambdaRange,
-                             m_result->LineModelSolutions[idx],
-                             m_result->ContinuumModelSolutions[idx],
-                             contreest_iterations, true);
-                mlmfit_modelInfoSave = true;
-                // CModelSpectrumResult
-                std::shared_ptr<CModelSpectrumResult> resultspcmodel =
-                        std::shared_ptr<CModelSpectrumResult>(
-                            new CModelSpectrumResult(
-                                m_model->GetModelSpectrum()));
-                // std::shared_ptr<CModelSpectrumResult>  resultspcmodel =
-                // std::shared_ptr<CModelSpectrumResult>( new
-                // CModelSpectrumResult(m_model->GetObservedSpectrumWithLinesRemoved())
-                // );
-                mlmfit_savedModelSpectrumResults_lmfit.push_back(resultspcmodel);
-                // CModelFittingResult
-                std::shared_ptr<CModelFittingResult> resultfitmodel =
-                        std::shared_ptr<CModelFittingResult>(
-                            new CModelFittingResult(
-                                m_result->LineModelSolutions[idx],
-                                m_result->Redshifts[idx],
-                                m_result->ChiSquare[idx], m_result->restRayList,
-                                m_model->GetVelocityEmission(),
-                                m_model->GetVelocityAbsorption()));
-                mlmfit_savedModelFittingResults_lmfit.push_back(resultfitmodel);
-                // CModelRulesResult
-                std::shared_ptr<CModelRulesResult> resultrulesmodel =
-                        std::shared_ptr<CModelRulesResult>(
-                            new CModelRulesResult(m_model->GetModelRulesLog()));
-                mlmfit_savedModelRulesResults_lmfit.push_back(resultrulesmodel);
+                model->SetFittingMethod("individual");
+            }
+            // m_model->m_enableAmplitudeOffsets = true;
+            // contreest_iterations = 1;
+            std::vector<std::vector<Int32>> idxVelfitGroups;
 
-                std::shared_ptr<CSpectraFluxResult> baselineResult_lmfit =
-                        (std::shared_ptr<
-                         CSpectraFluxResult>)new CSpectraFluxResult();
-                baselineResult_lmfit->m_optio = 0;
-                const CSpectrumFluxAxis &modelContinuumFluxAxis =
-                        m_model->GetModelContinuum();
-                UInt32 len = modelContinuumFluxAxis.GetSamplesCount();
+            for (Int32 iLineType = 0; iLineType < 2; iLineType++)
+            {
+                Float64 vInfLim;
+                Float64 vSupLim;
+                Float64 vStep;
 
-                baselineResult_lmfit->fluxes.resize(len);
-                baselineResult_lmfit->wavel.resize(len);
-                for (Int32 k = 0; k < len; k++)
+                if (iLineType == 0)
                 {
-                    baselineResult_lmfit->fluxes[k] =
-                            modelContinuumFluxAxis[k];
-                    baselineResult_lmfit->wavel[k] =
-                            (spectrum.GetSpectralAxis())[k];
+                    Log.LogInfo("  Operator-Linemodel: manualStep velocity fit ABSORPTION, for z = %.6f",
+                                m_result->Redshifts[idx]);
+                    vInfLim = velfitMinA;
+                    vSupLim = velfitMaxA;
+                    vStep = velfitStepA;
+                    if (m_enableWidthFitByGroups)
+                    {
+                        idxVelfitGroups.clear();
+                        idxVelfitGroups = model->GetModelVelfitGroups(CRay::nType_Absorption);
+                        Log.LogInfo("  Operator-Linemodel: VelfitGroups ABSORPTION - n = %d",
+                                    idxVelfitGroups.size());
+                        if (m_firstpass_extremumList.size() > 1 && idxVelfitGroups.size() > 1)
+                        {
+                            Log.LogError(
+                                        "  Operator-Linemodel: not allowed to "
+                                        "use more than 1 group per E/A for "
+                                        "more than 1 extremum (see .json "
+                                        "linemodel.extremacount)");
+                        }
+                    }
+                } else
+                {
+                    Log.LogInfo("  Operator-Linemodel: manualStep velocity fit EMISSION, for z = %.6f",
+                                m_result->Redshifts[idx]);
+                    vInfLim = velfitMinE;
+                    vSupLim = velfitMaxE;
+                    vStep = velfitStepE;
+                    if (m_enableWidthFitByGroups)
+                    {
+                        idxVelfitGroups.clear();
+                        idxVelfitGroups = model->GetModelVelfitGroups(
+                                  CRay::nType_Emission);
+                        Log.LogInfo("  Operator-Linemodel: VelfitGroups EMISSION - n = %d",
+                                    idxVelfitGroups.size());
+                        if (m_firstpass_extremumList.size() > 1 && idxVelfitGroups.size() > 1)
+                        {
+                            Log.LogError(
+                                        "  Operator-Linemodel: not allowed to "
+                                        "use more than 1 group per E/A for "
+                                        "more than 1 extremum (see .json "
+                                        "linemodel.extremacount)");
+                        }
+                    }
                 }
-                mlmfit_savedBaselineResult_lmfit.push_back(baselineResult_lmfit);
 
-                z = m_result->LineModelSolutions[idx].Redshift;
-                m_result->ExtremaResult.lmfitPass.push_back(z);
-                // m_result->Redshifts[idx] = z;
+                // Prepare velocity grid to be checked
+                Int32 nSteps = (int)((vSupLim - vInfLim) / vStep);
 
-                m_model->SetFittingMethod(opt_fittingmethod);
-                m_model->ResetElementIndexesDisabled();
-                Int32 velocityHasBeenReset =
-                        m_model->ApplyVelocityBound(velfitMinE, velfitMaxE);
-                enableManualStepVelocityFit = velocityHasBeenReset;
-            }
+                Float64 dzInfLim = m_secondPass_velfit_dzInfLim;
+                if (m_result->Redshifts[idx] + dzInfLim <
+                        m_result->Redshifts[0])
+                {
+                    dzInfLim = m_result->Redshifts[0] -
+                            m_result->Redshifts[idx];
+                }
+                Float64 dzSupLim = m_secondPass_velfit_dzSupLim;
+                if (m_result->Redshifts[idx] + dzSupLim >
+                        m_result->Redshifts[m_result->Redshifts.size() - 1])
+                {
+                    dzSupLim =
+                            m_result->Redshifts[m_result->Redshifts.size() -
+                            1] -
+                            m_result->Redshifts[idx];
+                }
 
-            if (enableManualStepVelocityFit)
-            {
-                // fit the emission and absorption width by minimizing the
-                // linemodel merit with linemodel "hybrid" fitting method
-                m_model->SetFittingMethod("hybrid");
-                if (opt_rigidity == "tplshape")
+                Float64 dzStep = m_secondPass_velfit_dzStep;
+                Int32 nDzSteps = (int)((dzSupLim - dzInfLim) / dzStep);
+                if (nDzSteps == 0)
+                {
+                    nDzSteps = 1;
+                    dzInfLim = 0.;
+                    dzSupLim = 0.;
+                }else
                 {
-                    m_model->SetFittingMethod("individual");
+                    Log.LogInfo("  Operator-Linemodel: dzInfLim n=%e", dzInfLim);
+                    Log.LogInfo("  Operator-Linemodel: dzSupLim n=%e", dzSupLim);
+                    Log.LogInfo("  Operator-Linemodel: manualStep n=%d", nDzSteps);
                 }
-                // m_model->m_enableAmplitudeOffsets = true;
-                // contreest_iterations = 1;
-                std::vector<std::vector<Int32>> idxVelfitGroups;
 
-                for (Int32 iLineType = 0; iLineType < 2; iLineType++)
+                Int32 n_progresssteps = idxVelfitGroups.size() * nDzSteps * nSteps;
+                // std::cout is not shared between the candidate threads: progress only shown when serial
+                std::unique_ptr<boost::progress_display> show_progress;
+                if (m_opt_secondpass_threadCount <= 0)
                 {
-                    Float64 vInfLim;
-                    Float64 vSupLim;
-                    Float64 vStep;
+                    show_progress.reset(new boost::progress_display(n_progresssteps));
+                }
+                for (Int32 kgroup = 0; kgroup < idxVelfitGroups.size(); kgroup++)
+                {
+                    Log.LogInfo("  Operator-Linemodel: manualStep fitting group=%d", kgroup);
 
-                    if (iLineType == 0)
+                    Float64 meritMin = DBL_MAX;
+                    Float64 vOptim = -1.0;
+                    Int32 nFits = 0;
+                    for (Int32 kdz = 0; kdz < nDzSteps; kdz++)
                     {
-                        Log.LogInfo("  Operator-Linemodel: manualStep velocity fit ABSORPTION, for z = %.6f",
-                                    m_result->Redshifts[idx]);
-                        vInfLim = velfitMinA;
-                        vSupLim = velfitMaxA;
-                        vStep = velfitStepA;
-                        if (m_enableWidthFitByGroups)
+                        Float64 dzTest = dzInfLim + kdz * dzStep;
+                        TFloat64List merits;
+                        TFloat64List velocities;
+                        nFits += fitVelocityGrid(model,
+                                                 m_result->Redshifts[idx] + dzTest*(1.+m_result->Redshifts[idx]),
+                                                 vInfLim,
+                                                 vStep,
+                                                 nSteps,
+                                                 iLineType,
+                                                 idxVelfitGroups[kgroup],
+                                                 lambdaRange,
+                                                 contreest_iterations,
+                                                 m_result->LineModelSolutions[idx], //maybe this member result should be replaced by an unused variable
+                                                 m_result->ContinuumModelSolutions[idx], //maybe this member result should be replaced by an unused variable
+                                                 merits,
+                                                 velocities);
+                        // the velocities that were not fitted have a NaN merit
+                        for (Int32 kv = 0; kv < nSteps; kv++)
                         {
-                            idxVelfitGroups.clear();
-                            idxVelfitGroups = m_model->GetModelVelfitGroups(CRay::nType_Absorption);
-                            Log.LogInfo("  Operator-Linemodel: VelfitGroups ABSORPTION - n = %d",
-                                        idxVelfitGroups.size());
-                            if (m_firstpass_extremumList.size() > 1 && idxVelfitGroups.size() > 1)
+                            if (meritMin > merits[kv])
                             {
-                                Log.LogError(
-                                            "  Operator-Linemodel: not allowed to "
-                                            "use more than 1 group per E/A for "
-                                            "more than 1 extremum (see .json "
-                                            "linemodel.extremacount)");
+                                meritMin = merits[kv];
+                                vOptim = velocities[kv];
                             }
                         }
-                    } else
-                    {
-                        Log.LogInfo("  Operator-Linemodel: manualStep velocity fit EMISSION, for z = %.6f",
-                                    m_result->Redshifts[idx]);
-                        vInfLim = velfitMinE;
-                        vSupLim = velfitMaxE;
-                        vStep = velfitStepE;
-                        if (m_enableWidthFitByGroups)
+                        if (show_progress)
                         {
-                            idxVelfitGroups.clear();
-                            idxVelfitGroups = m_model->GetModelVelfitGroups(
-                                        CRay::nType_Emission);
-                            Log.LogInfo("  Operator-Linemodel: VelfitGroups EMISSION - n = %d",
-                                        idxVelfitGroups.size());
-                            if (m_firstpass_extremumList.size() > 1 && idxVelfitGroups.size() > 1)
-                            {
-                                Log.LogError(
-                                            "  Operator-Linemodel: not allowed to "
-                                            "use more than 1 group per E/A for "
-                                            "more than 1 extremum (see .json "
-                                            "linemodel.extremacount)");
-                            }
+                            *show_progress += nSteps;
                         }
                     }
-
-                    // Prepare velocity grid to be checked
-                    Int32 nSteps = (int)((vSupLim - vInfLim) / vStep);
-
-                    Float64 dzInfLim = m_secondPass_velfit_dzInfLim;
-                    if (m_result->Redshifts[idx] + dzInfLim <
-                            m_result->Redshifts[0])
-                    {
-                        dzInfLim = m_result->Redshifts[0] -
-                                m_result->Redshifts[idx];
-                    }
-                    Float64 dzSupLim = m_secondPass_velfit_dzSupLim;
-                    if (m_result->Redshifts[idx] + dzSupLim >
-                            m_result->Redshifts[m_result->Redshifts.size() - 1])
-                    {
-                        dzSupLim =
-                                m_result->Redshifts[m_result->Redshifts.size() -
-                                1] -
-                                m_result->Redshifts[idx];
-                    }
-
-                    Float64 dzStep = m_secondPass_velfit_dzStep;
-                    Int32 nDzSteps = (int)((dzSupLim - dzInfLim) / dzStep);
-                    if (nDzSteps == 0)
-                    {
-                        nDzSteps = 1;
-                        dzInfLim = 0.;
-                        dzSupLim = 0.;
-                    }else
-                    {
-                        Log.LogInfo("  Operator-Linemodel: dzInfLim n=%e", dzInfLim);
-                        Log.LogInfo("  Operator-Linemodel: dzSupLim n=%e", dzSupLim);
-                        Log.LogInfo("  Operator-Linemodel: manualStep n=%d", nDzSteps);
-                    }
-
-                    Int32 n_progresssteps = idxVelfitGroups.size() * nDzSteps * nSteps;
-                    boost::progress_display show_progress(n_progresssteps);
-                    for (Int32 kgroup = 0; kgroup < idxVelfitGroups.size(); kgroup++)
+                    Log.LogInfo("  Operator-Linemodel: velocity fit with %s search: %d fits, %d saved over the full grid",
+                                m_opt_secondpass_velfitSearch.c_str(),
+                                nFits,
+                                nDzSteps * nSteps - nFits);
+                    if (vOptim != -1.0)
                     {
-                        Log.LogInfo("  Operator-Linemodel: manualStep fitting group=%d", kgroup);
-
-                        Float64 meritMin = DBL_MAX;
-                        Float64 vOptim = -1.0;
-                        for (Int32 kdz = 0; kdz < nDzSteps; kdz++)
+                        Log.LogInfo("  Operator-Linemodel: best Velocity found = %.1f", vOptim);
+                        m_result->ChiSquare[idx] = meritMin;
+                        if (iLineType == 0)
                         {
-                            Float64 dzTest = dzInfLim + kdz * dzStep;
-                            for (Int32 kv = 0; kv < nSteps; kv++)
+                            if (m_enableWidthFitByGroups)
                             {
-                                Float64 vTest = vInfLim + kv * vStep;
-                                if (iLineType == 0)
+                                for (Int32 ke = 0; ke < idxVelfitGroups[kgroup].size(); ke++)
                                 {
-                                    if (m_enableWidthFitByGroups)
-                                    {
-                                        for (Int32 ke = 0; ke < idxVelfitGroups[kgroup].size(); ke++)
-                                        {
-                                            m_model->SetVelocityAbsorptionOneElement(vTest,
-                                                                                     idxVelfitGroups[kgroup][ke]);
-                                        }
-                                    } else
-                                    {
-                                        m_model->SetVelocityAbsorption(vTest);
-                                    }
-                                } else
-                                {
-                                    if (m_enableWidthFitByGroups)
-                                    {
-                                        for (Int32 ke = 0; ke < idxVelfitGroups[kgroup].size(); ke++)
-                                        {
-                                            m_model->SetVelocityEmissionOneElement(vTest,
-                                                                                   idxVelfitGroups[kgroup][ke]);
-                                        }
-                                    } else
-                                    {
-                                        m_model->SetVelocityEmission(vTest);
-                                    }
+                                    model->SetVelocityAbsorptionOneElement( vOptim,
+                                                                            idxVelfitGroups[kgroup][ke]);
                                 }
-
-                                // Log.LogInfo( "  Operator-Linemodel:
-                                // testing v=%f", vTest);
-                                Float64 meritv;
-                                meritv = m_model->fit(m_result->Redshifts[idx] + dzTest*(1.+m_result->Redshifts[idx]),
-                                                      lambdaRange,
-                                                      m_result->LineModelSolutions[idx], //maybe this member result should be replaced by an unused variable
-                                                      m_result->ContinuumModelSolutions[idx], //maybe this member result should be replaced by an unused variable
-                                                      contreest_iterations,
-                                                      false);
-
-                                //                                    if(m_enableWidthFitByGroups)
-                                //                                    {
-                                //                                        meritv
-                                //                                        =
-                                //                                        0.0;
-                                //                                        for(Int32
-                                //                                        ke=0;
-                                //                                        ke<idxVelfitGroups[kgroup].size();
-                                //                                        ke++)
-                                //                                        {
-                                //                                            meritv += m_model->getModelErrorUnderElement(idxVelfitGroups[kgroup][ke]);
-                                //                                        }
-                                //                                    }
-
-
-                                Log.LogDebug("  Operator-Linemodel: testing velocity: merit=%.3e for velocity = %.1f", meritv, vTest);
-                                if (meritMin > meritv)
-                                {
-                                    meritMin = meritv;
-                                    if (iLineType == 0)
-                                    {
-                                        vOptim = m_model->GetVelocityAbsorption();
-                                    } else
-                                    {
-                                        vOptim = m_model->GetVelocityEmission();
-                                    }
-                                }
-                                ++show_progress;
+                                //todo: elv/alv fitting per fitting groups: should be saved in m_secondpass_parameters_extremaResult[i].GroupsLv
+                            } else
+                            {
+                                model->SetVelocityAbsorption(vOptim);
                             }
-                        }
-                        if (vOptim != -1.0)
+
+                            m_secondpass_parameters_extremaResult.Alv[i] = vOptim;
+                            Log.LogDebug("    Operator-Linemodel: secondpass_parameters extrema #%d set: alv=%.1f", i, vOptim);
+                        } else
                         {
-                            Log.LogInfo("  Operator-Linemodel: best Velocity found = %.1f", vOptim);
-                            m_result->ChiSquare[idx] = meritMin;
-                            if (iLineType == 0)
+                            if (m_enableWidthFitByGroups)
                             {
-                                if (m_enableWidthFitByGroups)
-                                {
-                                    for (Int32 ke = 0; ke < idxVelfitGroups[kgroup].size(); ke++)
-                                    {
-                                        m_model ->SetVelocityAbsorptionOneElement( vOptim,
-                                                                                   idxVelfitGroups[kgroup][ke]);
-                                    }
-                                    //todo: elv/alv fitting per fitting groups: should be saved in m_secondpass_parameters_extremaResult[i].GroupsLv
-                                } else
+                                for (Int32 ke = 0; ke < idxVelfitGroups[kgroup].size(); ke++)
                                 {
-                                    m_model->SetVelocityAbsorption(vOptim);
+                                    model->SetVelocityEmissionOneElement( vOptim,
+                                                                          idxVelfitGroups[kgroup][ke]);
                                 }
-
-                                m_secondpass_parameters_extremaResult.Alv[i] = vOptim;
-                                Log.LogDebug("    Operator-Linemodel: secondpass_parameters extrema #%d set: alv=%.1f", i, vOptim);
+                                //todo: elv/alv fitting per fitting groups: should be saved in m_secondpass_parameters_extremaResult[i].GroupsLv
                             } else
                             {
-                                if (m_enableWidthFitByGroups)
-                                {
-                                    for (Int32 ke = 0; ke < idxVelfitGroups[kgroup].size(); ke++)
-                                    {
-                                        m_model->SetVelocityEmissionOneElement( vOptim,
-                                                                                idxVelfitGroups[kgroup][ke]);
-                                    }
-                                    //todo: elv/alv fitting per fitting groups: should be saved in m_secondpass_parameters_extremaResult[i].GroupsLv
-                                } else
-                                {
-                                    m_model->SetVelocityEmission(vOptim);
-                                }
-                                m_secondpass_parameters_extremaResult.Elv[i] = vOptim;
-                                Log.LogDebug("    Operator-Linemodel: secondpass_parameters extrema #%d set: elv=%.1f", i, vOptim);
+                                model->SetVelocityEmission(vOptim);
                             }
+                            m_secondpass_parameters_extremaResult.Elv[i] = vOptim;
+                            Log.LogDebug("    Operator-Linemodel: secondpass_parameters extrema #%d set: elv=%.1f", i, vOptim);
                         }
                     }
                 }
-                m_model->SetFittingMethod(opt_fittingmethod);
-                // m_model->m_enableAmplitudeOffsets = false;
             }
+            model->SetFittingMethod(opt_fittingmethod);
+            // m_model->m_enableAmplitudeOffsets = false;
         }
     }
-
-    return 0;
 }
 
 Int32 COperatorLineModel::RecomputeAroundCandidates(TPointList input_extremumList,
@@ -1864,201 +2153,42 @@ Int32 COperatorLineModel::RecomputeAroundCandidates(TPointList input_extremumLis
     bool enable_recompute_around_candidate = true;
     if (enable_recompute_around_candidate)
     {
+        std::vector<SSecondPassCandidateFit> candidateFits(input_extremumList.size());
+        std::vector<boost::function<void ()>> tasks;
         for (Int32 i = 0; i < input_extremumList.size(); i++)
         {
-            Log.LogInfo("");
-            Log.LogInfo("  Operator-Linemodel: Second pass - recompute around Candidate #%d", i);
-            Log.LogInfo("  Operator-Linemodel: ---------- /\\ ---------- ---------- ---------- Candidate #%d", i);
-            Float64 z = input_extremumList[i].X;
-            m_model->SetVelocityEmission(m_secondpass_parameters_extremaResult.Elv[i]);
-            m_model->SetVelocityAbsorption(m_secondpass_parameters_extremaResult.Alv[i]);
-            Log.LogInfo("    Operator-Linemodel: recompute with elv=%.1f, alv=%.1f",
-                        m_model->GetVelocityEmission(),
-                        m_model->GetVelocityAbsorption());
-
-            // fix some fitcontinuum values for this extremum
-            if(tplfit_option==2 || tplfit_option==3)
-            {
-                m_model->SetFitContinuum_FitValues(m_secondpass_parameters_extremaResult.FittedTplName[i],
-                                                   m_secondpass_parameters_extremaResult.FittedTplAmplitude[i],
-                                                   m_secondpass_parameters_extremaResult.FittedTplMerit[i],
-                                                   m_secondpass_parameters_extremaResult.FittedTplDustCoeff[i],
-                                                   m_secondpass_parameters_extremaResult.FittedTplMeiksinIdx[i],
-                                                   m_secondpass_parameters_extremaResult.FittedTplRedshift[i],
-                                                   -1.,
-                                                   -1.,
-                                                   m_secondpass_parameters_extremaResult.FittedTplpCoeffs[i]);
-            }
-            m_model->SetFitContinuum_Option(tplfit_option);
-            Log.LogInfo("    Operator-Linemodel: recompute with tplfit_option=%d", tplfit_option);
-
-            // find the index in the zaxis results
-            Int32 idx = -1;
-            for (UInt32 i2 = 0; i2 < m_result->Redshifts.size(); i2++)
-            {
-                if (m_result->Redshifts[i2] == z)
-                {
-                    idx = i2;
-                    break;
-                }
-            }
-            if (idx == -1)
-            {
-                Log.LogInfo("  Operator-Linemodel: Problem. could not find "
-                            "extrema solution index...");
-                continue;
-            }
-
-            // reestimate the model (eventually with continuum reestimation) on
-            // the extrema selected
-            Int32 contreest_iterations = 0;
-            if (opt_continuumreest == "always")
-            {
-                contreest_iterations = 1;
-            } else
-            {
-                contreest_iterations = 0;
-            }
-
-            // finally compute the redshifts on the z-range around the extremum
-            TFloat64Range redshiftsRange(
-                m_result->Redshifts[0],
-                m_result->Redshifts[m_result->Redshifts.size() - 1]);
-            Float64 left_border = max(redshiftsRange.GetBegin(),
-                                      z - m_secondPass_extensionradius*(1.+z));
-            Float64 right_border = min(redshiftsRange.GetEnd(),
-                                       z + m_secondPass_extensionradius*(1.+z));
-            // m_model->SetFittingMethod("nofit");
-            _secondpass_recomputed_extremumList[i].Y = DBL_MAX;
-            _secondpass_recomputed_extremumList[i].X = m_result->Redshifts[idx];
-            Int32 idx2 = idx;
-
-            //find the candidate z-range min/max indexes
-            Int32 izmin_cand = -1;
-            Int32 izmax_cand = -1;
-            if(!overrideRecomputeOnlyOnTheCandidate)
-            {
-                izmin_cand = m_result->Redshifts.size();
-                izmax_cand = -1;
-                for (Int32 iz = 0; iz < m_result->Redshifts.size(); iz++)
-                {
-                    if (m_result->Redshifts[iz] >= left_border &&
-                            m_result->Redshifts[iz] <= right_border)
-                    {
-                        if(izmin_cand>iz)
-                        {
-                            izmin_cand = iz;
-                        }
-                        if(izmax_cand<iz)
-                        {
-                            izmax_cand = iz;
-                        }
-                    }
-                }
-            }else{
-                izmin_cand = idx;
-                izmax_cand = idx;
-            }
+            tasks.push_back(boost::bind(&COperatorLineModel::recomputeAroundCandidate,
+                                        this,
+                                        i,
+                                        input_extremumList[i].X,
+                                        boost::cref(lambdaRange),
+                                        boost::cref(opt_continuumreest),
+                                        tplfit_option,
+                                        overrideRecomputeOnlyOnTheCandidate,
+                                        boost::ref(candidateFits[i])));
+        }
+        runSecondPassCandidateTasks(tasks);
 
-            Int32 n_progresssteps = izmax_cand-izmin_cand+1;
-            Log.LogInfo("    Operator-Linemodel: Fit n=%d values for z in [%.6f; %.6f]",
-                        n_progresssteps,
-                        m_result->Redshifts[izmin_cand],
-                        m_result->Redshifts[izmax_cand]);
-            boost::progress_display show_progress(n_progresssteps);
-            for (Int32 iz = izmin_cand; iz <= izmax_cand; iz++)
+        // store the fits in the candidates order: where the z-ranges overlap,
+        // the last candidate wins as when they are recomputed one after the other
+        for (Int32 i = 0; i < input_extremumList.size(); i++)
+        {
+            const SSecondPassCandidateFit& candidateFit = candidateFits[i];
+            _secondpass_recomputed_extremumList[i] = candidateFit.recomputedExtremum;
+            for (Int32 k = 0; k < candidateFit.ChiSquare.size(); k++)
             {
-                // Log.LogInfo("Fit for Extended redshift %d, z = %f", iz,
-                // m_result->Redshifts[iz]);
-                m_result->ChiSquare[iz] =
-                        m_model->fit(m_result->Redshifts[iz],
-                                     lambdaRange,
-                                     m_result->LineModelSolutions[iz],
-                                     m_result->ContinuumModelSolutions[iz],
-                                     contreest_iterations, false);
-                m_result->ScaleMargCorrection[iz] =
-                        m_model->getScaleMargCorrection();
+                Int32 iz = candidateFit.izmin + k;
+                m_result->ChiSquare[iz] = candidateFit.ChiSquare[k];
+                m_result->ScaleMargCorrection[iz] = candidateFit.ScaleMargCorrection[k];
+                m_result->LineModelSolutions[iz] = candidateFit.LineModelSolutions[k];
+                m_result->ContinuumModelSolutions[iz] = candidateFit.ContinuumModelSolutions[k];
                 m_result->SetChisquareTplshapeResult(iz,
-                                                     m_model->GetChisquareTplshape(),
-                                                     m_model->GetScaleMargTplshape(),
-                                                     m_model->GetStrongELPresentTplshape());
-                if (m_estimateLeastSquareFast)
-                {
-                    m_result->ChiSquareContinuum[iz] =
-                            m_model->getLeastSquareContinuumMerit(lambdaRange);
-                } else
-                {
-                    m_result->ChiSquareContinuum[iz] =
-                            m_model->getLeastSquareContinuumMeritFast();
-                }
-                m_result->ScaleMargCorrectionContinuum[iz] =
-                        m_model->getContinuumScaleMargCorrection();
-                if (m_result->ChiSquare[iz] < _secondpass_recomputed_extremumList[i].Y)
-                {
-                    _secondpass_recomputed_extremumList[i].X = m_result->Redshifts[iz];
-                    _secondpass_recomputed_extremumList[i].Y = m_result->ChiSquare[iz];
-
-                    // set the second pass parameters used in the model export procedure in computeSecondPass()
-                    m_secondpass_parameters_extremaResult.Extrema[i] = m_result->Redshifts[iz];
-                    m_secondpass_parameters_extremaResult.ExtremaMerit[i] = m_result->ChiSquare[iz];
-                    CContinuumModelSolution csolution = m_model->GetContinuumModelSolution();
-                    m_secondpass_parameters_extremaResult.FittedTplName[i] = csolution.tplName;
-                    m_secondpass_parameters_extremaResult.FittedTplAmplitude[i] = csolution.tplAmplitude;
-                    m_secondpass_parameters_extremaResult.FittedTplMerit[i] = csolution.tplMerit;
-                    m_secondpass_parameters_extremaResult.FittedTplDustCoeff[i] = csolution.tplDustCoeff;
-                    m_secondpass_parameters_extremaResult.FittedTplMeiksinIdx[i] = csolution.tplMeiksinIdx;
-                    m_secondpass_parameters_extremaResult.FittedTplRedshift[i] = csolution.tplRedshift;
-                    m_secondpass_parameters_extremaResult.FittedTplpCoeffs[i] = csolution.pCoeffs;
-
-
-                    idx2 = iz;
-                }
-                ++show_progress;
+                                                     candidateFit.ChiSquareTplshape[k],
+                                                     candidateFit.ScaleMargCorrTplshape[k],
+                                                     candidateFit.StrongELPresentTplshape[k]);
+                m_result->ChiSquareContinuum[iz] = candidateFit.ChiSquareContinuum[k];
+                m_result->ScaleMargCorrectionContinuum[iz] = candidateFit.ScaleMargCorrectionContinuum[k];
             }
-            // m_model->SetFittingMethod(opt_fittingmethod);
-
-
-            Log.LogInfo("  Operator-Linemodel: Recomputed extr #%d, idx=%d, "
-                        "z_e.X=%f, m_e.Y=%f",
-                        i,
-                        idx2,
-                        _secondpass_recomputed_extremumList[i].X,
-                        _secondpass_recomputed_extremumList[i].Y);
-            Log.LogInfo("  Operator-Linemodel: Recomputed extr #%d, FittedTplName=%s",
-                        i,
-                        m_secondpass_parameters_extremaResult.FittedTplName[i].c_str());
-            Log.LogInfo("  Operator-Linemodel: Recomputed extr #%d, FittedTplAmplitude=%.4e",
-                        i,
-                        m_secondpass_parameters_extremaResult.FittedTplAmplitude[i]);
-            Log.LogInfo("  Operator-Linemodel: Recomputed extr #%d, FittedTplDustCoeff=%f, FittedTplMeiksinIdx=%d",
-                        i,
-                        m_secondpass_parameters_extremaResult.FittedTplDustCoeff[i],
-                        m_secondpass_parameters_extremaResult.FittedTplMeiksinIdx[i]);
-            Log.LogInfo("  Operator-Linemodel: Recomputed extr #%d, FittedTplRedshiftf=%.6f",
-                        i,
-                        m_secondpass_parameters_extremaResult.FittedTplRedshift[i]);
-
-            Float64 pCoeff0 = -1;
-            Float64 pCoeff1 = -1;
-            Float64 pCoeff2 = -1;
-            if(m_secondpass_parameters_extremaResult.FittedTplpCoeffs[i].size()>0)
-            {
-                pCoeff0=m_secondpass_parameters_extremaResult.FittedTplpCoeffs[i][0];
-            }
-            if(m_secondpass_parameters_extremaResult.FittedTplpCoeffs[i].size()>1)
-            {
-                pCoeff1=m_secondpass_parameters_extremaResult.FittedTplpCoeffs[i][1];
-            }
-            if(m_secondpass_parameters_extremaResult.FittedTplpCoeffs[i].size()>2)
-            {
-                pCoeff2=m_secondpass_parameters_extremaResult.FittedTplpCoeffs[i][2];
-            }
-            Log.LogInfo("  Operator-Linemodel: Recomputed extr #%d, FittedTplpCoeffs_0=%.4e, "
-                        "FittedTplpCoeffs_1=%.4e, FittedTplpCoeffs_2=%.4e",
-                        i,
-                        pCoeff0,
-                        pCoeff1,
-                        pCoeff2);
         }
     } else
     {
@@ -2116,6 +2246,419 @@ Int32 COperatorLineModel::RecomputeAroundCandidates(TPointList input_extremumLis
     return 0;
 }
 
+/**
+ * @brief COperatorLineModel::fitVelocity
+ * Fits the model at the given redshift with the velocity of one velocity fitting
+ * group (or of all the lines of the type if fitting by groups is disabled) set
+ * to velocity.
+ * @param fittedVelocity: velocity of the group after the fit
+ * @return the merit of the fit
+ */
+Float64 COperatorLineModel::fitVelocity(std::shared_ptr<CLineModelElementList> model,
+                                        Float64 redshift,
+                                        Float64 velocity,
+                                        Int32 iLineType,
+                                        const std::vector<Int32> &velfitGroup,
+                                        const TFloat64Range &lambdaRange,
+                                        Int32 contreest_iterations,
+                                        CLineModelSolution &modelSolution,
+                                        CContinuumModelSolution &continuumModelSolution,
+                                        Float64 &fittedVelocity)
+{
+    if (iLineType == 0)
+    {
+        if (m_enableWidthFitByGroups)
+        {
+            for (Int32 ke = 0; ke < velfitGroup.size(); ke++)
+            {
+                model->SetVelocityAbsorptionOneElement(velocity, velfitGroup[ke]);
+            }
+        } else
+        {
+            model->SetVelocityAbsorption(velocity);
+        }
+    } else
+    {
+        if (m_enableWidthFitByGroups)
+        {
+            for (Int32 ke = 0; ke < velfitGroup.size(); ke++)
+            {
+                model->SetVelocityEmissionOneElement(velocity, velfitGroup[ke]);
+            }
+        } else
+        {
+            model->SetVelocityEmission(velocity);
+        }
+    }
+
+    Float64 meritv = model->fit(redshift,
+                                lambdaRange,
+                                modelSolution,
+                                continuumModelSolution,
+                                contreest_iterations,
+                                false);
+    if (iLineType == 0)
+    {
+        fittedVelocity = model->GetVelocityAbsorption();
+    } else
+    {
+        fittedVelocity = model->GetVelocityEmission();
+    }
+    Log.LogDebug("  Operator-Linemodel: testing velocity: merit=%.3e for velocity = %.1f", meritv, velocity);
+    return meritv;
+}
+
+/**
+ * @brief COperatorLineModel::fitVelocityGrid
+ * Fits the velocities vInfLim + kv*vStep, kv in [0, nSteps[ at the given redshift.
+ *
+ * With m_opt_secondpass_velfitSearch=="coarsetofine", only every
+ * m_secondPass_velfit_coarseStep velocity is fitted first. If the coarse
+ * merits are unimodal, the grid is then fitted between the coarse neighbours
+ * of the coarse minimum only, else all the remaining velocities are fitted.
+ * @param merits: merit of each velocity of the grid, NaN for the velocities that were not fitted
+ * @param velocities: fitted velocity for each velocity of the grid
+ * @return the number of fits
+ */
+Int32 COperatorLineModel::fitVelocityGrid(std::shared_ptr<CLineModelElementList> model,
+                                          Float64 redshift,
+                                          Float64 vInfLim,
+                                          Float64 vStep,
+                                          Int32 nSteps,
+                                          Int32 iLineType,
+                                          const std::vector<Int32> &velfitGroup,
+                                          const TFloat64Range &lambdaRange,
+                                          Int32 contreest_iterations,
+                                          CLineModelSolution &modelSolution,
+                                          CContinuumModelSolution &continuumModelSolution,
+                                          TFloat64List &merits,
+                                          TFloat64List &velocities)
+{
+    merits.assign(std::max(nSteps, 0), NAN);
+    velocities.assign(std::max(nSteps, 0), -1.0);
+    Int32 coarseStep = m_secondPass_velfit_coarseStep;
+    Int32 nFits = 0;
+
+    TInt32List fitIndexes;
+    bool coarseToFine = (m_opt_secondpass_velfitSearch == "coarsetofine" && coarseStep > 1 && nSteps > 2 * coarseStep);
+    if (coarseToFine)
+    {
+        for (Int32 kv = 0; kv < nSteps; kv += coarseStep)
+        {
+            fitIndexes.push_back(kv);
+        }
+        if (fitIndexes.back() != nSteps - 1)
+        {
+            fitIndexes.push_back(nSteps - 1);
+        }
+    } else
+    {
+        for (Int32 kv = 0; kv < nSteps; kv++)
+        {
+            fitIndexes.push_back(kv);
+        }
+    }
+    for (Int32 k = 0; k < fitIndexes.size(); k++)
+    {
+        Int32 kv = fitIndexes[k];
+        merits[kv] = fitVelocity(model, redshift, vInfLim + kv * vStep, iLineType, velfitGroup,
+                                 lambdaRange, contreest_iterations, modelSolution, continuumModelSolution,
+                                 velocities[kv]);
+        nFits++;
+    }
+    if (!coarseToFine)
+    {
+        return nFits;
+    }
+
+    // unimodal: the coarse merits never decrease once they have increased
+    bool unimodal = true;
+    bool increasing = false;
+    Int32 kbest = 0;
+    for (Int32 k = 0; k < fitIndexes.size(); k++)
+    {
+        Float64 merit = merits[fitIndexes[k]];
+        if (merit != merit)
+        {
+            unimodal = false;
+            break;
+        }
+        if (k > 0)
+        {
+            Float64 meritPrev = merits[fitIndexes[k - 1]];
+            if (merit > meritPrev)
+            {
+                increasing = true;
+            } else if (merit < meritPrev && increasing)
+            {
+                unimodal = false;
+                break;
+            }
+        }
+        if (merit < merits[fitIndexes[kbest]])
+        {
+            kbest = k;
+        }
+    }
+
+    Int32 kvmin = 0;
+    Int32 kvmax = nSteps - 1;
+    if (unimodal)
+    {
+        kvmin = fitIndexes[std::max(kbest - 1, 0)];
+        kvmax = fitIndexes[std::min(kbest + 1, Int32(fitIndexes.size()) - 1)];
+    } else
+    {
+        Log.LogDetail("  Operator-Linemodel: velocity fit: coarse merits not unimodal, fitting the full grid");
+    }
+    for (Int32 kv = kvmin; kv <= kvmax; kv++)
+    {
+        if (merits[kv] == merits[kv] || velocities[kv] != -1.0)
+        {
+            continue;
+        }
+        merits[kv] = fitVelocity(model, redshift, vInfLim + kv * vStep, iLineType, velfitGroup,
+                                 lambdaRange, contreest_iterations, modelSolution, continuumModelSolution,
+                                 velocities[kv]);
+        nFits++;
+    }
+
+    return nFits;
+}
+
+/**
+ * @brief COperatorLineModel::recomputeAroundCandidate
+ * Fits the z-range around the candidate #i with the model of this candidate.
+ * The fits are kept in candidateFit, to be stored in m_result once all the
+ * candidates are done.
+ */
+void COperatorLineModel::recomputeAroundCandidate(Int32 i,
+                                                  Float64 z,
+                                                  const TFloat64Range &lambdaRange,
+                                                  const std::string &opt_continuumreest,
+                                                  const Int32 tplfit_option,
+                                                  const bool overrideRecomputeOnlyOnTheCandidate,
+                                                  SSecondPassCandidateFit &candidateFit)
+{
+    Log.LogInfo("");
+    Log.LogInfo("  Operator-Linemodel: Second pass - recompute around Candidate #%d", i);
+    Log.LogInfo("  Operator-Linemodel: ---------- /\\ ---------- ---------- ---------- Candidate #%d", i);
+    std::shared_ptr<CLineModelElementList> model = m_secondpass_candidateModels[i];
+    candidateFit.izmin = 0;
+    model->SetVelocityEmission(m_secondpass_parameters_extremaResult.Elv[i]);
+    model->SetVelocityAbsorption(m_secondpass_parameters_extremaResult.Alv[i]);
+    Log.LogInfo("    Operator-Linemodel: recompute with elv=%.1f, alv=%.1f",
+                model->GetVelocityEmission(),
+                model->GetVelocityAbsorption());
+
+    // fix some fitcontinuum values for this extremum
+    if(tplfit_option==2 || tplfit_option==3)
+    {
+        model->SetFitContinuum_FitValues(m_secondpass_parameters_extremaResult.FittedTplName[i],
+                                         m_secondpass_parameters_extremaResult.FittedTplAmplitude[i],
+                                         m_secondpass_parameters_extremaResult.FittedTplMerit[i],
+                                         m_secondpass_parameters_extremaResult.FittedTplDustCoeff[i],
+                                         m_secondpass_parameters_extremaResult.FittedTplMeiksinIdx[i],
+                                         m_secondpass_parameters_extremaResult.FittedTplRedshift[i],
+                                         -1.,
+                                         -1.,
+                                         m_secondpass_parameters_extremaResult.FittedTplpCoeffs[i]);
+    }
+    model->SetFitContinuum_Option(tplfit_option);
+    Log.LogInfo("    Operator-Linemodel: recompute with tplfit_option=%d", tplfit_option);
+
+    // find the index in the zaxis results
+    Int32 idx = -1;
+    for (UInt32 i2 = 0; i2 < m_result->Redshifts.size(); i2++)
+    {
+        if (m_result->Redshifts[i2] == z)
+        {
+            idx = i2;
+            break;
+        }
+    }
+    if (idx == -1)
+    {
+        Log.LogInfo("  Operator-Linemodel: Problem. could not find "
+                    "extrema solution index...");
+        return;
+    }
+
+    // reestimate the model (eventually with continuum reestimation) on
+    // the extrema selected
+    Int32 contreest_iterations = 0;
+    if (opt_continuumreest == "always")
+    {
+        contreest_iterations = 1;
+    } else
+    {
+        contreest_iterations = 0;
+    }
+
+    // finally compute the redshifts on the z-range around the extremum
+    TFloat64Range redshiftsRange(
+        m_result->Redshifts[0],
+        m_result->Redshifts[m_result->Redshifts.size() - 1]);
+    Float64 left_border = max(redshiftsRange.GetBegin(),
+                              z - m_secondPass_extensionradius*(1.+z));
+    Float64 right_border = min(redshiftsRange.GetEnd(),
+                               z + m_secondPass_extensionradius*(1.+z));
+    // m_model->SetFittingMethod("nofit");
+    candidateFit.recomputedExtremum.Y = DBL_MAX;
+    candidateFit.recomputedExtremum.X = m_result->Redshifts[idx];
+    Int32 idx2 = idx;
+
+    //find the candidate z-range min/max indexes
+    Int32 izmin_cand = -1;
+    Int32 izmax_cand = -1;
+    if(!overrideRecomputeOnlyOnTheCandidate)
+    {
+        izmin_cand = m_result->Redshifts.size();
+        izmax_cand = -1;
+        for (Int32 iz = 0; iz < m_result->Redshifts.size(); iz++)
+        {
+            if (m_result->Redshifts[iz] >= left_border &&
+                    m_result->Redshifts[iz] <= right_border)
+            {
+                if(izmin_cand>iz)
+                {
+                    izmin_cand = iz;
+                }
+                if(izmax_cand<iz)
+                {
+                    izmax_cand = iz;
+                }
+            }
+        }
+    }else{
+        izmin_cand = idx;
+        izmax_cand = idx;
+    }
+
+    Int32 n_progresssteps = izmax_cand-izmin_cand+1;
+    Log.LogInfo("    Operator-Linemodel: Fit n=%d values for z in [%.6f; %.6f]",
+                n_progresssteps,
+                m_result->Redshifts[izmin_cand],
+                m_result->Redshifts[izmax_cand]);
+    // the fits start from the current solutions, as when written in place in m_result
+    Int32 nfits = std::max(n_progresssteps, 0);
+    candidateFit.izmin = izmin_cand;
+    candidateFit.ChiSquare.resize(nfits);
+    candidateFit.ScaleMargCorrection.resize(nfits);
+    candidateFit.LineModelSolutions.assign(m_result->LineModelSolutions.begin() + izmin_cand,
+                                           m_result->LineModelSolutions.begin() + izmin_cand + nfits);
+    candidateFit.ContinuumModelSolutions.assign(m_result->ContinuumModelSolutions.begin() + izmin_cand,
+                                                m_result->ContinuumModelSolutions.begin() + izmin_cand + nfits);
+    candidateFit.ChiSquareTplshape.resize(nfits);
+    candidateFit.ScaleMargCorrTplshape.resize(nfits);
+    candidateFit.StrongELPresentTplshape.resize(nfits);
+    candidateFit.ChiSquareContinuum.resize(nfits);
+    candidateFit.ScaleMargCorrectionContinuum.resize(nfits);
+
+    // std::cout is not shared between the candidate threads: progress only shown when serial
+    std::unique_ptr<boost::progress_display> show_progress;
+    if (m_opt_secondpass_threadCount <= 0)
+    {
+        show_progress.reset(new boost::progress_display(n_progresssteps));
+    }
+    for (Int32 iz = izmin_cand; iz <= izmax_cand; iz++)
+    {
+        Int32 k = iz - izmin_cand;
+        // Log.LogInfo("Fit for Extended redshift %d, z = %f", iz,
+        // m_result->Redshifts[iz]);
+        candidateFit.ChiSquare[k] =
+                model->fit(m_result->Redshifts[iz],
+                           lambdaRange,
+                           candidateFit.LineModelSolutions[k],
+                           candidateFit.ContinuumModelSolutions[k],
+                           contreest_iterations, false);
+        candidateFit.ScaleMargCorrection[k] =
+                model->getScaleMargCorrection();
+        candidateFit.ChiSquareTplshape[k] = model->GetChisquareTplshape();
+        candidateFit.ScaleMargCorrTplshape[k] = model->GetScaleMargTplshape();
+        candidateFit.StrongELPresentTplshape[k] = model->GetStrongELPresentTplshape();
+        if (m_estimateLeastSquareFast)
+        {
+            candidateFit.ChiSquareContinuum[k] =
+                    model->getLeastSquareContinuumMerit(lambdaRange);
+        } else
+        {
+            candidateFit.ChiSquareContinuum[k] =
+                    model->getLeastSquareContinuumMeritFast();
+        }
+        candidateFit.ScaleMargCorrectionContinuum[k] =
+                model->getContinuumScaleMargCorrection();
+        if (candidateFit.ChiSquare[k] < candidateFit.recomputedExtremum.Y)
+        {
+            candidateFit.recomputedExtremum.X = m_result->Redshifts[iz];
+            candidateFit.recomputedExtremum.Y = candidateFit.ChiSquare[k];
+
+            // set the second pass parameters used in the model export procedure in computeSecondPass()
+            m_secondpass_parameters_extremaResult.Extrema[i] = m_result->Redshifts[iz];
+            m_secondpass_parameters_extremaResult.ExtremaMerit[i] = candidateFit.ChiSquare[k];
+            CContinuumModelSolution csolution = model->GetContinuumModelSolution();
+            m_secondpass_parameters_extremaResult.FittedTplName[i] = csolution.tplName;
+            m_secondpass_parameters_extremaResult.FittedTplAmplitude[i] = csolution.tplAmplitude;
+            m_secondpass_parameters_extremaResult.FittedTplMerit[i] = csolution.tplMerit;
+            m_secondpass_parameters_extremaResult.FittedTplDustCoeff[i] = csolution.tplDustCoeff;
+            m_secondpass_parameters_extremaResult.FittedTplMeiksinIdx[i] = csolution.tplMeiksinIdx;
+            m_secondpass_parameters_extremaResult.FittedTplRedshift[i] = csolution.tplRedshift;
+            m_secondpass_parameters_extremaResult.FittedTplpCoeffs[i] = csolution.pCoeffs;
+
+
+            idx2 = iz;
+        }
+        if (show_progress)
+        {
+            ++(*show_progress);
+        }
+    }
+    // m_model->SetFittingMethod(opt_fittingmethod);
+
+
+    Log.LogInfo("  Operator-Linemodel: Recomputed extr #%d, idx=%d, "
+                "z_e.X=%f, m_e.Y=%f",
+                i,
+                idx2,
+                candidateFit.recomputedExtremum.X,
+                candidateFit.recomputedExtremum.Y);
+    Log.LogInfo("  Operator-Linemodel: Recomputed extr #%d, FittedTplName=%s",
+                i,
+                m_secondpass_parameters_extremaResult.FittedTplName[i].c_str());
+    Log.LogInfo("  Operator-Linemodel: Recomputed extr #%d, FittedTplAmplitude=%.4e",
+                i,
+                m_secondpass_parameters_extremaResult.FittedTplAmplitude[i]);
+    Log.LogInfo("  Operator-Linemodel: Recomputed extr #%d, FittedTplDustCoeff=%f, FittedTplMeiksinIdx=%d",
+                i,
+                m_secondpass_parameters_extremaResult.FittedTplDustCoeff[i],
+                m_secondpass_parameters_extremaResult.FittedTplMeiksinIdx[i]);
+    Log.LogInfo("  Operator-Linemodel: Recomputed extr #%d, FittedTplRedshiftf=%.6f",
+                i,
+                m_secondpass_parameters_extremaResult.FittedTplRedshift[i]);
+
+    Float64 pCoeff0 = -1;
+    Float64 pCoeff1 = -1;
+    Float64 pCoeff2 = -1;
+    if(m_secondpass_parameters_extremaResult.FittedTplpCoeffs[i].size()>0)
+    {
+        pCoeff0=m_secondpass_parameters_extremaResult.FittedTplpCoeffs[i][0];
+    }
+    if(m_secondpass_parameters_extremaResult.FittedTplpCoeffs[i].size()>1)
+    {
+        pCoeff1=m_secondpass_parameters_extremaResult.FittedTplpCoeffs[i][1];
+    }
+    if(m_secondpass_parameters_extremaResult.FittedTplpCoeffs[i].size()>2)
+    {
+        pCoeff2=m_secondpass_parameters_extremaResult.FittedTplpCoeffs[i][2];
+    }
+    Log.LogInfo("  Operator-Linemodel: Recomputed extr #%d, FittedTplpCoeffs_0=%.4e, "
+                "FittedTplpCoeffs_1=%.4e, FittedTplpCoeffs_2=%.4e",
+                i,
+                pCoeff0,
+                pCoeff1,
+                pCoeff2);
+}
+
 Int32 COperatorLineModel::Init(const CSpectrum &spectrum,
                                const TFloat64List &redshifts)
 {
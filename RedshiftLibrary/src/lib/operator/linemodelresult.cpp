@@ -73,6 +73,7 @@ Int32 CLineModelResult::Init( std::vector<Float64> redshifts, CRayCatalog::TRayV
 
     ChiSquareContinuum.resize( nResults );
     ScaleMargCorrectionContinuum.resize( nResults);
+    FirstpassPruned.assign( nResults, false );
 
     return err;
 }
@@ -4,6 +4,7 @@
 #include <RedshiftLibrary/spectrum/fluxaxis.h>
 #include <RedshiftLibrary/spectrum/spectralaxis.h>
 #include <RedshiftLibrary/common/median.h>
+#include <RedshiftLibrary/common/slidingmedian.h>
 #include <RedshiftLibrary/operator/peakdetectionresult.h>
 
 #include <math.h>
@@ -162,12 +163,24 @@ void CPeakDetection::FindPossiblePeaks( const CSpectrumAxis& fluxAxis, const CSp
     std::vector<Float64> med;
     std::vector<Float64> xmad;
 
-    med.reserve( fluxAxis.GetSamplesCount() );
-    xmad.reserve( fluxAxis.GetSamplesCount() );
+    med.resize( fluxAxis.GetSamplesCount() );
+    xmad.resize( fluxAxis.GetSamplesCount() );
 
     // Compute median value for each sample over a window of size windowSampleCount
     const Float64* fluxData = fluxAxis.GetSamples();
     CMedian<Float64> medianFilter;
+    // the window bounds only move forward with the wavelength: the median and MAD are kept up to date
+    // as the window slides, unless a NaN prevents keeping the window values sorted
+    CSlidingMedian<Float64> slidingFilter;
+    bool useSlidingFilter = true;
+    for( Int32 i=0; i<fluxAxis.GetSamplesCount(); i++ )
+    {
+        if( std::isnan( fluxData[i] ) )
+        {
+            useSlidingFilter = false;
+            break;
+        }
+    }
     for( Int32 i=0; i<fluxAxis.GetSamplesCount(); i++ )
     {
         //old: regular sampling hypthesis
@@ -178,8 +191,16 @@ void CPeakDetection::FindPossiblePeaks( const CSpectrumAxis& fluxAxis, const CSp
         UInt32 start = std::max(0, spectralAxis.GetIndexAtWaveLength(spectralAxis[i]-m_winsize/2.0) );
         UInt32 stop = std::min( (Int32) fluxAxis.GetSamplesCount(), spectralAxis.GetIndexAtWaveLength(spectralAxis[i]+m_winsize/2.0)  );
 
-        med[i] = medianFilter.Find( fluxData + start, stop - start );
-        xmad[i] = XMad( fluxData+ start, stop - start , med[i] );
+        if( useSlidingFilter )
+        {
+            slidingFilter.Slide( fluxData, start, stop );
+            med[i] = slidingFilter.GetMedian();
+            xmad[i] = slidingFilter.GetMad( med[i] );
+        }else
+        {
+            med[i] = medianFilter.Find( fluxData + start, stop - start );
+            xmad[i] = XMad( fluxData+ start, stop - start , med[i] );
+        }
         xmad[i] += m_detectionnoiseoffset; //add a noise level, useful for simulation data
     }
 
@@ -245,7 +266,7 @@ Float64 CPeakDetection::XMad( const Float64* x, Int32 n, Float64 median )
     std::vector<Float64> xdata;
     Float64 xmadm = 0.0;
 
-    xdata.reserve( n );
+    xdata.resize( n );
 
     for( Int32 i=0;i<n; i++ )
     {
@@ -61,19 +61,22 @@ std::shared_ptr<const CLineDetectionResult> CLineDetection::Compute( const CSpec
     TInt32RangeList retestPeaks;
     TGaussParamsList retestGaussParams;
 
+    //find gaussian fit of all the peaks at once, with a single solver
+    //limit the peakRange
+    // optionally limit the size of the fitrange
+    //TInt32Range fitRange = LimitGaussianFitStartAndStop( j, resPeaksEnlarged, spectralAxis.GetSamplesCount(), spectralAxis);
+    TInt32RangeList fitRanges( resPeaksEnlarged.begin(), resPeaksEnlarged.begin() + nPeaks );
+    CGaussianFit fitter;
+    CGaussianFit::TResultList fitResults;
+    fitter.ComputeBatch( spc, fitRanges, fitResults );
+
     // filter the peaks with gaussian fit and create the detected rays catalog
     for( UInt32 j=0; j<nPeaks; j++ )
     {
         bool toAdd = true;
-        //find gaussian fit
-        CGaussianFit fitter;
-
-        //limit the peakRange
-        // optionally limit the size of the fitrange
-        //TInt32Range fitRange = LimitGaussianFitStartAndStop( j, resPeaksEnlarged, spectralAxis.GetSamplesCount(), spectralAxis);
-        TInt32Range fitRange = resPeaksEnlarged[j];
+        const CGaussianFit::SResult& fit = fitResults[j];
 
-        CGaussianFit::EStatus status = fitter.Compute( spc, TInt32Range( fitRange.GetBegin(), fitRange.GetEnd() ) );
+        CGaussianFit::EStatus status = fit.Status;
         if( status!=NSEpic::CGaussianFit::nStatus_Success )
 	  {
             std::string status = ( boost::format( "Peak_%1% : Fitting failed" ) % j ).str();
@@ -83,17 +86,14 @@ std::shared_ptr<const CLineDetectionResult> CLineDetection::Compute( const CSpec
             continue;
 	  }
 
-        Float64 gaussAmp;
-        Float64 gaussPos;
-        Float64 gaussWidth;
-        fitter.GetResults( gaussAmp, gaussPos, gaussWidth );
-        Float64 gaussAmpErr;
-        Float64 gaussPosErr;
-        Float64 gaussWidthErr;
-        fitter.GetResultsError( gaussAmpErr, gaussPosErr, gaussWidthErr );
-
-        Float64 gaussCont;
-        fitter.GetResultsPolyCoeff0( gaussCont );
+        Float64 gaussAmp = fit.Amplitude;
+        Float64 gaussPos = fit.Position;
+        Float64 gaussWidth = fit.Width;
+        Float64 gaussAmpErr = fit.AmplitudeErr;
+        Float64 gaussPosErr = fit.PositionErr;
+        Float64 gaussWidthErr = fit.WidthErr;
+
+        Float64 gaussCont = fit.PolyCoeff0;
 
         // check amp
         if( gaussAmp<0 )
@@ -1,6 +1,8 @@
 #include <RedshiftLibrary/operator/raymatching.h>
 
 #include <algorithm>    // std::sort
+#include <cmath>
+#include <set>
 #include <math.h>
 #include <stdio.h>
 
@@ -24,6 +26,8 @@ CRayMatching::~CRayMatching()
 
 /**
  * Executes the algorithm for matching the input sets of lines against the catalogue of atomic transitions.
+ * The (detected line, rest line) couples are indexed by redshift, so that the couples consistent with a given one
+ * are found by a binary search in the sorted redshift list rather than by a loop over all the couples.
  * Parameters:
  * - detectedRayCatalog, the set of lines detected in the spectrum.
  * - restRayCatalog, the set of reference lines.
@@ -58,86 +62,118 @@ std::shared_ptr<CRayMatchingResult> CRayMatching::Compute( const CRayCatalog& de
     }
   else
     {
+      // enumerate all the detected line / rest line couples, and index them by redshift
+      std::vector<SRedshiftCandidate> candidates;
       for( UInt32 iDetectedRay=0; iDetectedRay<detectedRayList.size(); iDetectedRay++ )
         {
 	  for( UInt32 iRestRay=0; iRestRay<restRayList.size(); iRestRay++ )
             {
-	      // for each detected line / rest line couple, enumerate how many other couples fit within the tolerance
-	      CRayMatchingResult::TSolutionSet solution;
 	      Float64 redShift=(detectedRayList[iDetectedRay].GetPosition()-restRayList[iRestRay].GetPosition())/restRayList[iRestRay].GetPosition();
 	      if( redShift < 0 ) // we don't care about blueshifts.
 		{
 		  continue;
                 }
-	      solution.push_back( CRayMatchingResult::SSolution( detectedRayList[iDetectedRay], restRayList[iRestRay], redShift) );
+	      SRedshiftCandidate candidate = { redShift, (Int32)iDetectedRay, (Int32)iRestRay };
+	      candidates.push_back( candidate );
+            }
+        }
 
-	      for( UInt32 iDetectedRay2=0; iDetectedRay2<detectedRayList.size(); iDetectedRay2++ )
-                {
-		  if( iDetectedRay!=iDetectedRay2 )
+      std::vector<std::pair<Float64, Int32> > sortedCandidates;
+      for( UInt32 iCand=0; iCand<candidates.size(); iCand++ )
+        {
+	  if( !std::isnan( candidates[iCand].Redshift ) )
+	    {
+	      sortedCandidates.push_back( std::make_pair( candidates[iCand].Redshift, (Int32)iCand ) );
+	    }
+        }
+      std::sort( sortedCandidates.begin(), sortedCandidates.end() );
+      TFloat64List sortedRedshifts( sortedCandidates.size() );
+      for( UInt32 k=0; k<sortedCandidates.size(); k++ )
+        {
+	  sortedRedshifts[k] = sortedCandidates[k].first;
+        }
+
+      std::vector<Int32> matches;
+      std::set<Float64> solutionPositions;
+      for( UInt32 iCand=0; iCand<candidates.size(); iCand++ )
+        {
+	  // for each detected line / rest line couple, find the other couples that fit within the tolerance
+	  const SRedshiftCandidate& anchor = candidates[iCand];
+	  Float64 redShift = anchor.Redshift;
+	  CRayMatchingResult::TSolutionSet solution;
+	  solution.push_back( CRayMatchingResult::SSolution( detectedRayList[anchor.DetectedIndex], restRayList[anchor.RestIndex], redShift) );
+
+	  matches.clear();
+	  if( !std::isnan( redShift ) )
+	    {
+	      // |z-z2| <= tol*(1+(z+z2)/2) bounds z2 to an interval, slightly widened here:
+	      // the exact test below decides.
+	      Float64 zMin = ( redShift*(1-tol*0.5)-tol )/( 1+tol*0.5 );
+	      Float64 zMax = ( redShift*(1+tol*0.5)+tol )/( 1-tol*0.5 );
+	      Float64 margin = 1e-9*( 1+fabs( zMax ) );
+	      TFloat64List::const_iterator itBegin = std::lower_bound( sortedRedshifts.begin(), sortedRedshifts.end(), zMin-margin );
+	      TFloat64List::const_iterator itEnd = std::upper_bound( itBegin, (TFloat64List::const_iterator)sortedRedshifts.end(), zMax+margin );
+	      for( TFloat64List::const_iterator it=itBegin; it!=itEnd; it++ )
+		{
+		  Int32 iCand2 = sortedCandidates[it-sortedRedshifts.begin()].second;
+		  if( candidates[iCand2].DetectedIndex==anchor.DetectedIndex )
 		    {
-		      for( UInt32 iRestRay2=0; iRestRay2<restRayList.size(); iRestRay2++ )
-                        {
-			  Float64 redShift2=(detectedRayList[iDetectedRay2].GetPosition()-restRayList[iRestRay2].GetPosition())/restRayList[iRestRay2].GetPosition();
-			  if( redShift2 < 0 ) // we don't care about blueshifts.
-			    {
-			      continue;
-                            }
-			  Float64 redshiftTolerance = tol*(1+(redShift+redShift2)*0.5);
-			  if( fabs( (redShift-redShift2) )<=redshiftTolerance )
-			    {
-			      Bool found = false;
-			      //avoid repeated solution sets
-			      for( UInt32 iSet=0; iSet<solution.size(); iSet++ )
-                                {
-				  if( solution[iSet].DetectedRay.GetPosition()==detectedRayList[iDetectedRay2].GetPosition() )
-				    {
-				      found = true;
-				      break;
-                                    }
-                                }
-			      if( !found )
-				{
-				  solution.push_back( CRayMatchingResult::SSolution( detectedRayList[iDetectedRay2], restRayList[iRestRay2], redShift2) );
-                                }
-                            }
-                        } // for
-                    }
-                } // for
-	      if( solution.size()>0 )
+		      continue;
+		    }
+		  Float64 redShift2 = candidates[iCand2].Redshift;
+		  Float64 redshiftTolerance = tol*(1+(redShift+redShift2)*0.5);
+		  if( fabs( (redShift-redShift2) )<=redshiftTolerance )
+		    {
+		      matches.push_back( iCand2 );
+		    }
+		}
+	      // candidates are enumerated by detected line, then rest line: keep the first rest line for each detected line
+	      std::sort( matches.begin(), matches.end() );
+	    }
+
+	  //avoid repeated solution sets
+	  solutionPositions.clear();
+	  solutionPositions.insert( detectedRayList[anchor.DetectedIndex].GetPosition() );
+	  for( UInt32 iMatch=0; iMatch<matches.size(); iMatch++ )
+	    {
+	      const SRedshiftCandidate& match = candidates[matches[iMatch]];
+	      if( solutionPositions.insert( detectedRayList[match.DetectedIndex].GetPosition() ).second )
 		{
-		  solutions.push_back( solution );
-                }
-            }
+		  solution.push_back( CRayMatchingResult::SSolution( detectedRayList[match.DetectedIndex], restRayList[match.RestIndex], match.Redshift) );
+		}
+	    }
+	  solutions.push_back( solution );
         }
     } 
 
   // delete duplicated solutions
   CRayMatchingResult::TSolutionSetList newSolutions;
+  std::set<TFloat64List> newSolutionKeys;
   for( UInt32 iSol=0; iSol<solutions.size(); iSol++ )
     {
       CRayMatchingResult::TSolutionSet currentSet = solutions[iSol];
       sort( currentSet.begin(), currentSet.end() );
-      Bool found = false;
-      for( UInt32 iNewSol=0; iNewSol<newSolutions.size(); iNewSol++ )
+      TFloat64List key;
+      Bool comparable = GetSolutionSetKey( currentSet, key );
+      if( comparable && newSolutionKeys.find( key ) != newSolutionKeys.end() )
         {
-	  if( AreSolutionSetsEqual( newSolutions[iNewSol],currentSet ) )
-	    {
-	      found = true;
-            }
+	  continue;
         }
-      if( !found ) // if solution is new, let's check it is within the range
+      // solution is new, let's check it is within the range
+      if( currentSet.size()>=nThreshold )
 	{
-	  if( currentSet.size()>=nThreshold )
+	  Float64 redshiftMean = 0.f;
+	  for( UInt32 i=0; i<currentSet.size(); i++ )
 	    {
-	      Float64 redshiftMean = 0.f;
-	      for( UInt32 i=0; i<currentSet.size(); i++ )
-		{
-		  redshiftMean += currentSet[i].Redshift;
-		}
-	      redshiftMean /= currentSet.size();
-	      if( redshiftMean>redshiftRange.GetBegin() && redshiftMean<redshiftRange.GetEnd() )
+	      redshiftMean += currentSet[i].Redshift;
+	    }
+	  redshiftMean /= currentSet.size();
+	  if( redshiftMean>redshiftRange.GetBegin() && redshiftMean<redshiftRange.GetEnd() )
+	    {
+	      newSolutions.push_back( currentSet );
+	      if( comparable )
 		{
-		  newSolutions.push_back( currentSet );
+		  newSolutionKeys.insert( key );
 		}
 	    }
 	}
@@ -155,6 +191,32 @@ std::shared_ptr<CRayMatchingResult> CRayMatching::Compute( const CRayCatalog& de
   return NULL;
 }
 
+/**
+ * Builds a key identifying a sorted TSolutionSet: two sets are equal (see AreSolutionSetsEqual) iff their keys are equal.
+ * Returns false if the set contains NaN values, such a set is never equal to another one.
+ */
+Bool CRayMatching::GetSolutionSetKey( const CRayMatchingResult::TSolutionSet& s, TFloat64List& key )
+{
+  key.clear();
+  key.reserve( 5*s.size() );
+  for( UInt32 iSet=0; iSet<s.size(); iSet++ )
+    {
+      key.push_back( s[iSet].DetectedRay.GetPosition() );
+      key.push_back( s[iSet].DetectedRay.GetAmplitude() );
+      key.push_back( s[iSet].RestRay.GetPosition() );
+      key.push_back( s[iSet].RestRay.GetAmplitude() );
+      key.push_back( s[iSet].Redshift );
+    }
+  for( UInt32 k=0; k<key.size(); k++ )
+    {
+      if( std::isnan( key[k] ) )
+	{
+	  return false;
+	}
+    }
+  return true;
+}
+
 /**
  * Given 2 TSolutionSets, returns true if they are equivalent (have the same line values), false otherwise.
  * The algorithm only works reliably if the inputs are sorted.
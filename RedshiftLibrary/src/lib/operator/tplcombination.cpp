@@ -8,6 +8,7 @@
 #include <RedshiftLibrary/operator/chisquareresult.h>
 #include <RedshiftLibrary/extremum/extremum.h>
 #include <RedshiftLibrary/common/quicksort.h>
+#include <RedshiftLibrary/common/threadpool.h>
 
 #include <RedshiftLibrary/processflow/datastore.h>
 #include <RedshiftLibrary/log/log.h>
@@ -31,6 +32,7 @@
 #include <boost/algorithm/string/predicate.hpp>
 #include <boost/chrono/thread_clock.hpp>
 #include <boost/progress.hpp>
+#include <boost/bind.hpp>
 
 #include <assert.h>
 
@@ -67,17 +69,18 @@ COperatorTplcombination::~COperatorTplcombination()
 
 
 void COperatorTplcombination::BasicFit(const CSpectrum& spectrum,
-                                       std::vector<CTemplate>& tplList,
-                                       Float64* pfgTplBuffer,
+                                       const TTemplateConstRefList& tplList,
                                        const TFloat64Range& lambdaRange,
                                        Float64 redshift,
                                        Float64 overlapThreshold,
                                        STplcombination_basicfitresult& fittingResults,
+                                       STplcombination_workspace& workspace,
                                        std::string opt_interp,
                                        Float64 forcedAmplitude,
                                        Int32 opt_extinction,
                                        Int32 opt_dustFitting,
-                                       CMask spcMaskAdditional)
+                                       CMask spcMaskAdditional,
+                                       Bool buildModel)
 {
     bool verbose = false;
     if(verbose)
@@ -107,7 +110,7 @@ void COperatorTplcombination::BasicFit(const CSpectrum& spectrum,
 
     const CSpectrumSpectralAxis& spcSpectralAxis = spectrum.GetSpectralAxis();
     const CSpectrumFluxAxis& spcFluxAxis = spectrum.GetFluxAxis();
-    const TFloat64List& spcError = spcFluxAxis.GetError();
+    const Float64* spcInvErr2 = spcFluxAxis.GetInverseVariance();
 
     if(spcMaskAdditional.GetMasksCount()!=spcFluxAxis.GetSamplesCount())
     {
@@ -125,29 +128,41 @@ void COperatorTplcombination::BasicFit(const CSpectrum& spectrum,
     Log.LogDebug("  Operator-tplcombination: BasicFit - interpolating");
     for(Int32 ktpl=0; ktpl<tplList.size(); ktpl++)
     {
-        const CSpectrumSpectralAxis& tplSpectralAxis = tplList[ktpl].GetSpectralAxis();
-        const CSpectrumFluxAxis& tplFluxAxis = tplList[ktpl].GetFluxAxis();
+        const CTemplate& tpl = *tplList[ktpl];
+        const CSpectrumSpectralAxis& tplSpectralAxis = tpl.GetSpectralAxis();
+        const CSpectrumFluxAxis& tplFluxAxis = tpl.GetFluxAxis();
 
         // Compute shifted template
         Float64 onePlusRedshift = 1.0 + redshift;
-        m_shiftedTemplatesSpectralAxis_bf[ktpl]->ShiftByWaveLength( tplSpectralAxis, onePlusRedshift, CSpectrumSpectralAxis::nShiftForward );
+        workspace.shiftedTemplatesSpectralAxis[ktpl]->ShiftByWaveLength( tplSpectralAxis, onePlusRedshift, CSpectrumSpectralAxis::nShiftForward );
         TFloat64Range intersectedLambdaRange( 0.0, 0.0 );
 
         // Compute clamped lambda range over template
         TFloat64Range tplLambdaRange;
-        m_shiftedTemplatesSpectralAxis_bf[ktpl]->ClampLambdaRange( lambdaRange, tplLambdaRange );
+        workspace.shiftedTemplatesSpectralAxis[ktpl]->ClampLambdaRange( lambdaRange, tplLambdaRange );
 
         // if there is any intersection between the lambda range of the spectrum and the lambda range of the template
         // Compute the intersected range
         TFloat64Range::Intersect( tplLambdaRange, spcLambdaRange, intersectedLambdaRange );
 
         //UInt32 tgtn = spcSpectralAxis.GetSamplesCount() ;
-        CSpectrumFluxAxis& itplTplFluxAxis = m_templatesRebined_bf[ktpl]->GetFluxAxis();
-        CSpectrumSpectralAxis& itplTplSpectralAxis = m_templatesRebined_bf[ktpl]->GetSpectralAxis();
-        CMask& itplMask = *m_masksRebined_bf[ktpl];
+        CSpectrumFluxAxis& itplTplFluxAxis = workspace.templatesRebined[ktpl]->GetFluxAxis();
+        CSpectrumSpectralAxis& itplTplSpectralAxis = workspace.templatesRebined[ktpl]->GetSpectralAxis();
+        CMask& itplMask = *workspace.masksRebined[ktpl];
 
         //CSpectrumFluxAxis::Rebin( intersectedLambdaRange, tplFluxAxis, shiftedTplSpectralAxis, spcSpectralAxis, itplTplFluxAxis, itplTplSpectralAxis, itplMask );
-        CSpectrumFluxAxis::Rebin2( intersectedLambdaRange, tplFluxAxis, pfgTplBuffer, redshift, *m_shiftedTemplatesSpectralAxis_bf[ktpl], spcSpectralAxis, itplTplFluxAxis, itplTplSpectralAxis, itplMask, opt_interp );
+        if( opt_interp=="precomputedfinegrid" && tpl.GetFineGridSinglePrecision() )
+        {
+            CSpectrumFluxAxis::Rebin2SinglePrecision( intersectedLambdaRange, tplFluxAxis, tpl.GetFineGridFluxSinglePrecision(), redshift, *workspace.shiftedTemplatesSpectralAxis[ktpl], spcSpectralAxis, itplTplFluxAxis, itplTplSpectralAxis, itplMask, opt_interp );
+        }else
+        {
+            const Float64* pfgTplBuffer = NULL;
+            if( opt_interp=="precomputedfinegrid" )
+            {
+                pfgTplBuffer = tpl.GetFineGridFlux();
+            }
+            CSpectrumFluxAxis::Rebin2( intersectedLambdaRange, tplFluxAxis, pfgTplBuffer, redshift, *workspace.shiftedTemplatesSpectralAxis[ktpl], spcSpectralAxis, itplTplFluxAxis, itplTplSpectralAxis, itplMask, opt_interp );
+        }
 
         Log.LogDebug("  Operator-Tplcombination: Rebinned template #%d has n=%d samples in lambdarange: %.2f - %.2f", ktpl, itplTplSpectralAxis.GetSamplesCount(), itplTplSpectralAxis[0], itplTplSpectralAxis[itplTplSpectralAxis.GetSamplesCount()-1]);
 
@@ -188,14 +203,6 @@ void COperatorTplcombination::BasicFit(const CSpectrum& spectrum,
     Int32 n=imax_lbda-imin_lbda+1;
     Log.LogDebug("  Operator-Tplcombination: prep. linear fitting with n=%d samples in the clamped lambdarange spectrum (imin=%d, lbda_min=%.3f - imax=%d, lbda_max=%.3f)", n, imin_lbda, spcSpectralAxis[imin_lbda], imax_lbda, spcSpectralAxis[imax_lbda]);
     Int32 nddl=tplList.size();
-    gsl_matrix *X, *cov;
-    gsl_vector *y, *w, *c;
-
-    X = gsl_matrix_alloc (n, nddl);
-    y = gsl_vector_alloc (n);
-    w = gsl_vector_alloc (n);
-    c = gsl_vector_alloc (nddl);
-    cov = gsl_matrix_alloc (nddl, nddl);
 
     // Normalizing factor
     Float64 normFactor;
@@ -213,26 +220,37 @@ void COperatorTplcombination::BasicFit(const CSpectrum& spectrum,
         Log.LogDetail("  Operator-Tplcombination: Linear fitting, found normalization Factor=%e", normFactor);
     }
 
-    // Prepare the fit data
-    Float64 yi, ei, chisq;
-    for(Int32 i = 0; i < n; i++)
+    // Prepare the normal equations of the weighted fit on the normalized flux y: A = Xt.W.X and b = Xt.W.y
+    // A only depends on the rebinned templates and on the noise: it gives both the amplitudes and their errors
+    Float64 normFactor2 = normFactor*normFactor;
+    const Float64* spcFlux = spcFluxAxis.GetSamples() + imin_lbda;
+    const Float64* spcW = spcInvErr2 + imin_lbda;
+    workspace.weightedTemplates.resize( n*nddl );
+    workspace.normalMatrix.resize( nddl*nddl );
+    workspace.normalVector.resize( nddl );
+    for (Int32 iddl = 0; iddl < nddl; iddl++)
     {
-        yi = spcFluxAxis[i+imin_lbda]/normFactor;
-        ei = spcError[i+imin_lbda]/normFactor;
-
-        for (Int32 iddl = 0; iddl < nddl; iddl++)
+        const Float64* x = workspace.templatesRebined[iddl]->GetFluxAxis().GetSamples() + imin_lbda;
+        Float64* wx = workspace.weightedTemplates.data() + iddl*n;
+        Float64 bi = 0.0;
+        for(Int32 i = 0; i < n; i++)
         {
-            Float64 fval =  m_templatesRebined_bf[iddl]->GetFluxAxis()[i+imin_lbda];
-            gsl_matrix_set (X, i, iddl, fval);
+            wx[i] = spcW[i]*normFactor2*x[i];
+            bi += wx[i]*spcFlux[i];
+        }
+        workspace.normalVector[iddl] = bi/normFactor;
 
-            if(0 && verbose)
+        for (Int32 jddl = 0; jddl <= iddl; jddl++)
+        {
+            const Float64* xj = workspace.templatesRebined[jddl]->GetFluxAxis().GetSamples() + imin_lbda;
+            Float64 aij = 0.0;
+            for(Int32 i = 0; i < n; i++)
             {
-                Log.LogDebug("  Operator-Tplcombination: Linear fitting, component[%d]_fval = %.3e", iddl, fval);
+                aij += wx[i]*xj[i];
             }
+            workspace.normalMatrix[iddl*nddl+jddl] = aij;
+            workspace.normalMatrix[jddl*nddl+iddl] = aij;
         }
-
-        gsl_vector_set (y, i, yi);
-        gsl_vector_set (w, i, 1.0/(ei*ei));
     }
 
     // Now fitting
@@ -240,86 +258,86 @@ void COperatorTplcombination::BasicFit(const CSpectrum& spectrum,
     Float64 duration_prep = boost::chrono::duration_cast<boost::chrono::microseconds>(stop_prep - start_prep).count();
     Log.LogDebug( "  Operator-Tplcombination: Linear fitting, preparation time = %.3f microsec", duration_prep);
     boost::chrono::thread_clock::time_point start_fit = boost::chrono::thread_clock::now();
-    {
-      gsl_multifit_linear_workspace * work = gsl_multifit_linear_alloc (n, nddl);
-      gsl_multifit_wlinear (X, w, y, c, cov, &chisq, work);
-      gsl_multifit_linear_free (work);
-    }
-    //
-    boost::chrono::thread_clock::time_point stop_fit = boost::chrono::thread_clock::now();
-    Float64 duration_fit = boost::chrono::duration_cast<boost::chrono::microseconds>(stop_fit - start_fit).count();
-    Log.LogDebug( "  Operator-Tplcombination: Linear fitting, fit = %.3f microsec", duration_fit);
-    boost::chrono::thread_clock::time_point start_postprocess = boost::chrono::thread_clock::now();
-
-    if(verbose)
-    {
-#define C(i) (gsl_vector_get(c,(i)))
-#define COV(i,j) (gsl_matrix_get(cov,(i),(j)))
-        if(1){
-            Log.LogInfo("# best fit: Y = %g X1 + %g X2 ...", C(0), C(1));
-            Log.LogInfo("# covariance matrix:");
-            Log.LogInfo("[");
-            Log.LogInfo("  %+.5e, %+.5e", COV(0,0), COV(0,1));
-            Log.LogInfo("  %+.5e, %+.5e", COV(1,0), COV(1,1));
-
-            //        Log.LogInfo("[ %+.5e, %+.5e, %+.5e  \n", COV(0,0), COV(0,1), COV(0,2));
-            //        Log.LogInfo("  %+.5e, %+.5e, %+.5e  \n", COV(1,0), COV(1,1), COV(1,2));
-            //        Log.LogInfo("  %+.5e, %+.5e, %+.5e ]\n", COV(2,0), COV(2,1), COV(2,2));
-
-            Log.LogInfo("]");
-            Log.LogInfo("# chisq/n = %g", chisq/n);
+    if( !SolveNormalEquations( workspace, nddl ) )
+    {
+        // ill-conditioned templates basis: full SVD of the design matrix, as gsl_multifit_wlinear truncates the small singular values
+        Log.LogDebug( "  Operator-Tplcombination: Linear fitting, normal equations ill-conditioned, using SVD for z=%f", redshift);
+        gsl_matrix *X, *cov;
+        gsl_vector *y, *w, *c;
+        X = gsl_matrix_alloc (n, nddl);
+        y = gsl_vector_alloc (n);
+        w = gsl_vector_alloc (n);
+        c = gsl_vector_alloc (nddl);
+        cov = gsl_matrix_alloc (nddl, nddl);
+        for(Int32 i = 0; i < n; i++)
+        {
+            for (Int32 iddl = 0; iddl < nddl; iddl++)
+            {
+                gsl_matrix_set (X, i, iddl, workspace.templatesRebined[iddl]->GetFluxAxis()[i+imin_lbda]);
+            }
+            gsl_vector_set (y, i, spcFlux[i]/normFactor);
+            gsl_vector_set (w, i, spcW[i]*normFactor2);
         }
-
+        Float64 chisq;
+        gsl_multifit_linear_workspace * work = gsl_multifit_linear_alloc (n, nddl);
+        gsl_multifit_wlinear (X, w, y, c, cov, &chisq, work);
+        gsl_multifit_linear_free (work);
         for (Int32 iddl = 0; iddl < nddl; iddl++)
         {
-            Float64 a = gsl_vector_get(c,iddl)*normFactor;
-            if(verbose)
+            workspace.amplitudes[iddl] = gsl_vector_get(c,iddl);
+            for (Int32 jddl = 0; jddl < nddl; jddl++)
             {
-                Log.LogInfo("# Found amplitude %d: %+.5e +- %.5e", iddl, a, COV(iddl,iddl)*normFactor);
+                workspace.covariance[iddl*nddl+jddl] = gsl_matrix_get(cov,iddl,jddl);
             }
         }
+        gsl_matrix_free (X);
+        gsl_vector_free (y);
+        gsl_vector_free (w);
+        gsl_vector_free (c);
+        gsl_matrix_free (cov);
     }
+    //
+    boost::chrono::thread_clock::time_point stop_fit = boost::chrono::thread_clock::now();
+    Float64 duration_fit = boost::chrono::duration_cast<boost::chrono::microseconds>(stop_fit - start_fit).count();
+    Log.LogDebug( "  Operator-Tplcombination: Linear fitting, fit = %.3f microsec", duration_fit);
+    boost::chrono::thread_clock::time_point start_postprocess = boost::chrono::thread_clock::now();
 
     //save the fitted amps and fitErrors, etc...
     for (Int32 iddl = 0; iddl < nddl; iddl++)
     {
-        Float64 a = gsl_vector_get(c,iddl)*normFactor;
+        Float64 a = workspace.amplitudes[iddl]*normFactor;
         fittingResults.fittingAmplitudes[iddl]=a;
-        Float64 err = COV(iddl,iddl)*normFactor;
+        Float64 err = workspace.covariance[iddl*nddl+iddl]*normFactor;
         fittingResults.fittingErrors[iddl] = err;
+        if(verbose)
+        {
+            Log.LogInfo("# Found amplitude %d: %+.5e +- %.5e", iddl, a, err);
+        }
     }
-    if(fittingResults.fittingAmplitudes.size()!=nddl)
+
+    //estimate the lst-square brute force, the model being only stored on request
+    if(buildModel)
     {
-        Log.LogDebug("  Operator-Tplcombination: Found nfittedamps(=%d) different than nddl(=%d)", fittingResults.fittingAmplitudes.size(), nddl);
+        fittingResults.modelSpectrum.GetSpectralAxis().SetSize(n);
+        fittingResults.modelSpectrum.GetFluxAxis().SetSize(n);
     }
-
-    //build the model
-    CSpectrum modelSpectrum;
-    modelSpectrum.GetSpectralAxis().SetSize(n);
-    modelSpectrum.GetFluxAxis().SetSize(n);
-    for(Int32 k=0; k<modelSpectrum.GetSampleCount(); k++)
+    fittingResults.chisquare = .0;
+    Float64 diff;
+    for(Int32 k=0; k<n; k++)
     {
-        modelSpectrum.GetSpectralAxis()[k]=spcSpectralAxis[k+imin_lbda];
-        modelSpectrum.GetFluxAxis()[k]=.0;
+        Float64 modelFlux = .0;
         for (Int32 iddl = 0; iddl < nddl; iddl++)
         {
             Float32 a = fittingResults.fittingAmplitudes[iddl];
-            if(k==0){
-                Log.LogDebug("  Operator-Tplcombination: Building model with tpl/component #%d with amplitude a=%+.5e", iddl, a);
-            }
-            modelSpectrum.GetFluxAxis()[k] += a*m_templatesRebined_bf[iddl]->GetFluxAxis()[k+imin_lbda];
+            modelFlux += a*workspace.templatesRebined[iddl]->GetFluxAxis()[k+imin_lbda];
         }
-    }
-    fittingResults.modelSpectrum = modelSpectrum;
-
-    //estimate the lst-square brute force
-    fittingResults.chisquare = .0;
-    Float64 diff, err2;
-    for(Int32 k=0; k<n; k++)
-    {
-        diff = modelSpectrum.GetFluxAxis()[k]-spcFluxAxis[k+imin_lbda];
-        err2 = spcError[k+imin_lbda]*spcError[k+imin_lbda];
-        fittingResults.chisquare += diff*diff/err2;
+        if(buildModel)
+        {
+            fittingResults.modelSpectrum.GetSpectralAxis()[k]=spcSpectralAxis[k+imin_lbda];
+            fittingResults.modelSpectrum.GetFluxAxis()[k]=modelFlux;
+        }
+        diff = modelFlux-spcFlux[k];
+        fittingResults.chisquare += diff*diff*spcW[k];
     }
 
     //save the interm chisquares: for now, ism and igm deactivated so that interm chi2=global chi2
@@ -335,13 +353,6 @@ void COperatorTplcombination::BasicFit(const CSpectrum& spectrum,
     Float64 duration_postprocess = boost::chrono::duration_cast<boost::chrono::microseconds>(stop_postprocess - start_postprocess).count();
     Log.LogDebug( "  Operator-Tplcombination: Linear fitting, postprocess = %.3f microsec", duration_postprocess);
 
-    gsl_matrix_free (X);
-    gsl_vector_free (y);
-    gsl_vector_free (w);
-    gsl_vector_free (c);
-    gsl_matrix_free (cov);
-
-
     if(status_chisquareSetAtLeastOnce)
     {
         fittingResults.status = COperator::nStatus_OK;
@@ -350,13 +361,178 @@ void COperatorTplcombination::BasicFit(const CSpectrum& spectrum,
     }
 }
 
+/**
+ * Allocates the rebinned templates and the fit buffers of a workspace, with regard to the spectrum and templates sizes.
+ */
+void COperatorTplcombination::AllocateWorkspace( STplcombination_workspace& workspace, const CSpectrum& spectrum, const TTemplateConstRefList& tplList )
+{
+    Int32 nddl = tplList.size();
+    workspace.templatesRebined.clear();
+    workspace.masksRebined.clear();
+    workspace.shiftedTemplatesSpectralAxis.clear();
+    for(Int32 ktpl=0; ktpl<nddl; ktpl++)
+    {
+        // Pre-Allocate the rebined template with regard to the spectrum size
+        std::shared_ptr<CTemplate> templateRebined_bf = std::shared_ptr<CTemplate>( new CTemplate( tplList[ktpl]->GetName(), tplList[ktpl]->GetCategory() ) );
+        templateRebined_bf->GetSpectralAxis().SetSize(spectrum.GetSampleCount());
+        templateRebined_bf->GetFluxAxis().SetSize(spectrum.GetSampleCount());
+        workspace.templatesRebined.push_back(templateRebined_bf);
+
+        // Pre-Allocate the rebined mask with regard to the spectrum size
+        std::shared_ptr<CMask> mskRebined_bf = std::shared_ptr<CMask>( new CMask() );
+        mskRebined_bf->SetSize(spectrum.GetSampleCount());
+        workspace.masksRebined.push_back(mskRebined_bf);
+
+        //
+        std::shared_ptr<CSpectrumSpectralAxis> shiftedTplSpectralAxis_bf = std::shared_ptr<CSpectrumSpectralAxis>( new CSpectrumSpectralAxis(  ));
+        shiftedTplSpectralAxis_bf->SetSize(tplList[ktpl]->GetSampleCount());
+        workspace.shiftedTemplatesSpectralAxis.push_back(shiftedTplSpectralAxis_bf);
+    }
+    workspace.weightedTemplates.reserve( spectrum.GetSampleCount()*nddl );
+    workspace.normalMatrix.resize( nddl*nddl );
+    workspace.normalVector.resize( nddl );
+    workspace.cholesky.resize( nddl*nddl );
+    workspace.amplitudes.resize( nddl );
+    workspace.covariance.resize( nddl*nddl );
+    workspace.unitVector.resize( nddl );
+    workspace.error.clear();
+}
+
+/**
+ * Solves the normal equations A.c = b of the workspace by Cholesky factorization: sets the amplitudes c and the covariance A^-1.
+ * Returns false if A is not numerically positive definite, a pivot losing more than 10 significant digits relative to
+ * its diagonal term: the SVD of the design matrix is then needed.
+ */
+Bool COperatorTplcombination::SolveNormalEquations( STplcombination_workspace& workspace, Int32 nddl )
+{
+    const Float64* A = workspace.normalMatrix.data();
+    Float64* L = workspace.cholesky.data();
+    for (Int32 i = 0; i < nddl; i++)
+    {
+        for (Int32 j = 0; j <= i; j++)
+        {
+            Float64 sum = A[i*nddl+j];
+            for (Int32 k = 0; k < j; k++)
+            {
+                sum -= L[i*nddl+k]*L[j*nddl+k];
+            }
+            if( i==j )
+            {
+                if( !(sum > 1e-10*A[i*nddl+i]) )
+                {
+                    return false;
+                }
+                L[i*nddl+i] = sqrt(sum);
+            }else
+            {
+                L[i*nddl+j] = sum/L[j*nddl+j];
+            }
+        }
+    }
+
+    // c = A^-1.b, then the columns of A^-1 from the unit vectors
+    for (Int32 col = -1; col < nddl; col++)
+    {
+        Float64* x = (col<0) ? workspace.amplitudes.data() : workspace.unitVector.data();
+        for (Int32 i = 0; i < nddl; i++)
+        {
+            Float64 sum = (col<0) ? workspace.normalVector[i] : ( i==col ? 1.0 : 0.0 );
+            for (Int32 k = 0; k < i; k++)
+            {
+                sum -= L[i*nddl+k]*x[k];
+            }
+            x[i] = sum/L[i*nddl+i];
+        }
+        for (Int32 i = nddl-1; i >= 0; i--)
+        {
+            Float64 sum = x[i];
+            for (Int32 k = i+1; k < nddl; k++)
+            {
+                sum -= L[k*nddl+i]*x[k];
+            }
+            x[i] = sum/L[i*nddl+i];
+        }
+        if( col>=0 )
+        {
+            for (Int32 i = 0; i < nddl; i++)
+            {
+                workspace.covariance[i*nddl+col] = x[i];
+            }
+        }
+    }
+    return true;
+}
+
+/**
+ * Fits the sorted redshifts izBegin to izEnd-1 with the workspace iWorkspace, and stores the chi2 in the result.
+ * Each thread has its own workspace and writes its own redshifts: the ranges can be fitted concurrently.
+ */
+void COperatorTplcombination::FitRedshiftRange( const STplcombination_fitinputs& inputs, Int32 izBegin, Int32 izEnd, Int32 iWorkspace )
+{
+    STplcombination_workspace& workspace = m_workspaces[iWorkspace];
+    CTplcombinationResult& result = *inputs.result;
+    try
+    {
+        CMask additional_spcMask;
+        for (Int32 i=izBegin;i<izEnd;i++)
+        {
+            //default mask
+            if(inputs.useDefaultMask)
+            {
+                additional_spcMask = *inputs.default_spcMask;
+            }else{
+                //masks from the input masks list
+                additional_spcMask = (*inputs.additional_spcMasks)[(*inputs.sortedIndexes)[i]];
+            }
+
+            Float64 redshift = result.Redshifts[i];
+
+            STplcombination_basicfitresult fittingResults;
+
+            BasicFit( *inputs.spectrum,
+                      *inputs.tplList,
+                      *inputs.lambdaRange,
+                      redshift,
+                      inputs.overlapThreshold,
+                      fittingResults,
+                      workspace,
+                      inputs.opt_interp,
+                      -1,
+                      inputs.opt_extinction,
+                      inputs.opt_dustFitting,
+                      additional_spcMask,
+                      false);
+
+            if(result.Status[i]==COperator::nStatus_InvalidProductsError)
+            {
+                Log.LogError("  Operator-Tplcombination: found invalid tplcombination products for z=%f. Now breaking z loop.", redshift);
+                break;
+            }
+
+            result.ChiSquare[i]=fittingResults.chisquare;
+            result.Overlap[i]=fittingResults.overlapRate;
+            result.ChiSquareIntermediate[i]=fittingResults.ChiSquareInterm;
+            result.FitAmplitudes[i]=fittingResults.fittingAmplitudes;
+            result.FitAmplitudesError[i]=fittingResults.fittingErrors;
+
+            if(inputs.progress)
+            {
+                ++(*inputs.progress);
+            }
+        }
+    } catch (std::exception const &e)
+    {
+        workspace.error = e.what();
+    }
+}
+
 /**
  * \brief
  *
  * input: if additional_spcMasks size is 0, no additional mask will be used, otherwise its size should match the redshifts list size
  **/
 std::shared_ptr<COperatorResult> COperatorTplcombination::Compute(const CSpectrum& spectrum,
-                                                                  std::vector<CTemplate> tplList,
+                                                                  const TTemplateConstRefList& tplList,
                                                                   const TFloat64Range& lambdaRange,
                                                                   const TFloat64List& redshifts,
                                                                   Float64 overlapThreshold,
@@ -387,105 +563,27 @@ std::shared_ptr<COperatorResult> COperatorTplcombination::Compute(const CSpectru
 
     for(Int32 ktpl=0; ktpl<tplList.size(); ktpl++)
     {
-        if( tplList[ktpl].GetSpectralAxis().IsInLinearScale() == false )
+        if( tplList[ktpl]->GetSpectralAxis().IsInLinearScale() == false )
         {
             Log.LogError("  Operator-tplcombination: input template k=%d are not in log scale (ignored)", ktpl);
             //return NULL;
         }
     }
 
-    Log.LogDebug("  Operator-tplcombination: allocating memory for buffers (N = %d)", tplList.size());
-    Float64* precomputedFineGridTplFlux = NULL; //Todo: define as a list for each tpl
     for(Int32 ktpl=0; ktpl<tplList.size(); ktpl++)
     {
-        // Pre-Allocate the rebined template with regard to the spectrum size
-        std::shared_ptr<CTemplate> templateRebined_bf = std::shared_ptr<CTemplate>( new CTemplate( tplList[ktpl].GetName(), tplList[ktpl].GetCategory() ) );
-        templateRebined_bf->GetSpectralAxis().SetSize(spectrum.GetSampleCount());
-        templateRebined_bf->GetFluxAxis().SetSize(spectrum.GetSampleCount());
-        m_templatesRebined_bf.push_back(templateRebined_bf);
-
-        // Pre-Allocate the rebined mask with regard to the spectrum size
-        std::shared_ptr<CMask> mskRebined_bf = std::shared_ptr<CMask>( new CMask() );
-        mskRebined_bf->SetSize(spectrum.GetSampleCount());
-        m_masksRebined_bf.push_back(mskRebined_bf);
-
-        //
-        std::shared_ptr<CSpectrumSpectralAxis> shiftedTplSpectralAxis_bf = std::shared_ptr<CSpectrumSpectralAxis>( new CSpectrumSpectralAxis(  ));
-        shiftedTplSpectralAxis_bf->SetSize(tplList[ktpl].GetSampleCount());
-        m_shiftedTemplatesSpectralAxis_bf.push_back(shiftedTplSpectralAxis_bf);
-
-        if(opt_interp=="precomputedfinegrid"){
-            /*/
-            // Precalculate a fine grid template to be used for the 'closest value' rebin method
-            Int32 n = tpl.GetSampleCount();
-            CSpectrumFluxAxis tplFluxAxis = tpl.GetFluxAxis();
-            CSpectrumSpectralAxis tplSpectralAxis = tpl.GetSpectralAxis();
-            //Float64 dLambdaTgt =  1.0 * ( spectrum.GetMeanResolution()*0.9 )/( 1+sortedRedshifts[sortedRedshifts.size()-1] );
-            Float64 dLambdaTgt =  0.1;
-            //Float64 lmin = tplSpectralAxis[0];
-            Float64 lmin = 0;
-            Float64 lmax = tplSpectralAxis[n-1];
-            Int32 nTgt = (lmax-lmin)/dLambdaTgt + 2.0/dLambdaTgt;
-
-            // pfg with std::vector
-            //CTemplate       templateFine;
-            //templateFine.GetSpectralAxis().SetSize(nTgt);
-            //templateFine.GetFluxAxis().SetSize(nTgt);
-            //Float64* precomputedFineGridTplFlux = templateFine.GetFluxAxis().GetSamples();
-            // pfg with malloc
-            precomputedFineGridTplFlux = (Float64*)malloc(nTgt*sizeof(Float64));
-            if(precomputedFineGridTplFlux == NULL)
+        // the precomputed fine grid is owned by each template (and thus by the template catalog): built once and
+        // reused for every spectrum
+        if(opt_interp=="precomputedfinegrid")
+        {
+            const CTemplate& tpl = *tplList[ktpl];
+            if( ( tpl.GetFineGridSinglePrecision() && tpl.GetFineGridFluxSinglePrecision()==NULL ) ||
+                ( !tpl.GetFineGridSinglePrecision() && tpl.GetFineGridFlux()==NULL ) )
             {
-                Log.LogError("  Operator-Chisquare2: unable to allocate the precomputed fine grid buffer... aborting!");
+                Log.LogError("  Operator-tplcombination: unable to allocate the precomputed fine grid buffer... aborting!");
                 return NULL;
             }
-            // pfg with static array => doesn't work
-            //nTgt = 999999;
-            //Float64 precomputedFineGridTplFlux[999999];
-            //Log.LogInfo( "nTgt: %d samples", nTgt);
-
-            //inialise and allocate the gsl objects
-            Float64* Ysrc = tplFluxAxis.GetSamples();
-            Float64* Xsrc = tplSpectralAxis.GetSamples();
-            // linear
-            //gsl_interp *interpolation = gsl_interp_alloc (gsl_interp_linear,n);
-            //gsl_interp_init(interpolation, Xsrc, Ysrc, n);
-            //gsl_interp_accel * accelerator =  gsl_interp_accel_alloc();
-
-            //spline
-            gsl_spline *spline = gsl_spline_alloc (gsl_interp_cspline, n);
-            gsl_spline_init (spline, Xsrc, Ysrc, n);
-            gsl_interp_accel * accelerator =  gsl_interp_accel_alloc();
-
-            Int32 k = 0;
-            Float64 x = 0.0;
-            for(k=0; k<nTgt; k++){
-                x = lmin + k*dLambdaTgt;
-                if(x < tplSpectralAxis[0] || x > tplSpectralAxis[n-1]){
-                    precomputedFineGridTplFlux[k] = 0.0;
-                }else{
-                    //precomputedFineGridTplFlux[k] = gsl_interp_eval(interpolation, Xsrc, Ysrc, x, accelerator);
-                    precomputedFineGridTplFlux[k] = gsl_spline_eval (spline, x, accelerator);
-                }
-            }
-
-            gsl_spline_free (spline);
-            gsl_interp_accel_free (accelerator);
-            //*/
-        }
-        /*//debug:
-        // save templateFine
-        FILE* f = fopen( "template_precomputedFineGrid.txt", "w+" );
-        for(Int32 m=0; m<nTgt; m++){
-            Float64 x = lmin + k*dLambdaTgt;
-            if( Yfine[m] < 0.0001 ){
-                fprintf( f, "%e %e\n", x, precomputedFineGridTplFlux[m]);
-            }else{
-                fprintf( f, "%f %f\n", x, precomputedFineGridTplFlux[m]);
-            }
         }
-        fclose( f );
-        //*/
     }
 
     //sort the redshift and keep track of the indexes
@@ -539,46 +637,49 @@ std::shared_ptr<COperatorResult> COperatorTplcombination::Compute(const CSpectru
     }
 
 
+    // one workspace per thread, each one fitting a contiguous part of the redshift grid
+    Int32 nThreads = std::max( 1, std::min( m_opt_threadCount, Int32(sortedRedshifts.size()) ) );
+    Log.LogDebug("  Operator-tplcombination: allocating memory for buffers (N = %d, threads = %d)", tplList.size(), nThreads);
+    m_workspaces.resize( nThreads );
+    for(Int32 kw=0; kw<nThreads; kw++)
+    {
+        AllocateWorkspace( m_workspaces[kw], spectrum, tplList );
+    }
+
     boost::progress_display show_progress(Float64(sortedRedshifts.size())) ;
-    for (Int32 i=0;i<sortedRedshifts.size();i++)
+    STplcombination_fitinputs fitInputs;
+    fitInputs.spectrum = &spectrum;
+    fitInputs.tplList = &tplList;
+    fitInputs.lambdaRange = &lambdaRange;
+    fitInputs.overlapThreshold = overlapThreshold;
+    fitInputs.additional_spcMasks = &additional_spcMasks;
+    fitInputs.default_spcMask = &default_spcMask;
+    fitInputs.useDefaultMask = useDefaultMask;
+    fitInputs.sortedIndexes = &sortedIndexes;
+    fitInputs.opt_interp = opt_interp;
+    fitInputs.opt_extinction = opt_extinction;
+    fitInputs.opt_dustFitting = opt_dustFitting;
+    fitInputs.result = result.get();
+    fitInputs.progress = (nThreads==1) ? &show_progress : NULL;
+    if(nThreads==1)
+    {
+        FitRedshiftRange( fitInputs, 0, sortedRedshifts.size(), 0 );
+    }else
     {
-        //default mask
-        if(useDefaultMask)
+        CThreadPool threadPool( nThreads );
+        Int32 nz = sortedRedshifts.size();
+        for(Int32 kw=0; kw<nThreads; kw++)
         {
-            additional_spcMask = default_spcMask;
-        }else{
-            //masks from the input masks list
-            additional_spcMask = additional_spcMasks[sortedIndexes[i]];
+            threadPool.AddTask( boost::bind( &COperatorTplcombination::FitRedshiftRange, this, boost::cref( fitInputs ), kw*nz/nThreads, (kw+1)*nz/nThreads, kw ) );
         }
-
-        Float64 redshift = result->Redshifts[i];
-
-        STplcombination_basicfitresult fittingResults;
-
-        BasicFit( spectrum,
-                  tplList,
-                  precomputedFineGridTplFlux,
-                  lambdaRange,
-                  redshift,
-                  overlapThreshold,
-                  fittingResults,
-                  opt_interp,
-                  -1,
-                  opt_extinction,
-                  opt_dustFitting,
-                  additional_spcMask);
-
-        if(result->Status[i]==COperator::nStatus_InvalidProductsError)
+    }
+    for(Int32 kw=0; kw<nThreads; kw++)
+    {
+        if( !m_workspaces[kw].error.empty() )
         {
-            Log.LogError("  Operator-Tplcombination: found invalid tplcombination products for z=%f. Now breaking z loop.", redshift);
-            break;
+            Log.LogError("  Operator-Tplcombination: fit failed: %s", m_workspaces[kw].error.c_str());
+            throw runtime_error( m_workspaces[kw].error );
         }
-
-        result->ChiSquare[i]=fittingResults.chisquare;
-        result->Overlap[i]=fittingResults.overlapRate;
-        result->ChiSquareIntermediate[i]=fittingResults.ChiSquareInterm;
-
-        ++show_progress;
     }
 
     //overlap warning
@@ -730,11 +831,11 @@ std::shared_ptr<COperatorResult> COperatorTplcombination::Compute(const CSpectru
 
             BasicFit( spectrum,
                       tplList,
-                      precomputedFineGridTplFlux,
                       lambdaRange,
                       redshift,
                       overlapThreshold,
                       fittingResults,
+                      m_workspaces[0],
                       opt_interp,
                       -1,
                       opt_extinction,
@@ -760,9 +861,6 @@ std::shared_ptr<COperatorResult> COperatorTplcombination::Compute(const CSpectru
         }
     }
 
-    if(opt_interp=="precomputedfinegrid"){
-        free(precomputedFineGridTplFlux);
-    }
     return result;
 
 }
@@ -23,6 +23,8 @@ void CTplcombinationResult::Init(UInt32 n , Int32 nISM, Int32 nIGM)
 {
     ChiSquare.resize( n );
     FitAmplitude.resize( n );
+    FitAmplitudes.resize( n );
+    FitAmplitudesError.resize( n );
     FitDustCoeff.resize( n );
     FitMeiksinIdx.resize( n );
     FitDtM.resize( n );
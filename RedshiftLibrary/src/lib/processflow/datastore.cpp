@@ -22,6 +22,19 @@ CDataStore::CDataStore( COperatorResultStore& resultStore, CParameterStore& para
 {
 }
 
+/**
+ * The copy shares the result and parameter stores of other, and starts from its scopes, spectrum name and processing ID.
+ * Pushing and popping scopes on the copy does not change the scopes of other: methods running concurrently each use their own copy.
+ */
+CDataStore::CDataStore( const CDataStore& other ) :
+   m_ResultStore( other.m_ResultStore ),
+   m_ParameterStore( other.m_ParameterStore ),
+   m_SpectrumName( other.m_SpectrumName ),
+   m_ProcessingID( other.m_ProcessingID ),
+   m_ScopeStack( other.m_ScopeStack )
+{
+}
+
 CDataStore::~CDataStore()
 {
 
@@ -1,5 +1,7 @@
 #include <RedshiftLibrary/processflow/parameterstore.h>
 
+#include <RedshiftLibrary/log/log.h>
+
 #include <boost/property_tree/json_parser.hpp>
 
 using namespace NSEpic;
@@ -11,15 +13,30 @@ CParameterStore::CParameterStore()
 
 }
 
+/**
+ * Copies the parameters, the copy has its own mutex.
+ */
+CParameterStore::CParameterStore( const CParameterStore& other )
+{
+    boost::recursive_mutex::scoped_lock lock( other.m_Mutex );
+    m_PropertyTree = other.m_PropertyTree;
+}
+
 CParameterStore::~CParameterStore()
 {
 
 }
 
 
-Bool CParameterStore::Get( const std::string& name, TBoolList& v, const TBoolList& defaultValue ) const
+/**
+ * Sets v to the value of name. A missing parameter is added to the store with defaultValue.
+ * Returns false, with v set to defaultValue, if the stored value cannot be read as a T: the stored value is kept,
+ * so that it is reported again and saved as it was given.
+ */
+template<typename T>
+Bool CParameterStore::GetValue( const std::string& name, T& v, const T& defaultValue ) const
 {
-  //std::cout << "Get v1" << std::endl;
+    boost::recursive_mutex::scoped_lock lock( m_Mutex );
     boost::optional< bpt::ptree & > property = m_PropertyTree.get_child_optional( name );
 
     // If property does not exist, add it
@@ -27,22 +44,26 @@ Bool CParameterStore::Get( const std::string& name, TBoolList& v, const TBoolLis
         CParameterStore & self = const_cast<CParameterStore &>(*this);
         self.Set( name, defaultValue );
         v = defaultValue;
-    } else {
-        v.resize( (*property).size() );
-
-        bpt::ptree::const_iterator it;
-        Int32 i=0;
-        for( it=property->begin(); it != property->end(); it++ ){
-            v[i++] = it->second.get_value<Bool>();
-        }
+        return true;
     }
 
+    boost::optional<T> value = property->get_value_optional<T>();
+    if( !value ) {
+        Log.LogError( "Invalid value for parameter %s: %s", name.c_str(), property->data().c_str() );
+        v = defaultValue;
+        return false;
+    }
+    v = *value;
     return true;
 }
 
-Bool CParameterStore::Get( const std::string& name, TInt64List& v, const TInt64List& defaultValue ) const
+/**
+ * Same as GetValue, for a parameter stored as an array of values.
+ */
+template<typename T>
+Bool CParameterStore::GetList( const std::string& name, std::vector<T>& v, const std::vector<T>& defaultValue ) const
 {
-  //std::cout << "Get v2" << std::endl;
+    boost::recursive_mutex::scoped_lock lock( m_Mutex );
     boost::optional< bpt::ptree & > property = m_PropertyTree.get_child_optional( name );
 
     // If property does not exist, add it
@@ -50,139 +71,75 @@ Bool CParameterStore::Get( const std::string& name, TInt64List& v, const TInt64L
         CParameterStore & self = const_cast<CParameterStore &>(*this);
         self.Set( name, defaultValue );
         v = defaultValue;
-    } else {
-        v.resize( (*property).size() );
-
-        bpt::ptree::const_iterator it;
-        Int32 i=0;
-        for( it=property->begin(); it != property->end(); it++ ){
-            v[i++] = it->second.get_value<Int64>();
-        }
+        return true;
     }
 
-    return true;
-}
-
-Bool CParameterStore::Get( const std::string& name, TFloat64List& v, const TFloat64List& defaultValue ) const
-{
-  //std::cout << "Get v3" << std::endl;
-    boost::optional< bpt::ptree & > property = m_PropertyTree.get_child_optional( name );
-
-    // If property does not exist, add it
-    if( !property ) {
-        CParameterStore & self = const_cast<CParameterStore &>(*this);
-        self.Set( name, defaultValue );
+    // a single value instead of an array
+    if( property->empty() && !property->data().empty() ) {
+        Log.LogError( "Invalid value for parameter %s: %s, an array is expected", name.c_str(), property->data().c_str() );
         v = defaultValue;
-    } else {
-        v.resize( (*property).size() );
+        return false;
+    }
 
-        bpt::ptree::const_iterator it;
-        Int32 i=0;
-        for( it=property->begin(); it != property->end(); it++ ){
-            v[i++] = it->second.get_value<Float64>();
+    std::vector<T> values;
+    bpt::ptree::const_iterator it;
+    for( it=property->begin(); it != property->end(); it++ ){
+        boost::optional<T> value = it->second.get_value_optional<T>();
+        if( !value ) {
+            Log.LogError( "Invalid value for parameter %s: %s", name.c_str(), it->second.data().c_str() );
+            v = defaultValue;
+            return false;
         }
+        values.push_back( *value );
     }
-
+    v = values;
     return true;
 }
 
-Bool CParameterStore::Get( const std::string& name, TStringList& v, const TStringList& defaultValue ) const
+Bool CParameterStore::Get( const std::string& name, TBoolList& v, const TBoolList& defaultValue ) const
 {
-  //std::cout << "Get v4" << std::endl;
-    boost::optional< bpt::ptree & > property = m_PropertyTree.get_child_optional( name );
+    return GetList( name, v, defaultValue );
+}
 
-    // If property does not exist, add it
-    if( !property ) {
-        CParameterStore & self = const_cast<CParameterStore &>(*this);
-        self.Set( name, defaultValue );
-        v = defaultValue;
-    } else {
-        v.resize( (*property).size() );
+Bool CParameterStore::Get( const std::string& name, TInt64List& v, const TInt64List& defaultValue ) const
+{
+    return GetList( name, v, defaultValue );
+}
 
-        bpt::ptree::const_iterator it;
-        Int32 i=0;
-        for( it=property->begin(); it != property->end(); it++ ){
-            v[i++] = it->second.get_value<std::string>();
-        }
-    }
+Bool CParameterStore::Get( const std::string& name, TFloat64List& v, const TFloat64List& defaultValue ) const
+{
+    return GetList( name, v, defaultValue );
+}
 
-    return true;
+Bool CParameterStore::Get( const std::string& name, TStringList& v, const TStringList& defaultValue ) const
+{
+    return GetList( name, v, defaultValue );
 }
 
 Bool CParameterStore::Get( const std::string& name, std::string& v, std::string defaultValue ) const
 {
-  //std::cout << "Get v5" << std::endl;
-  boost::optional< std::string > property = m_PropertyTree.get_optional< std::string >( name );
-  //std::cout << "got property tree" << std::endl;
-
-  // If property does not exist, add it
-  if( !property ) {
-    //std::cout << "!property" << std::endl;
-    CParameterStore & self = const_cast<CParameterStore &>(*this);
-    self.Set( name, defaultValue );
-    v = defaultValue;
-  } else {
-    //std::cout << "property" << std::endl;
-    v = *property;
-  }
-  //std::cout << "Returning from CParameterStore::Get v5" << std::endl;
-  return true;
+    return GetValue( name, v, defaultValue );
 }
 
 Bool CParameterStore::Get( const std::string& name, Float64& v, Float64 defaultValue ) const
 {
-  //std::cout << "Get v6" << std::endl;
-    boost::optional<Float64> property = m_PropertyTree.get_optional<Float64>( name );
-
-    // If property does not exist, add it
-    if( !property ) {
-        CParameterStore & self = const_cast<CParameterStore &>(*this);
-        self.Set( name, defaultValue );
-        v = defaultValue;
-    } else {
-        v = *property;
-    }
-
-    return true;
+    return GetValue( name, v, defaultValue );
 }
 
 Bool CParameterStore::Get( const std::string& name, Int64& v, Int64 defaultValue ) const
 {
-  //std::cout << "Get v7" << std::endl;
-    boost::optional<Int64> property = m_PropertyTree.get_optional<Int64>( name );
-
-    // If property does not exist, add it
-    if( !property ) {
-        CParameterStore & self = const_cast<CParameterStore &>(*this);
-        self.Set( name, defaultValue );
-        v = defaultValue;
-    } else {
-        v = *property;
-    }
-
-    return true;
+    return GetValue( name, v, defaultValue );
 }
 
 Bool CParameterStore::Get( const std::string& name, Bool& v, Bool defaultValue ) const
 {
-  //std::cout << "Get v8" << std::endl;
-    boost::optional<Bool> property = m_PropertyTree.get_optional<Bool>( name );
-
-    // If property does not exist, add it
-    if( !property ) {
-        CParameterStore & self = const_cast<CParameterStore &>(*this);
-        self.Set( name, defaultValue );
-        v = defaultValue;
-    } else {
-        v = *property;
-    }
-
-    return true;
+    return GetValue( name, v, defaultValue );
 }
 
 
 Bool CParameterStore::Get( const std::string& name, TFloat64Range& v, TFloat64Range defaultValue ) const
 {
+    boost::recursive_mutex::scoped_lock lock( m_Mutex );
   //std::cout << "Get v9" << std::endl;
     TFloat64List listDefault( 2 );
     TFloat64List list( 2 );
@@ -191,15 +148,41 @@ Bool CParameterStore::Get( const std::string& name, TFloat64Range& v, TFloat64Ra
     listDefault[1] = defaultValue.GetEnd();
 
     Bool r = Get( name, list, listDefault );
+    if( list.size()!=2 )
+    {
+        Log.LogError( "Invalid value for parameter %s: 2 values expected, %d found", name.c_str(), list.size() );
+        list = listDefault;
+        r = false;
+    }
 
     v.Set( list[0], list[1] );
 
     return r;
 }
 
+/**
+ * Returns the names of the parameters under name, the top-level ones for an empty name.
+ */
+TStringList CParameterStore::GetChildNames( const std::string& name ) const
+{
+    boost::recursive_mutex::scoped_lock lock( m_Mutex );
+    TStringList names;
+    boost::optional< bpt::ptree & > property = name.empty() ? boost::optional< bpt::ptree & >( m_PropertyTree ) : m_PropertyTree.get_child_optional( name );
+    if( property ) {
+        bpt::ptree::const_iterator it;
+        for( it=property->begin(); it != property->end(); it++ ){
+            if( !it->first.empty() ) {
+                names.push_back( it->first );
+            }
+        }
+    }
+    return names;
+}
+
 
 Bool CParameterStore::Set( const std::string& name, const TFloat64List& v )
 {
+    boost::recursive_mutex::scoped_lock lock( m_Mutex );
     boost::optional< bpt::ptree & > property = m_PropertyTree.get_child_optional( name );
 
     bpt::ptree array;
@@ -217,6 +200,7 @@ Bool CParameterStore::Set( const std::string& name, const TFloat64List& v )
 
 Bool CParameterStore::Set( const std::string& name, const TStringList& v )
 {
+    boost::recursive_mutex::scoped_lock lock( m_Mutex );
     boost::optional< bpt::ptree & > property = m_PropertyTree.get_child_optional( name );
 
     bpt::ptree array;
@@ -234,6 +218,7 @@ Bool CParameterStore::Set( const std::string& name, const TStringList& v )
 
 Bool CParameterStore::Set( const std::string& name, const TFloat64Range& v )
 {
+    boost::recursive_mutex::scoped_lock lock( m_Mutex );
     TFloat64List list( 2 );
 
     list[0] = v.GetBegin();
@@ -245,6 +230,7 @@ Bool CParameterStore::Set( const std::string& name, const TFloat64Range& v )
 
 Bool CParameterStore::Set( const std::string& name, const TInt64List& v )
 {
+    boost::recursive_mutex::scoped_lock lock( m_Mutex );
     boost::optional< bpt::ptree & > property = m_PropertyTree.get_child_optional( name );
 
     bpt::ptree array;
@@ -262,6 +248,7 @@ Bool CParameterStore::Set( const std::string& name, const TInt64List& v )
 
 Bool CParameterStore::Set( const std::string& name, const TBoolList& v )
 {
+    boost::recursive_mutex::scoped_lock lock( m_Mutex );
     boost::optional< bpt::ptree & > property = m_PropertyTree.get_child_optional( name );
 
     bpt::ptree array;
@@ -279,6 +266,7 @@ Bool CParameterStore::Set( const std::string& name, const TBoolList& v )
 
 Bool CParameterStore::Set( const std::string& name, Float64 v )
 {
+    boost::recursive_mutex::scoped_lock lock( m_Mutex );
     boost::optional<Float64> property = m_PropertyTree.get_optional<Float64>( name );
 
     m_PropertyTree.put( name, v );
@@ -287,6 +275,7 @@ Bool CParameterStore::Set( const std::string& name, Float64 v )
 
 Bool CParameterStore::Set( const std::string& name, Int64 v )
 {
+    boost::recursive_mutex::scoped_lock lock( m_Mutex );
     boost::optional<Int64> property = m_PropertyTree.get_optional<Int64>( name );
 
     m_PropertyTree.put( name, v );
@@ -295,6 +284,7 @@ Bool CParameterStore::Set( const std::string& name, Int64 v )
 
 Bool CParameterStore::Set( const std::string& name, Bool v )
 {
+    boost::recursive_mutex::scoped_lock lock( m_Mutex );
     boost::optional<Bool> property = m_PropertyTree.get_optional<Bool>( name );
 
     m_PropertyTree.put( name, v );
@@ -303,6 +293,7 @@ Bool CParameterStore::Set( const std::string& name, Bool v )
 
 Bool CParameterStore::Set( const std::string& name, const std::string& v )
 {
+    boost::recursive_mutex::scoped_lock lock( m_Mutex );
     boost::optional<std::string> property = m_PropertyTree.get_optional<std::string>( name );
 
     m_PropertyTree.put( name, v );
@@ -312,12 +303,14 @@ Bool CParameterStore::Set( const std::string& name, const std::string& v )
 
 Bool CParameterStore::Save( const std::string& path ) const
 {
+    boost::recursive_mutex::scoped_lock lock( m_Mutex );
     bpt::json_parser::write_json( path, m_PropertyTree );
     return true;
 }
 
 Bool CParameterStore::Load( const std::string& path )
 {
+    boost::recursive_mutex::scoped_lock lock( m_Mutex );
     bpt::json_parser::read_json( path, m_PropertyTree );
     return true;
 }
@@ -1,4 +1,6 @@
 #include <RedshiftLibrary/processflow/processflow.h>
+#include <RedshiftLibrary/processflow/processflowparameters.h>
+#include <RedshiftLibrary/processflow/referencecatalog.h>
 
 #include <RedshiftLibrary/continuum/standard.h>
 #include <RedshiftLibrary/spectrum/template/template.h>
@@ -17,6 +19,7 @@
 #include <RedshiftLibrary/ray/catalog.h>
 #include <RedshiftLibrary/operator/raymatching.h>
 #include <RedshiftLibrary/common/median.h>
+#include <RedshiftLibrary/common/threadpool.h>
 
 #include <RedshiftLibrary/operator/correlation.h>
 #include <RedshiftLibrary/operator/chicorr.h>
@@ -61,6 +64,7 @@
 #include <iostream>
 
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
 #include <stdio.h>
 #include <float.h>
 
@@ -79,17 +83,30 @@ CProcessFlow::~CProcessFlow()
 
 }
 
+/**
+ * Processes the spectrum of ctx, with the process flow parameters read from the parameter store of ctx.
+ */
 void CProcessFlow::Process( CProcessFlowContext& ctx )
 {
-    Log.LogInfo("<proc-spc><%s>", ctx.GetSpectrum().GetName().c_str());
+    CProcessFlowParameters params;
+    if( !params.Load( ctx.GetParameterStore() ) )
+    {
+        throw std::runtime_error( "Invalid process flow parameters" );
+    }
+    Process( ctx, params );
+}
 
-    TFloat64Range lambdaRange;
-    TFloat64Range redshiftRange;
-    Float64       redshiftStep;
+/**
+ * Processes the spectrum of ctx with the process flow parameters params, loaded once for all the spectra of a batch.
+ * The methods read their own parameters from the data store of ctx.
+ */
+void CProcessFlow::Process( CProcessFlowContext& ctx, const CProcessFlowParameters& params )
+{
+    Log.LogInfo("<proc-spc><%s>", ctx.GetSpectrum().GetName().c_str());
 
-    ctx.GetParameterStore().Get( "lambdarange", lambdaRange );
-    ctx.GetParameterStore().Get( "redshiftrange", redshiftRange );
-    ctx.GetParameterStore().Get( "redshiftstep", redshiftStep );
+    TFloat64Range lambdaRange = params.LambdaRange;
+    TFloat64Range redshiftRange = params.RedshiftRange;
+    Float64       redshiftStep = params.RedshiftStep;
     TFloat64Range spcLambdaRange;
     ctx.GetSpectrum().GetSpectralAxis().ClampLambdaRange( lambdaRange, spcLambdaRange );
 
@@ -97,26 +114,15 @@ void CProcessFlow::Process( CProcessFlowContext& ctx )
             spcLambdaRange.GetBegin(), spcLambdaRange.GetEnd(), ctx.GetSpectrum().GetResolution());
 
 
-    std::string methodName;
-    ctx.GetParameterStore().Get( "method", methodName );
-    boost::algorithm::to_lower(methodName);
+    const std::string& methodName = params.MethodName;
 
-    // Create redshift initial list by spanning redshift acdross the given range, with the given delta
-    std::string redshiftSampling;
-    ctx.GetParameterStore().Get( "redshiftsampling", redshiftSampling, "lin" ); //TODO: sampling in log cannot be used for now as zqual descriptors assume constant dz.
-    TFloat64List raw_redshifts;
-    if(redshiftSampling=="log")
-    {
-        raw_redshifts = redshiftRange.SpreadOverLog( redshiftStep ); //experimental: spreadover a grid at delta/(1+z), unusable because PDF needs regular z-step
-    }else
-    {
-        raw_redshifts = redshiftRange.SpreadOver( redshiftStep );
-    }
+    // Redshift initial list spanning the given range with the given delta, with the redshiftsampling parameter
+    //TODO: sampling in log cannot be used for now as zqual descriptors assume constant dz.
+    const TFloat64List& raw_redshifts = params.Redshifts;
 
 
     //Override z-search grid for line measurement: load the zref values from a tsv catalog file (col0: spc name, col1: zref float value)
-    std::string opt_linemeas_catalog_path;
-    ctx.GetParameterStore().Get( "linemeascatalog", opt_linemeas_catalog_path, "" );
+    const std::string& opt_linemeas_catalog_path = params.LineMeasCatalogPath;
     TFloat64List redshifts;
     if(opt_linemeas_catalog_path!="")
     {
@@ -133,7 +139,11 @@ void CProcessFlow::Process( CProcessFlowContext& ctx )
         {
             std::string spcSubStringId = ctx.GetSpectrum().GetName();
             Log.LogInfo( "Override z-search: using spc-string: %s", spcSubStringId.c_str());
-            getValueFromRefFile( refFilePath.c_str(), spcSubStringId, colId, zref, reverseInclusionForIdMatching);
+            std::shared_ptr<const CReferenceCatalog> refCatalog = CReferenceCatalog::GetShared( refFilePath.string() );
+            if( refCatalog )
+            {
+                refCatalog->GetValue( spcSubStringId, colId, zref, reverseInclusionForIdMatching );
+            }
         }
         if(zref==-1)
         {
@@ -175,8 +185,7 @@ void CProcessFlow::Process( CProcessFlowContext& ctx )
 
     std::string CategoryFilter="all";
     // Remove Star category, and filter the list with regard to input variable CategoryFilter
-    TStringList templateCategoryList;
-    ctx.GetParameterStore().Get( "templateCategoryList", templateCategoryList );
+    TStringList templateCategoryList = params.TemplateCategoryList;
     TStringList   filteredTemplateCategoryList;
     for( UInt32 i=0; i<templateCategoryList.size(); i++ )
     {
@@ -191,18 +200,11 @@ void CProcessFlow::Process( CProcessFlowContext& ctx )
     }
 
     //retrieve the calibration dir path
-    std::string calibrationDirPath;
-    ctx.GetParameterStore().Get( "calibrationDir", calibrationDirPath );
+    const std::string& calibrationDirPath = params.CalibrationDirPath;
 
 
     //************************************
-    Bool enableInputSpcCorrect = true;
-    std::string enableInputSpcCorrectStr;
-    ctx.GetParameterStore().Get( "autocorrectinput", enableInputSpcCorrectStr, "no" );
-    if(enableInputSpcCorrectStr!="yes")
-    {
-        enableInputSpcCorrect=false;
-    }
+    Bool enableInputSpcCorrect = params.AutoCorrectInput;
     if(methodName  == "reliability" )
     {
         enableInputSpcCorrect = false;
@@ -245,176 +247,37 @@ void CProcessFlow::Process( CProcessFlowContext& ctx )
     }
 
 
-    // Stellar method
+    // Stellar and quasar methods: they only read the spectra and write their results in their own scope,
+    // so they can run next to the galaxy method, each one on its own copy of the data store scopes
     std::shared_ptr<COperatorResult> starResult;
-    std::string enableStarFitting;
-    ctx.GetParameterStore().Get( "enablestellarsolve", enableStarFitting, "no" );
-    Log.LogInfo( "Stellar solve enabled : %s", enableStarFitting.c_str());
-    if(enableStarFitting=="yes"){
-        CDataStore::CAutoScope resultScope( ctx.GetDataStore(), "stellarsolve" );
-
-        std::string calibrationDirPath;
-        ctx.GetParameterStore().Get( "calibrationDir", calibrationDirPath );
-
-        bfs::path calibrationFolder( calibrationDirPath.c_str() );
-        CCalibrationConfigHelper calibrationConfig;
-        calibrationConfig.Init(calibrationDirPath);
+    Log.LogInfo( "Stellar solve enabled : %s", params.EnableStellarSolve ? "yes" : "no" );
 
-        std::string starTemplates = calibrationConfig.Get_starTemplates_relpath();
-
-        Log.LogInfo( "    Processflow - Loading star templates catalog : %s", starTemplates.c_str());
-        std::string templateDir = (calibrationFolder/starTemplates.c_str()).string();
-
-        TStringList   filteredStarTemplateCategoryList;
-        filteredStarTemplateCategoryList.push_back( "star" );
-
-        //temporary star catalog handling through calibration files, should be loaded somewhere else ?
-        std::string medianRemovalMethod="zero";
-        Float64 opt_medianKernelWidth = 150; //not used
-        Int64 opt_nscales=8; //not used
-        std::string dfBinPath="absolute_path_to_df_binaries_here"; //not used
-        std::shared_ptr<CTemplateCatalog> starTemplateCatalog = std::shared_ptr<CTemplateCatalog>( new CTemplateCatalog(medianRemovalMethod, opt_medianKernelWidth, opt_nscales, dfBinPath) );
-        starTemplateCatalog->Load( templateDir.c_str() );
-
-        for( UInt32 i=0; i<filteredStarTemplateCategoryList.size(); i++ )
-        {
-            std::string category = filteredStarTemplateCategoryList[i];
-            UInt32 ntpl = starTemplateCatalog->GetTemplateCount(category);
-            Log.LogInfo("stellar-solve: Loaded (category=%s) template count = %d", category.c_str(), ntpl);
-        }
-
-        Float64 overlapThreshold;
-        ctx.GetParameterStore().Get( "starsolve.overlapThreshold", overlapThreshold, 1.0);
-        std::string opt_spcComponent;
-        ctx.GetDataStore().GetScopedParam( "starsolve.spectrum.component", opt_spcComponent, "raw" );
-        std::string opt_interp;
-        ctx.GetDataStore().GetScopedParam( "starsolve.interpolation", opt_interp, "precomputedfinegrid" );
-        std::string opt_extinction;
-        ctx.GetDataStore().GetScopedParam( "starsolve.extinction", opt_extinction, "no" );
-        std::string opt_dustFit;
-        ctx.GetDataStore().GetScopedParam( "starsolve.dustfit", opt_dustFit, "yes" );
-
-        // prepare the unused masks
-        std::vector<CMask> maskList;
-        //define the redshift search grid
-        TFloat64Range starRedshiftRange=TFloat64Range(-1e-3, +1e-3);
-        Float64 starRedshiftStep = 5e-5;
-        Log.LogInfo("Stellar fitting redshift range = [%.5f, %.5f], step=%.6f", starRedshiftRange.GetBegin(), starRedshiftRange.GetEnd(), starRedshiftStep);
-        TFloat64List stars_redshifts = starRedshiftRange.SpreadOver( starRedshiftStep );
-        DebugAssert( stars_redshifts.size() > 0 );
-
-        Log.LogInfo("Processing stellar fitting");
-        CMethodChisquare2Solve solve(calibrationDirPath);
-        //CMethodChisquareLogSolve solve(calibrationDirPath);
-        starResult = solve.Compute( ctx.GetDataStore(),
-                                    ctx.GetSpectrum(),
-                                    ctx.GetSpectrumWithoutContinuum(),
-                                    *starTemplateCatalog,
-                                    filteredStarTemplateCategoryList,
-                                    spcLambdaRange,
-                                    stars_redshifts,
-                                    overlapThreshold,
-                                    maskList,
-                                    "stellar_zPDF",
-                                    opt_spcComponent, opt_interp, opt_extinction, opt_dustFit);
-
-
-        //finally save the stellar fitting results
-        if( starResult ) {
-            Log.LogInfo("Saving star fitting results");
-            ctx.GetDataStore().StoreScopedGlobalResult( "stellarresult", starResult );
-        }else{
-            Log.LogError( "Unable to store stellar result.");
-        }
-    }
-
-    // Quasar method
     std::shared_ptr<COperatorResult> qsoResult;
-    std::string enableQsoFitting;
-    ctx.GetParameterStore().Get( "enableqsosolve", enableQsoFitting, "no" );
-    Log.LogInfo( "QSO solve enabled : %s", enableQsoFitting.c_str());
-    if(enableQsoFitting=="yes"){
-        CDataStore::CAutoScope resultScope( ctx.GetDataStore(), "qsosolve" );
-
-        std::string calibrationDirPath;
-        ctx.GetParameterStore().Get( "calibrationDir", calibrationDirPath );
-
-        bfs::path calibrationFolder( calibrationDirPath.c_str() );
-        CCalibrationConfigHelper calibrationConfig;
-        calibrationConfig.Init(calibrationDirPath);
-
-        std::string qsoTemplates = calibrationConfig.Get_qsoTemplates_relpath();
-
-        Log.LogInfo( "    Processflow - Loading qso templates catalog : %s", qsoTemplates.c_str());
-        std::string templateDir = (calibrationFolder/qsoTemplates.c_str()).string();
+    Log.LogInfo( "QSO solve enabled : %s", params.EnableQsoSolve ? "yes" : "no" );
 
-        TStringList   filteredQSOTemplateCategoryList;
-        filteredQSOTemplateCategoryList.push_back( "emission" );
+    Int64 opt_threadcount = params.ThreadCount;
 
-        //temporary qso catalog handling through calibration files, should be loaded somewhere else ?
-        std::string medianRemovalMethod="zero";
-        Float64 opt_medianKernelWidth = 150; //not used
-        Int64 opt_nscales=8; //not used
-        std::string dfBinPath="absolute_path_to_df_binaries_here"; //not used
-        std::shared_ptr<CTemplateCatalog> qsoTemplateCatalog = std::shared_ptr<CTemplateCatalog>( new CTemplateCatalog(medianRemovalMethod, opt_medianKernelWidth, opt_nscales, dfBinPath) );
-        qsoTemplateCatalog->Load( templateDir.c_str() );
-
-        for( UInt32 i=0; i<filteredQSOTemplateCategoryList.size(); i++ )
-        {
-            std::string category = filteredQSOTemplateCategoryList[i];
-            UInt32 ntpl = qsoTemplateCatalog->GetTemplateCount(category);
-            Log.LogInfo("qso-solve: Loaded (category=%s) template count = %d", category.c_str(), ntpl);
-        }
-
-        Float64 overlapThreshold;
-        ctx.GetParameterStore().Get( "qsosolve.overlapThreshold", overlapThreshold, 1.0);
-        std::string opt_spcComponent;
-        ctx.GetDataStore().GetScopedParam( "qsosolve.spectrum.component", opt_spcComponent, "raw" );
-        std::string opt_interp;
-        ctx.GetDataStore().GetScopedParam( "qsosolve.interpolation", opt_interp, "precomputedfinegrid" );
-        std::string opt_extinction;
-        ctx.GetDataStore().GetScopedParam( "qsosolve.extinction", opt_extinction, "yes" );
-        std::string opt_dustFit;
-        ctx.GetDataStore().GetScopedParam( "qsosolve.dustfit", opt_dustFit, "no" );
-
-        // prepare the unused masks
-        std::vector<CMask> maskList;
-        //define the redshift search grid
-        TFloat64Range qsoRedshiftRange=TFloat64Range(0.0, 6.0);
-        Float64 qsoRedshiftStep = 5e-4;
-        Log.LogInfo("QSO fitting redshift range = [%.5f, %.5f], step=%.6f", qsoRedshiftRange.GetBegin(), qsoRedshiftRange.GetEnd(), qsoRedshiftStep);
-        TFloat64List qso_redshifts;
-        if(redshiftSampling=="log")
-        {
-            qso_redshifts = qsoRedshiftRange.SpreadOverLog( qsoRedshiftStep );
-        }else{
-            qso_redshifts = qsoRedshiftRange.SpreadOver( qsoRedshiftStep );
-        }
-        DebugAssert( qso_redshifts.size() > 0 );
-
-        Log.LogInfo("Processing stellar fitting");
-        CMethodChisquare2Solve solve(calibrationDirPath);
-        //CMethodChisquareLogSolve solve(calibrationDirPath);
-        qsoResult = solve.Compute( ctx.GetDataStore(),
-                                    ctx.GetSpectrum(),
-                                    ctx.GetSpectrumWithoutContinuum(),
-                                    *qsoTemplateCatalog,
-                                    filteredQSOTemplateCategoryList,
-                                    spcLambdaRange,
-                                    qso_redshifts,
-                                    overlapThreshold,
-                                    maskList,
-                                    "qso_zPDF",
-                                    opt_spcComponent, opt_interp, opt_extinction, opt_dustFit);
-
-
-        //finally save the qso fitting results
-        if( qsoResult ) {
-            Log.LogInfo("Saving qso fitting results");
-            ctx.GetDataStore().StoreScopedGlobalResult( "qsoresult", qsoResult );
-        }else{
-            Log.LogError( "Unable to store qso result.");
-        }
+    std::vector<boost::function<void ()>> solveTasks;
+    CDataStore starDataStore( ctx.GetDataStore() );
+    CDataStore qsoDataStore( ctx.GetDataStore() );
+    if(params.EnableStellarSolve){
+        solveTasks.push_back( boost::bind( &CProcessFlow::ProcessStellarSolve, this, boost::ref( ctx ), boost::cref( params ), boost::ref( starDataStore ), spcLambdaRange, boost::ref( starResult ) ) );
+    }
+    if(params.EnableQsoSolve){
+        solveTasks.push_back( boost::bind( &CProcessFlow::ProcessQsoSolve, this, boost::ref( ctx ), boost::cref( params ), boost::ref( qsoDataStore ), spcLambdaRange, boost::ref( qsoResult ) ) );
+    }
+    if( opt_threadcount>0 && solveTasks.size()>0 )
+    {
+        // build the lazily computed spectrum weights before they are shared between threads
+        ctx.GetSpectrum().GetFluxAxis().GetWeightedFlux();
+        ctx.GetSpectrumWithoutContinuum().GetFluxAxis().GetWeightedFlux();
+        Log.LogInfo( "Running %d stellar/qso solve(s) concurrently with the galaxy method", solveTasks.size() );
+    }
+    std::vector<std::string> solveTaskErrors( solveTasks.size() );
+    CThreadPool solveThreadPool( std::min( Int32( opt_threadcount ), Int32( solveTasks.size() ) ) );
+    for( UInt32 i=0; i<solveTasks.size(); i++ )
+    {
+        solveThreadPool.AddTask( boost::bind( &CProcessFlow::RunSolveTask, this, solveTasks[i], boost::ref( solveTaskErrors[i] ) ) );
     }
 
     // Galaxy method
@@ -463,22 +326,14 @@ void CProcessFlow::Process( CProcessFlowContext& ctx )
 
 
     }else if(methodName  == "chisquare2solve" ){
-        Float64 overlapThreshold;
-        ctx.GetParameterStore().Get( "chisquare2solve.overlapThreshold", overlapThreshold, 1.0);
-        std::string opt_spcComponent;
-        ctx.GetDataStore().GetScopedParam( "chisquare2solve.spectrum.component", opt_spcComponent, "raw" );
-        std::string opt_interp;
-        ctx.GetDataStore().GetScopedParam( "chisquare2solve.interpolation", opt_interp, "precomputedfinegrid" );
-        std::string opt_extinction;
-        ctx.GetDataStore().GetScopedParam( "chisquare2solve.extinction", opt_extinction, "no" );
-        std::string opt_dustFit;
-        ctx.GetDataStore().GetScopedParam( "chisquare2solve.dustfit", opt_dustFit, "no" );
+        Float64 overlapThreshold = params.MethodFitting.OverlapThreshold;
+        std::string opt_spcComponent = params.MethodFitting.SpcComponent;
+        std::string opt_interp = params.MethodFitting.Interpolation;
+        std::string opt_extinction = params.MethodFitting.Extinction;
+        std::string opt_dustFit = params.MethodFitting.DustFit;
 
         // prepare the unused masks
         std::vector<CMask> maskList;
-        //retrieve the calibration dir path
-        std::string calibrationDirPath;
-        ctx.GetParameterStore().Get( "calibrationDir", calibrationDirPath );
         CMethodChisquare2Solve solve(calibrationDirPath);
         mResult = solve.Compute( ctx.GetDataStore(),
                                  ctx.GetSpectrum(),
@@ -507,21 +362,14 @@ void CProcessFlow::Process( CProcessFlowContext& ctx )
         }
 
     }else if(methodName  == "chisquarelogsolve" ){
-        Float64 overlapThreshold;
-        ctx.GetParameterStore().Get( "chisquarelogsolve.overlapThreshold", overlapThreshold, 1.0);
-        std::string opt_spcComponent;
-        ctx.GetDataStore().GetScopedParam( "chisquarelogsolve.spectrum.component", opt_spcComponent, "raw" );
-        std::string opt_interp="unused";
-        std::string opt_extinction;
-        ctx.GetDataStore().GetScopedParam( "chisquarelogsolve.extinction", opt_extinction, "no" );
-        std::string opt_dustFit;
-        ctx.GetDataStore().GetScopedParam( "chisquarelogsolve.dustfit", opt_dustFit, "no" );
+        Float64 overlapThreshold = params.MethodFitting.OverlapThreshold;
+        std::string opt_spcComponent = params.MethodFitting.SpcComponent;
+        std::string opt_interp = params.MethodFitting.Interpolation;
+        std::string opt_extinction = params.MethodFitting.Extinction;
+        std::string opt_dustFit = params.MethodFitting.DustFit;
 
         // prepare the unused masks
         std::vector<CMask> maskList;
-        //retrieve the calibration dir path
-        std::string calibrationDirPath;
-        ctx.GetParameterStore().Get( "calibrationDir", calibrationDirPath );
         CMethodChisquareLogSolve solve(calibrationDirPath);
         mResult = solve.Compute( ctx.GetDataStore(),
                                  ctx.GetSpectrum(),
@@ -552,22 +400,14 @@ void CProcessFlow::Process( CProcessFlowContext& ctx )
 
 
     }else if(methodName  == "tplcombinationsolve" ){
-        Float64 overlapThreshold;
-        ctx.GetParameterStore().Get( "tplcombinationsolve.overlapThreshold", overlapThreshold, 1.0);
-        std::string opt_spcComponent;
-        ctx.GetDataStore().GetScopedParam( "tplcombinationsolve.spectrum.component", opt_spcComponent, "raw" );
-        std::string opt_interp="lin";
-        ctx.GetDataStore().GetScopedParam( "tplcombinationsolve.interpolation", opt_interp, "lin" );
-        std::string opt_extinction="no";
-        //ctx.GetDataStore().GetScopedParam( "tplcombinationsolve.extinction", opt_extinction, "no" );
-        std::string opt_dustFit="no";
-        //ctx.GetDataStore().GetScopedParam( "tplcombinationsolve.dustfit", opt_dustFit, "no" );
+        Float64 overlapThreshold = params.MethodFitting.OverlapThreshold;
+        std::string opt_spcComponent = params.MethodFitting.SpcComponent;
+        std::string opt_interp = params.MethodFitting.Interpolation;
+        std::string opt_extinction = params.MethodFitting.Extinction;
+        std::string opt_dustFit = params.MethodFitting.DustFit;
 
         // prepare the unused masks
         std::vector<CMask> maskList;
-        //retrieve the calibration dir path
-        std::string calibrationDirPath;
-        ctx.GetParameterStore().Get( "calibrationDir", calibrationDirPath );
         CMethodTplcombinationSolve solve(calibrationDirPath);
         mResult = solve.Compute( ctx.GetDataStore(),
                                  ctx.GetSpectrum(),
@@ -688,6 +528,16 @@ void CProcessFlow::Process( CProcessFlowContext& ctx )
         throw std::runtime_error("Problem found while parsing the method parameter");
     }
 
+    solveThreadPool.WaitForAllTaskToFinish();
+    for( UInt32 i=0; i<solveTaskErrors.size(); i++ )
+    {
+        if( !solveTaskErrors[i].empty() )
+        {
+            Log.LogError( "Stellar/qso solve failed: %s", solveTaskErrors[i].c_str() );
+            throw std::runtime_error( solveTaskErrors[i] );
+        }
+    }
+
     //Extracting the candidates summarized results (nb: only works for linemodel and chisquare methods as of Aug.2018)
     if(zcandidates_unordered_list.size()>0)
     {
@@ -754,7 +604,7 @@ void CProcessFlow::Process( CProcessFlowContext& ctx )
         Log.LogInfo( "Found galaxy evidence: %e", galaxyEvidence);
         typeLabel = "G";
     }
-    if(enableStarFitting=="yes"){
+    if(params.EnableStellarSolve){
         Int32 retStellarEv = starResult->GetEvidenceFromPdf(ctx.GetDataStore(), stellarEvidence);
         if(retStellarEv==0)
         {
@@ -765,7 +615,7 @@ void CProcessFlow::Process( CProcessFlowContext& ctx )
             }
         }
     }
-    if(enableQsoFitting=="yes"){
+    if(params.EnableQsoSolve){
         Int32 retQsoEv = qsoResult->GetEvidenceFromPdf(ctx.GetDataStore(), qsoEvidence);
         if(retQsoEv==0)
         {
@@ -800,6 +650,179 @@ void CProcessFlow::Process( CProcessFlowContext& ctx )
     }
 }
 
+/**
+ * Fits the star templates of the calibration directory on the spectrum, and stores the result in the "stellarsolve" scope of dataStore.
+ */
+void CProcessFlow::ProcessStellarSolve( CProcessFlowContext& ctx, const CProcessFlowParameters& params, CDataStore& dataStore, TFloat64Range spcLambdaRange, std::shared_ptr<COperatorResult>& starResult )
+{
+    CDataStore::CAutoScope resultScope( dataStore, "stellarsolve" );
+
+    const std::string& calibrationDirPath = params.CalibrationDirPath;
+
+    bfs::path calibrationFolder( calibrationDirPath.c_str() );
+    CCalibrationConfigHelper calibrationConfig;
+    calibrationConfig.Init(calibrationDirPath);
+
+    std::string starTemplates = calibrationConfig.Get_starTemplates_relpath();
+
+    Log.LogInfo( "    Processflow - Loading star templates catalog : %s", starTemplates.c_str());
+    std::string templateDir = (calibrationFolder/starTemplates.c_str()).string();
+
+    TStringList   filteredStarTemplateCategoryList;
+    filteredStarTemplateCategoryList.push_back( "star" );
+
+    //temporary star catalog handling through calibration files, should be loaded somewhere else ?
+    std::string medianRemovalMethod="zero";
+    Float64 opt_medianKernelWidth = 150; //not used
+    Int64 opt_nscales=8; //not used
+    std::string dfBinPath="absolute_path_to_df_binaries_here"; //not used
+    std::shared_ptr<CTemplateCatalog> starTemplateCatalog = std::shared_ptr<CTemplateCatalog>( new CTemplateCatalog(medianRemovalMethod, opt_medianKernelWidth, opt_nscales, dfBinPath) );
+    starTemplateCatalog->Load( templateDir.c_str() );
+
+    for( UInt32 i=0; i<filteredStarTemplateCategoryList.size(); i++ )
+    {
+        std::string category = filteredStarTemplateCategoryList[i];
+        UInt32 ntpl = starTemplateCatalog->GetTemplateCount(category);
+        Log.LogInfo("stellar-solve: Loaded (category=%s) template count = %d", category.c_str(), ntpl);
+    }
+
+    Float64 overlapThreshold = params.StellarFitting.OverlapThreshold;
+    std::string opt_spcComponent = params.StellarFitting.SpcComponent;
+    std::string opt_interp = params.StellarFitting.Interpolation;
+    std::string opt_extinction = params.StellarFitting.Extinction;
+    std::string opt_dustFit = params.StellarFitting.DustFit;
+
+    // prepare the unused masks
+    std::vector<CMask> maskList;
+    //define the redshift search grid
+    TFloat64Range starRedshiftRange=TFloat64Range(-1e-3, +1e-3);
+    Float64 starRedshiftStep = 5e-5;
+    Log.LogInfo("Stellar fitting redshift range = [%.5f, %.5f], step=%.6f", starRedshiftRange.GetBegin(), starRedshiftRange.GetEnd(), starRedshiftStep);
+    TFloat64List stars_redshifts = starRedshiftRange.SpreadOver( starRedshiftStep );
+    DebugAssert( stars_redshifts.size() > 0 );
+
+    Log.LogInfo("Processing stellar fitting");
+    CMethodChisquare2Solve solve(calibrationDirPath);
+    //CMethodChisquareLogSolve solve(calibrationDirPath);
+    starResult = solve.Compute( dataStore,
+                                ctx.GetSpectrum(),
+                                ctx.GetSpectrumWithoutContinuum(),
+                                *starTemplateCatalog,
+                                filteredStarTemplateCategoryList,
+                                spcLambdaRange,
+                                stars_redshifts,
+                                overlapThreshold,
+                                maskList,
+                                "stellar_zPDF",
+                                opt_spcComponent, opt_interp, opt_extinction, opt_dustFit);
+
+
+    //finally save the stellar fitting results
+    if( starResult ) {
+        Log.LogInfo("Saving star fitting results");
+        dataStore.StoreScopedGlobalResult( "stellarresult", starResult );
+    }else{
+        Log.LogError( "Unable to store stellar result.");
+    }
+}
+
+/**
+ * Fits the qso templates of the calibration directory on the spectrum, and stores the result in the "qsosolve" scope of dataStore.
+ */
+void CProcessFlow::ProcessQsoSolve( CProcessFlowContext& ctx, const CProcessFlowParameters& params, CDataStore& dataStore, TFloat64Range spcLambdaRange, std::shared_ptr<COperatorResult>& qsoResult )
+{
+    CDataStore::CAutoScope resultScope( dataStore, "qsosolve" );
+
+    const std::string& calibrationDirPath = params.CalibrationDirPath;
+
+    bfs::path calibrationFolder( calibrationDirPath.c_str() );
+    CCalibrationConfigHelper calibrationConfig;
+    calibrationConfig.Init(calibrationDirPath);
+
+    std::string qsoTemplates = calibrationConfig.Get_qsoTemplates_relpath();
+
+    Log.LogInfo( "    Processflow - Loading qso templates catalog : %s", qsoTemplates.c_str());
+    std::string templateDir = (calibrationFolder/qsoTemplates.c_str()).string();
+
+    TStringList   filteredQSOTemplateCategoryList;
+    filteredQSOTemplateCategoryList.push_back( "emission" );
+
+    //temporary qso catalog handling through calibration files, should be loaded somewhere else ?
+    std::string medianRemovalMethod="zero";
+    Float64 opt_medianKernelWidth = 150; //not used
+    Int64 opt_nscales=8; //not used
+    std::string dfBinPath="absolute_path_to_df_binaries_here"; //not used
+    std::shared_ptr<CTemplateCatalog> qsoTemplateCatalog = std::shared_ptr<CTemplateCatalog>( new CTemplateCatalog(medianRemovalMethod, opt_medianKernelWidth, opt_nscales, dfBinPath) );
+    qsoTemplateCatalog->Load( templateDir.c_str() );
+
+    for( UInt32 i=0; i<filteredQSOTemplateCategoryList.size(); i++ )
+    {
+        std::string category = filteredQSOTemplateCategoryList[i];
+        UInt32 ntpl = qsoTemplateCatalog->GetTemplateCount(category);
+        Log.LogInfo("qso-solve: Loaded (category=%s) template count = %d", category.c_str(), ntpl);
+    }
+
+    Float64 overlapThreshold = params.QsoFitting.OverlapThreshold;
+    std::string opt_spcComponent = params.QsoFitting.SpcComponent;
+    std::string opt_interp = params.QsoFitting.Interpolation;
+    std::string opt_extinction = params.QsoFitting.Extinction;
+    std::string opt_dustFit = params.QsoFitting.DustFit;
+
+    // prepare the unused masks
+    std::vector<CMask> maskList;
+    //define the redshift search grid
+    TFloat64Range qsoRedshiftRange=TFloat64Range(0.0, 6.0);
+    Float64 qsoRedshiftStep = 5e-4;
+    Log.LogInfo("QSO fitting redshift range = [%.5f, %.5f], step=%.6f", qsoRedshiftRange.GetBegin(), qsoRedshiftRange.GetEnd(), qsoRedshiftStep);
+    TFloat64List qso_redshifts;
+    if(params.RedshiftSampling=="log")
+    {
+        qso_redshifts = qsoRedshiftRange.SpreadOverLog( qsoRedshiftStep );
+    }else{
+        qso_redshifts = qsoRedshiftRange.SpreadOver( qsoRedshiftStep );
+    }
+    DebugAssert( qso_redshifts.size() > 0 );
+
+    Log.LogInfo("Processing stellar fitting");
+    CMethodChisquare2Solve solve(calibrationDirPath);
+    //CMethodChisquareLogSolve solve(calibrationDirPath);
+    qsoResult = solve.Compute( dataStore,
+                                ctx.GetSpectrum(),
+                                ctx.GetSpectrumWithoutContinuum(),
+                                *qsoTemplateCatalog,
+                                filteredQSOTemplateCategoryList,
+                                spcLambdaRange,
+                                qso_redshifts,
+                                overlapThreshold,
+                                maskList,
+                                "qso_zPDF",
+                                opt_spcComponent, opt_interp, opt_extinction, opt_dustFit);
+
+
+    //finally save the qso fitting results
+    if( qsoResult ) {
+        Log.LogInfo("Saving qso fitting results");
+        dataStore.StoreScopedGlobalResult( "qsoresult", qsoResult );
+    }else{
+        Log.LogError( "Unable to store qso result.");
+    }
+}
+
+/**
+ * Runs a stellar or qso solve task, keeping the message of the exception it may raise so that it is rethrown
+ * by Process once all the tasks are done.
+ */
+void CProcessFlow::RunSolveTask( boost::function<void ()> task, std::string& error )
+{
+    try
+    {
+        task();
+    } catch (std::exception const &e)
+    {
+        error = e.what();
+    }
+}
+
 /**
  * @brief isPdfValid
  * @return
@@ -851,85 +874,3 @@ Bool CProcessFlow::isPdfValid(CProcessFlowContext& ctx) const
 
     return true;
 }
-
-
-/**
- * \brief
- * Retrieve the true-redshift from a catalog file path
- *
- * reverseInclusion=0 (default): spcId is searched to be included in the Ref-File-Id
- * reverseInclusion=1 : Ref-File-Id is searched to be included in the spcId
- **/
-Int32 CProcessFlow::getValueFromRefFile( const char* filePath, std::string spcid, Int32 colID, Float64& zref, Int32 reverseInclusion )
-{
-    ifstream file;
-
-    file.open( filePath, ifstream::in );
-    if( file.rdstate() & ios_base::failbit )
-        return false;
-
-    string line;
-
-    // Read file line by line
-    while( getline( file, line ) )
-    {
-        // remove comments
-        if(line.compare(0,1,"#",1)==0){
-            continue;
-        }
-        char_separator<char> sep(" \t");
-
-        // Tokenize each line
-        typedef tokenizer< char_separator<char> > ttokenizer;
-        ttokenizer tok( line, sep );
-
-        // Check if it's not a comment
-        ttokenizer::iterator it = tok.begin();
-        if( it != tok.end() && *it != "#" )
-        {
-            string name;
-            if( it != tok.end() )
-            {
-                name = *it;
-            }
-
-            if(reverseInclusion==0)
-            {
-                std::size_t foundstr = name.find(spcid.c_str());
-                if (foundstr==std::string::npos){
-                    continue;
-                }
-            }else{
-                std::size_t foundstr = spcid.find(name.c_str());
-                if (foundstr==std::string::npos){
-                    continue;
-                }
-            }
-
-            // Found the correct spectrum ID: now read the ref values
-            Int32 nskip = colID-1;
-            for(Int32 i=0; i<nskip; i++)
-            {
-                ++it;
-            }
-            if( it != tok.end() )
-            {
-
-                zref = 0.0;
-                try
-                {
-                    zref = lexical_cast<double>(*it);
-                    return true;
-                }
-                catch (bad_lexical_cast&)
-                {
-                    zref = 0.0;
-                    return false;
-                }
-            }
-
-        }
-    }
-    file.close();
-    return true;
-}
@@ -0,0 +1,273 @@
+#include <RedshiftLibrary/processflow/processflowbatch.h>
+
+#include <RedshiftLibrary/common/threadpool.h>
+#include <RedshiftLibrary/log/log.h>
+#include <RedshiftLibrary/operator/pdfMargZLogResult.h>
+#include <RedshiftLibrary/processflow/context.h>
+#include <RedshiftLibrary/processflow/datastore.h>
+#include <RedshiftLibrary/processflow/parameterstore.h>
+#include <RedshiftLibrary/processflow/processflow.h>
+#include <RedshiftLibrary/processflow/processflowparameters.h>
+#include <RedshiftLibrary/processflow/resultstore.h>
+#include <RedshiftLibrary/ray/catalog.h>
+#include <RedshiftLibrary/reliability/zclassifierstore.h>
+#include <RedshiftLibrary/spectrum/spectrum.h>
+#include <RedshiftLibrary/spectrum/template/catalog.h>
+#include <RedshiftLibrary/statistics/pdfcandidateszresult.h>
+
+#include <boost/algorithm/string/join.hpp>
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+
+#include <limits>
+
+using namespace NSEpic;
+using namespace std;
+
+CProcessFlowBatch::CProcessFlowBatch( std::shared_ptr<const CTemplateCatalog> templateCatalog,
+                                      std::shared_ptr<const CRayCatalog> rayCatalog,
+                                      std::shared_ptr<CParameterStore> paramStore,
+                                      std::shared_ptr<CClassifierStore> zqualStore ) :
+    m_TemplateCatalog( templateCatalog ),
+    m_RayCatalog( rayCatalog ),
+    m_ParameterStore( paramStore ),
+    m_ClassifierStore( zqualStore )
+{
+
+}
+
+CProcessFlowBatch::~CProcessFlowBatch()
+{
+
+}
+
+/**
+ * Processes the nSpectra spectra, replacing the results of a previous batch.
+ * The process flow parameters are loaded and checked once, before the batch starts: invalid parameters throw.
+ * A spectrum whose processing fails gets a non-zero status and NaN results: it does not stop the batch.
+ */
+void CProcessFlowBatch::Process( const Float64* spectralAxis, const Float64* flux, const Float64* noise,
+                                 Int32 nSpectra, Int32 nSamples, Int32 threadCount )
+{
+    m_Results.clear();
+
+    std::shared_ptr<CProcessFlowParameters> params = std::shared_ptr<CProcessFlowParameters>( new CProcessFlowParameters() );
+    if( !params->Load( *m_ParameterStore ) )
+    {
+        throw runtime_error( "Invalid process flow parameters: " + boost::algorithm::join( params->GetErrors(), ", " ) );
+    }
+    m_ProcessFlowParameters = params;
+
+    m_Results.resize( std::max( nSpectra, 0 ) );
+
+    Log.LogInfo( "Processing a batch of %d spectra on %d threads", nSpectra, threadCount );
+    {
+        CThreadPool threadPool( std::min( threadCount, nSpectra )>1 ? std::min( threadCount, nSpectra ) : 0 );
+        for( Int32 i=0; i<nSpectra; i++ )
+        {
+            threadPool.AddTask( boost::bind( &CProcessFlowBatch::ProcessSpectrum, this,
+                                             spectralAxis + i*nSamples, flux + i*nSamples, noise + i*nSamples, nSamples, i ) );
+        }
+        threadPool.WaitForAllTaskToFinish();
+    }
+
+    Int32 nFailed = 0;
+    for( Int32 i=0; i<nSpectra; i++ )
+    {
+        if( m_Results[i].Status!=0 )
+        {
+            nFailed++;
+        }
+    }
+    Log.LogInfo( "Batch processed: %d spectra, %d failed", nSpectra, nFailed );
+}
+
+void CProcessFlowBatch::ProcessSpectrum( const Float64* spectralAxis, const Float64* flux, const Float64* noise, Int32 nSamples, Int32 iSpectrum )
+{
+    SSpectrumResult& result = m_Results[iSpectrum];
+    result.Status = 1;
+    result.Redshift = std::numeric_limits<Float64>::quiet_NaN();
+    result.Merit = std::numeric_limits<Float64>::quiet_NaN();
+
+    std::string processingID = boost::str( boost::format( "batch_%d" ) % iSpectrum );
+    try
+    {
+        CSpectrumSpectralAxis spcSpectralAxis( spectralAxis, nSamples );
+        CSpectrumFluxAxis spcFluxAxis( flux, nSamples, noise, nSamples );
+        std::shared_ptr<CSpectrum> spectrum = std::shared_ptr<CSpectrum>( new CSpectrum( spcSpectralAxis, spcFluxAxis ) );
+        spectrum->SetName( processingID.c_str() );
+
+        // each spectrum has its own parameters, the process flow may store values in them
+        std::shared_ptr<CParameterStore> paramStore = std::shared_ptr<CParameterStore>( new CParameterStore( *m_ParameterStore ) );
+
+        CProcessFlowContext ctx;
+        ctx.Init( spectrum, processingID, m_TemplateCatalog, m_RayCatalog, paramStore, m_ClassifierStore );
+
+        CProcessFlow processFlow;
+        processFlow.Process( ctx, *m_ProcessFlowParameters );
+
+        // best redshift and merit, the values of the redshift.csv line
+        auto redshiftResult = ctx.GetResultStore().GetGlobalResult( "redshiftresult" ).lock();
+        if( !redshiftResult )
+        {
+            throw runtime_error( "Unable to retrieve redshift result" );
+        }
+        if( !redshiftResult->GetRedshiftResult( ctx.GetDataStore(), result.Redshift, result.Merit ) )
+        {
+            throw runtime_error( "Unable to get the best redshift from the redshift result" );
+        }
+
+        auto pdfResult = std::dynamic_pointer_cast<const CPdfMargZLogResult>( ctx.GetDataStore().GetGlobalResult( "zPDF/logposterior.logMargP_Z_data" ).lock() );
+        if( pdfResult )
+        {
+            result.PdfRedshifts = pdfResult->Redshifts;
+            result.PdfLogProba = pdfResult->valProbaLog;
+        }
+
+        auto candidatesResult = std::dynamic_pointer_cast<const CPdfCandidateszResult>( ctx.GetDataStore().GetGlobalResult( "candidatesresult" ).lock() );
+        if( candidatesResult )
+        {
+            result.CandidatesRedshift = candidatesResult->Redshifts;
+            result.CandidatesProba = candidatesResult->ValSumProba;
+        }
+        result.Status = 0;
+    } catch( std::exception const& e )
+    {
+        result.Error = e.what();
+        Log.LogError( "Batch spectrum %d failed: %s", iSpectrum, e.what() );
+    }
+}
+
+Int32 CProcessFlowBatch::GetSpectraCount() const
+{
+    return m_Results.size();
+}
+
+/**
+ * Returns 0 if the spectrum iSpectrum was processed, else 1.
+ */
+Int32 CProcessFlowBatch::GetStatus( Int32 iSpectrum ) const
+{
+    CheckSpectraCount( iSpectrum+1 );
+    return m_Results[iSpectrum].Status;
+}
+
+std::string CProcessFlowBatch::GetError( Int32 iSpectrum ) const
+{
+    CheckSpectraCount( iSpectrum+1 );
+    return m_Results[iSpectrum].Error;
+}
+
+/**
+ * Returns the size of the pdf redshift grid, the same for all the spectra as it comes from the parameters.
+ */
+Int32 CProcessFlowBatch::GetPdfSize() const
+{
+    Int32 n = 0;
+    for( UInt32 i=0; i<m_Results.size(); i++ )
+    {
+        n = std::max( n, Int32( m_Results[i].PdfRedshifts.size() ) );
+    }
+    return n;
+}
+
+Int32 CProcessFlowBatch::GetCandidatesMaxCount() const
+{
+    Int32 n = 0;
+    for( UInt32 i=0; i<m_Results.size(); i++ )
+    {
+        n = std::max( n, Int32( m_Results[i].CandidatesRedshift.size() ) );
+    }
+    return n;
+}
+
+void CProcessFlowBatch::GetRedshifts( Float64* redshifts, Int32 nSpectra ) const
+{
+    CheckSpectraCount( nSpectra );
+    for( Int32 i=0; i<nSpectra; i++ )
+    {
+        redshifts[i] = m_Results[i].Redshift;
+    }
+}
+
+void CProcessFlowBatch::GetMerits( Float64* merits, Int32 nSpectra ) const
+{
+    CheckSpectraCount( nSpectra );
+    for( Int32 i=0; i<nSpectra; i++ )
+    {
+        merits[i] = m_Results[i].Merit;
+    }
+}
+
+void CProcessFlowBatch::GetPdfRedshifts( Float64* redshifts, Int32 nz ) const
+{
+    for( Int32 k=0; k<nz; k++ )
+    {
+        redshifts[k] = std::numeric_limits<Float64>::quiet_NaN();
+    }
+    for( UInt32 i=0; i<m_Results.size(); i++ )
+    {
+        if( m_Results[i].PdfRedshifts.size()>0 )
+        {
+            for( Int32 k=0; k<nz && k<m_Results[i].PdfRedshifts.size(); k++ )
+            {
+                redshifts[k] = m_Results[i].PdfRedshifts[k];
+            }
+            return;
+        }
+    }
+}
+
+/**
+ * Fills logProba (nSpectra rows of nz values) with the log of the pdf of each spectrum, NaN where there is none.
+ */
+void CProcessFlowBatch::GetPdfs( Float64* logProba, Int32 nSpectra, Int32 nz ) const
+{
+    CheckSpectraCount( nSpectra );
+    for( Int32 i=0; i<nSpectra; i++ )
+    {
+        const TFloat64List& pdf = m_Results[i].PdfLogProba;
+        for( Int32 k=0; k<nz; k++ )
+        {
+            logProba[i*nz+k] = k<pdf.size() ? pdf[k] : std::numeric_limits<Float64>::quiet_NaN();
+        }
+    }
+}
+
+/**
+ * Fills redshifts (nSpectra rows of nCandidates values) with the candidates of each spectrum, by decreasing probability,
+ * NaN after the last candidate.
+ */
+void CProcessFlowBatch::GetCandidates( Float64* redshifts, Int32 nSpectra, Int32 nCandidates ) const
+{
+    CheckSpectraCount( nSpectra );
+    for( Int32 i=0; i<nSpectra; i++ )
+    {
+        const TFloat64List& candidates = m_Results[i].CandidatesRedshift;
+        for( Int32 k=0; k<nCandidates; k++ )
+        {
+            redshifts[i*nCandidates+k] = k<candidates.size() ? candidates[k] : std::numeric_limits<Float64>::quiet_NaN();
+        }
+    }
+}
+
+void CProcessFlowBatch::GetCandidatesProba( Float64* proba, Int32 nSpectra, Int32 nCandidates ) const
+{
+    CheckSpectraCount( nSpectra );
+    for( Int32 i=0; i<nSpectra; i++ )
+    {
+        const TFloat64List& candidates = m_Results[i].CandidatesProba;
+        for( Int32 k=0; k<nCandidates; k++ )
+        {
+            proba[i*nCandidates+k] = k<candidates.size() ? candidates[k] : std::numeric_limits<Float64>::quiet_NaN();
+        }
+    }
+}
+
+void CProcessFlowBatch::CheckSpectraCount( Int32 nSpectra ) const
+{
+    if( nSpectra<0 || nSpectra>Int32( m_Results.size() ) )
+    {
+        throw runtime_error( "Batch results requested for more spectra than processed" );
+    }
+}
@@ -0,0 +1,194 @@
+#include <RedshiftLibrary/processflow/processflowparameters.h>
+
+#include <RedshiftLibrary/log/log.h>
+#include <RedshiftLibrary/processflow/parameterstore.h>
+
+#include <boost/algorithm/string.hpp>
+#include <boost/format.hpp>
+
+#include <algorithm>
+
+using namespace NSEpic;
+using namespace std;
+
+CProcessFlowParameters::CProcessFlowParameters() :
+    RedshiftStep( 0.0 ),
+    AutoCorrectInput( false ),
+    EnableStellarSolve( false ),
+    EnableQsoSolve( false ),
+    ThreadCount( 0 )
+{
+
+}
+
+CProcessFlowParameters::~CProcessFlowParameters()
+{
+
+}
+
+/**
+ * Reads and checks the process flow parameters, with the same names and default values as the process flow used to
+ * read them for each spectrum. The missing parameters are added to store with their default value.
+ * Returns false if there is any error, see GetErrors.
+ */
+Bool CProcessFlowParameters::Load( const CParameterStore& store )
+{
+    m_Errors.clear();
+    m_Warnings.clear();
+
+    CheckRead( store.Get( "lambdarange", LambdaRange ), "lambdarange" );
+    CheckRead( store.Get( "redshiftrange", RedshiftRange ), "redshiftrange" );
+    CheckRead( store.Get( "redshiftstep", RedshiftStep ), "redshiftstep" );
+    CheckRead( store.Get( "redshiftsampling", RedshiftSampling, "lin" ), "redshiftsampling" );
+    CheckRead( store.Get( "method", MethodName ), "method" );
+    boost::algorithm::to_lower( MethodName );
+    CheckRead( store.Get( "linemeascatalog", LineMeasCatalogPath, "" ), "linemeascatalog" );
+    CheckRead( store.Get( "templateCategoryList", TemplateCategoryList ), "templateCategoryList" );
+    CheckRead( store.Get( "calibrationDir", CalibrationDirPath ), "calibrationDir" );
+    CheckRead( store.Get( "processflow.threadcount", ThreadCount, 0 ), "processflow.threadcount" );
+
+    std::string autoCorrectInput, enableStellarSolve, enableQsoSolve;
+    CheckRead( store.Get( "autocorrectinput", autoCorrectInput, "no" ), "autocorrectinput" );
+    CheckRead( store.Get( "enablestellarsolve", enableStellarSolve, "no" ), "enablestellarsolve" );
+    CheckRead( store.Get( "enableqsosolve", enableQsoSolve, "no" ), "enableqsosolve" );
+    AutoCorrectInput = autoCorrectInput=="yes";
+    EnableStellarSolve = enableStellarSolve=="yes";
+    EnableQsoSolve = enableQsoSolve=="yes";
+
+    const TStringList samplings = { "lin", "log" };
+    CheckChoice( "redshiftsampling", RedshiftSampling, samplings );
+    const TStringList methods = { "linemodel", "zweimodelsolve", "chisquare2solve", "chisquarelogsolve", "tplcombinationsolve",
+                                  "amazed0_1", "amazed0_2", "amazed0_3", "correlationsolve", "blindsolve",
+                                  "linematching", "linematching2", "reliability" };
+    CheckChoice( "method", MethodName, methods );
+
+    if( !( RedshiftStep>0.0 ) )
+    {
+        m_Errors.push_back( boost::str( boost::format( "redshiftstep must be positive: %f" ) % RedshiftStep ) );
+    }else if( RedshiftSampling=="log" )
+    {
+        Redshifts = RedshiftRange.SpreadOverLog( RedshiftStep ); //experimental: spreadover a grid at delta/(1+z), unusable because PDF needs regular z-step
+    }else
+    {
+        Redshifts = RedshiftRange.SpreadOver( RedshiftStep );
+    }
+
+    // only the method in use is read, as the process flow does
+    if( MethodName=="chisquare2solve" )
+    {
+        LoadTemplateFitting( store, "chisquare2solve.overlapThreshold", "chisquare2solve.", "precomputedfinegrid", "no", "no", MethodFitting );
+    }else if( MethodName=="chisquarelogsolve" )
+    {
+        LoadTemplateFitting( store, "chisquarelogsolve.overlapThreshold", "chisquarelogsolve.", "", "no", "no", MethodFitting );
+        MethodFitting.Interpolation = "unused";
+    }else if( MethodName=="tplcombinationsolve" )
+    {
+        LoadTemplateFitting( store, "tplcombinationsolve.overlapThreshold", "tplcombinationsolve.", "lin", "", "", MethodFitting );
+        MethodFitting.Extinction = "no";
+        MethodFitting.DustFit = "no";
+    }
+    // the stellar and qso solves read their parameters in their own data store scope
+    if( EnableStellarSolve )
+    {
+        LoadTemplateFitting( store, "starsolve.overlapThreshold", "stellarsolve.starsolve.", "precomputedfinegrid", "no", "yes", StellarFitting );
+    }
+    if( EnableQsoSolve )
+    {
+        LoadTemplateFitting( store, "qsosolve.overlapThreshold", "qsosolve.qsosolve.", "precomputedfinegrid", "yes", "no", QsoFitting );
+    }
+
+    CheckUnknownNames( store );
+
+    for( UInt32 i=0; i<m_Warnings.size(); i++ )
+    {
+        Log.LogWarning( "Parameters: %s", m_Warnings[i].c_str() );
+    }
+    for( UInt32 i=0; i<m_Errors.size(); i++ )
+    {
+        Log.LogError( "Parameters: %s", m_Errors[i].c_str() );
+    }
+    return m_Errors.empty();
+}
+
+const TStringList& CProcessFlowParameters::GetErrors() const
+{
+    return m_Errors;
+}
+
+const TStringList& CProcessFlowParameters::GetWarnings() const
+{
+    return m_Warnings;
+}
+
+/**
+ * Reads the parameters of a template fitting solve, named prefix + "spectrum.component", "interpolation", "extinction"
+ * and "dustfit". An empty default value means the parameter is not read.
+ */
+void CProcessFlowParameters::LoadTemplateFitting( const CParameterStore& store, const std::string& overlapName, const std::string& prefix,
+                                                  const std::string& defaultInterpolation, const std::string& defaultExtinction,
+                                                  const std::string& defaultDustFit, STemplateFittingParameters& params )
+{
+    CheckRead( store.Get( overlapName, params.OverlapThreshold, 1.0 ), overlapName );
+    CheckRead( store.Get( prefix + "spectrum.component", params.SpcComponent, "raw" ), prefix + "spectrum.component" );
+    const TStringList components = { "raw", "nocontinuum", "continuum", "all" };
+    CheckChoice( prefix + "spectrum.component", params.SpcComponent, components );
+
+    if( !defaultInterpolation.empty() )
+    {
+        CheckRead( store.Get( prefix + "interpolation", params.Interpolation, defaultInterpolation ), prefix + "interpolation" );
+        const TStringList interpolations = { "precomputedfinegrid", "lin" };
+        CheckChoice( prefix + "interpolation", params.Interpolation, interpolations );
+    }
+    const TStringList yesNo = { "yes", "no" };
+    if( !defaultExtinction.empty() )
+    {
+        CheckRead( store.Get( prefix + "extinction", params.Extinction, defaultExtinction ), prefix + "extinction" );
+        CheckChoice( prefix + "extinction", params.Extinction, yesNo );
+    }
+    if( !defaultDustFit.empty() )
+    {
+        CheckRead( store.Get( prefix + "dustfit", params.DustFit, defaultDustFit ), prefix + "dustfit" );
+        CheckChoice( prefix + "dustfit", params.DustFit, yesNo );
+    }
+}
+
+void CProcessFlowParameters::CheckRead( Bool read, const std::string& name )
+{
+    if( !read )
+    {
+        m_Errors.push_back( name + ": invalid value type" );
+    }
+}
+
+void CProcessFlowParameters::CheckChoice( const std::string& name, const std::string& value, const TStringList& choices )
+{
+    if( std::find( choices.begin(), choices.end(), value )==choices.end() )
+    {
+        m_Errors.push_back( boost::str( boost::format( "%s: unknown value \"%s\"" ) % name % value ) );
+    }
+}
+
+/**
+ * Warns about the top-level parameters that are neither process flow parameters nor a method scope:
+ * they are most likely misspelled, and would be silently ignored.
+ */
+void CProcessFlowParameters::CheckUnknownNames( const CParameterStore& store )
+{
+    const TStringList knownNames = { "lambdarange", "redshiftrange", "redshiftstep", "redshiftsampling", "method",
+                                     "linemeascatalog", "templateCategoryList", "calibrationDir", "autocorrectinput",
+                                     "enablestellarsolve", "enableqsosolve", "processflow", "smoothWidth", "continuumRemoval",
+                                     "templateCatalog", "SaveIntermediateResults", "spectrumName", "dtreepathnum",
+                                     "linemodelsolve", "linemodeltplshapesolve", "zweimodel", "chisquaresolve", "chisquare2solve",
+                                     "chisquarelogsolve", "tplcombinationsolve", "correlationsolve", "blindsolve",
+                                     "linematchingsolve", "linematching2solve", "dtree7", "dtree7solve", "dtreeBsolve",
+                                     "dtreeCsolve", "starsolve", "stellarsolve", "qsosolve", "zReliability" };
+
+    TStringList names = store.GetChildNames();
+    for( UInt32 i=0; i<names.size(); i++ )
+    {
+        if( std::find( knownNames.begin(), knownNames.end(), names[i] )==knownNames.end() )
+        {
+            m_Warnings.push_back( boost::str( boost::format( "%s: unknown parameter" ) % names[i] ) );
+        }
+    }
+}
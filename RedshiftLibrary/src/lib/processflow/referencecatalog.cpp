@@ -0,0 +1,242 @@
+#include <RedshiftLibrary/processflow/referencecatalog.h>
+
+#include <RedshiftLibrary/log/log.h>
+
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/tokenizer.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <map>
+
+using namespace NSEpic;
+using namespace std;
+
+CReferenceCatalog::CReferenceCatalog()
+{
+
+}
+
+CReferenceCatalog::~CReferenceCatalog()
+{
+
+}
+
+/**
+ * Reads all the rows of the catalog and indexes them by ID. When an ID appears on several rows, the first one is kept.
+ * Returns false if the file cannot be opened.
+ */
+Bool CReferenceCatalog::Load( const std::string& filePath )
+{
+    m_Rows.clear();
+    m_IdIndex.clear();
+    m_StemIndex.clear();
+
+    ifstream file;
+    file.open( filePath.c_str(), ifstream::in );
+    if( file.rdstate() & ios_base::failbit )
+        return false;
+
+    typedef boost::tokenizer< boost::char_separator<char> > ttokenizer;
+    boost::char_separator<char> sep(" \t");
+
+    string line;
+    while( getline( file, line ) )
+    {
+        // remove comments
+        if( line.compare(0,1,"#",1)==0 ){
+            continue;
+        }
+
+        ttokenizer tok( line, sep );
+        ttokenizer::iterator it = tok.begin();
+        if( it == tok.end() || *it == "#" )
+        {
+            continue;
+        }
+
+        TStringList row( tok.begin(), tok.end() );
+        Int32 iRow = m_Rows.size();
+        m_IdIndex.insert( std::make_pair( row[0], iRow ) );
+        m_StemIndex.insert( std::make_pair( GetStem( row[0] ), iRow ) );
+        m_Rows.push_back( row );
+    }
+    file.close();
+
+    return true;
+}
+
+/**
+ * Returns the catalog read from filePath, loading it on first request only: the same read-only catalog
+ * is then returned to every caller. Returns an empty pointer if the file cannot be read.
+ */
+std::shared_ptr<const CReferenceCatalog> CReferenceCatalog::GetShared( const std::string& filePath )
+{
+    static boost::mutex sharedMutex;
+    static std::map<std::string, std::shared_ptr<const CReferenceCatalog> > sharedCatalogs;
+
+    boost::mutex::scoped_lock lock( sharedMutex );
+    std::map<std::string, std::shared_ptr<const CReferenceCatalog> >::iterator it = sharedCatalogs.find( filePath );
+    if( it != sharedCatalogs.end() )
+    {
+        return it->second;
+    }
+
+    std::shared_ptr<CReferenceCatalog> catalog = std::shared_ptr<CReferenceCatalog>( new CReferenceCatalog() );
+    if( !catalog->Load( filePath ) )
+    {
+        Log.LogError( "Unable to read the reference catalog %s", filePath.c_str() );
+        return std::shared_ptr<const CReferenceCatalog>();
+    }
+    Log.LogInfo( "Loaded reference catalog %s: %d rows", filePath.c_str(), catalog->GetRowCount() );
+    sharedCatalogs[filePath] = catalog;
+    return catalog;
+}
+
+UInt32 CReferenceCatalog::GetRowCount() const
+{
+    return m_Rows.size();
+}
+
+/**
+ * Returns the row of spectrum spcid that has at least colID columns (column 1 being the ID), -1 if there is none.
+ * With reverseInclusion==0 the row ID must include spcid, else the row ID must be included in spcid.
+ *
+ * Rows are searched in this order:
+ * - the rows found from the index, in file order: the row whose ID is spcid, and the row whose ID without extension
+ *   is spcid (with reverseInclusion, the rows whose ID is spcid or spcid without extension). For an ID repeated on
+ *   several rows, only its first row is indexed.
+ * - then the rows matching by inclusion, in file order.
+ * A candidate row without column colID is skipped, and the search goes on with the next candidate.
+ *
+ * An exact ID thus wins over an earlier row that only includes spcid: with the rows "spc_100.fits" then "spc_10.fits",
+ * spcid "spc_10" finds the second row.
+ */
+Int32 CReferenceCatalog::FindRow( const std::string& spcid, Int32 reverseInclusion, Int32 colID ) const
+{
+    Int32 rowId = FindIndexedRow( m_IdIndex, spcid );
+    Int32 rowStem;
+    if( reverseInclusion==0 )
+    {
+        rowStem = FindIndexedRow( m_StemIndex, spcid );
+    }else
+    {
+        rowStem = FindIndexedRow( m_IdIndex, GetStem( spcid ) );
+    }
+    Int32 indexedRows[2] = { std::min( rowId, rowStem ), std::max( rowId, rowStem ) };
+    for( Int32 k=0; k<2; k++ )
+    {
+        if( indexedRows[k]>=0 && HasColumn( indexedRows[k], colID ) )
+        {
+            return indexedRows[k];
+        }
+    }
+
+    for( UInt32 i=0; i<m_Rows.size(); i++ )
+    {
+        if( HasColumn( i, colID ) && IsIncluded( m_Rows[i][0], spcid, reverseInclusion ) )
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+/**
+ * Sets v to the value of column colID (starting at 1, the ID column) for spectrum spcid, read from the row given by
+ * FindRow. Returns false if no row of the spectrum has the column, or if the value is not a number.
+ */
+Bool CReferenceCatalog::GetValue( const std::string& spcid, Int32 colID, Float64& v, Int32 reverseInclusion ) const
+{
+    const std::string* field = GetField( spcid, colID, reverseInclusion );
+    if( field==NULL )
+    {
+        return false;
+    }
+    try
+    {
+        v = boost::lexical_cast<Float64>( *field );
+    }
+    catch( boost::bad_lexical_cast& )
+    {
+        return false;
+    }
+    return true;
+}
+
+Bool CReferenceCatalog::GetValue( const std::string& spcid, Int32 colID, Int64& v, Int32 reverseInclusion ) const
+{
+    const std::string* field = GetField( spcid, colID, reverseInclusion );
+    if( field==NULL )
+    {
+        return false;
+    }
+    try
+    {
+        v = boost::lexical_cast<Int64>( *field );
+    }
+    catch( boost::bad_lexical_cast& )
+    {
+        return false;
+    }
+    return true;
+}
+
+Bool CReferenceCatalog::GetValue( const std::string& spcid, Int32 colID, std::string& v, Int32 reverseInclusion ) const
+{
+    const std::string* field = GetField( spcid, colID, reverseInclusion );
+    if( field==NULL )
+    {
+        return false;
+    }
+    v = *field;
+    return true;
+}
+
+const std::string* CReferenceCatalog::GetField( const std::string& spcid, Int32 colID, Int32 reverseInclusion ) const
+{
+    Int32 row = FindRow( spcid, reverseInclusion, colID );
+    if( row<0 || colID<1 )
+    {
+        return NULL;
+    }
+    return &m_Rows[row][colID-1];
+}
+
+Bool CReferenceCatalog::HasColumn( Int32 row, Int32 colID ) const
+{
+    return colID<=(Int32)m_Rows[row].size();
+}
+
+Bool CReferenceCatalog::IsIncluded( const std::string& name, const std::string& spcid, Int32 reverseInclusion ) const
+{
+    if( reverseInclusion==0 )
+    {
+        return name.find( spcid )!=std::string::npos;
+    }
+    return spcid.find( name )!=std::string::npos;
+}
+
+Int32 CReferenceCatalog::FindIndexedRow( const TIdIndex& index, const std::string& key ) const
+{
+    TIdIndex::const_iterator it = index.find( key );
+    if( it == index.end() )
+    {
+        return -1;
+    }
+    return it->second;
+}
+
+/**
+ * Returns name without its extension, the characters from its last '.'.
+ */
+std::string CReferenceCatalog::GetStem( const std::string& name )
+{
+    std::size_t found = name.rfind( "." );
+    if( found==std::string::npos || found==0 )
+    {
+        return name;
+    }
+    return name.substr( 0, found );
+}
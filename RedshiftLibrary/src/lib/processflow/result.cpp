@@ -23,3 +23,12 @@ void COperatorResult::SetTypeLabel( std::string lbl )
 {
     m_TypeLabel = lbl;
 }
+
+/**
+ * Gets the best redshift and merit of a method result, the values of its redshift.csv line.
+ * Returns false for the results that are not a method result.
+ */
+Bool COperatorResult::GetRedshiftResult( const CDataStore& store, Float64& redshift, Float64& merit ) const
+{
+    return false;
+}
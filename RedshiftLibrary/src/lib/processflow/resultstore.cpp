@@ -18,6 +18,16 @@ COperatorResultStore::COperatorResultStore()
 
 }
 
+/**
+ * Copies the stored results, the copy has its own mutex.
+ */
+COperatorResultStore::COperatorResultStore( const COperatorResultStore& other )
+{
+    boost::mutex::scoped_lock lock( other.m_Mutex );
+    m_PerTemplateResults = other.m_PerTemplateResults;
+    m_GlobalResults = other.m_GlobalResults;
+}
+
 COperatorResultStore::~COperatorResultStore()
 {
 
@@ -45,6 +55,7 @@ void COperatorResultStore::StoreResult( TResultsMap& map, const std::string& pat
 
 void COperatorResultStore::StorePerTemplateResult( const CTemplate& t, const std::string& path, const std::string& name, std::shared_ptr<const COperatorResult> result )
 {
+    boost::mutex::scoped_lock lock( m_Mutex );
     TPerTemplateResultsMap::iterator it = m_PerTemplateResults.find( t.GetName() );
     if( it == m_PerTemplateResults.end() )
     {
@@ -56,11 +67,13 @@ void COperatorResultStore::StorePerTemplateResult( const CTemplate& t, const std
 
 void COperatorResultStore::StoreGlobalResult( const std::string& path, const std::string& name, std::shared_ptr<const COperatorResult> result )
 {
+    boost::mutex::scoped_lock lock( m_Mutex );
     StoreResult( m_GlobalResults, path, name, result );
 }
 
 std::weak_ptr<const COperatorResult> COperatorResultStore::GetPerTemplateResult( const CTemplate& t, const std::string& name ) const
 {
+    boost::mutex::scoped_lock lock( m_Mutex );
     TPerTemplateResultsMap::const_iterator it1 = m_PerTemplateResults.find( t.GetName() );
     if( it1 != m_PerTemplateResults.end() )
     {
@@ -77,6 +90,7 @@ std::weak_ptr<const COperatorResult> COperatorResultStore::GetPerTemplateResult(
 
 TOperatorResultMap COperatorResultStore::GetPerTemplateResult( const std::string& name ) const
 {
+    boost::mutex::scoped_lock lock( m_Mutex );
     TOperatorResultMap map;
     TPerTemplateResultsMap::const_iterator it;
     for( it = m_PerTemplateResults.begin(); it != m_PerTemplateResults.end(); ++it )
@@ -103,6 +117,7 @@ TOperatorResultMap COperatorResultStore::GetPerTemplateResult( const std::string
 
 std::weak_ptr<const COperatorResult> COperatorResultStore::GetGlobalResult( const std::string& name ) const
 {
+    boost::mutex::scoped_lock lock( m_Mutex );
     TResultsMap::const_iterator it = m_GlobalResults.find( name );
     if( it != m_GlobalResults.end() )
     {
@@ -485,6 +500,7 @@ void COperatorResultStore::SaveAllResults( const CDataStore& store, const bfs::p
 
 std::string COperatorResultStore::GetScope( const COperatorResult&  result) const
 {
+    boost::mutex::scoped_lock lock( m_Mutex );
     std::string n="";
 
     TResultsMap::const_iterator it;
@@ -1,10 +1,10 @@
 #include <cstdarg>
 #include <iostream>
 
-#include <gsl/gsl_multifit.h>
 #include <gsl/gsl_interp.h>
 #include <gsl/gsl_spline.h>
 
+#include <RedshiftLibrary/common/weightedleastsquares.h>
 #include <RedshiftLibrary/log/log.h>
 #include <RedshiftLibrary/ray/ruleBalmerLinearSolver.h>
 #include <RedshiftLibrary/ray/linetags.h>
@@ -245,14 +245,12 @@ void CRuleBalmerLinearSolver::Correct( CLineModelElementList& LineModelElementLi
 /**
  * \brief Make a linear fit of the lines selected for Balmer rule correction.
  **/
-TFloat64List CRuleBalmerLinearSolver::BalmerModelLinSolve( std::vector<Float64> lambdax, std::vector<Float64> continuumx, std::vector<Float64> datax, std::vector<Float64> errdatax )
+TFloat64List CRuleBalmerLinearSolver::BalmerModelLinSolve( const std::vector<Float64>& lambdax, const std::vector<Float64>& continuumx, const std::vector<Float64>& datax, const std::vector<Float64>& errdatax )
 {
   //Linear fit
   int i, n;
-  Float64 fval;
   double chisq;
-  gsl_matrix *X, *cov;
-  gsl_vector *y, *w, *c;
+  CWeightedLeastSquares<4> fit;
 
   n = lambdax.size();
   Int32 nddl = 4;
@@ -262,51 +260,26 @@ TFloat64List CRuleBalmerLinearSolver::BalmerModelLinSolve( std::vector<Float64>
       return empty;
     }
 
-  X = gsl_matrix_alloc (n, nddl);
-  y = gsl_vector_alloc (n);
-  w = gsl_vector_alloc (n);
-
-  c = gsl_vector_alloc (nddl);
-  cov = gsl_matrix_alloc (nddl, nddl);
-
   for (i = 0; i < n; i++)
     {
       double yi, ei;
       yi = datax[i];
       ei = errdatax[i];
 
-      for (Int32 iddl = 0; iddl < nddl; iddl++)
-        {
-	  if( iddl==0 )
-	    {
-	      fval = lambdax[i];
-	    }
-	  if( iddl==1 )
-	    {
-	      fval = continuumx[i];
-	    }
-	  if( iddl==2 )
-	    {
-	      fval = lambdax[i]*continuumx[i];
-	    }
-	  if( iddl==3 )
-	    {
-	      fval = 1.0;
-	    }
-	  gsl_matrix_set (X, i, iddl, fval);
-        }
-      gsl_vector_set (y, i, yi);
-      gsl_vector_set (w, i, 1.0/(ei*ei));
+      Float64 xrow[4] = { lambdax[i], continuumx[i], lambdax[i]*continuumx[i], 1.0 };
+      fit.AddSample( xrow, yi, 1.0/(ei*ei) );
     }
 
-  {
-    gsl_multifit_linear_workspace * work = gsl_multifit_linear_alloc (n, nddl);
-    gsl_multifit_wlinear (X, w, y, c, cov, &chisq, work);
-    gsl_multifit_linear_free (work);
-  }
+  if( !fit.Solve() )
+    {
+      Log.LogDebug( "Balmer linear fit failed: the lines do not constrain the model" );
+      TFloat64List empty;
+      return empty;
+    }
+  chisq = fit.GetChiSquare();
 
-#define C(i) (gsl_vector_get(c,(i)))
-#define COV(i,j) (gsl_matrix_get(cov,(i),(j)))
+#define C(i) (fit.GetCoefficient(i))
+#define COV(i,j) (fit.GetCovariance((i),(j)))
   if(1)
     {
       Log.LogInfo( "# best fit: Y = %g X + %g CX + %g XCX + %g", C(0), C(1), C(2), C(3) );
@@ -320,17 +293,10 @@ TFloat64List CRuleBalmerLinearSolver::BalmerModelLinSolve( std::vector<Float64>
     }
 
   TFloat64List coeffs;
-  coeffs.push_back(gsl_vector_get(c,(0)));
-  coeffs.push_back(gsl_vector_get(c,(1)));
-  coeffs.push_back(gsl_vector_get(c,(2)));
-  coeffs.push_back(gsl_vector_get(c,(3)));
-
-  gsl_matrix_free (X);
-  gsl_vector_free (y);
-  gsl_vector_free (w);
-  gsl_vector_free (c);
-  gsl_matrix_free (cov);
+  coeffs.push_back(C(0));
+  coeffs.push_back(C(1));
+  coeffs.push_back(C(2));
+  coeffs.push_back(C(3));
 
   return coeffs;
 }
-
@@ -6,6 +6,7 @@
 #include <RedshiftLibrary/common/mask.h>
 #include <RedshiftLibrary/spectrum/spectrum.h>
 #include <RedshiftLibrary/spectrum/spectralaxis.h>
+#include <RedshiftLibrary/spectrum/template/template.h>
 
 #include <math.h>
 #include <gsl/gsl_interp.h>
@@ -15,14 +16,18 @@
 using namespace NSEpic;
 using namespace std;
 
-CSpectrumFluxAxis::CSpectrumFluxAxis()
+CSpectrumFluxAxis::CSpectrumFluxAxis() :
+    m_InverseVarianceReady( false ),
+    m_WeightedFluxReady( false )
 {
 
 }
 
 CSpectrumFluxAxis::CSpectrumFluxAxis( UInt32 n ) :
     CSpectrumAxis( n ),
-    m_StatError( n )
+    m_StatError( n ),
+    m_InverseVarianceReady( false ),
+    m_WeightedFluxReady( false )
 {
     for( UInt32 i=0; i<n; i++ )
     {
@@ -32,7 +37,9 @@ CSpectrumFluxAxis::CSpectrumFluxAxis( UInt32 n ) :
 
 CSpectrumFluxAxis::CSpectrumFluxAxis( const Float64* samples, UInt32 n ) :
     CSpectrumAxis( samples, n ),
-    m_StatError( n )
+    m_StatError( n ),
+    m_InverseVarianceReady( false ),
+    m_WeightedFluxReady( false )
 {
     for( UInt32 i=0; i<n; i++ )
     {
@@ -43,7 +50,9 @@ CSpectrumFluxAxis::CSpectrumFluxAxis( const Float64* samples, UInt32 n ) :
 CSpectrumFluxAxis::CSpectrumFluxAxis( const Float64* samples, UInt32 n,
 				      const Float64* error, UInt32 m ) :
     CSpectrumAxis( samples, n ),
-    m_StatError( n )
+    m_StatError( n ),
+    m_InverseVarianceReady( false ),
+    m_WeightedFluxReady( false )
 {
     for( UInt32 i=0; i<n; i++ )
     {
@@ -51,6 +60,18 @@ CSpectrumFluxAxis::CSpectrumFluxAxis( const Float64* samples, UInt32 n,
     }
 }
 
+/**
+ * Copy constructor: the weights are not copied, they are built again on request.
+ */
+CSpectrumFluxAxis::CSpectrumFluxAxis( const CSpectrumFluxAxis& other ) :
+    CSpectrumAxis( other ),
+    m_StatError( other.m_StatError ),
+    m_InverseVarianceReady( false ),
+    m_WeightedFluxReady( false )
+{
+
+}
+
 CSpectrumFluxAxis::~CSpectrumFluxAxis()
 {
 
@@ -60,9 +81,105 @@ CSpectrumFluxAxis& CSpectrumFluxAxis::operator=(const CSpectrumFluxAxis& other)
 {
     m_StatError = other.m_StatError;
     CSpectrumAxis::operator=( other );
+    ResetWeights();
     return *this;
 }
 
+/**
+ * Returns 1/err^2 for each sample, computed on first call.
+ */
+const Float64* CSpectrumFluxAxis::GetInverseVariance() const
+{
+    boost::mutex::scoped_lock lock( m_WeightsMutex );
+    BuildInverseVariance();
+    return m_InverseVariance.data();
+}
+
+/**
+ * Returns flux/err^2 for each sample, computed on first call together with the cumulated flux^2/err^2
+ * used by GetSquaredWeightedFluxSum.
+ */
+const Float64* CSpectrumFluxAxis::GetWeightedFlux() const
+{
+    boost::mutex::scoped_lock lock( m_WeightsMutex );
+    BuildWeightedFlux();
+    return m_WeightedFlux.data();
+}
+
+/**
+ * Returns the sum of flux^2/err^2 over the samples imin to imax-1 (dtd), in constant time once the weights are built.
+ */
+Float64 CSpectrumFluxAxis::GetSquaredWeightedFluxSum( UInt32 imin, UInt32 imax ) const
+{
+    if( imax <= imin )
+    {
+        return 0.0;
+    }
+    boost::mutex::scoped_lock lock( m_WeightsMutex );
+    BuildWeightedFlux();
+    return m_SquaredWeightedFluxCumul[imax] - m_SquaredWeightedFluxCumul[imin];
+}
+
+/**
+ * Builds 1/err^2 if it was dropped. Called with m_WeightsMutex held.
+ */
+void CSpectrumFluxAxis::BuildInverseVariance() const
+{
+    if( !m_InverseVarianceReady )
+    {
+        UInt32 n = m_StatError.size();
+        m_InverseVariance.resize( n );
+        for( UInt32 i=0; i<n; i++ )
+        {
+            m_InverseVariance[i] = 1.0 / ( m_StatError[i] * m_StatError[i] );
+        }
+        m_InverseVarianceReady = true;
+        m_WeightedFluxReady = false;
+    }
+}
+
+/**
+ * Builds flux/err^2 and the cumulated flux^2/err^2 if they were dropped. Called with m_WeightsMutex held.
+ */
+void CSpectrumFluxAxis::BuildWeightedFlux() const
+{
+    BuildInverseVariance();
+    if( !m_WeightedFluxReady )
+    {
+        UInt32 n = m_Samples.size();
+        m_WeightedFlux.resize( n );
+        m_SquaredWeightedFluxCumul.resize( n+1 );
+        m_SquaredWeightedFluxCumul[0] = 0.0;
+        for( UInt32 i=0; i<n; i++ )
+        {
+            m_WeightedFlux[i] = m_Samples[i] * m_InverseVariance[i];
+            m_SquaredWeightedFluxCumul[i+1] = m_SquaredWeightedFluxCumul[i] + m_Samples[i] * m_WeightedFlux[i];
+        }
+        m_WeightedFluxReady = true;
+    }
+}
+
+/**
+ * Drops the weights, to be called after the errors were modified through a pointer or a reference obtained from the
+ * non-const accessors before the weights were last read.
+ */
+void CSpectrumFluxAxis::ResetWeights()
+{
+    boost::mutex::scoped_lock lock( m_WeightsMutex );
+    m_InverseVarianceReady = false;
+    m_WeightedFluxReady = false;
+}
+
+/**
+ * Drops the flux weights but keeps 1/err^2, to be called after the samples were modified through a pointer or a
+ * reference obtained from the non-const accessors before the weights were last read.
+ */
+void CSpectrumFluxAxis::ResetWeightedFlux()
+{
+    boost::mutex::scoped_lock lock( m_WeightsMutex );
+    m_WeightedFluxReady = false;
+}
+
 Bool CSpectrumFluxAxis::Rebin( const TFloat64Range& range, const CSpectrumFluxAxis& sourceFluxAxis, const CSpectrumSpectralAxis& sourceSpectralAxis, const CSpectrumSpectralAxis& targetSpectralAxis,
                                CSpectrumFluxAxis& rebinedFluxAxis, CSpectrumSpectralAxis& rebinedSpectralAxis, CMask& rebinedMask  )
 {
@@ -128,6 +245,7 @@ Bool CSpectrumFluxAxis::Rebin( const TFloat64Range& range, const CSpectrumFluxAx
         j++;
     }
 
+    rebinedFluxAxis.ResetWeightedFlux();
     return true;
 }
 
@@ -139,8 +257,11 @@ Bool CSpectrumFluxAxis::Rebin( const TFloat64Range& range, const CSpectrumFluxAx
 /// - opt_interp = 'spline' : GSL/spline interpolation is performed (TODO - not tested)
 /// - opt_interp = 'ngp' : nearest grid point is performed (TODO - not tested)
 ///
-Bool CSpectrumFluxAxis::Rebin2( const TFloat64Range& range, const CSpectrumFluxAxis& sourceFluxAxis, const Float64* pfgTplBuffer, Float64 sourcez, const CSpectrumSpectralAxis& sourceSpectralAxis, const CSpectrumSpectralAxis& targetSpectralAxis,
-                               CSpectrumFluxAxis& rebinedFluxAxis, CSpectrumSpectralAxis& rebinedSpectralAxis, CMask& rebinedMask , const std::string opt_interp )
+/// The precomputed fine grid can be stored in double or single precision, both share this implementation.
+///
+template <typename TFineGridSample>
+static Bool Rebin2Impl( const TFloat64Range& range, const CSpectrumFluxAxis& sourceFluxAxis, const TFineGridSample* pfgTplBuffer, Float64 sourcez, const CSpectrumSpectralAxis& sourceSpectralAxis, const CSpectrumSpectralAxis& targetSpectralAxis,
+                        CSpectrumFluxAxis& rebinedFluxAxis, CSpectrumSpectralAxis& rebinedSpectralAxis, CMask& rebinedMask , const std::string& opt_interp )
 {
     if( sourceFluxAxis.GetSamplesCount() != sourceSpectralAxis.GetSamplesCount() )
     {
@@ -213,7 +334,7 @@ Bool CSpectrumFluxAxis::Rebin2( const TFloat64Range& range, const CSpectrumFluxA
     }else if(opt_interp=="precomputedfinegrid"){
         //* // Precomputed FINE GRID nearest sample, 20150801
         Int32 k = 0;
-        Float64 dl = 0.1;
+        Float64 dl = CTemplate::FineGridStep;
         Float64 Coeffk = 1.0/dl/(1+sourcez);
         // For each sample in the target spectrum
         while( j<targetSpectralAxis.GetSamplesCount() && Xtgt[j] <= currentRange.GetEnd() )
@@ -287,9 +408,22 @@ Bool CSpectrumFluxAxis::Rebin2( const TFloat64Range& range, const CSpectrumFluxA
         j++;
     }
 
+    rebinedFluxAxis.ResetWeightedFlux();
     return true;
 }
 
+Bool CSpectrumFluxAxis::Rebin2( const TFloat64Range& range, const CSpectrumFluxAxis& sourceFluxAxis, const Float64* pfgTplBuffer, Float64 sourcez, const CSpectrumSpectralAxis& sourceSpectralAxis, const CSpectrumSpectralAxis& targetSpectralAxis,
+                               CSpectrumFluxAxis& rebinedFluxAxis, CSpectrumSpectralAxis& rebinedSpectralAxis, CMask& rebinedMask , const std::string opt_interp )
+{
+    return Rebin2Impl( range, sourceFluxAxis, pfgTplBuffer, sourcez, sourceSpectralAxis, targetSpectralAxis, rebinedFluxAxis, rebinedSpectralAxis, rebinedMask, opt_interp );
+}
+
+Bool CSpectrumFluxAxis::Rebin2SinglePrecision( const TFloat64Range& range, const CSpectrumFluxAxis& sourceFluxAxis, const Float32* pfgTplBuffer, Float64 sourcez, const CSpectrumSpectralAxis& sourceSpectralAxis, const CSpectrumSpectralAxis& targetSpectralAxis,
+                                              CSpectrumFluxAxis& rebinedFluxAxis, CSpectrumSpectralAxis& rebinedSpectralAxis, CMask& rebinedMask , const std::string opt_interp )
+{
+    return Rebin2Impl( range, sourceFluxAxis, pfgTplBuffer, sourcez, sourceSpectralAxis, targetSpectralAxis, rebinedFluxAxis, rebinedSpectralAxis, rebinedMask, opt_interp );
+}
+
 Bool CSpectrumFluxAxis::RebinVarianceWeighted( const CSpectrumFluxAxis& sourceFluxAxis, const CSpectrumSpectralAxis& sourceSpectralAxis, const CSpectrumFluxAxis& sourceError,
                                                const CSpectrumSpectralAxis& targetSpectralAxis,
                                                CSpectrumFluxAxis& rebinedFluxAxis, CSpectrumSpectralAxis& rebinedSpectralAxis, CSpectrumFluxAxis& rebinedError,
@@ -368,6 +502,8 @@ Bool CSpectrumFluxAxis::RebinVarianceWeighted( const CSpectrumFluxAxis& sourceFl
         }
     }
 
+    rebinedFluxAxis.ResetWeightedFlux();
+    rebinedError.ResetWeightedFlux();
     return true;
 }
 
@@ -376,6 +512,7 @@ void CSpectrumFluxAxis::SetSize( UInt32 s )
     CSpectrumAxis::SetSize( s );
     m_StatError.resize( s );
     m_StatError.assign(s, 1.0);
+    ResetWeights();
 }
 
 Bool CSpectrumFluxAxis::ApplyMedianSmooth( UInt32 kernelHalfWidth )
@@ -401,6 +538,7 @@ Bool CSpectrumFluxAxis::ApplyMedianSmooth( UInt32 kernelHalfWidth )
         (*this)[i] = median.Find( tmp.GetSamples()+left, ( right - left ) +1 );
     }
 
+    ResetWeightedFlux();
     return true;
 }
 
@@ -426,6 +564,7 @@ Bool CSpectrumFluxAxis::ApplyMeanSmooth( UInt32 kernelHalfWidth )
         (*this)[i] = mean.Find( tmp.GetSamples()+left, ( right - left ) +1 );
     }
 
+    ResetWeightedFlux();
     return true;
 }
 
@@ -556,6 +695,7 @@ Bool CSpectrumFluxAxis::Subtract(const CSpectrumFluxAxis& other)
     {
         m_Samples[i] = m_Samples[i]-other[i];
     }
+    ResetWeightedFlux();
     return true;
 }
 
@@ -566,6 +706,7 @@ Bool CSpectrumFluxAxis::Invert()
     {
         m_Samples[i] = -m_Samples[i];
     }
+    ResetWeightedFlux();
     return true;
 }
 
@@ -410,6 +410,7 @@ Bool CSpectrum::correctSpectrum( Float64 LambdaMin,  Float64 LambdaMax, Float64
     }
     if(nCorrected>0)
     {
+        m_FluxAxis.ResetWeights();
         Log.LogInfo("    CSpectrum::correctSpectrum - Corrected %d invalid samples with coeff (=%f), minFlux=%e, maxNoise=%e", nCorrected, coeffCorr, minFlux, maxNoise);
     }
     return corrected;
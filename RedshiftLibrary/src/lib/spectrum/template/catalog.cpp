@@ -25,6 +25,7 @@ CTemplateCatalog::CTemplateCatalog(string cremovalmethod, Float64 mediankernelsi
     m_continuumRemovalMedianKernelWidth = mediankernelsize;
     m_continuumRemovalWaveletsNScales = waveletsScales;
     m_continuumRemovalWaveletsBinPath = waveletsDFBinPath;
+    m_fineGridSinglePrecision = false;
 }
 
 /**
@@ -96,6 +97,29 @@ UInt32 CTemplateCatalog::GetTemplateCount( const std::string& category ) const
     return m_List.at( category ).size();
 }
 
+/**
+ * Selects the storage precision of the precomputed fine grid of every template, current and to be added.
+ * The fine grids are built lazily by the templates on their first use by an operator, and then shared by every spectrum.
+ */
+void CTemplateCatalog::SetFineGridSinglePrecision( Bool enable )
+{
+    m_fineGridSinglePrecision = enable;
+    for( auto it = m_List.begin(); it != m_List.end(); it++ )
+    {
+        for( UInt32 j=0; j<it->second.size(); j++ )
+        {
+            it->second[j]->SetFineGridSinglePrecision( enable );
+        }
+    }
+    for( auto it = m_ListWithoutCont.begin(); it != m_ListWithoutCont.end(); it++ )
+    {
+        for( UInt32 j=0; j<it->second.size(); j++ )
+        {
+            it->second[j]->SetFineGridSinglePrecision( enable );
+        }
+    }
+}
+
 /**
  * Adds the input to the list of templates, under its category. If the input doesn't have a category, function returns false. Also computes the template without continuum and adds it to the list of templates without continuum. Returns true.
  */
@@ -104,6 +128,7 @@ void CTemplateCatalog::Add( std::shared_ptr<CTemplate> r )
     if( r->GetCategory().empty() )
       throw runtime_error("Template has no category");
 
+    r->SetFineGridSinglePrecision( m_fineGridSinglePrecision );
     m_List[r->GetCategory()].push_back( r );
 
     // Compute continuum substracted spectrum
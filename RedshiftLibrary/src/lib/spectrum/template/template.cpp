@@ -1,15 +1,24 @@
 #include <RedshiftLibrary/spectrum/template/template.h>
 
 #include <RedshiftLibrary/common/mask.h>
+
+#include <gsl/gsl_interp.h>
+#include <gsl/gsl_spline.h>
+
 #include <fstream>
 
 using namespace NSEpic;
 using namespace std;
 
+// wavelength step of the precomputed fine grid, in Angstrom
+const Float64 CTemplate::FineGridStep = 0.1;
+
 /**
  * Constructor, empty.
  */
-CTemplate::CTemplate( )
+CTemplate::CTemplate( ) :
+    m_FineGridSinglePrecision( false ),
+    m_FineGridReady( false )
 {
 
 }
@@ -19,7 +28,9 @@ CTemplate::CTemplate( )
  */
 CTemplate::CTemplate( const std::string& name, const std::string& category ) :
     m_Category( category ),
-    m_Name( name )
+    m_Name( name ),
+    m_FineGridSinglePrecision( false ),
+    m_FineGridReady( false )
 {
 
 }
@@ -27,12 +38,27 @@ CTemplate::CTemplate( const std::string& name, const std::string& category ) :
 CTemplate::CTemplate( const std::string& name, const std::string& category,
 		      CSpectrumSpectralAxis& spectralAxis, CSpectrumFluxAxis& fluxAxis) :
     m_Category( category ),
-    m_Name( name )
+    m_Name( name ),
+    m_FineGridSinglePrecision( false ),
+    m_FineGridReady( false )
 {
   m_SpectralAxis = spectralAxis;
   m_FluxAxis = fluxAxis;
 }
 
+/**
+ * Copy constructor: the precomputed fine grid is not copied, the copy builds its own on request.
+ */
+CTemplate::CTemplate( const CTemplate& other ) :
+    CSpectrum( other ),
+    m_Category( other.m_Category ),
+    m_Name( other.m_Name ),
+    m_FineGridSinglePrecision( other.m_FineGridSinglePrecision ),
+    m_FineGridReady( false )
+{
+
+}
+
 /**
  * Destructor, empty.
  */
@@ -41,6 +67,20 @@ CTemplate::~CTemplate()
 
 }
 
+/**
+ * Assignment: copies the spectrum, name and category, and drops the precomputed fine grid.
+ */
+CTemplate& CTemplate::operator=( const CTemplate& other )
+{
+    CSpectrum::operator=( other );
+    m_Category = other.m_Category;
+    m_Name = other.m_Name;
+    m_FineGridSinglePrecision = other.m_FineGridSinglePrecision;
+    ResetFineGrid();
+
+    return *this;
+}
+
 /**
  * Returns the value stored in m_Name.
  */
@@ -90,3 +130,113 @@ Bool CTemplate::Save( const char* filePath ) const
     file.close();
     return true;
 }
+
+/**
+ * Selects the storage of the precomputed fine grid: float32 halves its footprint.
+ */
+void CTemplate::SetFineGridSinglePrecision( Bool enable )
+{
+    if( enable != m_FineGridSinglePrecision )
+    {
+        ResetFineGrid();
+    }
+    m_FineGridSinglePrecision = enable;
+}
+
+Bool CTemplate::GetFineGridSinglePrecision() const
+{
+    return m_FineGridSinglePrecision;
+}
+
+/**
+ * Returns the double precision fine grid flux, building it on first call.
+ * Returns NULL if the fine grid is stored in single precision.
+ */
+const Float64* CTemplate::GetFineGridFlux() const
+{
+    if( m_FineGridSinglePrecision )
+    {
+        return NULL;
+    }
+    InitFineGrid();
+    return m_FineGridFlux.data();
+}
+
+/**
+ * Returns the single precision fine grid flux, building it on first call.
+ * Returns NULL if the fine grid is stored in double precision.
+ */
+const Float32* CTemplate::GetFineGridFluxSinglePrecision() const
+{
+    if( !m_FineGridSinglePrecision )
+    {
+        return NULL;
+    }
+    InitFineGrid();
+    return m_FineGridFluxSinglePrecision.data();
+}
+
+/**
+ * Releases the precomputed fine grid. Has to be called if the template is modified after the fine grid was built.
+ */
+void CTemplate::ResetFineGrid()
+{
+    boost::mutex::scoped_lock lock( m_FineGridMutex );
+    m_FineGridReady = false;
+    TFloat64List().swap( m_FineGridFlux );
+    std::vector<Float32>().swap( m_FineGridFluxSinglePrecision );
+}
+
+/**
+ * Precalculates a fine grid template (spline interpolation, step FineGridStep, starting at 0A) to be used for the
+ * 'closest value' rebin method. Built once and shared by every operator and every spectrum using this template.
+ */
+void CTemplate::InitFineGrid() const
+{
+    boost::mutex::scoped_lock lock( m_FineGridMutex );
+    if( m_FineGridReady )
+    {
+        return;
+    }
+
+    Int32 n = GetSampleCount();
+    const Float64* Xsrc = m_SpectralAxis.GetSamples();
+    const Float64* Ysrc = m_FluxAxis.GetSamples();
+    Float64 lmin = 0;
+    Float64 lmax = Xsrc[n-1];
+    Int32 nTgt = (lmax-lmin)/FineGridStep + 2.0/FineGridStep;
+
+    if( m_FineGridSinglePrecision )
+    {
+        m_FineGridFluxSinglePrecision.resize( nTgt );
+    }else
+    {
+        m_FineGridFlux.resize( nTgt );
+    }
+
+    gsl_spline *spline = gsl_spline_alloc( gsl_interp_cspline, n );
+    gsl_spline_init( spline, Xsrc, Ysrc, n );
+    gsl_interp_accel *accelerator = gsl_interp_accel_alloc();
+
+    for( Int32 k=0; k<nTgt; k++ )
+    {
+        Float64 x = lmin + k*FineGridStep;
+        Float64 y = 0.0;
+        if( x >= Xsrc[0] && x <= Xsrc[n-1] )
+        {
+            y = gsl_spline_eval( spline, x, accelerator );
+        }
+        if( m_FineGridSinglePrecision )
+        {
+            m_FineGridFluxSinglePrecision[k] = y;
+        }else
+        {
+            m_FineGridFlux[k] = y;
+        }
+    }
+
+    gsl_spline_free( spline );
+    gsl_interp_accel_free( accelerator );
+
+    m_FineGridReady = true;
+}
@@ -1,13 +1,12 @@
 #include <RedshiftLibrary/statistics/deltaz.h>
 
+#include <RedshiftLibrary/common/weightedleastsquares.h>
 #include <RedshiftLibrary/log/log.h>
 
 using namespace NSEpic;
 using namespace std;
 #include <fstream>
 
-#include <gsl/gsl_multifit.h>
-
 CDeltaz::CDeltaz()
 {
 
@@ -25,9 +24,9 @@ CDeltaz::~CDeltaz()
  * @param redshift
  * @param redshiftRange
  * @param, output: sigma
- * @return 0: success, 1:problem with indexes,
+ * @return 0: success, 1:problem with indexes, 2:fit failed
  */
-Int32 CDeltaz::Compute(TFloat64List merits, TFloat64List redshifts, Float64 redshift, TFloat64Range redshiftRange, Float64& sigma)
+Int32 CDeltaz::Compute(const TFloat64List& merits, const TFloat64List& redshifts, Float64 redshift, TFloat64Range redshiftRange, Float64& sigma)
 {
     Bool verbose = false;
 
@@ -57,18 +56,10 @@ Int32 CDeltaz::Compute(TFloat64List merits, TFloat64List redshifts, Float64 reds
     //quadratic fit
     Int32 i, n;
     Float64 xi, yi, ei, chisq;
-    gsl_matrix *X, *cov;
-    gsl_vector *y, *w, *c;
+    CWeightedLeastSquares<1> fit;
 
     n = izmax - izmin +1;
 
-    X = gsl_matrix_alloc (n, 1);
-    y = gsl_vector_alloc (n);
-    w = gsl_vector_alloc (n);
-
-    c = gsl_vector_alloc (1);
-    cov = gsl_matrix_alloc (1, 1);
-
     Float64 x0 = redshifts[iz];
     Float64 y0 = merits[iz];
     for (i = 0; i < n; i++)
@@ -79,20 +70,18 @@ Int32 CDeltaz::Compute(TFloat64List merits, TFloat64List redshifts, Float64 reds
             fprintf (stderr, "  x = %+.5e,  y = %+.5e\n",xi, yi);
         }
         ei = 1.0; //todo, estimate weighting ?
-        gsl_matrix_set (X, i, 0, (xi-x0)*(xi-x0));
-
-        gsl_vector_set (y, i, yi);
-        gsl_vector_set (w, i, 1.0/(ei*ei));
+        Float64 xrow[1] = { (xi-x0)*(xi-x0) };
+        fit.AddSample( xrow, yi, 1.0/(ei*ei) );
     }
 
+    if( !fit.Solve() )
     {
-        gsl_multifit_linear_workspace * work = gsl_multifit_linear_alloc (n, 1);
-        gsl_multifit_wlinear (X, w, y, c, cov, &chisq, work);
-        gsl_multifit_linear_free (work);
+        return 2;
     }
+    chisq = fit.GetChiSquare();
 
-#define C(i) (gsl_vector_get(c,(i)))
-#define COV(i,j) (gsl_matrix_get(cov,(i),(j)))
+#define C(i) (fit.GetCoefficient(i))
+#define COV(i,j) (fit.GetCovariance((i),(j)))
 
     sigma = sqrt(1.0/C(0));
 
@@ -115,17 +104,11 @@ Int32 CDeltaz::Compute(TFloat64List merits, TFloat64List redshifts, Float64 reds
         fprintf (stderr, "# chisq/n = %g\n", chisq/n);
     }
 
-    gsl_matrix_free (X);
-    gsl_vector_free (y);
-    gsl_vector_free (w);
-    gsl_vector_free (c);
-    gsl_matrix_free (cov);
-
     return 0;
 }
 
 //todo : merge with previous function instead of duplicating code...
-Int32 CDeltaz::Compute3ddl(TFloat64List merits, TFloat64List redshifts, Float64 redshift, TFloat64Range redshiftRange, Float64& sigma)
+Int32 CDeltaz::Compute3ddl(const TFloat64List& merits, const TFloat64List& redshifts, Float64 redshift, TFloat64Range redshiftRange, Float64& sigma)
 {
     sigma = -1.0; //default value
     Bool verbose = false;
@@ -152,11 +135,13 @@ Int32 CDeltaz::Compute3ddl(TFloat64List merits, TFloat64List redshifts, Float64
         return 1;
     }
 
+#undef C
+#undef COV
+
     //quadratic fit
     Int32 i, n;
     Float64 xi, yi, ei, chisq;
-    gsl_matrix *X, *cov;
-    gsl_vector *y, *w, *c;
+    CWeightedLeastSquares<3> fit;
 
     n = izmax - izmin +1;
     if(n<3)
@@ -164,13 +149,6 @@ Int32 CDeltaz::Compute3ddl(TFloat64List merits, TFloat64List redshifts, Float64
         return 1;
     }
 
-    X = gsl_matrix_alloc (n, 3);
-    y = gsl_vector_alloc (n);
-    w = gsl_vector_alloc (n);
-
-    c = gsl_vector_alloc (3);
-    cov = gsl_matrix_alloc (3, 3);
-
     double x0 = redshift;
     for (i = 0; i < n; i++)
     {
@@ -181,22 +159,18 @@ Int32 CDeltaz::Compute3ddl(TFloat64List merits, TFloat64List redshifts, Float64
             fprintf (stderr, "  x = %+.5e ]\n", xi);
         }
         ei = 1.0; //todo, estimate weighting ?
-        gsl_matrix_set (X, i, 0, 1.0);
-        gsl_matrix_set (X, i, 1, xi-x0);
-        gsl_matrix_set (X, i, 2, (xi-x0)*(xi-x0));
-
-        gsl_vector_set (y, i, yi);
-        gsl_vector_set (w, i, 1.0/(ei*ei));
+        Float64 xrow[3] = { 1.0, xi-x0, (xi-x0)*(xi-x0) };
+        fit.AddSample( xrow, yi, 1.0/(ei*ei) );
     }
 
+    if( !fit.Solve() )
     {
-        gsl_multifit_linear_workspace * work = gsl_multifit_linear_alloc (n, 3);
-        gsl_multifit_wlinear (X, w, y, c, cov, &chisq, work);
-        gsl_multifit_linear_free (work);
+        return 2;
     }
+    chisq = fit.GetChiSquare();
 
-#define C(i) (gsl_vector_get(c,(i)))
-#define COV(i,j) (gsl_matrix_get(cov,(i),(j)))
+#define C(i) (fit.GetCoefficient(i))
+#define COV(i,j) (fit.GetCovariance((i),(j)))
 
     double zcorr = x0-C(1)/(2.0*C(2));
     sigma = sqrt(1.0/C(2));
@@ -231,12 +205,6 @@ Int32 CDeltaz::Compute3ddl(TFloat64List merits, TFloat64List redshifts, Float64
         fprintf (stderr, "# chisq/n = %g\n", chisq/n);
     }
 
-    gsl_matrix_free (X);
-    gsl_vector_free (y);
-    gsl_vector_free (w);
-    gsl_vector_free (c);
-    gsl_matrix_free (cov);
-
     //results.LogArea[indz] = logarea;
     //results.SigmaZ[indz] = sigma;
     //results.LogAreaCorrectedExtrema[indz] = zcorr;
@@ -1,9 +1,12 @@
 #include <RedshiftLibrary/statistics/pdfz.h>
+#include <RedshiftLibrary/statistics/pdfzmarginalizer.h>
+#include <RedshiftLibrary/statistics/pdfznumerics.h>
 
 #include <RedshiftLibrary/log/log.h>
 
 using namespace NSEpic;
 using namespace std;
+#include <algorithm>
 #include <fstream>
 
 #include <gsl/gsl_blas.h>
@@ -90,8 +93,8 @@ CPdfz::~CPdfz() {}
  * regular grid z-pdf anymore
  * @return 0: success, 1:problem, 3 not enough z values, 4: zPrior not valid
  */
-Int32 CPdfz::Compute(TFloat64List merits, TFloat64List redshifts,
-                     Float64 cstLog, TFloat64List logZPrior,
+Int32 CPdfz::Compute(const TFloat64List& merits, const TFloat64List& redshifts,
+                     Float64 cstLog, const TFloat64List& logZPrior,
                      TFloat64List &logPdf, Float64 &logEvidence)
 {
     Bool verbose = true;
@@ -100,54 +103,12 @@ Int32 CPdfz::Compute(TFloat64List merits, TFloat64List redshifts,
 
     if (verbose)
     {
-        Float64 meritmax = -DBL_MAX;
-        Float64 meritmin = DBL_MAX;
-        for (UInt32 k = 0; k < redshifts.size(); k++)
-        {
-            if (meritmax < merits[k])
-            {
-                meritmax = merits[k];
-            }
-            if (meritmin > merits[k])
-            {
-                meritmin = merits[k];
-            }
-        }
+        Float64 meritmin, meritmax;
+        CPdfzNumerics::MinMax(merits.data(), redshifts.size(), meritmin, meritmax);
         Log.LogDetail("Pdfz: Pdfz computation: using merit min=%e", meritmin);
         Log.LogDetail("Pdfz: Pdfz computation: using merit max=%e", meritmax);
     }
 
-    //
-    //    //check if the z step is constant. If not, pdf cannot be estimated by
-    //    the current method. Float64 reldzThreshold = 0.05; //relative
-    //    difference accepted bool constantdz = true; Float64 mindz = DBL_MAX;
-    //    Float64 maxdz = -DBL_MAX;
-    //    for ( UInt32 k=1; k<redshifts.size(); k++)
-    //    {
-    //        Float64 diff = redshifts[k]-redshifts[k-1];
-    //        if(mindz > diff)
-    //        {
-    //            mindz = diff;
-    //        }
-    //        if(maxdz < diff)
-    //        {
-    //            maxdz = diff;
-    //        }
-    //    }
-    //    Float64 zstep_mean = (maxdz+mindz)/2.0;
-    //    if(abs(maxdz-mindz)/zstep_mean>reldzThreshold)
-    //    {
-    //        constantdz = false;
-    //        return 2;
-    //    }
-    //
-
-    // deactivate logPrior just to see...
-    //    for ( UInt32 k=0; k<redshifts.size(); k++)
-    //    {
-    //        logZPrior[k] = 0;
-    //    }
-
     // check if there is at least 1 redshifts values
     if (redshifts.size() == 1) // consider this as a success
     {
@@ -164,145 +125,61 @@ Int32 CPdfz::Compute(TFloat64List merits, TFloat64List redshifts,
     if (logZPrior.size() != redshifts.size())
     {
         return 4;
-        // Float64 logPrior = log(1.0/redshifts.size()); //log(1.0)
     }
     if (verbose)
     {
-        Float64 logZPriorMax = -DBL_MAX;
-        Float64 logZPriorMin = DBL_MAX;
-        for (UInt32 k = 0; k < redshifts.size(); k++)
-        {
-            if (logZPriorMax < logZPrior[k])
-            {
-                logZPriorMax = logZPrior[k];
-            }
-            if (logZPriorMin > logZPrior[k])
-            {
-                logZPriorMin = logZPrior[k];
-            }
-        }
+        Float64 logZPriorMin, logZPriorMax;
+        CPdfzNumerics::MinMax(logZPrior.data(), redshifts.size(), logZPriorMin, logZPriorMax);
         Log.LogDetail("Pdfz: Pdfz computation: using logZPrior min=%e",
                       logZPriorMax);
         Log.LogDetail("Pdfz: Pdfz computation: using logZPrior max=%e",
                       logZPriorMin);
     }
-    //    std::vector<Float64> logZPrior(zPrior.size(), 1.0);
-    //    for(UInt32 kz=0; kz<zPrior.size(); kz++)
-    //    {
-    //        logZPrior[kz] = log(zPrior[kz]);
-    //    }
-
-    logPdf.resize(redshifts.size());
 
     /* ------------------------------------------------------------------
      * NOTE: this uses the LOG-SUM-EXP trick originally suggested by S. Jamal
      * ------------------------------------------------------------------  */
 
-    // prepare logLikelihood and LogEvidence
-    Float64 maxi = -DBL_MAX;
-    std::vector<Float64> mchi2Sur2(redshifts.size(), 0.0);
-    std::vector<Float64> smallVALUES(redshifts.size(), 0.0);
-    for (UInt32 k = 0; k < redshifts.size(); k++)
+    // logPdf first holds the log of the unnormalized posterior,
+    // -chi2/2 + logZPrior
+    UInt32 n = redshifts.size();
+    logPdf.resize(n);
+    for (UInt32 k = 0; k < n; k++)
     {
-        mchi2Sur2[k] = -0.5 * merits[k];
-        Float64 zstep;
-        // here, using rect. approx. (enough precision for maxi estimation)
-        if (k == 0)
-        {
-            zstep = (redshifts[k + 1] - redshifts[k]) * 0.5;
-        } else if (k == redshifts.size() - 1)
-        {
-            zstep = (redshifts[k] - redshifts[k - 1]) * 0.5;
-        } else
-        {
-            zstep = (redshifts[k + 1] + redshifts[k]) * 0.5 -
-                    (redshifts[k] + redshifts[k - 1]) * 0.5;
-        }
-        smallVALUES[k] = mchi2Sur2[k] + logZPrior[k];
-        if (maxi < smallVALUES[k] + log(zstep))
-        {
-            maxi = smallVALUES[k] +
-                   log(zstep); // maxi will be used to avoid underflows when
-                               // summing exponential of small values
-        }
+        logPdf[k] = -0.5 * merits[k] + logZPrior[k];
     }
-    Log.LogDebug(
-        "Pdfz: Pdfz computation: using maxi value for log-sum-exp trick=%e",
-        maxi);
 
-    Float64 sumModifiedExp = 0.0;
+    Float64 logSum = -INFINITY;
     if (sumMethod == 0)
     {
         Log.LogDebug(
             "Pdfz: Pdfz computation: summation method option = RECTANGLES");
-        for (UInt32 k = 0; k < redshifts.size(); k++)
-        {
-            Float64 modifiedEXPO = exp(smallVALUES[k] - maxi);
-            Float64 area = (modifiedEXPO);
-            Float64 zstep;
-            if (k == 0)
-            {
-                zstep = (redshifts[k + 1] - redshifts[k]) * 0.5;
-            } else if (k == redshifts.size() - 1)
-            {
-                zstep = (redshifts[k] - redshifts[k - 1]) * 0.5;
-            } else
-            {
-                zstep = (redshifts[k + 1] + redshifts[k]) * 0.5 -
-                        (redshifts[k] + redshifts[k - 1]) * 0.5;
-            }
-            area *= zstep;
-            sumModifiedExp += area;
-        }
+        logSum = CPdfzNumerics::LogRectExp(redshifts.data(), logPdf.data(), n);
     } else if (sumMethod == 1)
     {
         Log.LogDebug(
             "Pdfz: Pdfz computation: summation method option = TRAPEZOID");
-        Float64 modifiedEXPO_previous = exp(smallVALUES[0] - maxi);
-        for (UInt32 k = 1; k < redshifts.size(); k++)
-        {
-            Float64 modifiedEXPO = exp(smallVALUES[k] - maxi);
-            Float64 trapezArea = (modifiedEXPO + modifiedEXPO_previous) / 2.0;
-            trapezArea *= (redshifts[k] - redshifts[k - 1]);
-            sumModifiedExp += trapezArea;
-            modifiedEXPO_previous = modifiedEXPO;
-        }
+        logSum = CPdfzNumerics::LogTrapzExp(redshifts.data(), logPdf.data(), n);
     } else
     {
         Log.LogError(
             "Pdfz: Pdfz computation: unable to parse summation method option");
     }
-    logEvidence = cstLog + maxi + log(sumModifiedExp);
+    logEvidence = cstLog + logSum;
 
     if (verbose)
     {
         Log.LogDetail("Pdfz: Pdfz computation: using cstLog=%e", cstLog);
         Log.LogDetail("Pdfz: Pdfz computation: using logEvidence=%e",
                       logEvidence);
-        // Log.LogInfo("Pdfz: Pdfz computation: using logPrior=%f",  logPrior);
-        // //logPrior can be variable with z
     }
 
-    for (UInt32 k = 0; k < redshifts.size(); k++)
-    {
-        logPdf[k] = logZPrior[k] + (mchi2Sur2[k] + cstLog) - logEvidence;
-    }
+    CPdfzNumerics::AddScalar(logPdf.data(), cstLog - logEvidence, n);
 
     if (verbose)
     {
-        Float64 pdfmax = -DBL_MAX;
-        Float64 pdfmin = DBL_MAX;
-        for (UInt32 k = 0; k < redshifts.size(); k++)
-        {
-            if (pdfmax < logPdf[k])
-            {
-                pdfmax = logPdf[k];
-            }
-            if (pdfmin > logPdf[k])
-            {
-                pdfmin = logPdf[k];
-            }
-        }
+        Float64 pdfmin, pdfmax;
+        CPdfzNumerics::MinMax(logPdf.data(), n, pdfmin, pdfmax);
         Log.LogDetail("Pdfz: Pdfz computation: found pdf min=%e", pdfmin);
         Log.LogDetail("Pdfz: Pdfz computation: found pdf max=%e", pdfmax);
     }
@@ -310,119 +187,23 @@ Int32 CPdfz::Compute(TFloat64List merits, TFloat64List redshifts,
     return 0;
 }
 
-Float64 CPdfz::getSumTrapez(std::vector<Float64> redshifts,
-                            std::vector<Float64> valprobalog)
+Float64 CPdfz::getSumTrapez(const std::vector<Float64>& redshifts,
+                            const std::vector<Float64>& valprobalog)
 {
-    Float64 sum = 0.0;
-
-    // prepare LogEvidence
-    Float64 maxi = -DBL_MAX;
-    std::vector<Float64> smallVALUES(redshifts.size(), 0.0);
-    for (UInt32 k = 0; k < redshifts.size(); k++)
-    {
-        // find the smallest zstep in order to use most penalizing case fot the
-        // log-sum-exp trick
-        Float64 zstepPrevious = -1.;
-        if (k > 0)
-        {
-            zstepPrevious = (redshifts[k] - redshifts[k - 1]);
-        } else if (k < redshifts.size() - 1)
-        {
-            zstepPrevious = (redshifts[k + 1] - redshifts[k]);
-        }
-        Float64 zstepNext = -1.;
-        if (k < redshifts.size() - 1)
-        {
-            zstepNext = (redshifts[k + 1] - redshifts[k]);
-        } else if (k > 0)
-        {
-            zstepNext = (redshifts[k] - redshifts[k - 1]);
-        }
-        Float64 zstepCurrent = min(zstepPrevious, zstepNext);
-        smallVALUES[k] = valprobalog[k];
-        if (maxi < smallVALUES[k] + log(zstepCurrent))
-        {
-            maxi =
-                smallVALUES[k] +
-                log(zstepCurrent); // maxi will be used to avoid underflows when
-                                   // summing exponential of small values
-        }
-    }
-
-    Float64 sumModifiedExp = 0.0;
-    Float64 modifiedEXPO_previous = exp(smallVALUES[0] - maxi);
-    for (UInt32 k = 1; k < redshifts.size(); k++)
-    {
-        Float64 modifiedEXPO = exp(smallVALUES[k] - maxi);
-        Float64 trapezArea = (modifiedEXPO + modifiedEXPO_previous) / 2.0;
-        trapezArea *= (redshifts[k] - redshifts[k - 1]);
-        sumModifiedExp += trapezArea;
-        modifiedEXPO_previous = modifiedEXPO;
-    }
-    Float64 logSum = maxi + log(sumModifiedExp);
-
-    sum = exp(logSum);
-
-    return sum;
+    Float64 logSum = CPdfzNumerics::LogTrapzExp(redshifts.data(), valprobalog.data(),
+                                                redshifts.size());
+    return exp(logSum);
 }
 
-Float64 CPdfz::getSumRect(std::vector<Float64> redshifts,
-                          std::vector<Float64> valprobalog)
+Float64 CPdfz::getSumRect(const std::vector<Float64>& redshifts,
+                          const std::vector<Float64>& valprobalog)
 {
-    Float64 sum = 0.0;
-
-    // prepare LogEvidence
-    Float64 maxi = -DBL_MAX;
-    std::vector<Float64> smallVALUES(redshifts.size(), 0.0);
-    for (UInt32 k = 0; k < redshifts.size(); k++)
-    {
-        Float64 zstep;
-        if (k == 0)
-        {
-            zstep = (redshifts[k + 1] - redshifts[k]) * 0.5;
-        } else if (k == redshifts.size() - 1)
-        {
-            zstep = (redshifts[k] - redshifts[k - 1]) * 0.5;
-        } else
-        {
-            zstep = (redshifts[k + 1] + redshifts[k]) * 0.5 -
-                    (redshifts[k] + redshifts[k - 1]) * 0.5;
-        }
-        smallVALUES[k] = valprobalog[k];
-        if (maxi < smallVALUES[k] + log(zstep))
-        {
-            maxi = smallVALUES[k] +
-                   log(zstep); // maxi will be used to avoid underflows when
-                               // summing exponential of small values
-        }
-    }
-
-    Log.LogDebug("  pdfz: getSumRect - found maxi = %e", maxi);
-    Float64 sumModifiedExp = 0.0;
-    for (UInt32 k = 0; k < redshifts.size() - 1; k++)
-    {
-        Float64 modifiedEXPO = exp(smallVALUES[k] - maxi);
-        Float64 area = modifiedEXPO;
-        Float64 zstep;
-        if (k == 0)
-        {
-            zstep = (redshifts[k + 1] - redshifts[k]) * 0.5;
-        } else if (k == redshifts.size() - 1)
-        {
-            zstep = (redshifts[k] - redshifts[k - 1]) * 0.5;
-        } else
-        {
-            zstep = (redshifts[k + 1] + redshifts[k]) * 0.5 -
-                    (redshifts[k] + redshifts[k - 1]) * 0.5;
-        }
-        area *= zstep;
-        sumModifiedExp += area;
-    }
-    Float64 logSum = maxi + log(sumModifiedExp);
-
-    sum = exp(logSum);
-
-    return sum;
+    // the last sample is not included in the sum
+    std::vector<Float64> widths(redshifts.size());
+    CPdfzNumerics::RectWidths(redshifts.data(), redshifts.size(), widths.data());
+    Float64 logSum = CPdfzNumerics::LogSumExpWeighted(valprobalog.data(), widths.data(),
+                                                      redshifts.size() - 1);
+    return exp(logSum);
 }
 
 /**
@@ -433,8 +214,8 @@ Float64 CPdfz::getSumRect(std::vector<Float64> redshifts,
  * @param zwidth
  * @return -1 if error, else sum around the candidate
  */
-Float64 CPdfz::getCandidateSumTrapez(std::vector<Float64> redshifts,
-                                     std::vector<Float64> valprobalog,
+Float64 CPdfz::getCandidateSumTrapez(const std::vector<Float64>& redshifts,
+                                     const std::vector<Float64>& valprobalog,
                                      Float64 zcandidate, Float64 zwidth)
 {
     // check that redshifts are sorted
@@ -451,73 +232,25 @@ Float64 CPdfz::getCandidateSumTrapez(std::vector<Float64> redshifts,
 
     // find indexes kmin, kmax so that zmin and zmax are inside [
     // redshifts[kmin]:redshifts[kmax] ]
-    Int32 kmin = 0;
-    Int32 kmax = redshifts.size() - 1;
+    Int32 n = redshifts.size();
     Float64 halfzwidth = zwidth / 2.0;
-    for (UInt32 k = 0; k < redshifts.size(); k++)
-    {
-        if (redshifts[k] < (zcandidate - halfzwidth))
-        {
-            kmin = k;
-        }
-    }
+    Int32 kmin = std::lower_bound(redshifts.begin(), redshifts.end(),
+                                  zcandidate - halfzwidth) - redshifts.begin() - 1;
+    kmin = std::max(kmin, 0);
     Log.LogDebug("    CPdfz::getCandidateSumTrapez - kmin index=%d", kmin);
 
-    for (UInt32 k = redshifts.size() - 1; k > 0; k--)
-    {
-        if (redshifts[k] > (zcandidate + halfzwidth))
-        {
-            kmax = k;
-        }
-    }
+    Int32 kmax = std::upper_bound(redshifts.begin(), redshifts.end(),
+                                  zcandidate + halfzwidth) - redshifts.begin();
+    kmax = std::max(std::min(kmax, n - 1), std::min(1, n - 1));
     Log.LogDebug("    CPdfz::getCandidateSumTrapez - kmax index=%d", kmax);
 
-    // initialize the LOG-SUM-EXP trick
-    Float64 maxi = -DBL_MAX;
-    std::vector<Float64> smallVALUES(redshifts.size(), 0.0);
-    for (UInt32 k = kmin; k <= kmax; k++)
-    {
-        // estimate zstep for the log-sum-exp trick
-        Float64 zstep;
-        if (k == 0)
-        {
-            zstep = (redshifts[k + 1] - redshifts[k]);
-        } else if (k == redshifts.size() - 1)
-        {
-            zstep = (redshifts[k] - redshifts[k - 1]);
-        } else
-        {
-            zstep = (redshifts[k + 1] + redshifts[k]) * 0.5 -
-                    (redshifts[k] + redshifts[k - 1]) * 0.5;
-        }
-        smallVALUES[k] = valprobalog[k];
-        if (maxi < smallVALUES[k] + log(zstep))
-        {
-            maxi = smallVALUES[k] +
-                   log(zstep); // maxi will be used to avoid underflows when
-                               // summing exponential of small values
-        }
-    }
-
     // for now the sum is estimated between kmin and kmax.
     // todo: INTERPOLATE (linear) in order to start exactly at zmin and stop at
     // zmax
-    Float64 sum = 0.0;
-    Float64 sumModifiedExp = 0.0;
-    Float64 modifiedEXPO_previous = exp(smallVALUES[kmin] - maxi);
-    for (UInt32 k = kmin + 1; k <= kmax; k++)
-    {
-        Float64 modifiedEXPO = exp(smallVALUES[k] - maxi);
-        Float64 trapezArea = (modifiedEXPO + modifiedEXPO_previous) / 2.0;
-        trapezArea *= (redshifts[k] - redshifts[k - 1]);
-        sumModifiedExp += trapezArea;
-        modifiedEXPO_previous = modifiedEXPO;
-    }
-    Float64 logSum = maxi + log(sumModifiedExp);
-
-    sum = exp(logSum);
-
-    return sum;
+    Float64 logSum = CPdfzNumerics::LogTrapzExp(redshifts.data() + kmin,
+                                                valprobalog.data() + kmin,
+                                                kmax - kmin + 1);
+    return exp(logSum);
 }
 
 Int32 CPdfz::getCandidateRobustGaussFit(std::vector<Float64> redshifts,
@@ -952,8 +685,8 @@ std::vector<Float64> CPdfz::GetEuclidNhaLogZPrior(std::vector<Float64> redshifts
  * @param logprior2
  * @return
  */
-std::vector<Float64> CPdfz::CombineLogZPrior(std::vector<Float64> logprior1,
-                                             std::vector<Float64> logprior2)
+std::vector<Float64> CPdfz::CombineLogZPrior(const std::vector<Float64>& logprior1,
+                                             const std::vector<Float64>& logprior2)
 {
     bool normalizePrior=true;
     std::vector<Float64> logzPriorCombined;
@@ -963,27 +696,14 @@ std::vector<Float64> CPdfz::CombineLogZPrior(std::vector<Float64> logprior1,
     }
     Int32 n = logprior1.size();
 
-    Float64 maxi = DBL_MIN;
-    for (UInt32 k = 0; k < n; k++)
-    {
-        Float64 val = logprior1[k] + logprior2[k];
-        if (maxi < val)
-        {
-            maxi = val;
-        }
-    }
-    std::vector<Float64> zPrior_modif(n, 0.0);
-    for (UInt32 k = 0; k < n; k++)
-    {
-        zPrior_modif[k] = logprior1[k] + logprior2[k] - maxi;
-    }
-
-    Float64 sumExpModif = 0.0;
-    for (UInt32 k = 0; k < n; k++)
-    {
-        sumExpModif += exp(zPrior_modif[k]);
-    }
+    logzPriorCombined.resize(n);
+    CPdfzNumerics::Add(logprior1.data(), logprior2.data(), logzPriorCombined.data(), n);
 
+    // NB: the normalization term is kept as originally implemented,
+    // log(exp(maxi))*sum(exp(val-maxi)) with maxi>=DBL_MIN: it vanishes for
+    // log-priors <= 0, leaving the combined prior unnormalized
+    Float64 maxi = std::max(DBL_MIN, CPdfzNumerics::Max(logzPriorCombined.data(), n));
+    Float64 sumExpModif = exp(CPdfzNumerics::LogSumExp(logzPriorCombined.data(), n) - maxi);
     Float64 logSum = log(exp(maxi)) * sumExpModif;
     Float64 lognormterm = 0.;
     if(normalizePrior)
@@ -991,23 +711,24 @@ std::vector<Float64> CPdfz::CombineLogZPrior(std::vector<Float64> logprior1,
         lognormterm=logSum;
     }
 
-    logzPriorCombined.resize(n);
-    for (Int32 k = 0; k < n; k++)
-    {
-        logzPriorCombined[k] = logprior1[k] + logprior2[k] - lognormterm;
-    }
+    CPdfzNumerics::AddScalar(logzPriorCombined.data(), -lognormterm, n);
 
     return logzPriorCombined;
 }
 
-Int32 CPdfz::Marginalize(TFloat64List redshifts,
-                         std::vector<TFloat64List> meritResults,
-                         std::vector<TFloat64List> zPriors, Float64 cstLog,
+/**
+ * @brief CPdfz::Marginalize
+ * Marginalizes the z-pdf over all the models, see CPdfzMarginalizer for the
+ * streaming version used when the merit curves are produced one at a time.
+ * @return 0: success, -1: pdf computation failed, -9: size mismatch, -99: no
+ * merit curve
+ */
+Int32 CPdfz::Marginalize(const TFloat64List& redshifts,
+                         const std::vector<TFloat64List>& meritResults,
+                         const std::vector<TFloat64List>& zPriors, Float64 cstLog,
                          std::shared_ptr<CPdfMargZLogResult> postmargZResult,
-                         std::vector<Float64> modelPriors)
+                         const std::vector<Float64>& modelPriors)
 {
-    bool verbose = false;
-
     if (meritResults.size() != zPriors.size())
     {
         Log.LogError("Pdfz: Pdfz marginalize problem. merit.size (%d) != "
@@ -1023,217 +744,20 @@ Int32 CPdfz::Marginalize(TFloat64List redshifts,
         return -99;
     }
 
-    // check merit curves. Maybe this should be assert stuff ?
-    for (Int32 km = 0; km < meritResults.size(); km++)
-    {
-        TFloat64List _merit = meritResults[km];
-        Bool invalidFound = false;
-        for (Int32 kz = 0; kz < _merit.size(); kz++)
-        {
-            if (_merit[kz] != _merit[kz])
-            {
-                Log.LogError("    CPdfz::Marginalize - merit result #%d has at "
-                             "least one nan or invalid value at index=%d",
-                             km, kz);
-                invalidFound = true;
-            }
-            if (invalidFound)
-            {
-                break;
-            }
-        }
-    }
-
-    Bool initPostMarg = false;
-    std::vector<UInt32> nSum;
-
-    Float64 MaxiLogEvidence = -DBL_MAX;
-    TFloat64List LogEvidencesWPriorM;
-    Float64 sumModifiedEvidences = 0;
-
-    std::vector<Float64> logPriorModel;
-    if (/*false &&*/ modelPriors.size() != meritResults.size())
-    {
-        Float64 priorModelCst = 1.0 / ((Float64)meritResults.size());
-        Log.LogInfo(
-            "Pdfz: Marginalize: no priors loaded, using constant priors (=%f)",
-            priorModelCst);
-        for (Int32 km = 0; km < meritResults.size(); km++)
-        {
-            logPriorModel.push_back(log(priorModelCst));
-        }
-    } else
-    {
-        /*
-        //override modelPriors with pypelid 10 knn templates priors
-        logPriorModel.push_back(log(0.1490));
-        logPriorModel.push_back(log(0.0794));
-        logPriorModel.push_back(log(0.0744));
-        logPriorModel.push_back(log(0.0836));
-        logPriorModel.push_back(log(0.1089));
-        logPriorModel.push_back(log(0.1124));
-        logPriorModel.push_back(log(0.0786));
-        logPriorModel.push_back(log(0.1563));
-        logPriorModel.push_back(log(0.0509));
-        logPriorModel.push_back(log(0.1060));
-        //*/
-        for (Int32 km = 0; km < meritResults.size(); km++)
-        {
-            logPriorModel.push_back(log(modelPriors[km]));
-        }
-
-        // logging priors used
-        Float64 sumPriors = 0.;
-        for (Int32 km = 0; km < meritResults.size(); km++)
-        {
-            sumPriors += exp(logPriorModel[km]);
-            Log.LogDetail("Pdfz: Marginalize: for model k=%d, using prior=%f", km,
-                        exp(logPriorModel[km]));
-        }
-        Log.LogInfo("Pdfz: Marginalize: sumPriors=%f", sumPriors);
-        if (sumPriors > 1.1 || sumPriors < 0.9)
-        {
-            Log.LogError("Pdfz: sumPriors should be close to 1... !!!");
-        }
-    }
-
+    Bool useModelPriors = (modelPriors.size() == meritResults.size());
+    CPdfzMarginalizer marginalizer;
     for (Int32 km = 0; km < meritResults.size(); km++)
     {
-        // Todo: Check if the status is OK ?
-        // meritResult->Status[i] == COperator::nStatus_OK
-
-        CPdfz pdfz;
-        TFloat64List logProba;
-        Float64 logEvidence;
-        Int32 retPdfz = pdfz.Compute(meritResults[km], redshifts, cstLog,
-                                     zPriors[km], logProba, logEvidence);
-        if (retPdfz != 0)
+        Float64 modelPrior = useModelPriors ? modelPriors[km] : -1.0;
+        Int32 retAdd = marginalizer.Add(redshifts, meritResults[km],
+                                        zPriors[km], cstLog, modelPrior);
+        if (retAdd != 0)
         {
-            Log.LogError("Pdfz: Pdfz computation - compute logEvidence: failed "
-                         "for result km=%d",
-                         km);
-            return -1;
-        } else
-        {
-            //            if(verbose)
-            //            {
-            //                Log.LogInfo("Pdfz: Marginalize: for km=%d,
-            //                logEvidence=%e", km, MaxiLogEvidence);
-            //            }
-            Float64 logEvidenceWPriorM = logEvidence + logPriorModel[km];
-
-            LogEvidencesWPriorM.push_back(logEvidenceWPriorM);
-            if (MaxiLogEvidence < logEvidenceWPriorM)
-            {
-                MaxiLogEvidence = logEvidenceWPriorM;
-            }
+            return retAdd;
         }
     }
-    if (verbose)
-    {
-        Log.LogInfo("Pdfz: Marginalize: MaxiLogEvidence=%e", MaxiLogEvidence);
-    }
 
-    // Using computational trick to sum the evidences
-    for (Int32 k = 0; k < LogEvidencesWPriorM.size(); k++)
-    {
-        sumModifiedEvidences += exp(LogEvidencesWPriorM[k] - MaxiLogEvidence);
-    }
-    Float64 logSumEvidence = MaxiLogEvidence + log(sumModifiedEvidences);
-    if (verbose)
-    {
-        Log.LogInfo("Pdfz: Marginalize: logSumEvidence=%e", logSumEvidence);
-    }
-
-    for (Int32 km = 0; km < meritResults.size(); km++)
-    {
-        if (verbose)
-        {
-            Log.LogInfo("Pdfz: Marginalize: processing chi2-result km=%d", km);
-        }
-
-        // Todo: Check if the status is OK ?
-        // meritResult->Status[i] == COperator::nStatus_OK
-
-        CPdfz pdfz;
-        TFloat64List logProba;
-        Float64 logEvidence;
-        Int32 retPdfz = pdfz.Compute(meritResults[km], redshifts, cstLog,
-                                     zPriors[km], logProba, logEvidence);
-        if (retPdfz != 0)
-        {
-            Log.LogError("Pdfz: Pdfz computation failed for result km=%d", km);
-            return -1;
-        } else
-        {
-            if (!initPostMarg)
-            {
-                nSum.resize(redshifts.size());
-                postmargZResult->countTPL =
-                    redshifts.size(); // assumed 1 model per z
-                postmargZResult->Redshifts.resize(redshifts.size());
-                postmargZResult->valProbaLog.resize(redshifts.size());
-                for (UInt32 k = 0; k < redshifts.size(); k++)
-                {
-                    postmargZResult->Redshifts[k] = redshifts[k];
-                    postmargZResult->valProbaLog[k] = -INFINITY;
-                    nSum[k] = 0;
-                }
-                initPostMarg = true;
-            } else
-            {
-                // check if the redshift bins are the same
-                for (UInt32 k = 0; k < redshifts.size(); k++)
-                {
-                    if (postmargZResult->Redshifts[k] != redshifts[k])
-                    {
-                        Log.LogError("pdfz: Pdfz computation (z-bins "
-                                     "comparison) failed for result km=%d",
-                                     km);
-                        break;
-                    }
-                }
-            }
-
-            postmargZResult->valEvidenceLog = logSumEvidence;
-            for (UInt32 k = 0; k < redshifts.size(); k++)
-            {
-                if (true /*meritResult->Status[k]== COperator::nStatus_OK*/) // todo: check (temporarily considers status is always OK for linemodel tplshape)
-                {
-                    Float64 logValProba = postmargZResult->valProbaLog[k];
-                    Float64 logValProbaAdd = logProba[k] + logPriorModel[km] +
-                                             logEvidence - logSumEvidence;
-                    Float64 maxP = logValProba;
-                    if (maxP < logValProbaAdd)
-                    {
-                        maxP = logValProbaAdd;
-                    }
-                    Float64 valExp =
-                        exp(logValProba - maxP) + exp(logValProbaAdd - maxP);
-                    postmargZResult->valProbaLog[k] = maxP + log(valExp);
-                    nSum[k]++;
-                }
-            }
-        }
-    }
-
-    // THIS DOES NOT ALLOW Marginalization with coverage<100% for ALL templates
-    for (UInt32 k = 0; k < postmargZResult->Redshifts.size(); k++)
-    {
-        if (nSum[k] != meritResults.size())
-        {
-            postmargZResult->valProbaLog[k] = NAN;
-            Log.LogError("Pdfz: Pdfz computation failed. For z=%f, nSum=%d",
-                         postmargZResult->Redshifts[k], nSum[k]);
-            Log.LogError("Pdfz: Pdfz computation failed. For z=%f, "
-                         "meritResults.size()=%d",
-                         postmargZResult->Redshifts[k], meritResults.size());
-            Log.LogError("Pdfz: Pdfz computation failed. Not all templates "
-                         "have 100 percent coverage for all redshifts!");
-        }
-    }
-
-    return 0;
+    return marginalizer.Finalize(postmargZResult);
 }
 
 // This mathematically does not correspond to any valid method for combining
@@ -0,0 +1,167 @@
+#include <RedshiftLibrary/statistics/pdfzmarginalizer.h>
+#include <RedshiftLibrary/statistics/pdfz.h>
+#include <RedshiftLibrary/statistics/pdfznumerics.h>
+
+#include <RedshiftLibrary/log/log.h>
+
+#include <math.h>
+
+using namespace NSEpic;
+using namespace std;
+
+CPdfzMarginalizer::CPdfzMarginalizer() :
+    m_logSumEvidence(-INFINITY),
+    m_nModels(0),
+    m_nModelPriors(0),
+    m_sumModelPriors(0.0),
+    m_failed(false)
+{
+}
+
+CPdfzMarginalizer::~CPdfzMarginalizer() {}
+
+UInt32 CPdfzMarginalizer::GetModelCount() const
+{
+    return m_nModels;
+}
+
+/**
+ * @brief CPdfzMarginalizer::Add
+ * Accumulates the merit curve of one model. The curve is not stored: only
+ * the running log-sum-exp of the weighted posteriors and of the weighted
+ * evidences are updated.
+ * @param modelPrior: prior of this model, or a negative value to use
+ * constant model priors. Either all or none of the models must have a prior.
+ * @return 0: success, -1: pdf computation failed, -9: incompatible z grid
+ */
+Int32 CPdfzMarginalizer::Add(const TFloat64List& redshifts,
+                             const TFloat64List& merits,
+                             const TFloat64List& logZPrior,
+                             Float64 cstLog,
+                             Float64 modelPrior)
+{
+    if (m_nModels == 0)
+    {
+        m_redshifts = redshifts;
+        m_logSumProba.assign(redshifts.size(), -INFINITY);
+    } else if (redshifts.size() != m_redshifts.size())
+    {
+        Log.LogError("Pdfz: Pdfz marginalize problem. redshifts.size (%d) != "
+                     "%d for result km=%d",
+                     redshifts.size(), m_redshifts.size(), m_nModels);
+        m_failed = true;
+        return -9;
+    } else
+    {
+        // check if the redshift bins are the same
+        for (UInt32 k = 0; k < redshifts.size(); k++)
+        {
+            if (m_redshifts[k] != redshifts[k])
+            {
+                Log.LogError("pdfz: Pdfz computation (z-bins "
+                             "comparison) failed for result km=%d",
+                             m_nModels);
+                break;
+            }
+        }
+    }
+
+    for (UInt32 kz = 0; kz < merits.size(); kz++)
+    {
+        if (merits[kz] != merits[kz])
+        {
+            Log.LogError("    CPdfz::Marginalize - merit result #%d has at "
+                         "least one nan or invalid value at index=%d",
+                         m_nModels, kz);
+            break;
+        }
+    }
+
+    CPdfz pdfz;
+    TFloat64List logProba;
+    Float64 logEvidence;
+    Int32 retPdfz = pdfz.Compute(merits, redshifts, cstLog, logZPrior,
+                                 logProba, logEvidence);
+    if (retPdfz != 0)
+    {
+        Log.LogError("Pdfz: Pdfz computation failed for result km=%d",
+                     m_nModels);
+        m_failed = true;
+        return -1;
+    }
+
+    // constant model priors cancel out in the posterior, they are only
+    // applied to the evidence when finalizing
+    Float64 logPriorModel = 0.0;
+    if (modelPrior >= 0.0)
+    {
+        logPriorModel = log(modelPrior);
+        m_sumModelPriors += modelPrior;
+        m_nModelPriors++;
+        Log.LogDetail("Pdfz: Marginalize: for model k=%d, using prior=%f",
+                      m_nModels, modelPrior);
+    }
+
+    Float64 logEvidenceWPriorM = logEvidence + logPriorModel;
+    m_logSumEvidence = CPdfzNumerics::LogAddExp(m_logSumEvidence, logEvidenceWPriorM);
+    CPdfzNumerics::LogAddExp(m_logSumProba.data(), logProba.data(),
+                             logEvidenceWPriorM, m_redshifts.size());
+    m_nModels++;
+
+    return 0;
+}
+
+/**
+ * @brief CPdfzMarginalizer::Finalize
+ * Normalizes the accumulated posteriors by the sum of the evidences and
+ * fills the marginalized z-pdf.
+ * @return 0: success, -1: a model failed, -9: inconsistent model priors,
+ * -99: no model was added
+ */
+Int32 CPdfzMarginalizer::Finalize(std::shared_ptr<CPdfMargZLogResult> postmargZResult)
+{
+    if (m_nModels < 1 || m_redshifts.size() < 1)
+    {
+        Log.LogError("Pdfz: Pdfz marginalize problem. merit.size (%d) or "
+                     "redshifts.size (%d) is zero !",
+                     m_nModels, m_redshifts.size());
+        return -99;
+    }
+    if (m_failed)
+    {
+        return -1;
+    }
+
+    Float64 logSumEvidence = m_logSumEvidence;
+    if (m_nModelPriors == 0)
+    {
+        Float64 priorModelCst = 1.0 / ((Float64)m_nModels);
+        Log.LogInfo(
+            "Pdfz: Marginalize: no priors loaded, using constant priors (=%f)",
+            priorModelCst);
+        logSumEvidence += log(priorModelCst);
+    } else if (m_nModelPriors != m_nModels)
+    {
+        Log.LogError("Pdfz: Marginalize: found priors for %d models out of %d",
+                     m_nModelPriors, m_nModels);
+        return -9;
+    } else
+    {
+        Log.LogInfo("Pdfz: Marginalize: sumPriors=%f", m_sumModelPriors);
+        if (m_sumModelPriors > 1.1 || m_sumModelPriors < 0.9)
+        {
+            Log.LogError("Pdfz: sumPriors should be close to 1... !!!");
+        }
+    }
+
+    postmargZResult->countTPL = m_redshifts.size(); // assumed 1 model per z
+    postmargZResult->Redshifts = m_redshifts;
+    postmargZResult->valProbaLog.resize(m_redshifts.size());
+    for (UInt32 k = 0; k < m_redshifts.size(); k++)
+    {
+        postmargZResult->valProbaLog[k] = m_logSumProba[k] - m_logSumEvidence;
+    }
+    postmargZResult->valEvidenceLog = logSumEvidence;
+
+    return 0;
+}
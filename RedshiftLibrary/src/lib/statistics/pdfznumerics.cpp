@@ -0,0 +1,174 @@
+#include <RedshiftLibrary/statistics/pdfznumerics.h>
+
+#include <float.h>
+#include <math.h>
+#include <vector>
+
+using namespace NSEpic;
+using namespace std;
+
+/**
+ * Maximum of the array, NaN values are ignored. Returns -INFINITY for an
+ * empty array.
+ */
+Float64 CPdfzNumerics::Max(const Float64* x, UInt32 n)
+{
+    Float64 vmax = -INFINITY;
+    for (UInt32 k = 0; k < n; k++)
+    {
+        vmax = x[k] > vmax ? x[k] : vmax;
+    }
+    return vmax;
+}
+
+void CPdfzNumerics::MinMax(const Float64* x, UInt32 n, Float64& vmin, Float64& vmax)
+{
+    vmin = DBL_MAX;
+    vmax = -DBL_MAX;
+    for (UInt32 k = 0; k < n; k++)
+    {
+        vmin = x[k] < vmin ? x[k] : vmin;
+        vmax = x[k] > vmax ? x[k] : vmax;
+    }
+}
+
+/**
+ * log(exp(a)+exp(b)), robust to -INFINITY on either side
+ */
+Float64 CPdfzNumerics::LogAddExp(Float64 a, Float64 b)
+{
+    Float64 maxP = a > b ? a : b;
+    if (maxP == -INFINITY)
+    {
+        return -INFINITY;
+    }
+    return maxP + log1p(exp(-fabs(a - b)));
+}
+
+/**
+ * acc[k] = log(exp(acc[k]) + exp(x[k]+shift))
+ */
+void CPdfzNumerics::LogAddExp(Float64* acc, const Float64* x, Float64 shift, UInt32 n)
+{
+    for (UInt32 k = 0; k < n; k++)
+    {
+        Float64 a = acc[k];
+        Float64 b = x[k] + shift;
+        Float64 maxP = a > b ? a : b;
+        Float64 sum = maxP + log1p(exp(-fabs(a - b)));
+        acc[k] = maxP == -INFINITY ? maxP : sum;
+    }
+}
+
+/**
+ * log(sum_k exp(x[k]))
+ */
+Float64 CPdfzNumerics::LogSumExp(const Float64* x, UInt32 n)
+{
+    Float64 maxi = Max(x, n);
+    if (maxi == -INFINITY || maxi == INFINITY)
+    {
+        return maxi;
+    }
+    Float64 sum = 0.0;
+    for (UInt32 k = 0; k < n; k++)
+    {
+        sum += exp(x[k] - maxi);
+    }
+    return maxi + log(sum);
+}
+
+/**
+ * log(sum_k w[k]*exp(x[k])), with w[k] >= 0
+ */
+Float64 CPdfzNumerics::LogSumExpWeighted(const Float64* x, const Float64* w, UInt32 n)
+{
+    Float64 maxi = Max(x, n);
+    if (maxi == -INFINITY || maxi == INFINITY)
+    {
+        return maxi;
+    }
+    Float64 sum = 0.0;
+    for (UInt32 k = 0; k < n; k++)
+    {
+        sum += w[k] * exp(x[k] - maxi);
+    }
+    return maxi + log(sum);
+}
+
+/**
+ * Width of the rectangle centered on each sample of an irregular grid: half
+ * a step at both ends, and the distance between the mid-points elsewhere.
+ */
+void CPdfzNumerics::RectWidths(const Float64* z, UInt32 n, Float64* widths)
+{
+    if (n < 2)
+    {
+        for (UInt32 k = 0; k < n; k++)
+        {
+            widths[k] = 0.0;
+        }
+        return;
+    }
+    widths[0] = (z[1] - z[0]) * 0.5;
+    for (UInt32 k = 1; k < n - 1; k++)
+    {
+        widths[k] = (z[k + 1] - z[k - 1]) * 0.5;
+    }
+    widths[n - 1] = (z[n - 1] - z[n - 2]) * 0.5;
+}
+
+/**
+ * log of the trapezoidal integral of exp(logy) over the (irregular) grid z.
+ * Returns -INFINITY if there are less than 2 samples.
+ */
+Float64 CPdfzNumerics::LogTrapzExp(const Float64* z, const Float64* logy, UInt32 n)
+{
+    Float64 maxi = Max(logy, n);
+    if (n < 2 || maxi == -INFINITY || maxi == INFINITY)
+    {
+        return n < 2 ? -INFINITY : maxi;
+    }
+
+    std::vector<Float64> modifiedExp(n);
+    for (UInt32 k = 0; k < n; k++)
+    {
+        modifiedExp[k] = exp(logy[k] - maxi);
+    }
+    Float64 sum = 0.0;
+    for (UInt32 k = 1; k < n; k++)
+    {
+        sum += (modifiedExp[k] + modifiedExp[k - 1]) * (z[k] - z[k - 1]);
+    }
+    return maxi + log(sum * 0.5);
+}
+
+/**
+ * log of the rectangle-rule integral of exp(logy) over the (irregular) grid z,
+ * see RectWidths.
+ */
+Float64 CPdfzNumerics::LogRectExp(const Float64* z, const Float64* logy, UInt32 n)
+{
+    std::vector<Float64> widths(n);
+    RectWidths(z, n, widths.data());
+    return LogSumExpWeighted(logy, widths.data(), n);
+}
+
+/**
+ * out[k] = a[k] + b[k], out may alias a or b
+ */
+void CPdfzNumerics::Add(const Float64* a, const Float64* b, Float64* out, UInt32 n)
+{
+    for (UInt32 k = 0; k < n; k++)
+    {
+        out[k] = a[k] + b[k];
+    }
+}
+
+void CPdfzNumerics::AddScalar(Float64* x, Float64 c, UInt32 n)
+{
+    for (UInt32 k = 0; k < n; k++)
+    {
+        x[k] += c;
+    }
+}
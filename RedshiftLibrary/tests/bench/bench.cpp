@@ -0,0 +1,416 @@
+/**
+ * Performance harness for the main operators and methods.
+ *
+ * Every benchmark runs on reproducible inputs: synthetic spectra and templates generated with a fixed seed,
+ * the line catalog and the VVDS spectrum of tests/src/data. Each case is timed over several repetitions
+ * and the results are written as a JSON document, so that two releases can be compared.
+ *
+ * Usage: bench [--output bench.json] [--repeat 3] [--filter chisquare] [--quick]
+ */
+#include <RedshiftLibrary/common/datatypes.h>
+#include <RedshiftLibrary/common/mask.h>
+#include <RedshiftLibrary/continuum/irregularsamplingmedian.h>
+#include <RedshiftLibrary/continuum/median.h>
+#include <RedshiftLibrary/log/log.h>
+#include <RedshiftLibrary/operator/chisquare2.h>
+#include <RedshiftLibrary/operator/chisquareloglambda.h>
+#include <RedshiftLibrary/operator/linemodel.h>
+#include <RedshiftLibrary/operator/linemodelresult.h>
+#include <RedshiftLibrary/operator/pdfMargZLogResult.h>
+#include <RedshiftLibrary/processflow/datastore.h>
+#include <RedshiftLibrary/processflow/parameterstore.h>
+#include <RedshiftLibrary/processflow/resultstore.h>
+#include <RedshiftLibrary/ray/catalog.h>
+#include <RedshiftLibrary/spectrum/io/fitswriter.h>
+#include <RedshiftLibrary/spectrum/io/genericreader.h>
+#include <RedshiftLibrary/spectrum/spectrum.h>
+#include <RedshiftLibrary/spectrum/template/catalog.h>
+#include <RedshiftLibrary/spectrum/template/template.h>
+#include <RedshiftLibrary/statistics/pdfz.h>
+#include <RedshiftLibrary/version.h>
+
+#include "test-config.h"
+
+#include <boost/chrono.hpp>
+#include <boost/filesystem.hpp>
+#include <boost/format.hpp>
+#include <boost/program_options.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <math.h>
+#include <random>
+#include <string>
+#include <vector>
+
+using namespace NSEpic;
+namespace bfs = boost::filesystem;
+namespace po = boost::program_options;
+
+typedef std::map<std::string, Float64> TBenchParams;
+
+struct SBenchResult
+{
+    std::string Name;
+    TBenchParams Params;
+    TFloat64List Seconds;
+};
+
+static const Float64 benchRedshift = 1.2345;
+
+/**
+ * Runs fn repeat times (after one warm-up call) and stores the wall clock durations.
+ * setup, if set, is called before each run and is not timed.
+ */
+static void RunBench( const std::string& name, const TBenchParams& params, Int32 repeat, const std::string& filter,
+                      std::function<void()> setup, std::function<void()> fn, std::vector<SBenchResult>& results )
+{
+    if( !filter.empty() && name.find( filter ) == std::string::npos )
+    {
+        return;
+    }
+
+    SBenchResult result;
+    result.Name = name;
+    result.Params = params;
+
+    for( Int32 k=-1; k<repeat; k++ )
+    {
+        if( setup )
+            setup();
+        boost::chrono::steady_clock::time_point start = boost::chrono::steady_clock::now();
+        fn();
+        boost::chrono::steady_clock::time_point stop = boost::chrono::steady_clock::now();
+        if( k>=0 )
+            result.Seconds.push_back( boost::chrono::duration_cast<boost::chrono::microseconds>( stop - start ).count() / 1e6 );
+    }
+
+    Float64 best = *std::min_element( result.Seconds.begin(), result.Seconds.end() );
+    std::cerr << boost::format( "%-28s" ) % name;
+    for( TBenchParams::const_iterator it=params.begin(); it!=params.end(); it++ )
+    {
+        std::cerr << boost::format( " %s=%g" ) % it->first % it->second;
+    }
+    std::cerr << boost::format( " : %.4f s" ) % best << std::endl;
+
+    results.push_back( result );
+}
+
+static void WriteJson( const std::string& path, const std::vector<SBenchResult>& results, Int32 repeat )
+{
+    std::ofstream out( path.c_str() );
+    out.precision( 9 );
+    out << "{\n";
+    out << "  \"version\": \"" << get_version() << "\",\n";
+    out << "  \"repeat\": " << repeat << ",\n";
+    out << "  \"benchmarks\": [\n";
+    for( UInt32 i=0; i<results.size(); i++ )
+    {
+        const SBenchResult& r = results[i];
+        Float64 best = *std::min_element( r.Seconds.begin(), r.Seconds.end() );
+        Float64 mean = 0.0;
+        for( UInt32 k=0; k<r.Seconds.size(); k++ )
+            mean += r.Seconds[k];
+        mean /= r.Seconds.size();
+
+        out << "    {\"name\": \"" << r.Name << "\", \"params\": {";
+        for( TBenchParams::const_iterator it=r.Params.begin(); it!=r.Params.end(); it++ )
+        {
+            out << ( it==r.Params.begin() ? "" : ", " ) << "\"" << it->first << "\": " << it->second;
+        }
+        out << "}, \"min_s\": " << best << ", \"mean_s\": " << mean << ", \"runs_s\": [";
+        for( UInt32 k=0; k<r.Seconds.size(); k++ )
+        {
+            out << ( k==0 ? "" : ", " ) << r.Seconds[k];
+        }
+        out << "]}" << ( i+1<results.size() ? "," : "" ) << "\n";
+    }
+    out << "  ]\n}\n";
+}
+
+/**
+ * Continuum (power law with a 4000A break) and gaussian lines of the catalog, lines redshifted by z.
+ */
+static Float64 SyntheticFlux( Float64 lambda, Float64 z, const CRayCatalog::TRayVector& rays, Float64 lineAmp )
+{
+    Float64 restLambda = lambda / ( 1.0 + z );
+    Float64 flux = 1e-17 * pow( restLambda / 5000.0, -1.5 ) * ( restLambda < 4000.0 ? 0.6 : 1.0 );
+    for( UInt32 k=0; k<rays.size(); k++ )
+    {
+        Float64 sigma = rays[k].GetPosition() * 200.0 / 3e5;
+        Float64 dx = ( restLambda - rays[k].GetPosition() ) / sigma;
+        if( fabs( dx ) < 8.0 )
+        {
+            Float64 sign = rays[k].GetType() == CRay::nType_Emission ? 1.0 : -0.3;
+            flux += sign * lineAmp * 1e-17 * exp( -0.5 * dx * dx );
+        }
+    }
+    return flux;
+}
+
+static CSpectrum MakeSpectrum( Int32 nSamples, const CRayCatalog::TRayVector& rays, std::mt19937& rng )
+{
+    const Float64 lambdaMin = 3800.0;
+    const Float64 lambdaMax = 12600.0;
+    std::normal_distribution<Float64> noise( 0.0, 1.0 );
+
+    CSpectrumSpectralAxis spectralAxis( nSamples, false );
+    CSpectrumFluxAxis fluxAxis( nSamples );
+    TFloat64List& error = fluxAxis.GetError();
+    error.resize( nSamples );
+    for( Int32 i=0; i<nSamples; i++ )
+    {
+        Float64 lambda = lambdaMin + ( lambdaMax - lambdaMin ) * i / ( nSamples - 1 );
+        spectralAxis[i] = lambda;
+        error[i] = 1e-18;
+        fluxAxis[i] = SyntheticFlux( lambda, benchRedshift, rays, 3.0 ) + error[i] * noise( rng );
+    }
+    CSpectrum spectrum( spectralAxis, fluxAxis );
+    spectrum.SetName( "bench" );
+    return spectrum;
+}
+
+static std::shared_ptr<CTemplate> MakeTemplate( const std::string& name, Int32 nSamples, const CRayCatalog::TRayVector& rays )
+{
+    const Float64 lambdaMin = 900.0;
+    const Float64 lambdaMax = 13000.0;
+
+    CSpectrumSpectralAxis spectralAxis( nSamples, false );
+    CSpectrumFluxAxis fluxAxis( nSamples );
+    for( Int32 i=0; i<nSamples; i++ )
+    {
+        Float64 lambda = lambdaMin + ( lambdaMax - lambdaMin ) * i / ( nSamples - 1 );
+        spectralAxis[i] = lambda;
+        fluxAxis[i] = SyntheticFlux( lambda, 0.0, rays, 1.0 );
+    }
+    return std::shared_ptr<CTemplate>( new CTemplate( name, "galaxy", spectralAxis, fluxAxis ) );
+}
+
+static TFloat64List LogRedshiftGrid( Float64 zMin, Float64 zMax, Float64 step )
+{
+    TFloat64List redshifts;
+    for( Float64 z=zMin; z<=zMax; z=( 1.0 + z ) * ( 1.0 + step ) - 1.0 )
+    {
+        redshifts.push_back( z );
+    }
+    return redshifts;
+}
+
+int main( int argc, char** argv )
+{
+    std::string outputPath;
+    std::string filter;
+    Int32 repeat;
+
+    po::options_description desc( "Options" );
+    desc.add_options()
+        ( "help,h", "Print this help" )
+        ( "output,o", po::value<std::string>( &outputPath )->default_value( "bench.json" ), "JSON output file" )
+        ( "repeat,r", po::value<Int32>( &repeat )->default_value( 3 ), "Timed runs per benchmark" )
+        ( "filter,f", po::value<std::string>( &filter )->default_value( "" ), "Only run the benchmarks whose name contains this string" )
+        ( "quick,q", "Smallest grid sizes only" );
+    po::variables_map vm;
+    po::store( po::parse_command_line( argc, argv, desc ), vm );
+    po::notify( vm );
+    if( vm.count( "help" ) )
+    {
+        std::cout << desc << std::endl;
+        return 0;
+    }
+    Bool quick = vm.count( "quick" ) > 0;
+    repeat = std::max( repeat, 1 );
+
+    std::vector<SBenchResult> results;
+    std::mt19937 rng( 20190101 );
+
+    CRayCatalog rayCatalog;
+    std::string rayCatalogPath = std::string( DATA_ROOT_DIR ) + "RayTestCase/RayMatchingVVDS/raycatalog.txt";
+    rayCatalog.Load( rayCatalogPath.c_str() );
+    CRayCatalog::TRayVector rays = rayCatalog.GetList();
+
+    Int32 spcSizesAll[] = { 2000, 8000, 32000 };
+    Float64 zStepsAll[] = { 1e-3, 2e-4 };
+    std::vector<Int32> spcSizes( spcSizesAll, spcSizesAll + ( quick ? 1 : 3 ) );
+    std::vector<Float64> zSteps( zStepsAll, zStepsAll + ( quick ? 1 : 2 ) );
+    const TFloat64Range lambdaRange( 3900.0, 12500.0 );
+    const std::string calibrationPath = "";
+
+    for( UInt32 iSize=0; iSize<spcSizes.size(); iSize++ )
+    {
+        Int32 nSpc = spcSizes[iSize];
+        CSpectrum spectrum = MakeSpectrum( nSpc, rays, rng );
+        std::shared_ptr<CTemplate> tpl = MakeTemplate( "bench_tpl", 4*nSpc, rays );
+
+        // Continuum removal
+        TBenchParams sizeParams;
+        sizeParams["npix"] = nSpc;
+        RunBench( "continuum_median", sizeParams, repeat, filter, nullptr, [&]() {
+                CContinuumMedian continuum;
+                CSpectrumFluxAxis noContinuumFluxAxis;
+                continuum.RemoveContinuum( spectrum, noContinuumFluxAxis );
+            }, results );
+        RunBench( "continuum_irregularmedian", sizeParams, repeat, filter, nullptr, [&]() {
+                CContinuumIrregularSamplingMedian continuum;
+                CSpectrumFluxAxis noContinuumFluxAxis;
+                continuum.RemoveContinuum( spectrum, noContinuumFluxAxis );
+            }, results );
+
+        for( UInt32 iStep=0; iStep<zSteps.size(); iStep++ )
+        {
+            TFloat64List redshifts = LogRedshiftGrid( 0.0, 2.5, zSteps[iStep] );
+            TBenchParams params = sizeParams;
+            params["nz"] = redshifts.size();
+            params["zstep"] = zSteps[iStep];
+
+            std::vector<CMask> noMasks;
+            RunBench( "chisquare2", params, repeat, filter, nullptr, [&]() {
+                    COperatorChiSquare2 chiSquare( calibrationPath );
+                    chiSquare.Compute( spectrum, *tpl, lambdaRange, redshifts, 0.8, noMasks, "lin", 0, 0 );
+                }, results );
+            RunBench( "chisquare2_finegrid", params, repeat, filter, nullptr, [&]() {
+                    COperatorChiSquare2 chiSquare( calibrationPath );
+                    chiSquare.Compute( spectrum, *tpl, lambdaRange, redshifts, 0.8, noMasks, "precomputedfinegrid", 0, 0 );
+                }, results );
+            RunBench( "chisquareloglambda", params, repeat, filter, nullptr, [&]() {
+                    COperatorChiSquareLogLambda chiSquare( calibrationPath );
+                    chiSquare.enableSpcLogRebin( true );
+                    chiSquare.Compute( spectrum, *tpl, lambdaRange, redshifts, 0.8, noMasks, "lin", 0, 0 );
+                }, results );
+        }
+    }
+
+    // Linemodel first and second pass, on the smallest spectrum
+    {
+        CSpectrum spectrum = MakeSpectrum( spcSizes[0], rays, rng );
+        CSpectrum spectrumContinuum = spectrum;
+        CContinuumMedian continuum;
+        CSpectrumFluxAxis noContinuumFluxAxis;
+        continuum.RemoveContinuum( spectrum, noContinuumFluxAxis );
+        CSpectrumFluxAxis& continuumFluxAxis = spectrumContinuum.GetFluxAxis();
+        for( UInt32 i=0; i<continuumFluxAxis.GetSamplesCount(); i++ )
+        {
+            continuumFluxAxis[i] -= noContinuumFluxAxis[i];
+        }
+
+        CTemplateCatalog tplCatalog;
+        tplCatalog.Add( MakeTemplate( "bench_tpl", 4*spcSizes[0], rays ) );
+        TStringList tplCategories( 1, "galaxy" );
+
+        for( UInt32 iStep=0; iStep<zSteps.size(); iStep++ )
+        {
+            TFloat64List redshifts = LogRedshiftGrid( 0.0, 2.5, zSteps[iStep] );
+            TBenchParams params;
+            params["npix"] = spcSizes[0];
+            params["nz"] = redshifts.size();
+            params["zstep"] = zSteps[iStep];
+
+            COperatorResultStore resultStore;
+            CParameterStore parameterStore;
+            CDataStore dataStore( resultStore, parameterStore );
+
+            std::shared_ptr<COperatorLineModel> linemodel;
+            std::function<void()> firstPass = [&]() {
+                linemodel = std::shared_ptr<COperatorLineModel>( new COperatorLineModel() );
+                linemodel->Init( spectrum, redshifts );
+                linemodel->ComputeFirstPass( dataStore, spectrum, spectrumContinuum, tplCatalog, tplCategories, calibrationPath,
+                                             rayCatalog, "no", "no", lambdaRange, "hybrid", "fromspectrum", "velocitydriven",
+                                             2350.0, 100.0, 300.0, "no", "all", "no", 0.001, "log", "rules" );
+            };
+            std::function<void()> candidates = [&]() {
+                firstPass();
+                std::shared_ptr<const CLineModelResult> lmresult = std::dynamic_pointer_cast<const CLineModelResult>( linemodel->getResult() );
+                TFloat64List fvals( lmresult->ChiSquare.size() );
+                for( UInt32 i=0; i<fvals.size(); i++ )
+                {
+                    fvals[i] = -lmresult->ChiSquare[i];
+                }
+                linemodel->ComputeCandidates( 5, 1, fvals, -1 );
+            };
+
+            RunBench( "linemodel_firstpass", params, repeat, filter, nullptr, firstPass, results );
+            RunBench( "linemodel_secondpass", params, repeat, filter, candidates, [&]() {
+                    linemodel->ComputeSecondPass( dataStore, spectrum, spectrumContinuum, tplCatalog, tplCategories, calibrationPath,
+                                                  rayCatalog, "no", "no", lambdaRange, 5, "hybrid", "fromspectrum", "velocitydriven",
+                                                  2350.0, 100.0, 300.0, "no", "all", "no", "rules" );
+                }, results );
+        }
+    }
+
+    // Pdfz marginalization over several models
+    {
+        Int32 nModelsAll[] = { 10, 100 };
+        std::vector<Int32> nModels( nModelsAll, nModelsAll + ( quick ? 1 : 2 ) );
+        std::uniform_real_distribution<Float64> uniform( 0.0, 50.0 );
+        for( UInt32 iStep=0; iStep<zSteps.size(); iStep++ )
+        {
+            TFloat64List redshifts = LogRedshiftGrid( 0.0, 6.0, zSteps[iStep] );
+            for( UInt32 iModels=0; iModels<nModels.size(); iModels++ )
+            {
+                std::vector<TFloat64List> merits( nModels[iModels], TFloat64List( redshifts.size() ) );
+                for( UInt32 k=0; k<merits.size(); k++ )
+                {
+                    for( UInt32 i=0; i<redshifts.size(); i++ )
+                    {
+                        Float64 dz = ( redshifts[i] - benchRedshift ) / 0.01;
+                        merits[k][i] = 1000.0 + uniform( rng ) - 200.0 * exp( -0.5 * dz * dz );
+                    }
+                }
+                CPdfz pdfz;
+                std::vector<TFloat64List> zPriors( merits.size(), pdfz.GetConstantLogZPrior( redshifts.size() ) );
+
+                TBenchParams params;
+                params["nz"] = redshifts.size();
+                params["nmodels"] = nModels[iModels];
+                RunBench( "pdfz_marginalize", params, repeat, filter, nullptr, [&]() {
+                        std::shared_ptr<CPdfMargZLogResult> postmargZResult( new CPdfMargZLogResult() );
+                        pdfz.Marginalize( redshifts, merits, zPriors, -1.0, postmargZResult );
+                    }, results );
+            }
+        }
+    }
+
+    // Spectrum readers: ascii and fits round trips of a synthetic spectrum, and the VVDS spectrum
+    {
+        bfs::path tmpDir = bfs::temp_directory_path() / bfs::unique_path( "amazed_bench_%%%%%%%%" );
+        bfs::create_directories( tmpDir );
+        for( UInt32 iSize=0; iSize<spcSizes.size(); iSize++ )
+        {
+            CSpectrum spectrum = MakeSpectrum( spcSizes[iSize], rays, rng );
+            CTemplate asTemplate( "bench", "galaxy", spectrum.GetSpectralAxis(), spectrum.GetFluxAxis() );
+            std::string asciiPath = ( tmpDir / "bench.txt" ).string();
+            std::string fitsPath = ( tmpDir / "bench.fits" ).string();
+            asTemplate.Save( asciiPath.c_str() );
+            CSpectrumIOFitsWriter writer;
+            writer.Write( fitsPath.c_str(), spectrum );
+
+            TBenchParams params;
+            params["npix"] = spcSizes[iSize];
+            RunBench( "io_read_ascii", params, repeat, filter, nullptr, [&]() {
+                    CSpectrum s;
+                    CSpectrumIOGenericReader reader;
+                    reader.Read( asciiPath.c_str(), s );
+                }, results );
+            RunBench( "io_read_fits", params, repeat, filter, nullptr, [&]() {
+                    CSpectrum s;
+                    CSpectrumIOGenericReader reader;
+                    reader.Read( fitsPath.c_str(), s );
+                }, results );
+        }
+        bfs::remove_all( tmpDir );
+
+        std::string vvdsPath = std::string( DATA_ROOT_DIR ) + "RayTestCase/RayMatchingVVDS/sc_020100776_F02P017_vmM1_red_129_1_atm_clean.fits";
+        RunBench( "io_read_fits_vvds", TBenchParams(), repeat, filter, nullptr, [&]() {
+                CSpectrum s;
+                CSpectrumIOGenericReader reader;
+                reader.Read( vvdsPath.c_str(), s );
+            }, results );
+    }
+
+    WriteJson( outputPath, results, repeat );
+    std::cerr << "Results written to " << outputPath << std::endl;
+
+    return 0;
+}
@@ -0,0 +1,114 @@
+#include <RedshiftLibrary/common/datatypes.h>
+#include <RedshiftLibrary/log/log.h>
+#include <RedshiftLibrary/method/chisquarecoarsetofine.h>
+#include <RedshiftLibrary/operator/chisquare2.h>
+#include <RedshiftLibrary/operator/chisquareresult.h>
+#include <RedshiftLibrary/spectrum/spectrum.h>
+#include <RedshiftLibrary/spectrum/template/template.h>
+
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <math.h>
+
+using namespace NSEpic;
+
+BOOST_AUTO_TEST_SUITE(ChisquareCoarseToFine)
+
+/**
+ * Smooth chi2 continuum with a deep narrow minimum and two shallower ones.
+ */
+Float64 SyntheticChi2(Float64 z)
+{
+  Float64 chi2 = 2000.0 + 300.0*sin(3.0*z);
+  chi2 -= 500.0*exp(-0.5*pow((z-0.8)/0.004, 2));
+  chi2 -= 300.0*exp(-0.5*pow((z-1.6)/0.01, 2));
+  chi2 -= 200.0*exp(-0.5*pow((z-2.3)/0.006, 2));
+  return chi2;
+}
+
+/**
+ * Chisquare2 operator returning the synthetic chi2 at the requested redshifts, and counting them.
+ */
+class CSyntheticChiSquare2 : public COperatorChiSquare2
+{
+public:
+  CSyntheticChiSquare2() : COperatorChiSquare2(""), FittedCount(0) {}
+
+  std::shared_ptr<COperatorResult> Compute(const CSpectrum& spectrum, const CTemplate& tpl,
+                                           const TFloat64Range& lambdaRange, const TFloat64List& redshifts,
+                                           Float64 overlapThreshold, std::vector<CMask> additional_spcMasks,
+                                           std::string opt_interp, Int32 opt_extinction, Int32 opt_dustFitting)
+  {
+    std::shared_ptr<CChisquareResult> result = std::shared_ptr<CChisquareResult>(new CChisquareResult());
+    result->Init(redshifts.size(), 1, 1);
+    result->Redshifts = redshifts;
+    for (UInt32 i=0; i<redshifts.size(); i++) {
+      result->ChiSquare[i] = SyntheticChi2(redshifts[i]);
+      result->FitAmplitude[i] = 1.0 + redshifts[i];
+      result->Overlap[i] = 1.0;
+      result->Status[i] = COperator::nStatus_OK;
+      result->ChiSquareIntermediate[i][0][0] = result->ChiSquare[i];
+    }
+    FittedCount += redshifts.size();
+    EstimateExtrema(*result);
+    return result;
+  }
+
+  Int32 FittedCount;
+};
+
+BOOST_AUTO_TEST_CASE(MatchesFullGrid)
+{
+  CLog logger;
+  CSpectrum spectrum;
+  CTemplate tpl("tpl", "galaxy");
+  TFloat64Range lambdaRange(4000.0, 8000.0);
+  TFloat64List redshifts = TFloat64Range(0.0, 3.0).SpreadOver(5e-4);
+  std::vector<CMask> maskList;
+  const Float64 tolerance = 1.0;
+
+  CSyntheticChiSquare2 fullOperator;
+  std::shared_ptr<CChisquareResult> full = std::dynamic_pointer_cast<CChisquareResult>(
+      fullOperator.Compute(spectrum, tpl, lambdaRange, redshifts, 1.0, maskList, "lin", 0, -1));
+  BOOST_REQUIRE(full);
+
+  CChisquareCoarseToFine coarseToFine(10, 5, tolerance);
+  BOOST_REQUIRE(coarseToFine.IsApplicable(redshifts));
+  CSyntheticChiSquare2 coarseOperator;
+  std::shared_ptr<CChisquareResult> coarse = coarseToFine.Compute(coarseOperator, spectrum, tpl, lambdaRange, redshifts,
+                                                                  1.0, maskList, "lin", 0, -1);
+  BOOST_REQUIRE(coarse);
+  BOOST_CHECK(coarse->Redshifts == full->Redshifts);
+  BOOST_CHECK(coarseOperator.FittedCount == coarseToFine.GetFittedCount());
+  BOOST_CHECK(coarseToFine.GetFittedCount() < redshifts.size()/2);
+
+  // same best redshift, and the interpolated chi2 within the tolerance
+  Int32 iBestFull = std::min_element(full->ChiSquare.begin(), full->ChiSquare.end()) - full->ChiSquare.begin();
+  Int32 iBestCoarse = std::min_element(coarse->ChiSquare.begin(), coarse->ChiSquare.end()) - coarse->ChiSquare.begin();
+  BOOST_CHECK(iBestCoarse == iBestFull);
+  Float64 maxDiff = 0.0;
+  for (UInt32 i=0; i<redshifts.size(); i++) {
+    maxDiff = std::max(maxDiff, fabs(coarse->ChiSquare[i] - full->ChiSquare[i]));
+    BOOST_CHECK(coarse->Status[i] == COperator::nStatus_OK);
+  }
+  BOOST_TEST_MESSAGE("fitted " << coarseToFine.GetFittedCount() << " of " << redshifts.size() << ", max chi2 difference " << maxDiff);
+  BOOST_CHECK_SMALL(maxDiff, tolerance);
+
+  // same extrema
+  BOOST_REQUIRE(coarse->Extrema.size() == full->Extrema.size());
+  for (UInt32 k=0; k<3; k++) {
+    BOOST_CHECK_SMALL(coarse->Extrema[k] - full->Extrema[k], 1e-6);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(NotApplicable)
+{
+  TFloat64List redshifts = TFloat64Range(0.0, 1.0).SpreadOver(0.1);
+  BOOST_CHECK(!CChisquareCoarseToFine(0, 5, 1.0).IsApplicable(redshifts));
+  BOOST_CHECK(!CChisquareCoarseToFine(10, 5, 1.0).IsApplicable(redshifts));
+  BOOST_CHECK(CChisquareCoarseToFine(3, 5, 1.0).IsApplicable(redshifts));
+  std::reverse(redshifts.begin(), redshifts.end());
+  BOOST_CHECK(!CChisquareCoarseToFine(3, 5, 1.0).IsApplicable(redshifts));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
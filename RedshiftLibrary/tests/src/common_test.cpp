@@ -2,6 +2,8 @@
 #include <RedshiftLibrary/common/datatypes.h>
 #include <RedshiftLibrary/common/median.h>
 #include <RedshiftLibrary/common/mean.h>
+#include <RedshiftLibrary/common/slidingmedian.h>
+#include <RedshiftLibrary/common/weightedleastsquares.h>
 
 #include <time.h>
 #include <iostream>
@@ -146,6 +148,102 @@ BOOST_AUTO_TEST_CASE(Mean)
     BOOST_CHECK( mean.Find( data, size ) == 150.0 );
 }
 
+BOOST_AUTO_TEST_CASE(SlidingMedian)
+{
+    // same median and MAD as a full sort of each window, for growing, sliding
+    // and shrinking windows of odd and even sizes, with repeated values
+    const Int32 size = 3000;
+    std::vector<Float64> data( size );
+    srand( 1 );
+    for( Int32 i=0; i<size; i++ )
+    {
+        data[i] = floor( ( (Float64) rand() / (Float64) (RAND_MAX) ) * 50.0 ) * 0.5;
+    }
+
+    CMedian<Float64> median;
+    CSlidingMedian<Float64> sliding;
+    Int32 halfWidths[3] = { 3, 40, 700 };
+    for( Int32 w=0; w<3; w++ )
+    {
+        for( Int32 i=0; i<size; i++ )
+        {
+            Int32 start = std::max( 0, i - halfWidths[w] );
+            Int32 stop = std::min( size, i + halfWidths[w] + (i%2) );
+            Int32 n = stop - start;
+            sliding.Slide( data.data(), start, stop );
+            BOOST_REQUIRE( sliding.GetCount() == n );
+
+            Float64 med = median.Find( data.data() + start, n );
+            BOOST_CHECK( sliding.GetMedian() == med );
+
+            std::vector<Float64> dev( n );
+            for( Int32 k=0; k<n; k++ )
+            {
+                dev[k] = fabs( data[start+k] - med );
+            }
+            std::sort( dev.begin(), dev.end() );
+            Float64 mad = ( n%2 == 0 ) ? 0.5*( dev[n/2-1] + dev[n/2] ) : dev[n/2];
+            BOOST_CHECK( sliding.GetMad( med ) == mad );
+        }
+    }
+
+    // going backward rebuilds the window
+    sliding.Slide( data.data(), 10, 19 );
+    BOOST_CHECK( sliding.GetCount() == 9 );
+    BOOST_CHECK( sliding.GetMedian() == median.Find( data.data() + 10, 9 ) );
+}
+
 
 
+BOOST_AUTO_TEST_CASE(WeightedLeastSquares)
+{
+    // quadratic in dz, as for the deltaz fit: the parameters differ by orders of magnitude
+    CWeightedLeastSquares<3> fit;
+    BOOST_CHECK( fit.Solve() == false );
+
+    const Float64 c0 = 49833.3, c1 = -12.5, c2 = 3.2e5;
+    for( Int32 i=0; i<21; i++ )
+    {
+        Float64 dz = ( i - 10 )*1e-4;
+        Float64 x[3] = { 1.0, dz, dz*dz };
+        fit.AddSample( x, c0 + c1*dz + c2*dz*dz, 1.0 );
+    }
+    BOOST_CHECK( fit.GetSampleCount() == 21 );
+    BOOST_REQUIRE( fit.Solve() );
+    BOOST_CHECK_CLOSE( fit.GetCoefficient(0), c0, 1e-8 );
+    BOOST_CHECK_CLOSE( fit.GetCoefficient(1), c1, 1e-6 );
+    BOOST_CHECK_CLOSE( fit.GetCoefficient(2), c2, 1e-6 );
+    BOOST_CHECK( fit.GetChiSquare() < 1e-6 );
+
+    // one parameter: c = Sum wxy / Sum wx2, var(c) = 1 / Sum wx2
+    CWeightedLeastSquares<1> fit1;
+    Float64 xs[3] = { 1.0, 2.0, 3.0 };
+    Float64 ys[3] = { 2.0, 3.0, 7.0 };
+    Float64 ws[3] = { 1.0, 4.0, 0.25 };
+    Float64 sxy = 0.0, sxx = 0.0, syy = 0.0;
+    for( Int32 i=0; i<3; i++ )
+    {
+        fit1.AddSample( &xs[i], ys[i], ws[i] );
+        sxy += ws[i]*xs[i]*ys[i];
+        sxx += ws[i]*xs[i]*xs[i];
+        syy += ws[i]*ys[i]*ys[i];
+    }
+    BOOST_REQUIRE( fit1.Solve() );
+    BOOST_CHECK_CLOSE( fit1.GetCoefficient(0), sxy/sxx, 1e-10 );
+    BOOST_CHECK_CLOSE( fit1.GetCovariance(0,0), 1.0/sxx, 1e-10 );
+    BOOST_CHECK_CLOSE( fit1.GetChiSquare(), syy - sxy*sxy/sxx, 1e-8 );
+
+    // degenerate: two identical columns
+    CWeightedLeastSquares<2> fit2;
+    for( Int32 i=0; i<5; i++ )
+    {
+        Float64 x[2] = { Float64(i), Float64(i) };
+        fit2.AddSample( x, 2.0*i, 1.0 );
+    }
+    BOOST_CHECK( fit2.Solve() == false );
+
+    fit.Reset();
+    BOOST_CHECK( fit.GetSampleCount() == 0 );
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,125 @@
+#include <RedshiftLibrary/common/datatypes.h>
+#include <RedshiftLibrary/operator/correlation.h>
+#include <RedshiftLibrary/operator/correlationresult.h>
+#include <RedshiftLibrary/spectrum/spectrum.h>
+#include <RedshiftLibrary/spectrum/template/template.h>
+
+#include <boost/test/unit_test.hpp>
+#include <math.h>
+
+using namespace NSEpic;
+
+BOOST_AUTO_TEST_SUITE(Correlation)
+
+BOOST_AUTO_TEST_CASE(FFTMatchesDirect)
+{
+  // log-regular spectrum and template, sharing the same log-lambda step
+  const Float64 logStep = 1e-4;
+  const Int32 nSpc = 2000;
+  const Int32 nTpl = 6000;
+  const Float64 spcLogLambda0 = log(4000.0);
+  const Float64 tplLogLambda0 = log(2500.0);
+
+  TFloat64List spcLambda(nSpc), spcFlux(nSpc), spcError(nSpc);
+  for (Int32 j=0; j<nSpc; j++) {
+    spcLambda[j] = spcLogLambda0 + j*logStep;
+    spcFlux[j] = 1.0 + 0.3*sin(j*0.05) + 0.2*cos(j*0.013) + ((j*7919)%13)*0.01;
+    spcError[j] = 0.05 + 0.01*((j*31)%7);
+  }
+  TFloat64List tplLambda(nTpl), tplFlux(nTpl);
+  for (Int32 k=0; k<nTpl; k++) {
+    tplLambda[k] = tplLogLambda0 + k*logStep;
+    tplFlux[k] = 2.0 + 0.5*sin(k*0.05 + 0.3) + 0.1*cos(k*0.007);
+  }
+
+  CSpectrumSpectralAxis spcSpectralAxis(spcLambda.data(), nSpc, true);
+  CSpectrumFluxAxis spcFluxAxis(spcFlux.data(), nSpc, spcError.data(), nSpc);
+  CSpectrum spectrum(spcSpectralAxis, spcFluxAxis);
+  CSpectrumSpectralAxis tplSpectralAxis(tplLambda.data(), nTpl, true);
+  CSpectrumFluxAxis tplFluxAxis(tplFlux.data(), nTpl);
+  CTemplate tpl("tpl", "galaxy", tplSpectralAxis, tplFluxAxis);
+
+  // redshifts aligned on the log-lambda grid, with the template covering the whole spectrum
+  TFloat64List redshifts;
+  for (Int32 lag=1200; lag<2500; lag+=100) {
+    redshifts.push_back(exp(spcLogLambda0 - tplLogLambda0 - lag*logStep) - 1.0);
+  }
+  TFloat64Range lambdaRange(exp(spcLogLambda0), exp(spcLambda[nSpc-1]));
+  std::vector<CMask> maskList;
+
+  COperatorCorrelation correlation;
+  std::shared_ptr<CCorrelationResult> direct = std::dynamic_pointer_cast<CCorrelationResult>(
+      correlation.Compute(spectrum, tpl, lambdaRange, redshifts, 0.9, maskList));
+  BOOST_REQUIRE(direct);
+
+  correlation.EnableFFT(true);
+  std::shared_ptr<CCorrelationResult> fft = std::dynamic_pointer_cast<CCorrelationResult>(
+      correlation.Compute(spectrum, tpl, lambdaRange, redshifts, 0.9, maskList));
+  BOOST_REQUIRE(fft);
+
+  BOOST_CHECK(fft->Correlation.size() == redshifts.size());
+  for (Int32 i=0; i<redshifts.size(); i++) {
+    BOOST_CHECK(direct->Status[i] == COperator::nStatus_OK);
+    BOOST_CHECK(fft->Status[i] == COperator::nStatus_OK);
+    BOOST_CHECK_CLOSE(fft->Overlap[i], direct->Overlap[i], 1e-6);
+    BOOST_CHECK_SMALL(fft->Correlation[i] - direct->Correlation[i], 1e-6);
+  }
+
+  // template out of the spectrum range
+  TFloat64List farRedshifts(1, 10.0);
+  fft = std::dynamic_pointer_cast<CCorrelationResult>(
+      correlation.Compute(spectrum, tpl, lambdaRange, farRedshifts, 0.9, maskList));
+  BOOST_REQUIRE(fft);
+  BOOST_CHECK(fft->Status[0] == COperator::nStatus_NoOverlap);
+}
+
+BOOST_AUTO_TEST_CASE(FFTMatchesDirectOnLinearRedshiftGrid)
+{
+  // template sampled linearly in lambda and a linear redshift grid, which does not fall on the log-lambda lags of the
+  // spectrum: the FFT mode resamples the template and interpolates its sums between two lags
+  const Int32 nSpc = 1500;
+  const Int32 nTpl = 5000;
+  TFloat64List spcLambda(nSpc), spcFlux(nSpc), spcError(nSpc);
+  for (Int32 j=0; j<nSpc; j++) {
+    spcLambda[j] = log(4000.0) + j*4e-4;
+    spcFlux[j] = 1.0 + 0.3*sin(j*0.02) + 0.2*cos(j*0.005);
+    spcError[j] = 0.05 + 0.01*((j*31)%7);
+  }
+  TFloat64List tplLambda(nTpl), tplFlux(nTpl);
+  for (Int32 k=0; k<nTpl; k++) {
+    tplLambda[k] = log(1500.0 + k*1.0);
+    tplFlux[k] = 2.0 + 0.5*sin(k*0.01) + 0.1*cos(k*0.003);
+  }
+
+  CSpectrumSpectralAxis spcSpectralAxis(spcLambda.data(), nSpc, true);
+  CSpectrumFluxAxis spcFluxAxis(spcFlux.data(), nSpc, spcError.data(), nSpc);
+  CSpectrum spectrum(spcSpectralAxis, spcFluxAxis);
+  CSpectrumSpectralAxis tplSpectralAxis(tplLambda.data(), nTpl, true);
+  CSpectrumFluxAxis tplFluxAxis(tplFlux.data(), nTpl);
+  CTemplate tpl("tpl", "galaxy", tplSpectralAxis, tplFluxAxis);
+
+  TFloat64Range lambdaRange(exp(spcLambda[0]), exp(spcLambda[nSpc-1]));
+  TFloat64List redshifts = TFloat64Range(0.2, 1.0).SpreadOver(0.0137);
+  std::vector<CMask> maskList;
+
+  COperatorCorrelation correlation;
+  std::shared_ptr<CCorrelationResult> direct = std::dynamic_pointer_cast<CCorrelationResult>(
+      correlation.Compute(spectrum, tpl, lambdaRange, redshifts, 0.9, maskList));
+  BOOST_REQUIRE(direct);
+  correlation.EnableFFT(true);
+  std::shared_ptr<CCorrelationResult> fft = std::dynamic_pointer_cast<CCorrelationResult>(
+      correlation.Compute(spectrum, tpl, lambdaRange, redshifts, 0.9, maskList));
+  BOOST_REQUIRE(fft);
+
+  UInt32 nOk = 0;
+  for (Int32 i=0; i<redshifts.size(); i++) {
+    BOOST_CHECK(fft->Status[i] == direct->Status[i]);
+    if (direct->Status[i] != COperator::nStatus_OK)
+      continue;
+    nOk++;
+    BOOST_CHECK_SMALL(fft->Correlation[i] - direct->Correlation[i], 1e-4);
+  }
+  BOOST_CHECK(nOk > 10);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
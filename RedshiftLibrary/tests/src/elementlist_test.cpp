@@ -1,13 +1,17 @@
 #include <RedshiftLibrary/linemodel/elementlist.h>
 #include <RedshiftLibrary/noise/flat.h>
 #include <RedshiftLibrary/noise/fromfile.h>
+#include <RedshiftLibrary/ray/catalogsTplShape.h>
 #include <RedshiftLibrary/spectrum/io/genericreader.h>
+#include <RedshiftLibrary/spectrum/template/template.h>
 #include <RedshiftLibrary/log/log.h>
 #include <RedshiftLibrary/log/consolehandler.h>
 #include <RedshiftLibrary/tests/test-tools.h>
 
 #include <time.h>
+#include <fstream>
 #include <iostream>
+#include <math.h>
 #include <stdlib.h>
 #include <boost/test/unit_test.hpp>
 #include "test-config.h"
@@ -121,4 +125,410 @@ BOOST_AUTO_TEST_CASE(Constructor)
   bfs::remove_all(calibrationPath);
 }
 
+// 4 Em lines then 3 Abs lines
+const char* tplshapeNames[7] = {"Halpha", "OIIIa", "Hbeta", "OII", "CaH", "CaK", "MgI"};
+const Float64 tplshapeLambdas[7] = {6562.8, 5006.8, 4861.3, 3727.5, 3968.5, 3933.7, 5175.0};
+
+/**
+ * Writes a line catalog with the Em and Abs lines of the tplshape test, with the given nominal amplitudes.
+ */
+void write_tplshape_catalog(const bfs::path& path, const Float64* amps)
+{
+  ofstream out(path.c_str());
+  out << "#version:0.4.0" << endl;
+  for(Int32 k=0; k<7; k++){
+    out << tplshapeLambdas[k] << "\t" << tplshapeNames[k] << "\t" << (k<4 ? "E" : "A") << "\tS\tSYM\t" << (k<4 ? "E1" : "A1") << "\t" << amps[k] << "\t-1" << endl;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(TplratioFitFromBasis)
+{
+  CLog log;
+
+  // two tpl-ratios for the Em and Abs multilines
+  bfs::path calibrationPath = generate_calibration_dir();
+  bfs::path tplratioPath = calibrationPath / "linecatalogs_tplshape";
+  bfs::create_directories(tplratioPath / "velocities");
+  const Float64 ampsA[7] = {1.0, 0.5, 0.35, 0.8, 1.0, 0.8, 0.5};
+  const Float64 ampsB[7] = {1.0, 2.0, 0.3, 1.5, 0.6, 1.0, 0.2};
+  write_tplshape_catalog(tplratioPath / "ratioA_catalog.txt", ampsA);
+  write_tplshape_catalog(tplratioPath / "ratioB_catalog.txt", ampsB);
+  {
+    ofstream velA((tplratioPath / "velocities" / "ratioA_velocities.txt").c_str());
+    velA << "100" << endl << "300" << endl;
+    ofstream velB((tplratioPath / "velocities" / "ratioB_velocities.txt").c_str());
+    velB << "100" << endl << "300" << endl;
+  }
+  const Float64 ampsUnit[7] = {1.0, 1.0, 1.0, 1.0, 1.0, 1.0, 1.0};
+  bfs::path linecatalogPath = bfs::unique_path("tst_%%%%%%%%%%");
+  write_tplshape_catalog(linecatalogPath, ampsUnit);
+  CRayCatalog lineCatalog;
+  lineCatalog.Load(linecatalogPath.c_str());
+  CRayCatalog::TRayVector lineList = lineCatalog.GetFilteredList(-1, -1);
+
+  // the first tpl-ratio at z=0.3 on a flat continuum
+  const Float64 redshift = 0.3;
+  const Int32 n = 3000;
+  TFloat64List lambda(n), flux(n), error(n, 0.1), continuum(n, 1.0);
+  for(Int32 i=0; i<n; i++){
+    lambda[i] = 3500.0 + 3.0*i;
+    flux[i] = 1.0 + 0.05*sin(0.7*i);
+    for(Int32 k=0; k<7; k++){
+      Float64 x = (lambda[i] - tplshapeLambdas[k]*(1.0+redshift))/(k<4 ? 3.0 : 6.0);
+      flux[i] += (k<4 ? 2.0 : -0.3)*ampsA[k]*exp(-0.5*x*x);
+    }
+  }
+  CSpectrumSpectralAxis spectralAxis(lambda.data(), n);
+  CSpectrumFluxAxis fluxAxis(flux.data(), n, error.data(), n);
+  CSpectrumFluxAxis continuumFluxAxis(continuum.data(), n, error.data(), n);
+  CSpectrum spectrum(spectralAxis, fluxAxis);
+  CSpectrum spectrumContinuum(spectralAxis, continuumFluxAxis);
+  CTemplateCatalog tplCatalog;
+  TStringList tplCategories;
+  TFloat64Range range(3600, 12000);
+  CLineModelSolution solution;
+  CContinuumModelSolution c_solution;
+
+  CLineModelElementList model(spectrum, spectrumContinuum, tplCatalog, tplCategories, calibrationPath.c_str(), lineList,
+                              "hybrid", "fromspectrum", "velocitydriven", 2350, 100, 300, "no", "tplshape");
+  BOOST_REQUIRE(model.initTplratioCatalogs("linecatalogs_tplshape", 0));
+  BOOST_REQUIRE(model.m_Elements.size() == 2);
+  Int32 nTplratio = model.m_CatalogTplShape->GetCatalogsCount();
+  BOOST_REQUIRE(nTplratio == 2);
+
+  // the amplitudes of both elements are fitted from the basis, for each tpl-ratio
+  Float64 merit = model.fit(redshift, range, solution, c_solution);
+  BOOST_CHECK(model.m_tplratioFitFromBasisCount == nTplratio);
+  TFloat64List chi2 = model.m_ChisquareTplshape;
+  std::vector<TFloat64List> amps = model.m_FittedAmpTplshape;
+
+  // same amplitudes and merits as the hybrid fit of each tpl-ratio
+  model.m_opt_enableTplratioFitFromBasis = false;
+  Float64 meritHybrid = model.fit(redshift, range, solution, c_solution);
+  BOOST_CHECK(model.m_tplratioFitFromBasisCount == nTplratio);
+  BOOST_CHECK_CLOSE(merit, meritHybrid, 1e-8);
+  for(Int32 k=0; k<nTplratio; k++){
+    BOOST_CHECK_CLOSE(chi2[k], model.m_ChisquareTplshape[k], 1e-8);
+    for(UInt32 iElts=0; iElts<model.m_Elements.size(); iElts++){
+      BOOST_CHECK(amps[k][iElts] > 0.0);
+      BOOST_CHECK_CLOSE(amps[k][iElts], model.m_FittedAmpTplshape[k][iElts], 1e-8);
+    }
+  }
+
+  // not fitted from the basis when a lambda offset is to be fitted
+  model.m_opt_enableTplratioFitFromBasis = true;
+  model.m_Elements[0]->m_Rays[0].EnableOffsetFit(true);
+  model.fit(redshift, range, solution, c_solution);
+  BOOST_CHECK(model.m_tplratioFitFromBasisCount == nTplratio);
+
+  bfs::remove(linecatalogPath);
+  bfs::remove_all(calibrationPath);
+}
+
+BOOST_AUTO_TEST_CASE(IncrementalRefreshModel)
+{
+  CLog log;
+
+  // single lines, some of them with overlapping supports
+  bfs::path calibrationPath = generate_calibration_dir();
+  bfs::path linecatalogPath = bfs::unique_path("tst_%%%%%%%%%%");
+  const Int32 nLines = 9;
+  const char* names[nLines] = {"Halpha", "[NII]6583", "Hbeta", "[OIII]4959", "[OIII]5007", "[OII]3727", "CaK", "CaH", "MgI"};
+  const Float64 lambdas[nLines] = {6562.8, 6583.4, 4861.3, 4958.9, 5006.8, 3727.5, 3933.7, 3968.5, 5175.0};
+  {
+    ofstream out(linecatalogPath.c_str());
+    out << "#version:0.4.0" << endl;
+    for(Int32 k=0; k<nLines; k++){
+      out << lambdas[k] << "\t" << names[k] << "\t" << (k<6 ? "E" : "A") << "\tS\tSYM\t-1\t1.0\t-1" << endl;
+    }
+  }
+  CRayCatalog lineCatalog;
+  lineCatalog.Load(linecatalogPath.c_str());
+  CRayCatalog::TRayVector lineList = lineCatalog.GetFilteredList(-1, -1);
+
+  const Float64 redshift = 0.6;
+  const Int32 n = 3000;
+  TFloat64List lambda(n), flux(n), error(n, 0.1), continuum(n, 1.0);
+  for(Int32 i=0; i<n; i++){
+    lambda[i] = 3500.0 + 3.0*i;
+    flux[i] = 1.0 + 0.05*sin(0.7*i);
+    for(Int32 k=0; k<nLines; k++){
+      Float64 x = (lambda[i] - lambdas[k]*(1.0+redshift))/(k<6 ? 4.0 : 8.0);
+      flux[i] += (k<6 ? 1.5 : -0.3)*exp(-0.5*x*x);
+    }
+  }
+  CSpectrumSpectralAxis spectralAxis(lambda.data(), n);
+  CSpectrumFluxAxis fluxAxis(flux.data(), n, error.data(), n);
+  CSpectrumFluxAxis continuumFluxAxis(continuum.data(), n, error.data(), n);
+  CSpectrum spectrum(spectralAxis, fluxAxis);
+  CSpectrum spectrumContinuum(spectralAxis, continuumFluxAxis);
+  CTemplateCatalog tplCatalog;
+  TStringList tplCategories;
+  TFloat64Range range(3600, 12000);
+  CLineModelSolution solution;
+  CContinuumModelSolution c_solution;
+
+  // the same fit in two models: one refreshed incrementally, the other fully
+  CLineModelElementList model(spectrum, spectrumContinuum, tplCatalog, tplCategories, calibrationPath.c_str(), lineList,
+                              "hybrid", "fromspectrum", "velocitydriven", 2350, 300, 300, "no", "rules");
+  CLineModelElementList reference(spectrum, spectrumContinuum, tplCatalog, tplCategories, calibrationPath.c_str(), lineList,
+                                  "hybrid", "fromspectrum", "velocitydriven", 2350, 300, 300, "no", "rules");
+  BOOST_REQUIRE(model.m_Elements.size() == nLines);
+  model.fit(redshift, range, solution, c_solution);
+  reference.fit(redshift, range, solution, c_solution);
+  model.refreshModel();
+  model.getLeastSquareMerit(range);
+
+  srand(12345);
+  for(Int32 it=0; it<200; it++){
+    Int32 nChanged = 1 + rand()%3;
+    for(Int32 k=0; k<nChanged; k++){
+      Int32 iElts = rand()%nLines;
+      Float64 amp = 2.0*rand()/RAND_MAX;
+      model.SetElementAmplitude(iElts, amp, 1.0);
+      reference.SetElementAmplitude(iElts, amp, 1.0);
+    }
+    // half of the refreshes without the absorption lines
+    Int32 lineTypeFilter = (it%4<2) ? -1 : CRay::nType_Emission;
+    model.refreshModel(lineTypeFilter);
+    Float64 merit = model.getLeastSquareMerit(range);
+
+    // invalidates the cache, for a full refresh
+    reference.refreshModelInitAllGrid();
+    reference.refreshModel(lineTypeFilter);
+    Float64 meritReference = reference.getLeastSquareMerit(range);
+
+    Float64 maxDiff = 0.0;
+    for(Int32 i=0; i<n; i++){
+      maxDiff = std::max(maxDiff, fabs(model.getModelFluxVal(i) - reference.getModelFluxVal(i)));
+    }
+    BOOST_CHECK_SMALL(maxDiff, 1e-12);
+    BOOST_CHECK_CLOSE(merit, meritReference, 1e-10);
+  }
+
+  bfs::remove(linecatalogPath);
+  bfs::remove_all(calibrationPath);
+}
+
+/**
+ * Checks the first pass merit lower bound of a model of the lines lambdas (emission if amps>0) on a spectrum of these lines at z=0.6:
+ * a bound below the fitted merit over a z-range when the supports are disjoint, and no bound when two of them overlap.
+ */
+void check_fit_merit_lower_bound(const bfs::path& calibrationPath, Int32 nLines, const char** names, const Float64* lambdas,
+                                 const Float64* amps, bool overlapping)
+{
+  bfs::path linecatalogPath = bfs::unique_path("tst_%%%%%%%%%%");
+  {
+    ofstream out(linecatalogPath.c_str());
+    out << "#version:0.4.0" << endl;
+    for(Int32 k=0; k<nLines; k++){
+      out << lambdas[k] << "\t" << names[k] << "\t" << (amps[k]>0.0 ? "E" : "A") << "\tS\tSYM\t-1\t1.0\t-1" << endl;
+    }
+  }
+  CRayCatalog lineCatalog;
+  lineCatalog.Load(linecatalogPath.c_str());
+  CRayCatalog::TRayVector lineList = lineCatalog.GetFilteredList(-1, -1);
+
+  const Int32 n = 3000;
+  TFloat64List lambda(n), flux(n), error(n, 0.1), continuum(n, 1.0);
+  for(Int32 i=0; i<n; i++){
+    lambda[i] = 3500.0 + 3.0*i;
+    flux[i] = 1.0 + 0.05*sin(0.7*i);
+    for(Int32 k=0; k<nLines; k++){
+      Float64 x = (lambda[i] - lambdas[k]*1.6)/(amps[k]>0.0 ? 4.0 : 8.0);
+      flux[i] += amps[k]*exp(-0.5*x*x);
+    }
+  }
+  CSpectrumSpectralAxis spectralAxis(lambda.data(), n);
+  CSpectrumFluxAxis fluxAxis(flux.data(), n, error.data(), n);
+  CSpectrumFluxAxis continuumFluxAxis(continuum.data(), n, error.data(), n);
+  CSpectrum spectrum(spectralAxis, fluxAxis);
+  CSpectrum spectrumContinuum(spectralAxis, continuumFluxAxis);
+  CTemplateCatalog tplCatalog;
+  TStringList tplCategories;
+  TFloat64Range range(3600, 12000);
+  CLineModelSolution solution;
+  CContinuumModelSolution c_solution;
+
+  CLineModelElementList model(spectrum, spectrumContinuum, tplCatalog, tplCategories, calibrationPath.c_str(), lineList,
+                              "hybrid", "fromspectrum", "velocitydriven", 2350, 300, 300, "no", "rules");
+  BOOST_REQUIRE(model.m_Elements.size() == nLines);
+  for(Float64 z=0.5; z<0.7; z+=0.01){
+    Float64 meritLowerBound, continuumMerit;
+    bool bounded = model.getFitMeritLowerBound(z, range, 0, meritLowerBound, continuumMerit);
+    BOOST_CHECK(bounded == !overlapping);
+    if(bounded){
+      Float64 merit = model.fit(z, range, solution, c_solution);
+      BOOST_CHECK_MESSAGE(meritLowerBound <= merit*(1.0+1e-10), "z=" << z << ": bound " << meritLowerBound << " > merit " << merit);
+    }
+  }
+
+  bfs::remove(linecatalogPath);
+}
+
+BOOST_AUTO_TEST_CASE(FitMeritLowerBound)
+{
+  CLog log;
+  bfs::path calibrationPath = generate_calibration_dir();
+
+  // disjoint supports
+  const char* names[4] = {"Halpha", "[OIII]5007", "[OII]3727", "CaK"};
+  const Float64 lambdas[4] = {6562.8, 5006.8, 3727.5, 3933.7};
+  const Float64 amps[4] = {1.5, 1.0, 1.2, -0.3};
+  check_fit_merit_lower_bound(calibrationPath, 4, names, lambdas, amps, false);
+
+  // an overlapping pair of emission lines
+  const char* namesNII[5] = {"Halpha", "[OIII]5007", "[OII]3727", "CaK", "[NII]6583"};
+  const Float64 lambdasNII[5] = {6562.8, 5006.8, 3727.5, 3933.7, 6583.4};
+  const Float64 ampsNII[5] = {1.5, 1.0, 1.2, -0.3, 0.8};
+  check_fit_merit_lower_bound(calibrationPath, 5, namesNII, lambdasNII, ampsNII, true);
+
+  // an absorption line overlapping an emission line
+  const char* namesFeII[5] = {"Halpha", "[OIII]5007", "[OII]3727", "CaK", "FeII6575"};
+  const Float64 lambdasFeII[5] = {6562.8, 5006.8, 3727.5, 3933.7, 6575.0};
+  const Float64 ampsFeII[5] = {1.5, 1.0, 1.2, -0.3, -0.4};
+  check_fit_merit_lower_bound(calibrationPath, 5, namesFeII, lambdasFeII, ampsFeII, true);
+
+  bfs::remove_all(calibrationPath);
+}
+
+/**
+ * Checks the lmfit residual and jacobian evaluated on the supports of the elements against the evaluation on the whole
+ * grid, at the same parameters x.
+ */
+void check_lmfit_evaluation(CLineModelElementList& model, CLineModelElementList& reference, const CSpectrumFluxAxis& fluxAxis,
+                            CLmfitController& controller, const TFloat64List& x)
+{
+  TFloat64List residual, jacobian, residualFull, jacobianFull;
+  BOOST_REQUIRE(model.evaluateLmfit(fluxAxis, &controller, x, false, residual, jacobian) == 0);
+  BOOST_REQUIRE(reference.evaluateLmfit(fluxAxis, &controller, x, true, residualFull, jacobianFull) == 0);
+  BOOST_REQUIRE(residual.size() == residualFull.size());
+  BOOST_REQUIRE(jacobian.size() == jacobianFull.size());
+
+  Float64 maxDiff = 0.0;
+  for(UInt32 i=0; i<residual.size(); i++){
+    maxDiff = std::max(maxDiff, fabs(residual[i] - residualFull[i]));
+  }
+  BOOST_CHECK_SMALL(maxDiff, 1e-12);
+
+  // the lines profiles are cut at the bounds of the supports, a few sigmas away from their centers: the full grid
+  // jacobian only adds their tails
+  UInt32 p = x.size();
+  for(UInt32 k=0; k<p; k++){
+    Float64 colMax = 0.0;
+    Float64 colDiff = 0.0;
+    for(UInt32 i=0; i<residual.size(); i++){
+      colMax = std::max(colMax, fabs(jacobianFull[i*p+k]));
+      colDiff = std::max(colDiff, fabs(jacobian[i*p+k] - jacobianFull[i*p+k]));
+    }
+    BOOST_CHECK(colMax > 0.0);
+    BOOST_CHECK_MESSAGE(colDiff <= 1e-4*colMax, "parameter " << k << ": jacobian diff " << colDiff << " for max " << colMax);
+  }
+}
+
+/**
+ * Sets the lmfit parameters of the nLines first elements: the square roots of their amplitudes.
+ */
+void set_lmfit_lines_parameters(TFloat64List& x, UInt32 nLines)
+{
+  for(UInt32 k=0; k<nLines; k++){
+    x[k] = 0.6 + 0.1*k;
+  }
+}
+
+BOOST_AUTO_TEST_CASE(LmfitSupportEvaluation)
+{
+  CLog log;
+
+  bfs::path calibrationPath = generate_calibration_dir();
+  bfs::path linecatalogPath = bfs::unique_path("tst_%%%%%%%%%%");
+  const Int32 nLines = 6;
+  const char* names[nLines] = {"Halpha", "[NII]6583", "Hbeta", "[OIII]5007", "[OII]3727", "CaK"};
+  const Float64 lambdas[nLines] = {6562.8, 6583.4, 4861.3, 5006.8, 3727.5, 3933.7};
+  {
+    ofstream out(linecatalogPath.c_str());
+    out << "#version:0.4.0" << endl;
+    for(Int32 k=0; k<nLines; k++){
+      out << lambdas[k] << "\t" << names[k] << "\t" << (k<5 ? "E" : "A") << "\tS\tSYM\t-1\t1.0\t-1" << endl;
+    }
+  }
+  CRayCatalog lineCatalog;
+  lineCatalog.Load(linecatalogPath.c_str());
+  CRayCatalog::TRayVector lineList = lineCatalog.GetFilteredList(-1, -1);
+
+  // the lines at z=0.6 on the continuum template
+  const Float64 redshift = 0.6;
+  const Int32 n = 3000;
+  const Int32 nTpl = 6000;
+  TFloat64List tplLambda(nTpl), tplFlux(nTpl);
+  for(Int32 k=0; k<nTpl; k++){
+    tplLambda[k] = 1500.0 + k;
+    tplFlux[k] = 1.0 + 0.3*sin(tplLambda[k]/400.0);
+  }
+  CSpectrumSpectralAxis tplSpectralAxis(tplLambda.data(), nTpl);
+  CSpectrumFluxAxis tplFluxAxis(tplFlux.data(), nTpl);
+  CTemplate tpl("continuum", "galaxy", tplSpectralAxis, tplFluxAxis);
+
+  TFloat64List lambda(n), flux(n), error(n, 0.1), continuum(n);
+  for(Int32 i=0; i<n; i++){
+    lambda[i] = 3500.0 + 3.0*i;
+    continuum[i] = 1.0 + 0.3*sin(lambda[i]/(1.0+redshift)/400.0);
+    flux[i] = 1.2*continuum[i] + 0.05*sin(0.7*i);
+    for(Int32 k=0; k<nLines; k++){
+      Float64 x = (lambda[i] - lambdas[k]*(1.0+redshift))/(k<5 ? 4.0 : 8.0);
+      flux[i] += (k<5 ? 1.5 : -0.3*continuum[i])*exp(-0.5*x*x);
+    }
+  }
+  CSpectrumSpectralAxis spectralAxis(lambda.data(), n);
+  CSpectrumFluxAxis fluxAxis(flux.data(), n, error.data(), n);
+  CSpectrumFluxAxis continuumFluxAxis(continuum.data(), n, error.data(), n);
+  CSpectrum spectrum(spectralAxis, fluxAxis);
+  CSpectrum spectrumContinuum(spectralAxis, continuumFluxAxis);
+  CTemplateCatalog tplCatalog;
+  TStringList tplCategories;
+  TFloat64Range range(3600, 12000);
+
+  CLineModelElementList model(spectrum, spectrumContinuum, tplCatalog, tplCategories, calibrationPath.c_str(), lineList,
+                              "lmfit", "fromspectrum", "velocitydriven", 2350, 300, 300, "no", "rules");
+  CLineModelElementList reference(spectrum, spectrumContinuum, tplCatalog, tplCategories, calibrationPath.c_str(), lineList,
+                                  "lmfit", "fromspectrum", "velocitydriven", 2350, 300, 300, "no", "rules");
+  BOOST_REQUIRE(model.m_Elements.size() == nLines);
+  model.initModelAtZ(redshift, range, spectralAxis);
+  reference.initModelAtZ(redshift, range, spectralAxis);
+  std::vector<UInt32> validEltsIdx = model.GetModelValidElementsIndexes();
+  BOOST_REQUIRE(validEltsIdx.size() == nLines);
+
+  // without the continuum fitted, with the emission velocity
+  CLmfitController controllerNoContinuum(true, false);
+  for(UInt32 k=0; k<validEltsIdx.size(); k++){
+    controllerNoContinuum.addElement(validEltsIdx[k]);
+  }
+  controllerNoContinuum.calculatedIndices();
+  TFloat64List xNoContinuum(controllerNoContinuum.getNumberParameters());
+  set_lmfit_lines_parameters(xNoContinuum, validEltsIdx.size());
+  xNoContinuum[controllerNoContinuum.getIndEmissionVel()] = sqrt(250.0);
+  xNoContinuum[controllerNoContinuum.getIndRedshift()] = redshift;
+  check_lmfit_evaluation(model, reference, fluxAxis, controllerNoContinuum, xNoContinuum);
+
+  // with the continuum template amplitude fitted
+  std::vector<Float64> polyCoeffs;
+  model.SetFitContinuum_FitValues("continuum", 1.0, 0.0, -1, -1, redshift, 0.0, 0.0, polyCoeffs);
+  reference.SetFitContinuum_FitValues("continuum", 1.0, 0.0, -1, -1, redshift, 0.0, 0.0, polyCoeffs);
+  model.ApplyContinuumOnGrid(tpl, redshift);
+  reference.ApplyContinuumOnGrid(tpl, redshift);
+  CLmfitController controllerContinuum(tpl, true, true, false, false);
+  for(UInt32 k=0; k<validEltsIdx.size(); k++){
+    controllerContinuum.addElement(validEltsIdx[k]);
+  }
+  controllerContinuum.calculatedIndices();
+  TFloat64List xContinuum(controllerContinuum.getNumberParameters());
+  set_lmfit_lines_parameters(xContinuum, validEltsIdx.size());
+  xContinuum[controllerContinuum.getIndContinuumAmp()] = sqrt(1.2);
+  xContinuum[controllerContinuum.getIndRedshift()] = redshift;
+  check_lmfit_evaluation(model, reference, fluxAxis, controllerContinuum, xContinuum);
+
+  bfs::remove(linecatalogPath);
+  bfs::remove_all(calibrationPath);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -436,5 +436,66 @@ BOOST_AUTO_TEST_CASE(RebinVarianceWeighted)
 
 }
 
+BOOST_AUTO_TEST_CASE(weights)
+{
+  Float64 flux[5] = {1., -2., 3., 0.5, 4.};
+  Float64 error[5] = {1., 2., 0.5, 4., 1.};
+  CSpectrumFluxAxis fluxAxis(flux, 5, error, 5);
+
+  const CSpectrumFluxAxis& constFluxAxis = fluxAxis;
+  const Float64* invErr2 = constFluxAxis.GetInverseVariance();
+  const Float64* weightedFlux = constFluxAxis.GetWeightedFlux();
+  Float64 dtd = 0.;
+  for (UInt32 i = 0; i < 5; i++) {
+    BOOST_CHECK_CLOSE(invErr2[i], 1. / (error[i] * error[i]), 1e-12);
+    BOOST_CHECK_CLOSE(weightedFlux[i], flux[i] / (error[i] * error[i]), 1e-12);
+    dtd += flux[i] * flux[i] / (error[i] * error[i]);
+  }
+  BOOST_CHECK_CLOSE(constFluxAxis.GetSquaredWeightedFluxSum(0, 5), dtd, 1e-12);
+  BOOST_CHECK_CLOSE(constFluxAxis.GetSquaredWeightedFluxSum(1, 3), 1. + 36., 1e-12);
+  BOOST_CHECK(constFluxAxis.GetSquaredWeightedFluxSum(3, 3) == 0.);
+
+  // the non-const accessors drop the weights they may modify
+  fluxAxis[1] = 4.;
+  BOOST_CHECK_CLOSE(constFluxAxis.GetWeightedFlux()[1], 1., 1e-12);
+  BOOST_CHECK_CLOSE(constFluxAxis.GetSquaredWeightedFluxSum(1, 2), 4., 1e-12);
+  fluxAxis.GetSamples()[1] = 2.;
+  BOOST_CHECK_CLOSE(constFluxAxis.GetSquaredWeightedFluxSum(1, 2), 1., 1e-12);
+  fluxAxis.GetError()[1] = 1.;
+  BOOST_CHECK_CLOSE(constFluxAxis.GetInverseVariance()[1], 1., 1e-12);
+  BOOST_CHECK_CLOSE(constFluxAxis.GetWeightedFlux()[1], 2., 1e-12);
+  BOOST_CHECK_CLOSE(constFluxAxis.GetSquaredWeightedFluxSum(1, 2), 4., 1e-12);
+
+  // a pointer kept across a weights request needs an explicit reset
+  Float64* samples = fluxAxis.GetSamples();
+  BOOST_CHECK_CLOSE(constFluxAxis.GetWeightedFlux()[1], 2., 1e-12);
+  samples[1] = 4.;
+  fluxAxis.ResetWeightedFlux();
+  BOOST_CHECK_CLOSE(constFluxAxis.GetWeightedFlux()[1], 4., 1e-12);
+  TFloat64List& errors = fluxAxis.GetError();
+  BOOST_CHECK_CLOSE(constFluxAxis.GetInverseVariance()[1], 1., 1e-12);
+  errors[1] = 2.;
+  fluxAxis.ResetWeights();
+  BOOST_CHECK_CLOSE(constFluxAxis.GetInverseVariance()[1], 0.25, 1e-12);
+  BOOST_CHECK_CLOSE(constFluxAxis.GetWeightedFlux()[1], 1., 1e-12);
+  errors[1] = 1.;
+  fluxAxis.ResetWeights();
+  fluxAxis.Invert();
+  BOOST_CHECK_CLOSE(constFluxAxis.GetWeightedFlux()[1], -4., 1e-12);
+
+  // copies have their own weights
+  CSpectrumFluxAxis copy(fluxAxis);
+  copy[0] = 10.;
+  BOOST_CHECK_CLOSE(copy.GetSquaredWeightedFluxSum(0, 1), 100., 1e-12);
+  BOOST_CHECK_CLOSE(constFluxAxis.GetSquaredWeightedFluxSum(0, 1), 1., 1e-12);
+  copy = fluxAxis;
+  BOOST_CHECK_CLOSE(copy.GetSquaredWeightedFluxSum(0, 1), 1., 1e-12);
+
+  // the smoothing resets the weights itself
+  CSpectrumFluxAxis smoothed(flux, 5, error, 5);
+  smoothed.GetWeightedFlux();
+  smoothed.ApplyMeanSmooth(1);
+  BOOST_CHECK_CLOSE(smoothed.GetWeightedFlux()[0], smoothed[0] / (error[0] * error[0]), 1e-12);
+}
 
 BOOST_AUTO_TEST_SUITE_END()
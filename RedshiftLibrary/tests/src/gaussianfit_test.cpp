@@ -147,4 +147,59 @@ BOOST_AUTO_TEST_CASE(GaussianFit){
 
 }
 
+BOOST_AUTO_TEST_CASE(GaussianFitBatch){
+  CSpectrum spc =  CSpectrum();
+
+  Int32 n = 1000;
+  CSpectrumSpectralAxis spectralAxis = CSpectrumSpectralAxis(n, false );
+  Float64* fluxAxis = spectralAxis.GetSamples();
+  for(Int32 k=0; k<n; k++){
+    fluxAxis[k]=k;
+  }
+  spc.GetSpectralAxis() = spectralAxis;
+  CSpectrumFluxAxis modelfluxAxis = CSpectrumFluxAxis(n);
+  addRay(modelfluxAxis, 4,40,1.5);
+  addRay(modelfluxAxis, 4,150.5,1.5);
+  addRay(modelfluxAxis, 3,300,2.5);
+  spc.GetFluxAxis() = modelfluxAxis;
+
+  TInt32RangeList ranges;
+  ranges.push_back(TInt32Range( 140, 160 ));
+  ranges.push_back(TInt32Range( 50, 52 ));
+  ranges.push_back(TInt32Range( 0, 60 ));
+  ranges.push_back(TInt32Range( 285, 315 ));
+  ranges.push_back(TInt32Range( 140, 160 ));
+
+  // the same fitter is reused for all the ranges
+  CGaussianFit batchFitter;
+  CGaussianFit::TResultList results;
+  batchFitter.ComputeBatch( spc, ranges, results );
+  BOOST_CHECK_EQUAL(results.size(), ranges.size());
+
+  for(UInt32 k=0; k<ranges.size(); k++){
+    CGaussianFit fitter;
+    CGaussianFit::EStatus status = fitter.Compute( spc, ranges[k] );
+    BOOST_CHECK_EQUAL(results[k].Status, status);
+    if(status == CGaussianFit::nStatus_IllegalInput){
+      continue;
+    }
+    Float64 gaussAmp, gaussPos, gaussWidth;
+    Float64 gaussAmpErr, gaussPosErr, gaussWidthErr;
+    Float64 coeff0;
+    fitter.GetResults( gaussAmp, gaussPos, gaussWidth );
+    fitter.GetResultsError( gaussAmpErr, gaussPosErr, gaussWidthErr );
+    fitter.GetResultsPolyCoeff0( coeff0 );
+    BOOST_CHECK_EQUAL(results[k].Amplitude, gaussAmp);
+    BOOST_CHECK_EQUAL(results[k].Position, gaussPos);
+    BOOST_CHECK_EQUAL(results[k].Width, gaussWidth);
+    BOOST_CHECK_EQUAL(results[k].AmplitudeErr, gaussAmpErr);
+    BOOST_CHECK_EQUAL(results[k].PositionErr, gaussPosErr);
+    BOOST_CHECK_EQUAL(results[k].WidthErr, gaussWidthErr);
+    BOOST_CHECK_EQUAL(results[k].PolyCoeff0, coeff0);
+  }
+  BOOST_CHECK_EQUAL(results[1].Status, CGaussianFit::nStatus_IllegalInput);
+  BOOST_CHECK_EQUAL(results[0].Position, results[4].Position);
+  BOOST_CHECK_CLOSE(results[0].Position, 150.5, precision);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,309 @@
+#include <RedshiftLibrary/common/datatypes.h>
+#include <RedshiftLibrary/log/log.h>
+#include <RedshiftLibrary/operator/linemodel.h>
+#include <RedshiftLibrary/operator/linemodelresult.h>
+#include <RedshiftLibrary/processflow/datastore.h>
+#include <RedshiftLibrary/processflow/parameterstore.h>
+#include <RedshiftLibrary/processflow/resultstore.h>
+#include <RedshiftLibrary/ray/catalog.h>
+#include <RedshiftLibrary/spectrum/spectrum.h>
+#include <RedshiftLibrary/spectrum/template/catalog.h>
+#include <RedshiftLibrary/tests/test-tools.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include <algorithm>
+#include <float.h>
+#include <fstream>
+#include <math.h>
+
+namespace bfs = boost::filesystem;
+using namespace NSEpic;
+using namespace CPFTest;
+
+BOOST_AUTO_TEST_SUITE(test_operatorlinemodel)
+
+/**
+ * Runs the first pass and the candidates search on the spectrum, with or without the pruning.
+ */
+std::shared_ptr<const CLineModelResult> ComputeFirstPass(const CSpectrum& spectrum, const CSpectrum& spectrumContinuum,
+                                                         const CRayCatalog& lineCatalog, const bfs::path& calibrationPath,
+                                                         bool pruning, TFloat64List& candidates)
+{
+  TFloat64List redshifts = TFloat64Range(0.0, 1.5).SpreadOver(0.002);
+  TFloat64Range lambdaRange(3600.0, 12000.0);
+  CTemplateCatalog tplCatalog;
+  TStringList tplCategories;
+  COperatorResultStore resultStore;
+  CParameterStore parameterStore;
+  CDataStore dataStore(resultStore, parameterStore);
+
+  COperatorLineModel linemodel;
+  linemodel.m_opt_firstpass_fittingmethod = "hybrid";
+  linemodel.m_opt_firstpass_pruning = Int32(pruning);
+  linemodel.m_opt_firstpass_pruningTolerance = 100.0;
+  BOOST_REQUIRE(linemodel.Init(spectrum, redshifts) == 0);
+  BOOST_REQUIRE(linemodel.ComputeFirstPass(dataStore, spectrum, spectrumContinuum, tplCatalog, tplCategories,
+                                           calibrationPath.string(), lineCatalog, "no", "no", lambdaRange,
+                                           "hybrid", "fromspectrum", "velocitydriven", 2350, 100, 300,
+                                           "no", "no", "no", 0.0) == 0);
+  std::shared_ptr<const CLineModelResult> result = std::dynamic_pointer_cast<const CLineModelResult>(linemodel.getResult());
+  BOOST_REQUIRE(result);
+
+  BOOST_REQUIRE(linemodel.ComputeCandidates(5, -1, result->ChiSquare, -1) == 0);
+  candidates = linemodel.GetFirstpassExtremaResult()->Extrema;
+  return result;
+}
+
+// the FeII absorption overlaps Hbeta: the absorption fit depends on the emission velocity, and the first pass cannot be pruned
+const Int32 nLinesMax = 7;
+const char* lineNames[nLinesMax] = {"Halpha", "[OIII]5007", "Hbeta", "[OII]3727", "CaK", "MgI", "FeII4872"};
+const Float64 lineLambdas[nLinesMax] = {6562.8, 5006.8, 4861.3, 3727.5, 3933.7, 5175.0, 4872.0};
+const Float64 lineAmps[nLinesMax] = {2.0, 1.5, 0.7, 1.0, -0.3, -0.2, -0.4};
+
+/**
+ * Writes the catalog of the nLines first test lines, with one velocity group for the emission lines and one for the absorption lines.
+ */
+void WriteLineCatalog(const bfs::path& linecatalogPath, Int32 nLines)
+{
+  std::ofstream out(linecatalogPath.c_str());
+  out << "#version:0.4.0" << std::endl;
+  for (Int32 k=0; k<nLines; k++) {
+    out << lineLambdas[k] << "\t" << lineNames[k] << "\t" << (lineAmps[k]>0.0 ? "E\tS\tSYM\tem" : "A\tS\tSYM\tabs")
+        << "\t1.0\t-1" << std::endl;
+  }
+}
+
+/**
+ * The nLines first test lines at the redshift on a flat continuum, with a deterministic noise.
+ */
+void CreateSpectrum(Float64 redshift, Int32 nLines, CSpectrum& spectrum, CSpectrum& spectrumContinuum)
+{
+  const Int32 n = 3000;
+  TFloat64List lambda(n), flux(n), error(n, 0.1), continuum(n, 1.0);
+  for (Int32 i=0; i<n; i++) {
+    lambda[i] = 3500.0 + 3.0*i;
+    flux[i] = 1.0 + 0.05*sin(0.7*i);
+    for (Int32 k=0; k<nLines; k++) {
+      Float64 x = (lambda[i] - lineLambdas[k]*(1.0+redshift))/(lineAmps[k]>0.0 ? 5.0 : 8.0);
+      flux[i] += lineAmps[k]*exp(-0.5*x*x);
+    }
+  }
+  CSpectrumSpectralAxis spectralAxis(lambda.data(), n);
+  CSpectrumFluxAxis fluxAxis(flux.data(), n, error.data(), n);
+  CSpectrumFluxAxis continuumFluxAxis(continuum.data(), n, error.data(), n);
+  spectrum = CSpectrum(spectralAxis, fluxAxis);
+  spectrumContinuum = CSpectrum(spectralAxis, continuumFluxAxis);
+}
+
+BOOST_AUTO_TEST_CASE(FirstpassPruning)
+{
+  CLog log;
+
+  bfs::path calibrationPath = generate_calibration_dir();
+  bfs::path linecatalogPath = bfs::unique_path("tst_%%%%%%%%%%");
+  WriteLineCatalog(linecatalogPath, nLinesMax-1);
+  CRayCatalog lineCatalog;
+  lineCatalog.Load(linecatalogPath.c_str());
+
+  const Float64 redshift = 0.43;
+  CSpectrum spectrum, spectrumContinuum;
+  CreateSpectrum(redshift, nLinesMax-1, spectrum, spectrumContinuum);
+
+  TFloat64List candidatesFull, candidatesPruned;
+  std::shared_ptr<const CLineModelResult> full = ComputeFirstPass(spectrum, spectrumContinuum, lineCatalog, calibrationPath,
+                                                                  false, candidatesFull);
+  std::shared_ptr<const CLineModelResult> pruned = ComputeFirstPass(spectrum, spectrumContinuum, lineCatalog, calibrationPath,
+                                                                    true, candidatesPruned);
+  BOOST_REQUIRE(pruned->Redshifts == full->Redshifts);
+
+  // the pruned z are stored with a merit above the fitted one, and the fitted z are unchanged
+  Int32 nPruned = 0;
+  for (UInt32 i=0; i<full->Redshifts.size(); i++) {
+    BOOST_CHECK(!full->FirstpassPruned[i]);
+    if (pruned->FirstpassPruned[i]) {
+      nPruned++;
+      BOOST_CHECK(pruned->ChiSquare[i] >= full->ChiSquare[i]);
+    } else {
+      BOOST_CHECK(pruned->ChiSquare[i] == full->ChiSquare[i]);
+    }
+  }
+  BOOST_TEST_MESSAGE("pruned " << nPruned << " of " << full->Redshifts.size());
+  BOOST_CHECK(nPruned > full->Redshifts.size()/2);
+
+  // same best redshift, and no candidate at a pruned z
+  Int32 iBestFull = std::min_element(full->ChiSquare.begin(), full->ChiSquare.end()) - full->ChiSquare.begin();
+  Int32 iBestPruned = std::min_element(pruned->ChiSquare.begin(), pruned->ChiSquare.end()) - pruned->ChiSquare.begin();
+  BOOST_CHECK(iBestPruned == iBestFull);
+  BOOST_CHECK_SMALL(full->Redshifts[iBestFull] - redshift, 0.0021);
+  BOOST_REQUIRE(candidatesFull.size() > 0 && candidatesPruned.size() > 0);
+  BOOST_CHECK(candidatesPruned[0] == candidatesFull[0]);
+  for (UInt32 k=0; k<candidatesPruned.size(); k++) {
+    Int32 idx = std::find(pruned->Redshifts.begin(), pruned->Redshifts.end(), candidatesPruned[k]) - pruned->Redshifts.begin();
+    BOOST_REQUIRE(idx < pruned->Redshifts.size());
+    BOOST_CHECK(!pruned->FirstpassPruned[idx]);
+  }
+
+  // with the overlapping Hbeta and FeII lines, no z can be pruned while they are in the lambda range
+  WriteLineCatalog(linecatalogPath, nLinesMax);
+  CRayCatalog overlappingLineCatalog;
+  overlappingLineCatalog.Load(linecatalogPath.c_str());
+  CreateSpectrum(redshift, nLinesMax, spectrum, spectrumContinuum);
+  std::shared_ptr<const CLineModelResult> overlapping = ComputeFirstPass(spectrum, spectrumContinuum, overlappingLineCatalog,
+                                                                         calibrationPath, true, candidatesPruned);
+  for (UInt32 i=0; i<overlapping->Redshifts.size(); i++) {
+    if (lineLambdas[nLinesMax-1]*(1.0+overlapping->Redshifts[i]) < 11900.0) {
+      BOOST_CHECK(!overlapping->FirstpassPruned[i]);
+    }
+  }
+
+  bfs::remove(linecatalogPath);
+  bfs::remove_all(calibrationPath);
+}
+
+/**
+ * Runs the first pass, the candidates search and the second pass with velocity fitting on threadCount threads.
+ */
+std::shared_ptr<const CLineModelResult> ComputeSecondPass(const CSpectrum& spectrum, const CSpectrum& spectrumContinuum,
+                                                          const CRayCatalog& lineCatalog, const bfs::path& calibrationPath,
+                                                          Int32 threadCount)
+{
+  TFloat64List redshifts = TFloat64Range(0.0, 1.5).SpreadOver(0.002);
+  TFloat64Range lambdaRange(3600.0, 12000.0);
+  CTemplateCatalog tplCatalog;
+  TStringList tplCategories;
+  COperatorResultStore resultStore;
+  CParameterStore parameterStore;
+  CDataStore dataStore(resultStore, parameterStore);
+
+  COperatorLineModel linemodel;
+  linemodel.m_opt_firstpass_fittingmethod = "hybrid";
+  linemodel.m_opt_secondpass_threadCount = threadCount;
+  BOOST_REQUIRE(linemodel.Init(spectrum, redshifts) == 0);
+  BOOST_REQUIRE(linemodel.ComputeFirstPass(dataStore, spectrum, spectrumContinuum, tplCatalog, tplCategories,
+                                           calibrationPath.string(), lineCatalog, "no", "no", lambdaRange,
+                                           "hybrid", "fromspectrum", "velocitydriven", 2350, 100, 300,
+                                           "no", "no", "no", 0.0) == 0);
+  std::shared_ptr<const CLineModelResult> result = std::dynamic_pointer_cast<const CLineModelResult>(linemodel.getResult());
+  BOOST_REQUIRE(result);
+  BOOST_REQUIRE(linemodel.ComputeCandidates(3, -1, result->ChiSquare, -1) == 0);
+  BOOST_REQUIRE(linemodel.GetFirstpassExtremaResult()->Extrema.size() > 1);
+  BOOST_REQUIRE(linemodel.ComputeSecondPass(dataStore, spectrum, spectrumContinuum, tplCatalog, tplCategories,
+                                            calibrationPath.string(), lineCatalog, "no", "no", lambdaRange, 3,
+                                            "hybrid", "fromspectrum", "velocitydriven", 2350, 100, 300,
+                                            "no", "no", "yes", "rules",
+                                            20., 500., 40., 150., 500., 50.) == 0);
+  return result;
+}
+
+BOOST_AUTO_TEST_CASE(SecondPassThreadCount)
+{
+  CLog log;
+
+  bfs::path calibrationPath = generate_calibration_dir();
+  bfs::path linecatalogPath = bfs::unique_path("tst_%%%%%%%%%%");
+  WriteLineCatalog(linecatalogPath, nLinesMax);
+  CRayCatalog lineCatalog;
+  lineCatalog.Load(linecatalogPath.c_str());
+
+  CSpectrum spectrum, spectrumContinuum;
+  CreateSpectrum(0.43, nLinesMax, spectrum, spectrumContinuum);
+
+  // each candidate is refined from its own model, serially or concurrently: same results
+  std::shared_ptr<const CLineModelResult> serial = ComputeSecondPass(spectrum, spectrumContinuum, lineCatalog, calibrationPath, 0);
+  std::shared_ptr<const CLineModelResult> threaded = ComputeSecondPass(spectrum, spectrumContinuum, lineCatalog, calibrationPath, 3);
+  BOOST_REQUIRE(threaded->ChiSquare.size() == serial->ChiSquare.size());
+  for (UInt32 i=0; i<serial->ChiSquare.size(); i++) {
+    BOOST_CHECK(threaded->ChiSquare[i] == serial->ChiSquare[i]);
+    BOOST_CHECK(threaded->LineModelSolutions[i].EmissionVelocity == serial->LineModelSolutions[i].EmissionVelocity);
+    BOOST_CHECK(threaded->LineModelSolutions[i].AbsorptionVelocity == serial->LineModelSolutions[i].AbsorptionVelocity);
+  }
+  const CLineModelExtremaResult& serialExtrema = serial->ExtremaResult;
+  const CLineModelExtremaResult& threadedExtrema = threaded->ExtremaResult;
+  BOOST_REQUIRE(serialExtrema.Extrema.size() > 1);
+  BOOST_CHECK(threadedExtrema.Extrema == serialExtrema.Extrema);
+  BOOST_CHECK(threadedExtrema.ExtremaMerit == serialExtrema.ExtremaMerit);
+  BOOST_CHECK(threadedExtrema.Elv == serialExtrema.Elv);
+  BOOST_CHECK(threadedExtrema.Alv == serialExtrema.Alv);
+
+  bfs::remove(linecatalogPath);
+  bfs::remove_all(calibrationPath);
+}
+
+/**
+ * Line model operator whose velocity fits return an analytic merit, unimodal or bimodal in the velocity.
+ */
+class CVelocityMeritLineModel : public COperatorLineModel
+{
+public:
+  CVelocityMeritLineModel(bool bimodal) : m_bimodal(bimodal) {}
+
+  /**
+   * Searches the velocities vInfLim + kv*vStep, kv in [0, nSteps[ with the given search, as the second pass does.
+   * Returns the number of fits.
+   */
+  Int32 searchVelocity(const std::string& search, Float64 vInfLim, Float64 vStep, Int32 nSteps, Float64& vOptim)
+  {
+    m_opt_secondpass_velfitSearch = search;
+    std::shared_ptr<CLineModelElementList> model;
+    std::vector<Int32> velfitGroup;
+    CLineModelSolution modelSolution;
+    CContinuumModelSolution continuumModelSolution;
+    TFloat64List merits, velocities;
+    Int32 nFits = fitVelocityGrid(model, 0.5, vInfLim, vStep, nSteps, 1, velfitGroup, TFloat64Range(3600.0, 12000.0), 0,
+                                  modelSolution, continuumModelSolution, merits, velocities);
+    Float64 meritMin = DBL_MAX;
+    vOptim = -1.0;
+    for (Int32 kv = 0; kv < nSteps; kv++) {
+      if (meritMin > merits[kv]) {
+        meritMin = merits[kv];
+        vOptim = velocities[kv];
+      }
+    }
+    return nFits;
+  }
+
+protected:
+  Float64 fitVelocity(std::shared_ptr<CLineModelElementList> model, Float64 redshift, Float64 velocity, Int32 iLineType,
+                      const std::vector<Int32>& velfitGroup, const TFloat64Range& lambdaRange, Int32 contreest_iterations,
+                      CLineModelSolution& modelSolution, CContinuumModelSolution& continuumModelSolution,
+                      Float64& fittedVelocity)
+  {
+    fittedVelocity = velocity;
+    if (!m_bimodal) {
+      return (velocity - 237.0) * (velocity - 237.0);
+    }
+    // a broad local minimum at 100 km/s, the global one at 410 km/s is narrower than the coarse step
+    return std::min(0.01 * (velocity - 100.0) * (velocity - 100.0) + 5.0, (velocity - 410.0) * (velocity - 410.0));
+  }
+
+private:
+  bool m_bimodal;
+};
+
+BOOST_AUTO_TEST_CASE(VelocityCoarseToFine)
+{
+  CLog log;
+  const Float64 vInfLim = 20.0;
+  const Float64 vStep = 10.0;
+  const Int32 nSteps = 49;
+
+  // unimodal merit: the coarse grid is refined around its minimum, same velocity as the full grid with fewer fits
+  CVelocityMeritLineModel unimodal(false);
+  Float64 vGrid, vCoarseToFine;
+  BOOST_CHECK_EQUAL(unimodal.searchVelocity("grid", vInfLim, vStep, nSteps, vGrid), nSteps);
+  Int32 nFits = unimodal.searchVelocity("coarsetofine", vInfLim, vStep, nSteps, vCoarseToFine);
+  BOOST_CHECK_EQUAL(vGrid, 240.0);
+  BOOST_CHECK_EQUAL(vCoarseToFine, vGrid);
+  BOOST_CHECK(nFits < nSteps / 2);
+
+  // bimodal merit: the coarse minimum is the local one, the search falls back on the full grid
+  CVelocityMeritLineModel bimodal(true);
+  BOOST_CHECK_EQUAL(bimodal.searchVelocity("grid", vInfLim, vStep, nSteps, vGrid), nSteps);
+  nFits = bimodal.searchVelocity("coarsetofine", vInfLim, vStep, nSteps, vCoarseToFine);
+  BOOST_CHECK_EQUAL(vGrid, 410.0);
+  BOOST_CHECK_EQUAL(vCoarseToFine, vGrid);
+  BOOST_CHECK_EQUAL(nFits, nSteps);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
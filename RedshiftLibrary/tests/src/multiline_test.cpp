@@ -249,6 +249,71 @@ BOOST_AUTO_TEST_CASE(prepareSupportJoined) {
   }
 }
 
+BOOST_AUTO_TEST_CASE(prepareSupportCache) {
+
+  CRay ray = CRay("Abs", 5500, 1, CRay::SYM, 2, 10.2, 10.3, 10.4, 10.5, 10.6, 10.7,
+                  "group", 10.8);
+  CRay ray2 = CRay("Em", 5520, 2, CRay::SYM, 2, 10.2, 10.3, 20.4, 10.5, 10.6, 10.7,
+                   "group", 10.8);
+  CRay ray3 = CRay("Em2", 4400, 2, CRay::SYM, 2, 10.2, 10.3, 20.4, 10.5, 10.6, 10.7,
+                   "group", 10.8);
+  std::vector<CRay> rs;
+  rs.push_back(ray);
+  rs.push_back(ray2);
+  rs.push_back(ray3);
+  TFloat64List nominalAmplitudes;
+  nominalAmplitudes.push_back(0.8);
+  nominalAmplitudes.push_back(0.5);
+  nominalAmplitudes.push_back(0.1);
+  TUInt32List catalogIndexes;
+  catalogIndexes.push_back(1);
+  catalogIndexes.push_back(0);
+  catalogIndexes.push_back(2);
+
+  CSpectrumSpectralAxis spectralAxis = CSpectrumSpectralAxis(15000, false);
+  Float64 *fluxAxis = spectralAxis.GetSamples();
+  for (Int32 k = 0; k < spectralAxis.GetSamplesCount(); k++) {
+    fluxAxis[k] = k;
+  }
+  TFloat64Range lambdaRange = TFloat64Range(3900.0, 12500.0);
+
+  CMultiLine element = CMultiLine(rs, "velocitydriven", 0.9, 300., 300.,
+                                  nominalAmplitudes, 10.2, catalogIndexes);
+  CMultiLine cachedElement = CMultiLine(rs, "velocitydriven", 0.9, 300., 300.,
+                                        nominalAmplitudes, 10.2, catalogIndexes);
+  cachedElement.SetSupportCacheSize(3);
+
+  // the cached supports match the computed ones, whatever the order of the
+  // redshifts and line widths, and after the cache is full
+  Float64 redshifts[6] = {0.1, 0.5, 0.1, 1.0, 0.5, 0.1};
+  Float64 velocities[6] = {300., 300., 2000., 300., 300., 300.};
+  for (Int32 i = 0; i < 6; i++) {
+    element.SetVelocityEmission(velocities[i]);
+    cachedElement.SetVelocityEmission(velocities[i]);
+    element.prepareSupport(spectralAxis, redshifts[i], lambdaRange);
+    cachedElement.prepareSupport(spectralAxis, redshifts[i], lambdaRange);
+
+    TInt32RangeList support = element.getSupport();
+    TInt32RangeList cachedSupport = cachedElement.getSupport();
+    BOOST_REQUIRE(support.size() == cachedSupport.size());
+    for (Int32 k = 0; k < support.size(); k++) {
+      BOOST_CHECK(support[k].GetBegin() == cachedSupport[k].GetBegin());
+      BOOST_CHECK(support[k].GetEnd() == cachedSupport[k].GetEnd());
+    }
+    for (Int32 k = 0; k < rs.size(); k++) {
+      BOOST_CHECK(element.IsOutsideLambdaRange(k) ==
+                  cachedElement.IsOutsideLambdaRange(k));
+      BOOST_CHECK(element.getTheoreticalSupportSubElt(k).GetBegin() ==
+                  cachedElement.getTheoreticalSupportSubElt(k).GetBegin());
+      BOOST_CHECK(element.getTheoreticalSupportSubElt(k).GetEnd() ==
+                  cachedElement.getTheoreticalSupportSubElt(k).GetEnd());
+    }
+    BOOST_CHECK_CLOSE(element.getModelAtLambda(6061., redshifts[i], 1.0, 0),
+                      cachedElement.getModelAtLambda(6061., redshifts[i], 1.0, 0),
+                      precision);
+  }
+}
+
 BOOST_AUTO_TEST_CASE(addModel_SupportAll) {
   // in this case multiline support is equal to spetral axis.
   // So all the bin continuum are duplicate in model after init model
@@ -572,4 +637,149 @@ BOOST_AUTO_TEST_CASE(fitAmplitude) {
   BOOST_CHECK_CLOSE(-1, element.GetElementAmplitude(), precision);
 }
 
+BOOST_AUTO_TEST_CASE(fitAmplitudeFromBasis) {
+  // the fit from the unit profiles cross products matches the direct fit,
+  // for any nominal amplitudes
+  CRay ray = CRay("Abs", 10, 1, CRay::SYM, 2, 1, 5, 20.4, 10.5, 10.6, 10.7,
+                  "group", 10.8);
+  CRay ray2 = CRay("Em", 15, 2, CRay::SYM, 2, 1, 5, 20.4, 10.5, 10.6, 10.7,
+                   "group", 10.8);
+  CRay ray3 = CRay("Em2", 17, 2, CRay::SYM, 2, 1, 5, 20.4, 10.5, 10.6, 10.7,
+                   "group", 10.8);
+  std::vector<CRay> rs;
+  rs.push_back(ray);
+  rs.push_back(ray2);
+  rs.push_back(ray3);
+  TFloat64List nominalAmplitudes;
+  nominalAmplitudes.push_back(0.2);
+  nominalAmplitudes.push_back(1.0);
+  nominalAmplitudes.push_back(0.5);
+  TUInt32List catalogIndexes;
+  catalogIndexes.push_back(0);
+  catalogIndexes.push_back(1);
+  catalogIndexes.push_back(2);
+  CSpectrumSpectralAxis spectralAxis = CSpectrumSpectralAxis(40, false);
+  Float64 *lambdas = spectralAxis.GetSamples();
+  for (Int32 k = 0; k < spectralAxis.GetSamplesCount(); k++) {
+    lambdas[k] = k;
+  }
+
+  CSpectrumFluxAxis noContinuumfluxAxis = CSpectrumFluxAxis(40);
+  CSpectrumFluxAxis continuumFluxAxis = CSpectrumFluxAxis(40);
+  Float64 *flux = noContinuumfluxAxis.GetSamples();
+  Float64 *continuum = continuumFluxAxis.GetSamples();
+  for (Int32 k = 0; k < 40; k++) {
+    flux[k] = 3.0 * exp(-pow(k - 16.5, 2) / 2.0) - 0.4 * exp(-pow(k - 11.0, 2) / 8.0);
+    continuum[k] = 1.0 + 0.01 * k;
+  }
+
+  Float64 redshift = 0.1;
+  TFloat64Range lambdaRange = TFloat64Range(0, 39);
+  CMultiLine element = CMultiLine(rs, "velocitydriven", 0.9, 20000., 30000.,
+                                  nominalAmplitudes, 10.2, catalogIndexes);
+  element.prepareSupport(spectralAxis, redshift, lambdaRange);
+  element.prepareAmplitudeFitBasis(spectralAxis, noContinuumfluxAxis,
+                                   continuumFluxAxis, redshift);
+
+  Float64 tplratios[3][3] = {{0.2, 1.0, 0.5}, {0.0, 1.0, 2.0}, {1.5, 0.3, 0.0}};
+  for (Int32 t = 0; t < 3; t++) {
+    for (Int32 k = 0; k < 3; k++) {
+      element.SetNominalAmplitude(k, tplratios[t][k]);
+    }
+    element.fitAmplitude(spectralAxis, noContinuumfluxAxis, continuumFluxAxis,
+                         redshift);
+    Float64 A = element.GetElementAmplitude();
+    Float64 dtm = element.GetSumCross();
+    Float64 mtm = element.GetSumGauss();
+    TFloat64List amps;
+    for (Int32 k = 0; k < 3; k++) {
+      amps.push_back(element.GetFittedAmplitude(k));
+    }
+
+    BOOST_CHECK(mtm > 0.0);
+    BOOST_REQUIRE(element.fitAmplitudeFromBasis(redshift));
+    BOOST_CHECK_CLOSE(A, element.GetElementAmplitude(), 1e-9);
+    BOOST_CHECK_CLOSE(dtm, element.GetSumCross(), 1e-9);
+    BOOST_CHECK_CLOSE(mtm, element.GetSumGauss(), 1e-9);
+    for (Int32 k = 0; k < 3; k++) {
+      BOOST_CHECK_CLOSE(amps[k], element.GetFittedAmplitude(k), 1e-9);
+    }
+  }
+
+  // the basis is not valid for another redshift or line width
+  BOOST_CHECK(element.fitAmplitudeFromBasis(0.2) == false);
+  element.SetVelocityEmission(10000.);
+  BOOST_CHECK(element.fitAmplitudeFromBasis(redshift) == false);
+}
+
+BOOST_AUTO_TEST_CASE(basisMaxChi2Reduction) {
+  // the chi2 decrease with free ray amplitudes bounds the decrease of any
+  // nominal amplitudes fit, and equals it for a single ray
+  CRay ray = CRay("Em", 15, 2, CRay::SYM, 2, 1, 5, 20.4, 10.5, 10.6, 10.7,
+                  "group", 10.8);
+  CRay ray2 = CRay("Em2", 17, 2, CRay::SYM, 2, 1, 5, 20.4, 10.5, 10.6, 10.7,
+                   "group", 10.8);
+  CSpectrumSpectralAxis spectralAxis = CSpectrumSpectralAxis(40, false);
+  Float64 *lambdas = spectralAxis.GetSamples();
+  for (Int32 k = 0; k < spectralAxis.GetSamplesCount(); k++) {
+    lambdas[k] = k;
+  }
+  CSpectrumFluxAxis noContinuumfluxAxis = CSpectrumFluxAxis(40);
+  CSpectrumFluxAxis continuumFluxAxis = CSpectrumFluxAxis(40);
+  Float64 *flux = noContinuumfluxAxis.GetSamples();
+  Float64 *continuum = continuumFluxAxis.GetSamples();
+  for (Int32 k = 0; k < 40; k++) {
+    flux[k] = 3.0 * exp(-pow(k - 16.5, 2) / 2.0) + 0.2 * sin(k);
+    continuum[k] = 1.0;
+  }
+  Float64 redshift = 0.1;
+  TFloat64Range lambdaRange = TFloat64Range(0, 39);
+
+  std::vector<CRay> rs1;
+  rs1.push_back(ray);
+  CMultiLine single = CMultiLine(rs1, "velocitydriven", 0.9, 20000., 30000.,
+                                 TFloat64List(1, 1.0), 10.2, TUInt32List(1, 0));
+  single.prepareSupport(spectralAxis, redshift, lambdaRange);
+  single.fitAmplitude(spectralAxis, noContinuumfluxAxis, continuumFluxAxis,
+                      redshift);
+  Float64 singleReduction = pow(single.GetSumCross(), 2) / single.GetSumGauss();
+  single.prepareAmplitudeFitBasis(spectralAxis, noContinuumfluxAxis,
+                                  continuumFluxAxis, redshift);
+  BOOST_CHECK_CLOSE(singleReduction, single.GetBasisMaxChi2Reduction(), 1e-9);
+
+  // a duplicated ray does not add any direction to the projection
+  std::vector<CRay> rsDup;
+  rsDup.push_back(ray);
+  rsDup.push_back(ray);
+  TUInt32List dupIndexes;
+  dupIndexes.push_back(0);
+  dupIndexes.push_back(1);
+  CMultiLine dup = CMultiLine(rsDup, "velocitydriven", 0.9, 20000., 30000.,
+                              TFloat64List(2, 1.0), 10.2, dupIndexes);
+  dup.prepareSupport(spectralAxis, redshift, lambdaRange);
+  dup.prepareAmplitudeFitBasis(spectralAxis, noContinuumfluxAxis,
+                               continuumFluxAxis, redshift);
+  BOOST_CHECK_CLOSE(singleReduction, dup.GetBasisMaxChi2Reduction(), 1e-6);
+
+  std::vector<CRay> rs2;
+  rs2.push_back(ray);
+  rs2.push_back(ray2);
+  CMultiLine element = CMultiLine(rs2, "velocitydriven", 0.9, 20000., 30000.,
+                                  TFloat64List(2, 1.0), 10.2, dupIndexes);
+  element.prepareSupport(spectralAxis, redshift, lambdaRange);
+  element.prepareAmplitudeFitBasis(spectralAxis, noContinuumfluxAxis,
+                                   continuumFluxAxis, redshift);
+  Float64 maxReduction = element.GetBasisMaxChi2Reduction();
+  Float64 tplratios[3][2] = {{1.0, 1.0}, {0.1, 1.0}, {1.0, 0.0}};
+  for (Int32 t = 0; t < 3; t++) {
+    element.SetNominalAmplitude(0, tplratios[t][0]);
+    element.SetNominalAmplitude(1, tplratios[t][1]);
+    element.fitAmplitude(spectralAxis, noContinuumfluxAxis, continuumFluxAxis,
+                         redshift);
+    Float64 reduction = pow(element.GetSumCross(), 2) / element.GetSumGauss();
+    BOOST_CHECK(reduction <= maxReduction * (1.0 + 1e-12));
+  }
+  BOOST_CHECK(maxReduction > singleReduction);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
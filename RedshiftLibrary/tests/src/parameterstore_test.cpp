@@ -1,6 +1,7 @@
 #include <RedshiftLibrary/processflow/parameterstore.h>
 #include <RedshiftLibrary/common/datatypes.h>
 #include <RedshiftLibrary/common/range.h>
+#include <RedshiftLibrary/log/log.h>
 
 #include <time.h>
 #include <iostream>
@@ -173,5 +174,34 @@ BOOST_AUTO_TEST_CASE(ParameterStore3)
 
 }
 
+BOOST_AUTO_TEST_CASE(ParameterStoreInvalidType)
+{
+  CLog logger;
+  CParameterStore store;
+  store.Set( "string", std::string("foo") );
+  store.Set( "Float64", 12.3 );
+
+  Float64 float64_;
+  BOOST_CHECK( store.Get( "string", float64_, 1.5 ) == false );
+  BOOST_CHECK_CLOSE( float64_, 1.5, 1e-6 );
+
+  // the invalid value is kept
+  std::string string_;
+  store.Get( "string", string_ );
+  BOOST_CHECK( string_ == "foo" );
+
+  TFloat64List float64_list_;
+  BOOST_CHECK( store.Get( "Float64", float64_list_ ) == false );
+
+  TFloat64Range float64range_;
+  store.Set( "TFloat64List", TFloat64List( {1.0, 2.0, 3.0} ) );
+  BOOST_CHECK( store.Get( "TFloat64List", float64range_, TFloat64Range( 0.5, 1.5 ) ) == false );
+  BOOST_CHECK_CLOSE( float64range_.GetEnd(), 1.5, 1e-6 );
+
+  store.Set( "scope.Int64", Int64(3) );
+  TStringList names = store.GetChildNames();
+  BOOST_CHECK( names.size() == 4 );
+  BOOST_CHECK( store.GetChildNames( "scope" ) == TStringList( {"Int64"} ) );
+}
 
 BOOST_AUTO_TEST_SUITE_END()
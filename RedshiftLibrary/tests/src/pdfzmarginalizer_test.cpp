@@ -0,0 +1,117 @@
+#include <RedshiftLibrary/common/datatypes.h>
+#include <RedshiftLibrary/log/log.h>
+#include <RedshiftLibrary/statistics/pdfz.h>
+#include <RedshiftLibrary/statistics/pdfzmarginalizer.h>
+
+#include <boost/test/unit_test.hpp>
+#include <math.h>
+
+using namespace NSEpic;
+
+BOOST_AUTO_TEST_SUITE(PdfzMarginalizer)
+
+BOOST_AUTO_TEST_CASE(StreamingMatchesReference)
+{
+  CLog logger;
+  const Int32 nz = 200;
+  const Int32 nModels = 4;
+  TFloat64List redshifts(nz);
+  for (Int32 k=0; k<nz; k++) {
+    redshifts[k] = 0.5 + k*0.005;
+  }
+
+  CPdfz pdfz;
+  Float64 cstLog = -12.3;
+  TFloat64List zPrior = pdfz.GetConstantLogZPrior(nz);
+  std::vector<TFloat64List> merits(nModels, TFloat64List(nz));
+  TFloat64List modelPriors(nModels);
+  for (Int32 km=0; km<nModels; km++) {
+    Float64 zc = 0.6 + 0.2*km;
+    for (Int32 k=0; k<nz; k++) {
+      merits[km][k] = 100.0 + 5.0*km + pow((redshifts[k]-zc)/0.02, 2);
+    }
+    modelPriors[km] = (km+1)/10.0;
+  }
+
+  // reference: sum over models of P(z|m) P(m) E(m), normalized by sum of P(m) E(m)
+  std::vector<TFloat64List> logProba(nModels);
+  TFloat64List logEvidence(nModels);
+  for (Int32 km=0; km<nModels; km++) {
+    BOOST_REQUIRE(pdfz.Compute(merits[km], redshifts, cstLog, zPrior, logProba[km], logEvidence[km]) == 0);
+  }
+  Float64 sumEvidence = 0.0;
+  for (Int32 km=0; km<nModels; km++) {
+    sumEvidence += modelPriors[km]*exp(logEvidence[km]);
+  }
+
+  CPdfzMarginalizer marginalizer;
+  for (Int32 km=0; km<nModels; km++) {
+    BOOST_CHECK(marginalizer.Add(redshifts, merits[km], zPrior, cstLog, modelPriors[km]) == 0);
+  }
+  BOOST_CHECK(marginalizer.GetModelCount() == nModels);
+  std::shared_ptr<CPdfMargZLogResult> streamed = std::shared_ptr<CPdfMargZLogResult>(new CPdfMargZLogResult());
+  BOOST_REQUIRE(marginalizer.Finalize(streamed) == 0);
+
+  BOOST_REQUIRE(streamed->valProbaLog.size() == nz);
+  BOOST_CHECK_CLOSE(streamed->valEvidenceLog, log(sumEvidence), 1e-9);
+  for (Int32 k=0; k<nz; k++) {
+    Float64 sumProba = 0.0;
+    for (Int32 km=0; km<nModels; km++) {
+      sumProba += modelPriors[km]*exp(logEvidence[km] + logProba[km][k]);
+    }
+    BOOST_CHECK(streamed->Redshifts[k] == redshifts[k]);
+    if (sumProba > 1e-200) {
+      BOOST_CHECK_SMALL(streamed->valProbaLog[k] - log(sumProba/sumEvidence), 1e-9);
+    }
+  }
+  BOOST_CHECK_CLOSE(pdfz.getSumTrapez(redshifts, streamed->valProbaLog), 1.0, 1e-6);
+
+  // the batch interface gives the same posterior
+  std::shared_ptr<CPdfMargZLogResult> batch = std::shared_ptr<CPdfMargZLogResult>(new CPdfMargZLogResult());
+  std::vector<TFloat64List> zPriors(nModels, zPrior);
+  BOOST_REQUIRE(pdfz.Marginalize(redshifts, merits, zPriors, cstLog, batch, modelPriors) == 0);
+  BOOST_CHECK(batch->valEvidenceLog == streamed->valEvidenceLog);
+  for (Int32 k=0; k<nz; k++) {
+    BOOST_CHECK(batch->valProbaLog[k] == streamed->valProbaLog[k]);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(ConstantModelPriors)
+{
+  CLog logger;
+  const Int32 nz = 50;
+  TFloat64List redshifts(nz);
+  TFloat64List merits(nz);
+  for (Int32 k=0; k<nz; k++) {
+    redshifts[k] = k*0.01;
+    merits[k] = pow((redshifts[k]-0.25)/0.05, 2);
+  }
+  CPdfz pdfz;
+  TFloat64List zPrior = pdfz.GetConstantLogZPrior(nz);
+  TFloat64List logProba;
+  Float64 logEvidence;
+  BOOST_REQUIRE(pdfz.Compute(merits, redshifts, 0.0, zPrior, logProba, logEvidence) == 0);
+
+  // the same model twice with constant priors gives back the single model pdf
+  CPdfzMarginalizer marginalizer;
+  marginalizer.Add(redshifts, merits, zPrior, 0.0);
+  marginalizer.Add(redshifts, merits, zPrior, 0.0);
+  std::shared_ptr<CPdfMargZLogResult> result = std::shared_ptr<CPdfMargZLogResult>(new CPdfMargZLogResult());
+  BOOST_REQUIRE(marginalizer.Finalize(result) == 0);
+  BOOST_CHECK_CLOSE(result->valEvidenceLog, logEvidence, 1e-9);
+  for (Int32 k=0; k<nz; k++) {
+    BOOST_CHECK_SMALL(result->valProbaLog[k] - logProba[k], 1e-9);
+  }
+
+  // mixing constant and explicit model priors is rejected
+  CPdfzMarginalizer mixed;
+  mixed.Add(redshifts, merits, zPrior, 0.0, 0.5);
+  mixed.Add(redshifts, merits, zPrior, 0.0);
+  BOOST_CHECK(mixed.Finalize(result) == -9);
+
+  // nothing to marginalize
+  CPdfzMarginalizer empty;
+  BOOST_CHECK(empty.Finalize(result) == -99);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,168 @@
+#include <RedshiftLibrary/common/datatypes.h>
+#include <RedshiftLibrary/log/log.h>
+#include <RedshiftLibrary/statistics/pdfz.h>
+#include <RedshiftLibrary/statistics/pdfznumerics.h>
+
+#include <boost/test/unit_test.hpp>
+#include <float.h>
+#include <math.h>
+
+using namespace NSEpic;
+
+BOOST_AUTO_TEST_SUITE(PdfzNumerics)
+
+// scalar reference implementations, as the kernels replaced them in CPdfz
+
+static Float64 refLogTrapzExp(const TFloat64List& z, const TFloat64List& logy, Int32 kmin, Int32 kmax)
+{
+  Float64 maxi = -DBL_MAX;
+  for (Int32 k=kmin; k<=kmax; k++) {
+    Float64 zstep;
+    if (k == 0) {
+      zstep = z[k+1] - z[k];
+    } else if (k == z.size()-1) {
+      zstep = z[k] - z[k-1];
+    } else {
+      zstep = (z[k+1] + z[k])*0.5 - (z[k] + z[k-1])*0.5;
+    }
+    if (maxi < logy[k] + log(zstep)) {
+      maxi = logy[k] + log(zstep);
+    }
+  }
+  Float64 sumModifiedExp = 0.0;
+  Float64 modifiedEXPO_previous = exp(logy[kmin] - maxi);
+  for (Int32 k=kmin+1; k<=kmax; k++) {
+    Float64 modifiedEXPO = exp(logy[k] - maxi);
+    sumModifiedExp += (modifiedEXPO + modifiedEXPO_previous)/2.0*(z[k] - z[k-1]);
+    modifiedEXPO_previous = modifiedEXPO;
+  }
+  return maxi + log(sumModifiedExp);
+}
+
+static Float64 refSumRect(const TFloat64List& z, const TFloat64List& logy)
+{
+  Float64 sum = 0.0;
+  for (Int32 k=0; k<z.size()-1; k++) {
+    Float64 zstep = (k == 0) ? (z[k+1] - z[k])*0.5 : (z[k+1] + z[k])*0.5 - (z[k] + z[k-1])*0.5;
+    sum += exp(logy[k])*zstep;
+  }
+  return sum;
+}
+
+static void makeGrid(TFloat64List& z, TFloat64List& logy, Float64 offset)
+{
+  // irregular grid, log-regular in (1+z)
+  z.resize(3000);
+  logy.resize(z.size());
+  for (Int32 k=0; k<z.size(); k++) {
+    z[k] = exp(k*1e-3)*1.05 - 1.0;
+    logy[k] = offset - 0.5*pow((z[k]-2.1)/0.01, 2) + 0.1*sin(k*0.3);
+  }
+}
+
+BOOST_AUTO_TEST_CASE(Kernels)
+{
+  Float64 x[4] = {-1000.0, -1001.0, -INFINITY, -999.5};
+  Float64 w[4] = {1.0, 2.0, 3.0, 0.5};
+  Float64 sum = exp(-0.5) + exp(-1.5) + 1.0;
+  BOOST_CHECK_CLOSE(CPdfzNumerics::LogSumExp(x, 4), -999.5 + log(sum), 1e-12);
+  Float64 wsum = exp(-0.5) + 2.0*exp(-1.5) + 0.5;
+  BOOST_CHECK_CLOSE(CPdfzNumerics::LogSumExpWeighted(x, w, 4), -999.5 + log(wsum), 1e-12);
+  BOOST_CHECK(CPdfzNumerics::Max(x, 4) == -999.5);
+  BOOST_CHECK(CPdfzNumerics::LogSumExp(x+2, 1) == -INFINITY);
+
+  BOOST_CHECK_CLOSE(CPdfzNumerics::LogAddExp(-1000.0, -1001.0), -1000.0 + log(1.0 + exp(-1.0)), 1e-12);
+  BOOST_CHECK(CPdfzNumerics::LogAddExp(-INFINITY, -3.0) == -3.0);
+  BOOST_CHECK(CPdfzNumerics::LogAddExp(-INFINITY, -INFINITY) == -INFINITY);
+
+  Float64 acc[3] = {-INFINITY, -2.0, -INFINITY};
+  Float64 add[3] = {-1.0, -3.0, -INFINITY};
+  CPdfzNumerics::LogAddExp(acc, add, 0.5, 3);
+  BOOST_CHECK(acc[0] == -0.5);
+  BOOST_CHECK_CLOSE(acc[1], log(exp(-2.0) + exp(-2.5)), 1e-12);
+  BOOST_CHECK(acc[2] == -INFINITY);
+}
+
+BOOST_AUTO_TEST_CASE(SumsMatchReference)
+{
+  CLog logger;
+  CPdfz pdfz;
+  TFloat64List z, logy;
+
+  // values that would underflow without the log-sum-exp trick
+  makeGrid(z, logy, -800.0);
+  Float64 logTrapz = CPdfzNumerics::LogTrapzExp(z.data(), logy.data(), z.size());
+  BOOST_CHECK_CLOSE(logTrapz, refLogTrapzExp(z, logy, 0, z.size()-1), 1e-12);
+
+  makeGrid(z, logy, 3.0);
+  BOOST_CHECK_CLOSE(pdfz.getSumTrapez(z, logy), exp(refLogTrapzExp(z, logy, 0, z.size()-1)), 1e-10);
+  BOOST_CHECK_CLOSE(pdfz.getSumRect(z, logy), refSumRect(z, logy), 1e-10);
+
+  // candidate sums: same index range as the former linear search
+  Float64 zcandidates[4] = {2.1, 2.1005, z[0], z[z.size()-1] + 0.5};
+  for (Int32 i=0; i<4; i++) {
+    Float64 zwidth = 0.02;
+    Int32 kmin = 0;
+    Int32 kmax = z.size()-1;
+    for (Int32 k=0; k<z.size(); k++) {
+      if (z[k] < zcandidates[i] - zwidth/2.0) kmin = k;
+    }
+    for (Int32 k=z.size()-1; k>0; k--) {
+      if (z[k] > zcandidates[i] + zwidth/2.0) kmax = k;
+    }
+    Float64 ref = (kmax > kmin) ? exp(refLogTrapzExp(z, logy, kmin, kmax)) : 0.0;
+    Float64 val = pdfz.getCandidateSumTrapez(z, logy, zcandidates[i], zwidth);
+    if (ref == 0.0) {
+      BOOST_CHECK(val == 0.0);
+    } else {
+      BOOST_CHECK_CLOSE(val, ref, 1e-10);
+    }
+  }
+}
+
+BOOST_AUTO_TEST_CASE(ComputeMatchesReference)
+{
+  CLog logger;
+  CPdfz pdfz;
+  TFloat64List z, logy;
+  makeGrid(z, logy, 0.0);
+  TFloat64List merits(z.size());
+  for (Int32 k=0; k<z.size(); k++) {
+    merits[k] = 1500.0 - 2.0*logy[k];
+  }
+  TFloat64List zPrior = pdfz.GetConstantLogZPrior(z.size());
+  Float64 cstLog = -42.0;
+
+  TFloat64List logPdf;
+  Float64 logEvidence;
+  BOOST_REQUIRE(pdfz.Compute(merits, z, cstLog, zPrior, logPdf, logEvidence) == 0);
+
+  TFloat64List smallValues(z.size());
+  for (Int32 k=0; k<z.size(); k++) {
+    smallValues[k] = -0.5*merits[k] + zPrior[k];
+  }
+  Float64 refLogEvidence = cstLog + refLogTrapzExp(z, smallValues, 0, z.size()-1);
+  BOOST_CHECK_CLOSE(logEvidence, refLogEvidence, 1e-12);
+  for (Int32 k=0; k<z.size(); k++) {
+    BOOST_CHECK_SMALL(logPdf[k] - (zPrior[k] + (-0.5*merits[k] + cstLog) - refLogEvidence), 1e-9);
+  }
+  BOOST_CHECK_CLOSE(pdfz.getSumTrapez(z, logPdf), 1.0, 1e-10);
+}
+
+BOOST_AUTO_TEST_CASE(CombineLogZPriorMatchesReference)
+{
+  CPdfz pdfz;
+  TFloat64List prior1 = pdfz.GetConstantLogZPrior(100);
+  TFloat64List prior2(100);
+  for (Int32 k=0; k<100; k++) {
+    prior2[k] = -0.01*k;
+  }
+  TFloat64List combined = pdfz.CombineLogZPrior(prior1, prior2);
+  BOOST_REQUIRE(combined.size() == 100);
+  for (Int32 k=0; k<100; k++) {
+    BOOST_CHECK_SMALL(combined[k] - (prior1[k] + prior2[k]), 1e-12);
+  }
+  BOOST_CHECK(pdfz.CombineLogZPrior(prior1, TFloat64List(3, 0.0)).size() == 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,328 @@
+#include <RedshiftLibrary/common/datatypes.h>
+#include <RedshiftLibrary/log/log.h>
+#include <RedshiftLibrary/method/chisquare2solveresult.h>
+#include <RedshiftLibrary/operator/pdfMargZLogResult.h>
+#include <RedshiftLibrary/processflow/context.h>
+#include <RedshiftLibrary/processflow/parameterstore.h>
+#include <RedshiftLibrary/processflow/processflow.h>
+#include <RedshiftLibrary/processflow/processflowbatch.h>
+#include <RedshiftLibrary/processflow/resultstore.h>
+#include <RedshiftLibrary/ray/catalog.h>
+#include <RedshiftLibrary/reliability/zclassifierstore.h>
+#include <RedshiftLibrary/spectrum/spectrum.h>
+#include <RedshiftLibrary/spectrum/template/catalog.h>
+#include <RedshiftLibrary/spectrum/template/template.h>
+
+#include <boost/filesystem.hpp>
+#include <boost/test/unit_test.hpp>
+#include <fstream>
+#include <math.h>
+
+using namespace NSEpic;
+
+BOOST_AUTO_TEST_SUITE(ProcessFlowBatch)
+
+/**
+ * Continuum with a break and a few emission lines, at rest.
+ */
+Float64 SyntheticFlux(Float64 lambda)
+{
+  Float64 flux = lambda>4000.0 ? 1.0 : 0.6;
+  const Float64 lines[4] = {3727.0, 4861.0, 5007.0, 6563.0};
+  for (UInt32 k=0; k<4; k++) {
+    flux += 2.0*exp(-0.5*pow((lambda-lines[k])/4.0, 2));
+  }
+  return flux;
+}
+
+std::shared_ptr<CParameterStore> CreateParameters(const std::string& calibrationDir)
+{
+  std::shared_ptr<CParameterStore> params = std::shared_ptr<CParameterStore>(new CParameterStore());
+  params->Set("lambdarange", TFloat64Range(4000.0, 8000.0));
+  params->Set("redshiftrange", TFloat64Range(0.0, 1.0));
+  params->Set("redshiftstep", 0.01);
+  params->Set("method", std::string("chisquare2solve"));
+  params->Set("chisquare2solve.interpolation", std::string("lin"));
+  params->Set("templateCategoryList", TStringList(1, "galaxy"));
+  params->Set("calibrationDir", calibrationDir);
+  return params;
+}
+
+BOOST_AUTO_TEST_CASE(MatchesProcessFlow)
+{
+  CLog logger;
+
+  // calibration without dust extinction, as the chisquare2 operator requires
+  boost::filesystem::path calibrationDir = boost::filesystem::unique_path("tst_%%%%%%%%%%");
+  BOOST_REQUIRE(boost::filesystem::create_directories(calibrationDir/"ism"));
+  {
+    std::ofstream calzetti((calibrationDir/"ism"/"SB_calzetti.dl1.txt").c_str());
+    calzetti << "100.0 0.0" << std::endl;
+  }
+
+  TFloat64List tplLambda, tplFlux;
+  for (Float64 lambda=1500.0; lambda<9000.0; lambda+=1.0) {
+    tplLambda.push_back(lambda);
+    tplFlux.push_back(SyntheticFlux(lambda));
+  }
+  CSpectrumSpectralAxis tplSpectralAxis(tplLambda.data(), tplLambda.size());
+  CSpectrumFluxAxis tplFluxAxis(tplFlux.data(), tplFlux.size());
+  std::shared_ptr<CTemplateCatalog> tplCatalog = std::shared_ptr<CTemplateCatalog>(new CTemplateCatalog());
+  tplCatalog->Add(std::shared_ptr<CTemplate>(new CTemplate("synthetic", "galaxy", tplSpectralAxis, tplFluxAxis)));
+  std::shared_ptr<CRayCatalog> rayCatalog = std::shared_ptr<CRayCatalog>(new CRayCatalog());
+  std::shared_ptr<CClassifierStore> zqualStore = std::shared_ptr<CClassifierStore>(new CClassifierStore());
+
+  // row-wise spectra, the template redshifted and scaled, with a deterministic noise
+  const Int32 nSpectra = 4;
+  const Int32 nSamples = 1001;
+  const Float64 trueRedshifts[nSpectra] = {0.12, 0.35, 0.58, 0.81};
+  TFloat64List spectralAxis(nSpectra*nSamples), flux(nSpectra*nSamples), noise(nSpectra*nSamples);
+  for (Int32 i=0; i<nSpectra; i++) {
+    for (Int32 k=0; k<nSamples; k++) {
+      Float64 lambda = 4000.0 + 4.0*k;
+      spectralAxis[i*nSamples+k] = lambda;
+      flux[i*nSamples+k] = (1.0+0.5*i)*SyntheticFlux(lambda/(1.0+trueRedshifts[i])) + 0.05*sin(0.7*k+i);
+      noise[i*nSamples+k] = 0.05;
+    }
+  }
+
+  std::shared_ptr<CParameterStore> params = CreateParameters(calibrationDir.string());
+  CProcessFlowBatch batch(tplCatalog, rayCatalog, params, zqualStore);
+  batch.Process(spectralAxis.data(), flux.data(), noise.data(), nSpectra, nSamples, 1);
+  BOOST_REQUIRE(batch.GetSpectraCount() == nSpectra);
+  TFloat64List redshifts1(nSpectra), merits1(nSpectra);
+  batch.GetRedshifts(redshifts1.data(), nSpectra);
+  batch.GetMerits(merits1.data(), nSpectra);
+
+  batch.Process(spectralAxis.data(), flux.data(), noise.data(), nSpectra, nSamples, 3);
+  TFloat64List redshiftsN(nSpectra), meritsN(nSpectra);
+  batch.GetRedshifts(redshiftsN.data(), nSpectra);
+  batch.GetMerits(meritsN.data(), nSpectra);
+
+  for (Int32 i=0; i<nSpectra; i++) {
+    BOOST_CHECK_MESSAGE(batch.GetStatus(i) == 0, batch.GetError(i));
+
+    // the same spectrum processed on its own
+    CSpectrumSpectralAxis spcSpectralAxis(spectralAxis.data() + i*nSamples, nSamples);
+    CSpectrumFluxAxis spcFluxAxis(flux.data() + i*nSamples, nSamples, noise.data() + i*nSamples, nSamples);
+    std::shared_ptr<CSpectrum> spectrum = std::shared_ptr<CSpectrum>(new CSpectrum(spcSpectralAxis, spcFluxAxis));
+    spectrum->SetName("single");
+    CProcessFlowContext ctx;
+    ctx.Init(spectrum, "single", tplCatalog, rayCatalog,
+             std::shared_ptr<CParameterStore>(new CParameterStore(*CreateParameters(calibrationDir.string()))), zqualStore);
+    CProcessFlow processFlow;
+    processFlow.Process(ctx);
+
+    std::shared_ptr<const CChisquare2SolveResult> solveResult = std::dynamic_pointer_cast<const CChisquare2SolveResult>(
+        ctx.GetResultStore().GetGlobalResult("redshiftresult").lock());
+    BOOST_REQUIRE(solveResult);
+    Float64 redshift, merit, evidence;
+    BOOST_REQUIRE(solveResult->GetBestRedshiftFromPdf(ctx.GetDataStore(), redshift, merit, evidence));
+
+    BOOST_CHECK_CLOSE(redshifts1[i], redshift, 1e-10);
+    BOOST_CHECK_CLOSE(merits1[i], merit, 1e-10);
+    BOOST_CHECK(redshiftsN[i] == redshifts1[i]);
+    BOOST_CHECK(meritsN[i] == merits1[i]);
+    BOOST_CHECK_SMALL(redshift - trueRedshifts[i], 0.011);
+  }
+
+  boost::filesystem::remove_all(calibrationDir);
+}
+
+BOOST_AUTO_TEST_CASE(FFTMethodsThreaded)
+{
+  CLog logger;
+
+  boost::filesystem::path calibrationDir = boost::filesystem::unique_path("tst_%%%%%%%%%%");
+  BOOST_REQUIRE(boost::filesystem::create_directories(calibrationDir/"ism"));
+  {
+    std::ofstream calzetti((calibrationDir/"ism"/"SB_calzetti.dl1.txt").c_str());
+    calzetti << "100.0 0.0" << std::endl;
+  }
+
+  TFloat64List tplLambda, tplFlux;
+  for (Float64 lambda=1500.0; lambda<9000.0; lambda+=1.0) {
+    tplLambda.push_back(lambda);
+    tplFlux.push_back(SyntheticFlux(lambda));
+  }
+  CSpectrumSpectralAxis tplSpectralAxis(tplLambda.data(), tplLambda.size());
+  CSpectrumFluxAxis tplFluxAxis(tplFlux.data(), tplFlux.size());
+  std::shared_ptr<CTemplateCatalog> tplCatalog = std::shared_ptr<CTemplateCatalog>(new CTemplateCatalog());
+  tplCatalog->Add(std::shared_ptr<CTemplate>(new CTemplate("synthetic", "galaxy", tplSpectralAxis, tplFluxAxis)));
+  std::shared_ptr<CRayCatalog> rayCatalog = std::shared_ptr<CRayCatalog>(new CRayCatalog());
+  std::shared_ptr<CClassifierStore> zqualStore = std::shared_ptr<CClassifierStore>(new CClassifierStore());
+
+  // more spectra than threads, so that the FFT plans are created and destroyed concurrently
+  const Int32 nSpectra = 8;
+  const Int32 nSamples = 1001;
+  TFloat64List spectralAxis(nSpectra*nSamples), flux(nSpectra*nSamples), noise(nSpectra*nSamples);
+  for (Int32 i=0; i<nSpectra; i++) {
+    Float64 redshift = 0.1 + 0.1*i;
+    for (Int32 k=0; k<nSamples; k++) {
+      Float64 lambda = 4000.0 + 4.0*k;
+      spectralAxis[i*nSamples+k] = lambda;
+      flux[i*nSamples+k] = SyntheticFlux(lambda/(1.0+redshift)) + 0.05*sin(0.7*k+i);
+      noise[i*nSamples+k] = 0.05;
+    }
+  }
+
+  const std::string methods[2] = {"chisquarelogsolve", "correlationsolve"};
+  for (UInt32 m=0; m<2; m++) {
+    std::shared_ptr<CParameterStore> params = CreateParameters(calibrationDir.string());
+    params->Set("method", methods[m]);
+    params->Set("correlationsolve.fft", std::string("yes"));
+    // the correlation refines its extrema within 0.001, the grid has to be finer
+    params->Set("redshiftrange", TFloat64Range(0.05, 0.9));
+    params->Set("redshiftstep", 0.0005);
+    CProcessFlowBatch batch(tplCatalog, rayCatalog, params, zqualStore);
+
+    batch.Process(spectralAxis.data(), flux.data(), noise.data(), nSpectra, nSamples, 1);
+    BOOST_REQUIRE(batch.GetSpectraCount() == nSpectra);
+    TFloat64List redshifts1(nSpectra), merits1(nSpectra);
+    batch.GetRedshifts(redshifts1.data(), nSpectra);
+    batch.GetMerits(merits1.data(), nSpectra);
+    TInt32List status1(nSpectra);
+    for (Int32 i=0; i<nSpectra; i++) {
+      status1[i] = batch.GetStatus(i);
+      BOOST_CHECK_MESSAGE(status1[i] == 0, methods[m] << ": " << batch.GetError(i));
+    }
+
+    batch.Process(spectralAxis.data(), flux.data(), noise.data(), nSpectra, nSamples, 4);
+    TFloat64List redshiftsN(nSpectra), meritsN(nSpectra);
+    batch.GetRedshifts(redshiftsN.data(), nSpectra);
+    batch.GetMerits(meritsN.data(), nSpectra);
+    for (Int32 i=0; i<nSpectra; i++) {
+      BOOST_CHECK(batch.GetStatus(i) == status1[i]);
+      BOOST_CHECK_MESSAGE(redshiftsN[i] == redshifts1[i], methods[m] << ": " << redshiftsN[i] << " != " << redshifts1[i]);
+      BOOST_CHECK_MESSAGE(meritsN[i] == merits1[i], methods[m] << ": " << meritsN[i] << " != " << merits1[i]);
+    }
+  }
+
+  boost::filesystem::remove_all(calibrationDir);
+}
+
+/**
+ * Writes a template file in the category directory, sampled every 1A from lambdaMin to lambdaMax.
+ */
+void WriteTemplate(const boost::filesystem::path& categoryDir, const std::string& name, Float64 lambdaMin, Float64 lambdaMax,
+                   Float64 slope, Float64 lineLambda)
+{
+  BOOST_REQUIRE(boost::filesystem::exists(categoryDir) || boost::filesystem::create_directories(categoryDir));
+  std::ofstream out((categoryDir/name).c_str());
+  for (Float64 lambda=lambdaMin; lambda<=lambdaMax; lambda+=1.0) {
+    out << lambda << " " << 1.0 + slope*(lambda-5000.0)/5000.0 + 3.0*exp(-0.5*pow((lambda-lineLambda)/30.0, 2)) << std::endl;
+  }
+}
+
+/**
+ * Processes the spectrum with the galaxy method and the stellar and qso solves, on threadCount threads.
+ */
+void ProcessWithSolves(const boost::filesystem::path& calibrationDir, std::shared_ptr<CSpectrum> spectrum,
+                       std::shared_ptr<CTemplateCatalog> tplCatalog, std::shared_ptr<CRayCatalog> rayCatalog,
+                       std::shared_ptr<CClassifierStore> zqualStore, Int32 threadCount, CProcessFlowContext& ctx)
+{
+  std::shared_ptr<CParameterStore> params = CreateParameters(calibrationDir.string());
+  params->Set("enablestellarsolve", std::string("yes"));
+  params->Set("enableqsosolve", std::string("yes"));
+  // no IGM calibration
+  params->Set("qsosolve.qsosolve.extinction", std::string("no"));
+  params->Set("processflow.threadcount", Int64(threadCount));
+  ctx.Init(spectrum, "single", tplCatalog, rayCatalog, params, zqualStore);
+  CProcessFlow processFlow;
+  processFlow.Process(ctx);
+}
+
+/**
+ * Checks that the pdf stored under name is the same in both contexts.
+ */
+void CheckSamePdf(CProcessFlowContext& serial, CProcessFlowContext& threaded, const std::string& name)
+{
+  std::shared_ptr<const CPdfMargZLogResult> serialPdf = std::dynamic_pointer_cast<const CPdfMargZLogResult>(
+      serial.GetResultStore().GetGlobalResult(name).lock());
+  std::shared_ptr<const CPdfMargZLogResult> threadedPdf = std::dynamic_pointer_cast<const CPdfMargZLogResult>(
+      threaded.GetResultStore().GetGlobalResult(name).lock());
+  BOOST_REQUIRE_MESSAGE(serialPdf && threadedPdf, name);
+  BOOST_CHECK(serialPdf->Redshifts.size() > 1);
+  BOOST_CHECK_MESSAGE(threadedPdf->Redshifts == serialPdf->Redshifts, name);
+  BOOST_CHECK_MESSAGE(threadedPdf->valProbaLog == serialPdf->valProbaLog, name);
+  BOOST_CHECK_MESSAGE(threadedPdf->valEvidenceLog == serialPdf->valEvidenceLog, name);
+}
+
+/**
+ * Checks that the best redshift of the chisquare2 solve result stored under name is the same in both contexts.
+ */
+void CheckSameBestRedshift(CProcessFlowContext& serial, CProcessFlowContext& threaded, const std::string& name)
+{
+  std::shared_ptr<const CChisquare2SolveResult> serialResult = std::dynamic_pointer_cast<const CChisquare2SolveResult>(
+      serial.GetResultStore().GetGlobalResult(name).lock());
+  std::shared_ptr<const CChisquare2SolveResult> threadedResult = std::dynamic_pointer_cast<const CChisquare2SolveResult>(
+      threaded.GetResultStore().GetGlobalResult(name).lock());
+  BOOST_REQUIRE_MESSAGE(serialResult && threadedResult, name);
+  Float64 serialRedshift, serialMerit, threadedRedshift, threadedMerit;
+  std::string serialTpl, threadedTpl;
+  Float64 amplitude, dustCoeff;
+  Int32 meiksinIdx;
+  BOOST_REQUIRE(serialResult->GetBestRedshift(serial.GetDataStore(), serialRedshift, serialMerit, serialTpl, amplitude, dustCoeff, meiksinIdx));
+  BOOST_REQUIRE(threadedResult->GetBestRedshift(threaded.GetDataStore(), threadedRedshift, threadedMerit, threadedTpl, amplitude, dustCoeff, meiksinIdx));
+  BOOST_CHECK_MESSAGE(threadedRedshift == serialRedshift, name);
+  BOOST_CHECK_MESSAGE(threadedMerit == serialMerit, name);
+  BOOST_CHECK_EQUAL(threadedTpl, serialTpl);
+}
+
+BOOST_AUTO_TEST_CASE(StellarQsoSolvesThreaded)
+{
+  CLog logger;
+
+  // calibration with the star and qso templates
+  boost::filesystem::path calibrationDir = boost::filesystem::unique_path("tst_%%%%%%%%%%");
+  BOOST_REQUIRE(boost::filesystem::create_directories(calibrationDir/"ism"));
+  {
+    std::ofstream calzetti((calibrationDir/"ism"/"SB_calzetti.dl1.txt").c_str());
+    calzetti << "100.0 0.0" << std::endl;
+    std::ofstream config((calibrationDir/"calibration-config.txt").c_str());
+    config << "star-templates-dir=templates_stars" << std::endl;
+    config << "qso-templates-dir=templates_qso" << std::endl;
+  }
+  WriteTemplate(calibrationDir/"templates_stars"/"star", "star1.txt", 3000.0, 9000.0, 0.5, 5500.0);
+  WriteTemplate(calibrationDir/"templates_stars"/"star", "star2.txt", 3000.0, 9000.0, -0.5, 4300.0);
+  WriteTemplate(calibrationDir/"templates_qso"/"emission", "qso1.txt", 500.0, 9000.0, 0.2, 2800.0);
+
+  TFloat64List tplLambda, tplFlux;
+  for (Float64 lambda=1500.0; lambda<9000.0; lambda+=1.0) {
+    tplLambda.push_back(lambda);
+    tplFlux.push_back(SyntheticFlux(lambda));
+  }
+  CSpectrumSpectralAxis tplSpectralAxis(tplLambda.data(), tplLambda.size());
+  CSpectrumFluxAxis tplFluxAxis(tplFlux.data(), tplFlux.size());
+  std::shared_ptr<CTemplateCatalog> tplCatalog = std::shared_ptr<CTemplateCatalog>(new CTemplateCatalog());
+  tplCatalog->Add(std::shared_ptr<CTemplate>(new CTemplate("synthetic", "galaxy", tplSpectralAxis, tplFluxAxis)));
+  std::shared_ptr<CRayCatalog> rayCatalog = std::shared_ptr<CRayCatalog>(new CRayCatalog());
+  std::shared_ptr<CClassifierStore> zqualStore = std::shared_ptr<CClassifierStore>(new CClassifierStore());
+
+  const Int32 nSamples = 1001;
+  TFloat64List lambda(nSamples), flux(nSamples), noise(nSamples, 0.05);
+  for (Int32 k=0; k<nSamples; k++) {
+    lambda[k] = 4000.0 + 4.0*k;
+    flux[k] = SyntheticFlux(lambda[k]/1.35) + 0.05*sin(0.7*k);
+  }
+  CSpectrumSpectralAxis spcSpectralAxis(lambda.data(), nSamples);
+  CSpectrumFluxAxis spcFluxAxis(flux.data(), nSamples, noise.data(), nSamples);
+  std::shared_ptr<CSpectrum> spectrum = std::shared_ptr<CSpectrum>(new CSpectrum(spcSpectralAxis, spcFluxAxis));
+  spectrum->SetName("single");
+
+  // the stellar and qso solves next to the galaxy method, or after it: same stored results
+  CProcessFlowContext serial, threaded;
+  ProcessWithSolves(calibrationDir, spectrum, tplCatalog, rayCatalog, zqualStore, 0, serial);
+  ProcessWithSolves(calibrationDir, spectrum, tplCatalog, rayCatalog, zqualStore, 2, threaded);
+
+  CheckSamePdf(serial, threaded, "zPDF/logposterior.logMargP_Z_data");
+  CheckSamePdf(serial, threaded, "stellar_zPDF/logposterior.logMargP_Z_data");
+  CheckSamePdf(serial, threaded, "qso_zPDF/logposterior.logMargP_Z_data");
+  CheckSameBestRedshift(serial, threaded, "redshiftresult");
+  CheckSameBestRedshift(serial, threaded, "stellarsolve.stellarresult");
+  CheckSameBestRedshift(serial, threaded, "qsosolve.qsoresult");
+
+  boost::filesystem::remove_all(calibrationDir);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,56 @@
+#include <RedshiftLibrary/processflow/processflowparameters.h>
+#include <RedshiftLibrary/processflow/parameterstore.h>
+#include <RedshiftLibrary/log/log.h>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace NSEpic;
+
+BOOST_AUTO_TEST_SUITE(ProcessFlowParameters)
+
+BOOST_AUTO_TEST_CASE(Load)
+{
+  CLog logger;
+  CParameterStore store;
+  store.Set( "lambdarange", TFloat64Range( 4000.0, 9000.0 ) );
+  store.Set( "redshiftrange", TFloat64Range( 0.0, 1.0 ) );
+  store.Set( "redshiftstep", 0.1 );
+  store.Set( "method", std::string("ChiSquare2Solve") );
+  store.Set( "enablestellarsolve", std::string("yes") );
+  store.Set( "chisquare2solve.spectrum.component", std::string("nocontinuum") );
+
+  CProcessFlowParameters params;
+  BOOST_CHECK( params.Load( store ) );
+  BOOST_CHECK( params.GetWarnings().empty() );
+  BOOST_CHECK( params.MethodName == "chisquare2solve" );
+  BOOST_CHECK( params.Redshifts.size() == 11 );
+  BOOST_CHECK( params.EnableStellarSolve && !params.EnableQsoSolve );
+  BOOST_CHECK( params.MethodFitting.SpcComponent == "nocontinuum" );
+  BOOST_CHECK( params.MethodFitting.Interpolation == "precomputedfinegrid" );
+  BOOST_CHECK( params.StellarFitting.DustFit == "yes" );
+
+  // the defaults are added to the store
+  std::string sampling;
+  store.Get( "redshiftsampling", sampling );
+  BOOST_CHECK( sampling == "lin" );
+}
+
+BOOST_AUTO_TEST_CASE(Errors)
+{
+  CLog logger;
+  CParameterStore store;
+  store.Set( "lambdarange", TFloat64Range( 4000.0, 9000.0 ) );
+  store.Set( "redshiftrange", TFloat64Range( 0.0, 1.0 ) );
+  store.Set( "redshiftstep", std::string("fine") );
+  store.Set( "redshiftsampling", std::string("quadratic") );
+  store.Set( "method", std::string("linemodel") );
+  store.Set( "linemodelsolv", std::string("typo") );
+
+  CProcessFlowParameters params;
+  BOOST_CHECK( params.Load( store ) == false );
+  // wrong redshiftstep type, and then not positive, unknown redshiftsampling
+  BOOST_CHECK( params.GetErrors().size() == 3 );
+  BOOST_CHECK( params.GetWarnings().size() == 1 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
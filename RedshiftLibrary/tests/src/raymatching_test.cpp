@@ -5,7 +5,9 @@
 
 #include <time.h>
 #include <iostream>
+#include <sstream>
 #include <stdlib.h>
+#include <math.h>
 #include <boost/test/unit_test.hpp>
 
 using namespace NSEpic;
@@ -87,4 +89,146 @@ BOOST_AUTO_TEST_CASE(Compute){
   BOOST_CHECK_CLOSE(res->SolutionSetList[2][0].Redshift,7, precision);
 }
 
+/**
+ * Reference matching: the double loop over all the detected line / rest line couples, as done by CRayMatching
+ * before the couples were indexed by redshift.
+ */
+CRayMatchingResult::TSolutionSetList bruteForceMatching(const CRayCatalog& detectedRayCatalog, const CRayCatalog& restRayCatalog,
+                                                        const TFloat64Range& redshiftRange, Int32 nThreshold, Float64 tol)
+{
+  CRayCatalog::TRayVector detectedRayList = detectedRayCatalog.GetFilteredList(CRay::nType_Emission, -1);
+  CRayCatalog::TRayVector restRayList = restRayCatalog.GetFilteredList(CRay::nType_Emission, -1);
+
+  CRayMatchingResult::TSolutionSetList solutions;
+  if(detectedRayList.size() == 1){
+    for(UInt32 iRest=0; iRest<restRayList.size(); iRest++){
+      Float64 z = (detectedRayList[0].GetPosition()-restRayList[iRest].GetPosition())/restRayList[iRest].GetPosition();
+      if(z > 0){
+        solutions.push_back(CRayMatchingResult::TSolutionSet(1, CRayMatchingResult::SSolution(detectedRayList[0], restRayList[iRest], z)));
+      }
+    }
+  }else{
+    for(UInt32 iDet=0; iDet<detectedRayList.size(); iDet++){
+      for(UInt32 iRest=0; iRest<restRayList.size(); iRest++){
+        Float64 z = (detectedRayList[iDet].GetPosition()-restRayList[iRest].GetPosition())/restRayList[iRest].GetPosition();
+        if(z < 0){
+          continue;
+        }
+        CRayMatchingResult::TSolutionSet solution(1, CRayMatchingResult::SSolution(detectedRayList[iDet], restRayList[iRest], z));
+        for(UInt32 iDet2=0; iDet2<detectedRayList.size(); iDet2++){
+          if(iDet2 == iDet){
+            continue;
+          }
+          for(UInt32 iRest2=0; iRest2<restRayList.size(); iRest2++){
+            Float64 z2 = (detectedRayList[iDet2].GetPosition()-restRayList[iRest2].GetPosition())/restRayList[iRest2].GetPosition();
+            if(z2 < 0 || fabs(z-z2) > tol*(1+(z+z2)*0.5)){
+              continue;
+            }
+            bool found = false;
+            for(UInt32 iSet=0; iSet<solution.size(); iSet++){
+              if(solution[iSet].DetectedRay.GetPosition() == detectedRayList[iDet2].GetPosition()){
+                found = true;
+                break;
+              }
+            }
+            if(!found){
+              solution.push_back(CRayMatchingResult::SSolution(detectedRayList[iDet2], restRayList[iRest2], z2));
+            }
+          }
+        }
+        solutions.push_back(solution);
+      }
+    }
+  }
+
+  CRayMatchingResult::TSolutionSetList newSolutions;
+  for(UInt32 iSol=0; iSol<solutions.size(); iSol++){
+    CRayMatchingResult::TSolutionSet currentSet = solutions[iSol];
+    sort(currentSet.begin(), currentSet.end());
+    bool found = false;
+    for(UInt32 iNew=0; iNew<newSolutions.size() && !found; iNew++){
+      const CRayMatchingResult::TSolutionSet& newSet = newSolutions[iNew];
+      bool equal = newSet.size() == currentSet.size();
+      for(UInt32 iSet=0; iSet<currentSet.size() && equal; iSet++){
+        equal = !(newSet[iSet].DetectedRay != currentSet[iSet].DetectedRay) && !(newSet[iSet].RestRay != currentSet[iSet].RestRay)
+            && newSet[iSet].Redshift == currentSet[iSet].Redshift;
+      }
+      found = equal;
+    }
+    if(found || currentSet.size() < nThreshold){
+      continue;
+    }
+    Float64 zMean = 0.0;
+    for(UInt32 i=0; i<currentSet.size(); i++){
+      zMean += currentSet[i].Redshift;
+    }
+    zMean /= currentSet.size();
+    if(zMean > redshiftRange.GetBegin() && zMean < redshiftRange.GetEnd()){
+      newSolutions.push_back(currentSet);
+    }
+  }
+  return newSolutions;
+}
+
+BOOST_AUTO_TEST_CASE(MatchesBruteForce){
+  // random catalogs: a few detected lines at a common redshift, the others at random positions,
+  // some of them at the same position
+  srand(1234);
+  CRayMatching lineMatching;
+  TFloat64Range redshiftRange(0, 5);
+  Int32 nNonEmpty = 0;
+  for(Int32 iTrial=0; iTrial<300; iTrial++){
+    CRayCatalog restRayCatalog;
+    Int32 nRest = 1 + rand()%12;
+    TFloat64List restPositions;
+    for(Int32 k=0; k<nRest; k++){
+      restPositions.push_back(1000.0 + 6000.0*rand()/RAND_MAX);
+      std::ostringstream name;
+      name << "Rest" << k;
+      restRayCatalog.Add(CRay(name.str(), restPositions[k], CRay::nType_Emission, CRay::SYM, 2, 1, 4, 5.6));
+    }
+
+    CRayCatalog detectedRayCatalog;
+    Int32 nDetected = 1 + rand()%10;
+    Float64 z = 3.0*rand()/RAND_MAX;
+    for(Int32 k=0; k<nDetected; k++){
+      Float64 position;
+      Int32 kind = rand()%4;
+      if(kind < 2){
+        position = restPositions[rand()%nRest]*(1+z)*(1+0.002*(2.0*rand()/RAND_MAX-1));
+      }else if(kind == 2 && k > 0){
+        position = detectedRayCatalog.GetList()[rand()%k].GetPosition();
+      }else{
+        position = 1000.0 + 20000.0*rand()/RAND_MAX;
+      }
+      std::ostringstream name;
+      name << "Detected" << k;
+      detectedRayCatalog.Add(CRay(name.str(), position, CRay::nType_Emission, CRay::SYM, 2, 1, 4, 5.6));
+    }
+
+    Int32 nThreshold = 1 + rand()%3;
+    Float64 tol = (rand()%2) ? 0.002 : 0.01;
+    CRayMatchingResult::TSolutionSetList expected = bruteForceMatching(detectedRayCatalog, restRayCatalog, redshiftRange, nThreshold, tol);
+    std::shared_ptr<CRayMatchingResult> res = lineMatching.Compute(detectedRayCatalog, restRayCatalog, redshiftRange, nThreshold, tol,
+                                                                   CRay::nType_Emission, -1, -1);
+    if(expected.empty()){
+      BOOST_CHECK(!res);
+      continue;
+    }
+    nNonEmpty++;
+    BOOST_REQUIRE(res);
+    BOOST_REQUIRE_EQUAL(res->SolutionSetList.size(), expected.size());
+    for(UInt32 iSol=0; iSol<expected.size(); iSol++){
+      BOOST_REQUIRE_EQUAL(res->SolutionSetList[iSol].size(), expected[iSol].size());
+      for(UInt32 iSet=0; iSet<expected[iSol].size(); iSet++){
+        const CRayMatchingResult::SSolution& s = res->SolutionSetList[iSol][iSet];
+        BOOST_CHECK_EQUAL(s.DetectedRay.GetName(), expected[iSol][iSet].DetectedRay.GetName());
+        BOOST_CHECK_EQUAL(s.RestRay.GetName(), expected[iSol][iSet].RestRay.GetName());
+        BOOST_CHECK_EQUAL(s.Redshift, expected[iSol][iSet].Redshift);
+      }
+    }
+  }
+  BOOST_CHECK(nNonEmpty > 100);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
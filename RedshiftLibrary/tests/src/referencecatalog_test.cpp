@@ -0,0 +1,112 @@
+#include <RedshiftLibrary/processflow/referencecatalog.h>
+#include <RedshiftLibrary/common/datatypes.h>
+#include <RedshiftLibrary/log/log.h>
+
+#include <fstream>
+#include <boost/test/unit_test.hpp>
+
+using namespace NSEpic;
+
+BOOST_AUTO_TEST_SUITE(ReferenceCatalog)
+
+BOOST_AUTO_TEST_CASE(ReferenceCatalog1)
+{
+  CLog logger;
+  const std::string path = "/tmp/referencecatalog.test";
+  {
+    std::ofstream file( path.c_str() );
+    file << "# id zref flag" << std::endl;
+    file << "spc_100.fits 0.5 1" << std::endl;
+    file << "" << std::endl;
+    file << "spc_10.fits\t1.25 2" << std::endl;
+    file << "spc_20.fits abc 3" << std::endl;
+    file << "spc_10.fits 9.0 4" << std::endl;
+  }
+
+  CReferenceCatalog catalog;
+  BOOST_CHECK( catalog.Load( path ) );
+  BOOST_CHECK_EQUAL( catalog.GetRowCount(), 4 );
+
+  // exact ID, and ID without extension
+  BOOST_CHECK_EQUAL( catalog.FindRow( "spc_10.fits" ), 1 );
+  BOOST_CHECK_EQUAL( catalog.FindRow( "spc_10" ), 1 );
+  // inclusion: spc_1 is part of spc_100.fits, the first row
+  BOOST_CHECK_EQUAL( catalog.FindRow( "spc_1" ), 0 );
+  // reverse inclusion: the row ID is part of the spectrum name
+  BOOST_CHECK_EQUAL( catalog.FindRow( "spc_20.fits", 1 ), 2 );
+  BOOST_CHECK_EQUAL( catalog.FindRow( "spc_20", 1 ), -1 );
+  BOOST_CHECK_EQUAL( catalog.FindRow( "spc_30" ), -1 );
+
+  Float64 zref = -1.0;
+  BOOST_CHECK( catalog.GetValue( "spc_10", 2, zref ) );
+  BOOST_CHECK_EQUAL( zref, 1.25 );
+  Int64 flag = 0;
+  BOOST_CHECK( catalog.GetValue( "spc_100", 3, flag ) );
+  BOOST_CHECK_EQUAL( flag, 1 );
+  std::string name;
+  BOOST_CHECK( catalog.GetValue( "spc_20", 1, name ) );
+  BOOST_CHECK_EQUAL( name, "spc_20.fits" );
+
+  zref = -1.0;
+  BOOST_CHECK( !catalog.GetValue( "spc_20", 2, zref ) );
+  BOOST_CHECK( !catalog.GetValue( "spc_10", 4, zref ) );
+  BOOST_CHECK( !catalog.GetValue( "spc_30", 2, zref ) );
+  BOOST_CHECK_EQUAL( zref, -1.0 );
+
+  // the shared catalog is read once
+  std::shared_ptr<const CReferenceCatalog> shared = CReferenceCatalog::GetShared( path );
+  BOOST_CHECK( shared );
+  BOOST_CHECK( shared == CReferenceCatalog::GetShared( path ) );
+  BOOST_CHECK_EQUAL( shared->GetRowCount(), 4 );
+
+  BOOST_CHECK( !catalog.Load( "/tmp/referencecatalog.notfound" ) );
+  BOOST_CHECK( !CReferenceCatalog::GetShared( "/tmp/referencecatalog.notfound" ) );
+}
+
+BOOST_AUTO_TEST_CASE(RowPriority)
+{
+  CLog logger;
+  const std::string path = "/tmp/referencecatalog_priority.test";
+  {
+    std::ofstream file( path.c_str() );
+    file << "spc_100.fits 0.5 1" << std::endl;
+    file << "spc_10.fits 1.25" << std::endl;
+    file << "spc_10 2.5 2" << std::endl;
+    file << "spc_10.fits 3.75 3 7" << std::endl;
+    file << "obj_5 4.0 4" << std::endl;
+  }
+
+  CReferenceCatalog catalog;
+  BOOST_REQUIRE( catalog.Load( path ) );
+
+  // the indexed rows win over the earlier row spc_100.fits, that only includes spc_10
+  BOOST_CHECK_EQUAL( catalog.FindRow( "spc_10.fits" ), 1 );
+  // ID and ID without extension: the earlier of the two
+  BOOST_CHECK_EQUAL( catalog.FindRow( "spc_10" ), 1 );
+  // no indexed row: the first row matching by inclusion
+  BOOST_CHECK_EQUAL( catalog.FindRow( "spc_1" ), 0 );
+  BOOST_CHECK_EQUAL( catalog.FindRow( "obj_5_b.fits", 1 ), 4 );
+  BOOST_CHECK_EQUAL( catalog.FindRow( "obj_5.fits", 1 ), 4 );
+
+  // the indexed row has no column 3: the search falls through to the other indexed row, then to the rows matching by
+  // inclusion, in file order
+  BOOST_CHECK_EQUAL( catalog.FindRow( "spc_10", 0, 3 ), 2 );
+  BOOST_CHECK_EQUAL( catalog.FindRow( "spc_10.fits", 0, 3 ), 3 );
+  BOOST_CHECK_EQUAL( catalog.FindRow( "spc_10.f", 0, 3 ), 3 );
+  // only the repeated row has a column 4
+  BOOST_CHECK_EQUAL( catalog.FindRow( "spc_10", 0, 4 ), 3 );
+  BOOST_CHECK_EQUAL( catalog.FindRow( "spc_10", 0, 5 ), -1 );
+
+  Float64 zref = -1.0;
+  BOOST_CHECK( catalog.GetValue( "spc_10.fits", 2, zref ) );
+  BOOST_CHECK_EQUAL( zref, 1.25 );
+  Int64 flag = 0;
+  BOOST_CHECK( catalog.GetValue( "spc_10.fits", 3, flag ) );
+  BOOST_CHECK_EQUAL( flag, 3 );
+  BOOST_CHECK( catalog.GetValue( "spc_10", 3, flag ) );
+  BOOST_CHECK_EQUAL( flag, 2 );
+  BOOST_CHECK( catalog.GetValue( "spc_10", 4, flag ) );
+  BOOST_CHECK_EQUAL( flag, 7 );
+}
+
+BOOST_AUTO_TEST_SUITE_END()
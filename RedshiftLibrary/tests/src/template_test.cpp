@@ -62,5 +62,36 @@ BOOST_AUTO_TEST_CASE(Save)
 
 }
 
+BOOST_AUTO_TEST_CASE(FineGrid)
+{
+  Float64 array[] = {1.,2.,3.,4.,5.};
+  Float64 flux[] = {1.,1.,1.,1.,1.};
+  CSpectrumSpectralAxis spectralAxis(array, 5, false) ;
+  CSpectrumFluxAxis fluxAxis(flux, 5);
+  CTemplate tmpl("name", "category", spectralAxis, fluxAxis);
+
+  // double precision
+  BOOST_CHECK(tmpl.GetFineGridFluxSinglePrecision() == NULL);
+  const Float64* fineGrid = tmpl.GetFineGridFlux();
+  BOOST_CHECK(fineGrid != NULL);
+  BOOST_CHECK(tmpl.GetFineGridFlux() == fineGrid);
+  BOOST_CHECK_CLOSE(fineGrid[0], 0.0, 1e-8);
+  BOOST_CHECK_CLOSE(fineGrid[25], 1.0, 1e-8);
+  BOOST_CHECK_CLOSE(fineGrid[50], 1.0, 1e-8);
+
+  // single precision
+  tmpl.SetFineGridSinglePrecision(true);
+  BOOST_CHECK(tmpl.GetFineGridFlux() == NULL);
+  const Float32* fineGrid32 = tmpl.GetFineGridFluxSinglePrecision();
+  BOOST_CHECK(fineGrid32 != NULL);
+  BOOST_CHECK_CLOSE(fineGrid32[0], 0.0, 1e-6);
+  BOOST_CHECK_CLOSE(fineGrid32[25], 1.0, 1e-6);
+
+  // copies don't share the fine grid
+  CTemplate tmplCopy(tmpl);
+  BOOST_CHECK(tmplCopy.GetFineGridSinglePrecision());
+  BOOST_CHECK(tmplCopy.GetFineGridFluxSinglePrecision() != fineGrid32);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
 
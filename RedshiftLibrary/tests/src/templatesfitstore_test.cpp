@@ -0,0 +1,53 @@
+#include <RedshiftLibrary/common/datatypes.h>
+#include <RedshiftLibrary/linemodel/templatesfitstore.h>
+
+#include <boost/test/unit_test.hpp>
+
+using namespace NSEpic;
+
+BOOST_AUTO_TEST_SUITE(TemplatesFitStore)
+
+BOOST_AUTO_TEST_CASE(RedshiftIndex)
+{
+  CTemplatesFitStore storeLin(0.5, 1.5, 0.01, "lin", 2);
+  TFloat64List zlin = storeLin.GetRedshiftList();
+  for (Int32 k=0; k<zlin.size(); k++) {
+    BOOST_CHECK(storeLin.GetRedshiftIndex(zlin[k]) == k);
+  }
+  BOOST_CHECK(storeLin.GetRedshiftIndex(zlin[3]+0.005) == -1);
+
+  CTemplatesFitStore storeLog(0.5, 4.5, 0.0005, "log", 2);
+  TFloat64List zlog = storeLog.GetRedshiftList();
+  for (Int32 k=0; k<zlog.size(); k++) {
+    BOOST_CHECK(storeLog.GetRedshiftIndex(zlog[k]) == k);
+  }
+  BOOST_CHECK(storeLog.GetRedshiftIndex(-1.0) == -1);
+}
+
+BOOST_AUTO_TEST_CASE(AddTopK)
+{
+  CTemplatesFitStore store(0.5, 1.5, 0.01, "lin", 2);
+  Float64 z = store.GetRedshiftList()[10];
+  Int32 idA = store.RegisterTemplate("tplA");
+  Int32 idB = store.RegisterTemplate("tplB");
+  Int32 idC = store.RegisterTemplate("tplC");
+
+  BOOST_CHECK(store.GetContinuumCount() == 0);
+  BOOST_CHECK(store.Add(idA, 0.0, -1, z, 30.0, 1.0, 1.0, 1.0));
+  BOOST_CHECK(store.Add(idB, 0.0, -1, z, 10.0, 2.0, 1.0, 1.0));
+  BOOST_CHECK(store.Add(idC, 0.0, -1, z, 20.0, 3.0, 1.0, 1.0));
+  BOOST_CHECK(store.Add(idA, 0.0, -1, z+0.001, 20.0, 3.0, 1.0, 1.0) == false);
+  BOOST_CHECK(store.GetContinuumCount() == 2);
+
+  CTemplatesFitStore::TemplateFitValues best = store.GetFitValues(z, 0);
+  BOOST_CHECK(store.GetTplName(best.tplId) == "tplB");
+  BOOST_CHECK_CLOSE(best.merit, 10.0, 1e-12);
+  CTemplatesFitStore::TemplateFitValues second = store.GetFitValues(z, 1);
+  BOOST_CHECK(store.GetTplName(second.tplId) == "tplC");
+  BOOST_CHECK_CLOSE(second.fitAmplitude, 3.0, 1e-12);
+
+  // not enough candidates at this redshift
+  BOOST_CHECK(store.GetFitValues(store.GetRedshiftList()[11], 0).tplId == -1);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
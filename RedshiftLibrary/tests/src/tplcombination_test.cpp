@@ -0,0 +1,197 @@
+#include <RedshiftLibrary/common/datatypes.h>
+#include <RedshiftLibrary/operator/tplcombination.h>
+#include <RedshiftLibrary/operator/tplcombinationresult.h>
+#include <RedshiftLibrary/spectrum/spectrum.h>
+#include <RedshiftLibrary/spectrum/template/template.h>
+
+#include <boost/test/unit_test.hpp>
+#include <gsl/gsl_multifit.h>
+#include <algorithm>
+#include <math.h>
+#include <sstream>
+
+using namespace NSEpic;
+
+BOOST_AUTO_TEST_SUITE(Tplcombination)
+
+// spectrum sampled every 1A from 4000A to 5000A, templates every 1A from 3000A to 6000A: at z=0 the rebinned
+// templates are the template samples themselves
+const Int32 nSpc = 1001;
+const Float64 spcLambda0 = 4000.0;
+const Int32 nTpl = 3001;
+const Float64 tplLambda0 = 3000.0;
+
+Float64 tplFlux(Int32 ktpl, Float64 lambda, Float64 collinearity)
+{
+  Float64 u = (lambda - 4500.0) / 500.0;
+  if (ktpl == 0) {
+    return 1.0 + 0.5 * u;
+  }
+  if (collinearity > 0.0) {
+    // the first template, up to a small quadratic term
+    return (1.0 + 0.5 * u) * (1.0 + collinearity * u * u);
+  }
+  if (ktpl == 1) {
+    return exp(-(lambda - 4200.0) * (lambda - 4200.0) / 900.0);
+  }
+  return cos(lambda / 50.0);
+}
+
+void buildTemplates(Int32 nddl, Float64 collinearity, TTemplateConstRefList& tplList)
+{
+  for (Int32 ktpl = 0; ktpl < nddl; ktpl++) {
+    TFloat64List lambda(nTpl), flux(nTpl);
+    for (Int32 k = 0; k < nTpl; k++) {
+      lambda[k] = tplLambda0 + k;
+      flux[k] = tplFlux(ktpl, lambda[k], collinearity);
+    }
+    CSpectrumSpectralAxis tplSpectralAxis(lambda.data(), nTpl, false);
+    CSpectrumFluxAxis tplFluxAxis(flux.data(), nTpl);
+    std::ostringstream name;
+    name << "tpl" << ktpl;
+    tplList.push_back(std::shared_ptr<const CTemplate>(new CTemplate(name.str(), "galaxy", tplSpectralAxis, tplFluxAxis)));
+  }
+}
+
+/**
+ * Fits the spectrum at z=0 with the combination operator and checks the amplitudes, their errors and the chi2
+ * against gsl_multifit_wlinear on the same design matrix.
+ */
+void checkAgainstWlinear(Int32 nddl, Float64 collinearity, const TFloat64List& amplitudes, Float64 tol)
+{
+  TTemplateConstRefList tplList;
+  buildTemplates(nddl, collinearity, tplList);
+
+  TFloat64List lambda(nSpc), flux(nSpc), error(nSpc);
+  gsl_matrix* X = gsl_matrix_alloc(nSpc, nddl);
+  gsl_vector* y = gsl_vector_alloc(nSpc);
+  gsl_vector* w = gsl_vector_alloc(nSpc);
+  Float64 normFactor = 0.0;
+  for (Int32 i = 0; i < nSpc; i++) {
+    lambda[i] = spcLambda0 + i;
+    flux[i] = 0.05 * sin(1.7 * i);
+    for (Int32 ktpl = 0; ktpl < nddl; ktpl++) {
+      Float64 x = tplFlux(ktpl, lambda[i], collinearity);
+      gsl_matrix_set(X, i, ktpl, x);
+      flux[i] += amplitudes[ktpl] * x;
+    }
+    error[i] = 0.1 * (1.0 + 0.5 * sin(0.01 * i));
+    gsl_vector_set(y, i, flux[i]);
+    gsl_vector_set(w, i, 1.0 / (error[i] * error[i]));
+    normFactor = std::max(normFactor, fabs(flux[i]));
+  }
+  gsl_vector* c = gsl_vector_alloc(nddl);
+  gsl_matrix* cov = gsl_matrix_alloc(nddl, nddl);
+  Float64 chisq;
+  gsl_multifit_linear_workspace* work = gsl_multifit_linear_alloc(nSpc, nddl);
+  gsl_multifit_wlinear(X, w, y, c, cov, &chisq, work);
+  gsl_multifit_linear_free(work);
+
+  CSpectrumSpectralAxis spcSpectralAxis(lambda.data(), nSpc, false);
+  CSpectrumFluxAxis spcFluxAxis(flux.data(), nSpc, error.data(), nSpc);
+  CSpectrum spectrum(spcSpectralAxis, spcFluxAxis);
+  TFloat64Range lambdaRange(spcLambda0, spcLambda0 + nSpc - 1);
+  TFloat64List redshifts(1, 0.0);
+  std::vector<CMask> maskList;
+
+  COperatorTplcombination tplcombination("");
+  std::shared_ptr<CTplcombinationResult> result = std::dynamic_pointer_cast<CTplcombinationResult>(
+      tplcombination.Compute(spectrum, tplList, lambdaRange, redshifts, 1.0, maskList, "lin"));
+  BOOST_REQUIRE(result);
+  BOOST_REQUIRE(result->FitAmplitudes[0].size() == nddl);
+
+  for (Int32 ktpl = 0; ktpl < nddl; ktpl++) {
+    BOOST_CHECK_CLOSE(result->FitAmplitudes[0][ktpl], gsl_vector_get(c, ktpl), tol);
+    // the error is the diagonal of the covariance of the fit on the flux normalized by its maximum, rescaled
+    BOOST_CHECK_CLOSE(result->FitAmplitudesError[0][ktpl], gsl_matrix_get(cov, ktpl, ktpl) / normFactor, tol);
+  }
+  // the model is built from single precision amplitudes
+  BOOST_CHECK_CLOSE(result->ChiSquare[0], chisq, 1e-3);
+
+  gsl_matrix_free(X);
+  gsl_vector_free(y);
+  gsl_vector_free(w);
+  gsl_vector_free(c);
+  gsl_matrix_free(cov);
+}
+
+BOOST_AUTO_TEST_CASE(MatchesWlinear)
+{
+  TFloat64List amplitudes;
+  amplitudes.push_back(2.0);
+  amplitudes.push_back(0.7);
+  amplitudes.push_back(-0.3);
+  checkAgainstWlinear(2, 0.0, amplitudes, 1e-6);
+  checkAgainstWlinear(3, 0.0, amplitudes, 1e-6);
+}
+
+BOOST_AUTO_TEST_CASE(MatchesWlinearOnCollinearBasis)
+{
+  // the second template departs from the first by 1e-6: the second Cholesky pivot of Xt.W.X keeps ~1e-13 of its
+  // diagonal term, below the 1e-10 threshold, so the fit falls back on the SVD
+  Float64 collinearity = 1e-6;
+  Float64 a11 = 0.0, a12 = 0.0, a22 = 0.0;
+  for (Int32 i = 0; i < nSpc; i++) {
+    Float64 lambda = spcLambda0 + i;
+    Float64 error = 0.1 * (1.0 + 0.5 * sin(0.01 * i));
+    Float64 x1 = tplFlux(0, lambda, collinearity);
+    Float64 x2 = tplFlux(1, lambda, collinearity);
+    a11 += x1 * x1 / (error * error);
+    a12 += x1 * x2 / (error * error);
+    a22 += x2 * x2 / (error * error);
+  }
+  BOOST_CHECK((a22 - a12 * a12 / a11) < 1e-10 * a22);
+
+  TFloat64List amplitudes;
+  amplitudes.push_back(2.0);
+  amplitudes.push_back(3.0);
+  checkAgainstWlinear(2, collinearity, amplitudes, 1e-4);
+}
+
+BOOST_AUTO_TEST_CASE(ThreadCount)
+{
+  TTemplateConstRefList tplList;
+  buildTemplates(3, 0.0, tplList);
+
+  TFloat64List lambda(nSpc), flux(nSpc), error(nSpc);
+  for (Int32 i = 0; i < nSpc; i++) {
+    lambda[i] = spcLambda0 + i;
+    Float64 restLambda = lambda[i] / 1.06;
+    flux[i] = 2.0 * tplFlux(0, restLambda, 0.0) + 0.7 * tplFlux(1, restLambda, 0.0) - 0.3 * tplFlux(2, restLambda, 0.0)
+        + 0.05 * sin(1.7 * i);
+    error[i] = 0.1 * (1.0 + 0.5 * sin(0.01 * i));
+  }
+  CSpectrumSpectralAxis spcSpectralAxis(lambda.data(), nSpc, false);
+  CSpectrumFluxAxis spcFluxAxis(flux.data(), nSpc, error.data(), nSpc);
+  CSpectrum spectrum(spcSpectralAxis, spcFluxAxis);
+  TFloat64Range lambdaRange(spcLambda0, spcLambda0 + nSpc - 1);
+  // the emission template stays inside the spectrum over the whole grid
+  TFloat64List redshifts;
+  for (Int32 iz = 0; iz < 61; iz++) {
+    redshifts.push_back(0.0025 * iz);
+  }
+  std::vector<CMask> maskList;
+
+  COperatorTplcombination serial("");
+  std::shared_ptr<CTplcombinationResult> serialResult = std::dynamic_pointer_cast<CTplcombinationResult>(
+      serial.Compute(spectrum, tplList, lambdaRange, redshifts, 1.0, maskList, "lin"));
+  BOOST_REQUIRE(serialResult);
+
+  COperatorTplcombination threaded("");
+  threaded.m_opt_threadCount = 4;
+  std::shared_ptr<CTplcombinationResult> threadedResult = std::dynamic_pointer_cast<CTplcombinationResult>(
+      threaded.Compute(spectrum, tplList, lambdaRange, redshifts, 1.0, maskList, "lin"));
+  BOOST_REQUIRE(threadedResult);
+
+  BOOST_REQUIRE(threadedResult->ChiSquare.size() == serialResult->ChiSquare.size());
+  for (Int32 iz = 0; iz < serialResult->ChiSquare.size(); iz++) {
+    BOOST_CHECK_EQUAL(threadedResult->Redshifts[iz], serialResult->Redshifts[iz]);
+    BOOST_CHECK_EQUAL(threadedResult->ChiSquare[iz], serialResult->ChiSquare[iz]);
+    BOOST_CHECK_EQUAL(threadedResult->Overlap[iz], serialResult->Overlap[iz]);
+    BOOST_CHECK(threadedResult->FitAmplitudes[iz] == serialResult->FitAmplitudes[iz]);
+  }
+  BOOST_CHECK(threadedResult->Extrema == serialResult->Extrema);
+  BOOST_CHECK_CLOSE(serialResult->Extrema[0], 0.06, 1e-6);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
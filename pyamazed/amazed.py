@@ -63,6 +63,11 @@ def amazed():
     #                                    opt_nscales, dfBinPath)
     template_catalog = FitsTemplateCatalog(medianRemovalMethod, opt_medianKernelWidth,
                                            opt_nscales, dfBinPath)
+    retcode, fineGridPrecision = param.Get_String("templateCatalog.fineGridPrecision",
+                                                  "float64")
+    assert retcode
+    template_catalog.SetFineGridSinglePrecision(fineGridPrecision == "float32")
+
     print("Loading %s" % config.template_dir)
 
     try:
@@ -0,0 +1,56 @@
+from .redshift import *
+import numpy as np
+
+
+def _as_batch_array(values, shape=None):
+    """Return values as a C-contiguous 2-D float64 array, broadcast to shape if given"""
+    values = np.asarray(values, dtype=np.float64)
+    if values.ndim == 1:
+        values = values[np.newaxis, :]
+    if shape is not None and values.shape != shape:
+        values = np.broadcast_to(values, shape)
+    return np.ascontiguousarray(values)
+
+
+def process_batch(wavelength, flux, noise, template_catalog, line_catalog,
+                  param, classif, thread_count=1):
+    """Run the process flow on a batch of spectra held in memory.
+
+    flux and noise are (n_spectra, n_samples) arrays, wavelength is either
+    of the same shape or a single (n_samples) grid shared by all the spectra.
+    The spectra are processed on thread_count threads, without the GIL.
+
+    Returns a dict of numpy arrays: redshift and merit (n_spectra),
+    status (n_spectra, 0 if processed), pdf_redshift (n_z) and
+    pdf_logproba (n_spectra, n_z), candidates and candidates_proba
+    (n_spectra, n_candidates, NaN padded), and the errors list.
+    """
+    flux = _as_batch_array(flux)
+    noise = _as_batch_array(noise, flux.shape)
+    wavelength = _as_batch_array(wavelength, flux.shape)
+
+    batch = CProcessFlowBatch(template_catalog, line_catalog, param, classif)
+    batch.Process(wavelength, flux, noise, thread_count)
+
+    n_spectra = batch.GetSpectraCount()
+    results = {}
+    results['redshift'] = np.empty(n_spectra)
+    batch.GetRedshifts(results['redshift'])
+    results['merit'] = np.empty(n_spectra)
+    batch.GetMerits(results['merit'])
+    results['status'] = np.array([batch.GetStatus(i) for i in range(n_spectra)])
+    results['errors'] = [batch.GetError(i) for i in range(n_spectra)]
+
+    n_z = batch.GetPdfSize()
+    results['pdf_redshift'] = np.empty(n_z)
+    batch.GetPdfRedshifts(results['pdf_redshift'])
+    results['pdf_logproba'] = np.empty((n_spectra, n_z))
+    batch.GetPdfs(results['pdf_logproba'])
+
+    n_candidates = batch.GetCandidatesMaxCount()
+    results['candidates'] = np.empty((n_spectra, n_candidates))
+    batch.GetCandidates(results['candidates'])
+    results['candidates_proba'] = np.empty((n_spectra, n_candidates))
+    batch.GetCandidatesProba(results['candidates_proba'])
+
+    return results
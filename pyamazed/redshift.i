@@ -1,4 +1,4 @@
-%module(directors="1") redshift
+%module(directors="1", threads="1") redshift
 
 %include typemaps.i
 %include std_string.i
@@ -24,6 +24,10 @@
 %feature("director");
 %feature("nodirector") CSpectrumFluxAxis;
 
+// the GIL is only released by the batch processing
+%nothread;
+%thread CProcessFlowBatch::Process;
+
 %{
 #define SWIG_FILE_WITH_INIT
 #include "RedshiftLibrary/common/datatypes.h"
@@ -36,6 +40,7 @@
 #include "RedshiftLibrary/reliability/zclassifierstore.h"
 #include "RedshiftLibrary/processflow/context.h"
 #include "RedshiftLibrary/processflow/processflow.h"
+#include "RedshiftLibrary/processflow/processflowbatch.h"
 #include "RedshiftLibrary/processflow/resultstore.h"
 #include "RedshiftLibrary/ray/catalog.h"
 #include "RedshiftLibrary/spectrum/template/catalog.h"
@@ -56,6 +61,7 @@ import_array();
 // %include "../RedshiftLibrary/RedshiftLibrary/common/datatypes.h"
 typedef	double Float64;
 typedef unsigned int UInt32;
+typedef int Int32;
 
 namespace NSEpic {
 }
@@ -136,6 +142,7 @@ public:
     CTemplateCatalog( std::string cremovalmethod="Median", Float64 mediankernelsize=75.0, Float64 waveletsScales=8, std::string waveletsDFBinPath="");
     void Load( const char* filePath );
     void Add( std::shared_ptr<CTemplate> r );
+    void SetFineGridSinglePrecision( bool enable );
 };
 
 class CProcessFlowContext {
@@ -159,6 +166,48 @@ public:
   void Process( CProcessFlowContext& ctx );
 };
 
+%catches(std::string, std::runtime_error, ...) CProcessFlowBatch::Process;
+
+%apply (double* IN_ARRAY2, int DIM1, int DIM2) {(const Float64* spectralAxis, Int32 nSpectraAxis, Int32 nSamplesAxis),
+                                                (const Float64* flux, Int32 nSpectraFlux, Int32 nSamplesFlux),
+                                                (const Float64* noise, Int32 nSpectraNoise, Int32 nSamplesNoise)};
+%apply (double* INPLACE_ARRAY1, int DIM1) {(Float64* out_array, Int32 n)};
+%apply (double* INPLACE_ARRAY2, int DIM1, int DIM2) {(Float64* out_array2, Int32 n1, Int32 n2)};
+
+class CProcessFlowBatch {
+public:
+  CProcessFlowBatch( std::shared_ptr<const CTemplateCatalog> templateCatalog,
+                     std::shared_ptr<const CRayCatalog> rayCatalog,
+                     std::shared_ptr<CParameterStore> paramStore,
+                     std::shared_ptr<CClassifierStore> zqualStore );
+  int GetSpectraCount() const;
+  int GetStatus( int iSpectrum ) const;
+  std::string GetError( int iSpectrum ) const;
+  int GetPdfSize() const;
+  int GetCandidatesMaxCount() const;
+  void GetRedshifts( Float64* out_array, Int32 n ) const;
+  void GetMerits( Float64* out_array, Int32 n ) const;
+  void GetPdfRedshifts( Float64* out_array, Int32 n ) const;
+  void GetPdfs( Float64* out_array2, Int32 n1, Int32 n2 ) const;
+  void GetCandidates( Float64* out_array2, Int32 n1, Int32 n2 ) const;
+  void GetCandidatesProba( Float64* out_array2, Int32 n1, Int32 n2 ) const;
+};
+
+%extend CProcessFlowBatch {
+  // the 2-D arrays are used in place when they are C-contiguous float64 arrays
+  void Process( const Float64* spectralAxis, Int32 nSpectraAxis, Int32 nSamplesAxis,
+                const Float64* flux, Int32 nSpectraFlux, Int32 nSamplesFlux,
+                const Float64* noise, Int32 nSpectraNoise, Int32 nSamplesNoise,
+                Int32 threadCount ) {
+    if( nSpectraFlux!=nSpectraAxis || nSpectraNoise!=nSpectraAxis ||
+        nSamplesFlux!=nSamplesAxis || nSamplesNoise!=nSamplesAxis )
+    {
+      throw std::runtime_error("Batch wavelength, flux and noise arrays must have the same shape");
+    }
+    $self->Process( spectralAxis, flux, noise, nSpectraAxis, nSamplesAxis, threadCount );
+  }
+};
+
 class CDataStore
 {
 public: